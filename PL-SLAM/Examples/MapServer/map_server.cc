@@ -0,0 +1,71 @@
+/**
+* Map server of the multi-agent mode: merges the maps streamed by the SLAM clients
+* (MapServer.address and MapServer.agentId in their settings files).
+*/
+
+
+#include<iostream>
+#include<thread>
+#include<csignal>
+#include<cstdlib>
+#include<unistd.h>
+
+#include<MapServer.h>
+
+using namespace std;
+
+volatile sig_atomic_t gbStop = 0;
+
+void HandleSignal(int)
+{
+    gbStop = 1;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc != 4 && argc != 5)
+    {
+        cerr << endl << "Usage: ./map_server path_to_vocabulary path_to_socket path_to_output [fix_scale]" << endl
+             << "  fix_scale: 1 if the clients are stereo or RGB-D (default 0: monocular)" << endl;
+        return 1;
+    }
+
+    const bool bFixScale = argc==5 && atoi(argv[4])!=0;
+
+    cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+    ORB_SLAM2::ORBVocabulary* pVocabulary = new ORB_SLAM2::ORBVocabulary();
+    const string strVocFile = argv[1];
+    const bool bVocLoad = strVocFile.size()>4 && strVocFile.compare(strVocFile.size()-4,4,".txt")==0 ?
+                          pVocabulary->loadFromTextFile(strVocFile) : pVocabulary->loadFromBinaryFile(strVocFile);
+    if(!bVocLoad)
+    {
+        cerr << "Wrong path to vocabulary. " << endl;
+        cerr << "Falied to open at: " << strVocFile << endl;
+        return 1;
+    }
+    cout << "Vocabulary loaded!" << endl << endl;
+
+    ORB_SLAM2::UnixSocketListener* pListener = ORB_SLAM2::UnixSocketListener::Listen(argv[2]);
+    if(!pListener)
+        return 1;
+
+    signal(SIGINT,HandleSignal);
+    signal(SIGTERM,HandleSignal);
+
+    ORB_SLAM2::MapServer server(pVocabulary,pListener,bFixScale);
+    thread tServer(&ORB_SLAM2::MapServer::Run,&server);
+    cout << "Map server listening on " << argv[2] << ", Ctrl-C to stop" << endl;
+
+    while(!gbStop)
+        usleep(100000);
+
+    server.RequestFinish();
+    tServer.join();
+
+    server.SaveSharedMaps(argv[3]);
+
+    delete pListener;
+    delete pVocabulary;
+
+    return 0;
+}
@@ -121,6 +121,13 @@ int main(int argc, char **argv)
     // Save camera trajectory
     SLAM.SaveKeyFrameTrajectoryTUM("KeyFrameTrajectory.txt");    
 
+    // Multi-agent mode: the same trajectory in the frame shared with the other agents, once the maps are merged
+    cv::Mat Sws;
+    unsigned int nReferenceAgent;
+    if(SLAM.GetSharedMapAlignment(Sws,nReferenceAgent))
+        SLAM.SaveSharedKeyFrameTrajectoryTUM("SharedKeyFrameTrajectory.txt");
+    SLAM.SaveLockProfile("LockProfile.txt");
+
     return 0;
 }
 
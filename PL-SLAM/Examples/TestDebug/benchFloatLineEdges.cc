@@ -0,0 +1,224 @@
+// Float vs double line edges of the local BA (EdgeLineProjectXYZFloat / EdgeLineProjectXYZ) on a synthetic scene:
+// a few keyframes observing random 3D segments, the first two keyframes fixed and the others perturbed.
+// Reports the linearization time per edge, the time of the LM solve and the largest differences of the
+// residuals, Jacobians and optimized poses between the two versions.
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_eigen.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+#include "floatEdge.h"
+
+using namespace std;
+
+// Same camera as TUM1.yaml
+const double fx = 517.306408, fy = 516.469215, cx = 318.643040, cy = 255.313989;
+
+struct Scene
+{
+    vector<g2o::SE3Quat> vTcw;          // ground truth poses
+    vector<g2o::SE3Quat> vTcwInit;      // perturbed poses, the first two are kept fixed
+    vector<Eigen::Vector3d> vStart, vEnd;
+    vector<Eigen::Vector3d> vStartInit, vEndInit;
+    vector<vector<Eigen::Vector3d> > vvLineFunctions;  // [keyframe][line], normalized as in Frame
+};
+
+void MakeScene(const int nKFs, const int nLines, Scene &scene)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> uxy(-2.0,2.0), uz(4.0,8.0);
+    std::normal_distribution<double> nPose(0.0,0.02), nRot(0.0,0.01), nPoint(0.0,0.05), nPixel(0.0,0.5);
+
+    for(int k=0; k<nKFs; k++)
+    {
+        const Eigen::Quaterniond q(Eigen::AngleAxisd(0.02*k,Eigen::Vector3d::UnitY()));
+        const g2o::SE3Quat Tcw(q,Eigen::Vector3d(-0.1*k,0.01*k,0.0));
+        scene.vTcw.push_back(Tcw);
+
+        if(k<2)
+            scene.vTcwInit.push_back(Tcw);
+        else
+        {
+            const Eigen::Quaterniond dq(Eigen::AngleAxisd(nRot(rng),Eigen::Vector3d::UnitX())*
+                                        Eigen::AngleAxisd(nRot(rng),Eigen::Vector3d::UnitY()));
+            const Eigen::Vector3d dt(nPose(rng),nPose(rng),nPose(rng));
+            scene.vTcwInit.push_back(g2o::SE3Quat(dq,dt)*Tcw);
+        }
+    }
+
+    scene.vvLineFunctions.resize(nKFs);
+    for(int i=0; i<nLines; i++)
+    {
+        const Eigen::Vector3d Xs(uxy(rng),uxy(rng),uz(rng));
+        const Eigen::Vector3d Xe(uxy(rng),uxy(rng),uz(rng));
+        scene.vStart.push_back(Xs);
+        scene.vEnd.push_back(Xe);
+        scene.vStartInit.push_back(Xs+Eigen::Vector3d(nPoint(rng),nPoint(rng),nPoint(rng)));
+        scene.vEndInit.push_back(Xe+Eigen::Vector3d(nPoint(rng),nPoint(rng),nPoint(rng)));
+
+        for(int k=0; k<nKFs; k++)
+        {
+            const Eigen::Vector3d Ps = scene.vTcw[k].map(Xs);
+            const Eigen::Vector3d Pe = scene.vTcw[k].map(Xe);
+            const Eigen::Vector3d ps(fx*Ps[0]/Ps[2]+cx+nPixel(rng), fy*Ps[1]/Ps[2]+cy+nPixel(rng), 1.0);
+            const Eigen::Vector3d pe(fx*Pe[0]/Pe[2]+cx+nPixel(rng), fy*Pe[1]/Pe[2]+cy+nPixel(rng), 1.0);
+            Eigen::Vector3d l = ps.cross(pe);
+            l = l/sqrt(l[0]*l[0]+l[1]*l[1]);
+            scene.vvLineFunctions[k].push_back(l);
+        }
+    }
+}
+
+// Same vertices, edges, information and robust kernel as Optimizer::LocalBundleAdjustmentWithLine
+void BuildProblem(const Scene &scene, const bool bFloat, g2o::SparseOptimizer &optimizer, vector<EdgeLineProjectXYZ*> &vpEdges)
+{
+    g2o::BlockSolver_6_3::LinearSolverType* linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    g2o::BlockSolver_6_3* solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+    optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(solver_ptr));
+
+    const int nKFs = scene.vTcw.size();
+    const int nLines = scene.vStart.size();
+    for(int k=0; k<nKFs; k++)
+    {
+        g2o::VertexSE3Expmap* vSE3 = new g2o::VertexSE3Expmap();
+        vSE3->setEstimate(scene.vTcwInit[k]);
+        vSE3->setId(k);
+        vSE3->setFixed(k<2);
+        optimizer.addVertex(vSE3);
+    }
+
+    const double invSigma = 0.5;
+    const double thHuberLEnd = sqrt(3.84);
+    for(int i=0; i<nLines; i++)
+    {
+        for(int s=0; s<2; s++)
+        {
+            g2o::VertexSBAPointXYZ* vPoint = new g2o::VertexSBAPointXYZ();
+            vPoint->setEstimate(s==0 ? scene.vStartInit[i] : scene.vEndInit[i]);
+            vPoint->setId(nKFs+2*i+s);
+            vPoint->setMarginalized(true);
+            optimizer.addVertex(vPoint);
+
+            for(int k=0; k<nKFs; k++)
+            {
+                EdgeLineProjectXYZ* e = bFloat ? new EdgeLineProjectXYZFloat() : new EdgeLineProjectXYZ();
+                e->setVertex(0, vPoint);
+                e->setVertex(1, optimizer.vertex(k));
+                e->setMeasurement(scene.vvLineFunctions[k][i]);
+                e->setInformation(Eigen::Matrix3d::Identity()*invSigma);
+
+                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+                e->setRobustKernel(rk);
+                rk->setDelta(thHuberLEnd);
+
+                e->fx = fx;
+                e->fy = fy;
+                e->cx = cx;
+                e->cy = cy;
+
+                optimizer.addEdge(e);
+                vpEdges.push_back(e);
+            }
+        }
+    }
+}
+
+// Mean time of one linearization of the edges, in ns per edge. The Jacobians are mapped onto the workspace of
+// the optimizer, as in the solve
+double TimeLinearization(g2o::SparseOptimizer &optimizer, const vector<EdgeLineProjectXYZ*> &vpEdges, const int nRepeats)
+{
+    optimizer.initializeOptimization();
+    g2o::JacobianWorkspace &workspace = optimizer.jacobianWorkspace();
+
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    for(int r=0; r<nRepeats; r++)
+    {
+        for(size_t i=0; i<vpEdges.size(); i++)
+        {
+            vpEdges[i]->computeError();
+            static_cast<g2o::OptimizableGraph::Edge*>(vpEdges[i])->linearizeOplus(workspace);
+        }
+    }
+    std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count()*1e9/(nRepeats*vpEdges.size());
+}
+
+// Time of the LM solve in ms, with the same number of iterations as the local BA
+double TimeSolve(g2o::SparseOptimizer &optimizer, const int nIterations)
+{
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    optimizer.initializeOptimization();
+    optimizer.optimize(nIterations);
+    std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count()*1e3;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc > 4)
+    {
+        cerr << endl << "Usage: ./benchFloatLineEdges [num_keyframes num_lines [repeats]]" << endl;
+        return 1;
+    }
+
+    const int nKFs = argc > 1 ? max(3,atoi(argv[1])) : 5;
+    const int nLines = argc > 2 ? max(1,atoi(argv[2])) : 300;
+    const int nRepeats = argc > 3 ? max(1,atoi(argv[3])) : 20;
+
+    Scene scene;
+    MakeScene(nKFs,nLines,scene);
+
+    g2o::SparseOptimizer optimizerDouble, optimizerFloat;
+    vector<EdgeLineProjectXYZ*> vpEdgesDouble, vpEdgesFloat;
+    BuildProblem(scene,false,optimizerDouble,vpEdgesDouble);
+    BuildProblem(scene,true,optimizerFloat,vpEdgesFloat);
+
+    cout << nKFs << " keyframes, " << nLines << " lines, " << vpEdgesDouble.size() << " line edges" << endl;
+
+    // Linearization at the initial estimates
+    const double tLinDouble = TimeLinearization(optimizerDouble,vpEdgesDouble,nRepeats);
+    const double tLinFloat = TimeLinearization(optimizerFloat,vpEdgesFloat,nRepeats);
+    cout << endl << "Linearization (ns/edge): double " << tLinDouble << ", float " << tLinFloat
+         << ", speedup " << tLinDouble/tLinFloat << endl;
+
+    double maxErrorDiff = 0, maxJacobianDiff = 0;
+    for(size_t i=0; i<vpEdgesFloat.size(); i++)
+        static_cast<EdgeLineProjectXYZFloat*>(vpEdgesFloat[i])->CompareWithDouble(maxErrorDiff,maxJacobianDiff);
+    cout << "Max residual difference " << maxErrorDiff << " px, max Jacobian difference "
+         << 100*maxJacobianDiff << "%" << endl;
+
+    // LM solves from the same initial estimates
+    const int nIterations = 10;
+    const double tSolveDouble = TimeSolve(optimizerDouble,nIterations);
+    const double tSolveFloat = TimeSolve(optimizerFloat,nIterations);
+    cout << endl << "LM solve, " << nIterations << " iterations (ms): double " << tSolveDouble << ", float "
+         << tSolveFloat << ", speedup " << tSolveDouble/tSolveFloat << endl;
+
+    double maxTranslationDiff = 0, maxRotationDiff = 0, maxTranslationError = 0;
+    for(int k=2; k<nKFs; k++)
+    {
+        const g2o::SE3Quat Td = static_cast<g2o::VertexSE3Expmap*>(optimizerDouble.vertex(k))->estimate();
+        const g2o::SE3Quat Tf = static_cast<g2o::VertexSE3Expmap*>(optimizerFloat.vertex(k))->estimate();
+        maxTranslationDiff = max(maxTranslationDiff,(Td.translation()-Tf.translation()).norm());
+        maxRotationDiff = max(maxRotationDiff,Td.rotation().angularDistance(Tf.rotation()));
+        maxTranslationError = max(maxTranslationError,(Td.translation()-scene.vTcw[k].translation()).norm());
+    }
+    cout << "Optimized poses: max translation difference " << maxTranslationDiff << " m, max rotation difference "
+         << maxRotationDiff << " rad (double run error to ground truth " << maxTranslationError << " m)" << endl;
+
+    return 0;
+}
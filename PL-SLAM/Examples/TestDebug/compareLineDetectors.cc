@@ -0,0 +1,177 @@
+// Runs the LSD and EDLines modes of LINEextractor on the same TUM sequence and reports, for each one,
+// the detection and description time, the number of lines and the number of lines matched to the previous frame.
+// The LINEextractor parameters (except the detector) are read from the settings file.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "LineExtractor.h"
+#include "LSDmatcher.h"
+
+using namespace std;
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames);
+
+// Matches of the lines of a frame to the lines of the previous frame: descriptor threshold and ratio test
+int MatchLines(const cv::Mat &desc1, const cv::Mat &desc2)
+{
+    if(desc1.empty() || desc2.empty())
+        return 0;
+
+    vector<vector<cv::DMatch> > matches;
+    cv::BFMatcher matcher(cv::NORM_HAMMING,false);
+    matcher.knnMatch(desc1,desc2,matches,2);
+
+    int nMatches = 0;
+    for(size_t i=0; i<matches.size(); i++)
+    {
+        if(matches[i].empty() || matches[i][0].distance>=ORB_SLAM2::LSDmatcher::TH_HIGH)
+            continue;
+        if(matches[i].size()>1 && matches[i][0].distance>=0.7f*matches[i][1].distance)
+            continue;
+        nMatches++;
+    }
+    return nMatches;
+}
+
+struct DetectorStats
+{
+    vector<double> vTimes;
+    long nLines = 0;
+    long nMatches = 0;
+};
+
+int main(int argc, char **argv)
+{
+    if(argc != 3 && argc != 4)
+    {
+        cerr << endl << "Usage: ./compareLineDetectors path_to_settings path_to_sequence [max_images]" << endl;
+        return 1;
+    }
+
+    cv::FileStorage fSettings(argv[1], cv::FileStorage::READ);
+    if(!fSettings.isOpened())
+    {
+        cerr << "Failed to open settings file at: " << argv[1] << endl;
+        return 1;
+    }
+
+    const int nFeaturesLine = fSettings["LINEextractor.nFeatures"];
+    const float fScaleFactorLine = fSettings["LINEextractor.scaleFactor"];
+    const int nLevelsLine = fSettings["LINEextractor.nLevels"];
+    const int min_length = fSettings["LINEextractor.min_line_length"];
+    const int nRGB = fSettings["Camera.RGB"];
+
+    vector<string> vstrImageFilenames;
+    LoadImages(string(argv[2])+"/rgb.txt", vstrImageFilenames);
+    size_t nImages = vstrImageFilenames.size();
+    if(argc == 4)
+        nImages = min(nImages,static_cast<size_t>(atoi(argv[3])));
+    if(nImages==0)
+    {
+        cerr << "No images found in " << argv[2] << endl;
+        return 1;
+    }
+
+    const int vDetectors[2] = {ORB_SLAM2::LINEextractor::LSD, ORB_SLAM2::LINEextractor::EDLINES};
+    const char* vNames[2] = {"LSD", "EDLines"};
+    ORB_SLAM2::LINEextractor* vpExtractors[2];
+    DetectorStats vStats[2];
+    cv::Mat vLastDescriptors[2];
+    for(int d=0; d<2; d++)
+    {
+        vpExtractors[d] = new ORB_SLAM2::LINEextractor(nLevelsLine, fScaleFactorLine, nFeaturesLine, min_length, vDetectors[d]);
+        vStats[d].vTimes.reserve(nImages);
+    }
+
+    cout << "Images in the sequence: " << nImages << endl;
+
+    for(size_t ni=0; ni<nImages; ni++)
+    {
+        cv::Mat im = cv::imread(string(argv[2])+"/"+vstrImageFilenames[ni],cv::IMREAD_UNCHANGED);
+        if(im.empty())
+        {
+            cerr << "Failed to load image at: " << string(argv[2]) << "/" << vstrImageFilenames[ni] << endl;
+            return 1;
+        }
+
+        // Same conversion as Tracking::GrabImageMonocular
+        if(im.channels()==3)
+            cv::cvtColor(im,im,nRGB ? CV_RGB2GRAY : CV_BGR2GRAY);
+        else if(im.channels()==4)
+            cv::cvtColor(im,im,nRGB ? CV_RGBA2GRAY : CV_BGRA2GRAY);
+
+        // Both detectors run on the same image, one after the other
+        for(int d=0; d<2; d++)
+        {
+            vector<line_descriptor::KeyLine> vKeyLines;
+            cv::Mat descriptors;
+            vector<Eigen::Vector3d> vLineFunctions;
+
+            std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+            (*vpExtractors[d])(im,cv::Mat(),vKeyLines,descriptors,vLineFunctions);
+            std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+            vStats[d].vTimes.push_back(std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count());
+            vStats[d].nLines += vKeyLines.size();
+            vStats[d].nMatches += MatchLines(descriptors,vLastDescriptors[d]);
+            vLastDescriptors[d] = descriptors;
+        }
+    }
+
+    cout << endl << "detector  median time (ms)  mean time (ms)  lines/frame  matches/frame" << endl;
+    for(int d=0; d<2; d++)
+    {
+        vector<double> &vTimes = vStats[d].vTimes;
+        double totaltime = 0;
+        for(size_t i=0; i<vTimes.size(); i++)
+            totaltime += vTimes[i];
+        sort(vTimes.begin(),vTimes.end());
+
+        // Matches are counted from the second frame on
+        const double linesPerFrame = double(vStats[d].nLines)/nImages;
+        const double matchesPerFrame = nImages>1 ? double(vStats[d].nMatches)/(nImages-1) : 0.0;
+
+        cout << vNames[d] << "  " << 1e3*vTimes[vTimes.size()/2] << "  " << 1e3*totaltime/nImages << "  "
+             << linesPerFrame << "  " << matchesPerFrame << endl;
+
+        delete vpExtractors[d];
+    }
+
+    return 0;
+}
+
+void LoadImages(const string &strFile, vector<string> &vstrImageFilenames)
+{
+    ifstream f;
+    f.open(strFile.c_str());
+
+    // skip first three lines
+    string s0;
+    getline(f,s0);
+    getline(f,s0);
+    getline(f,s0);
+
+    while(!f.eof())
+    {
+        string s;
+        getline(f,s);
+        if(!s.empty())
+        {
+            stringstream ss;
+            ss << s;
+            double t;
+            string sRGB;
+            ss >> t;
+            ss >> sRGB;
+            vstrImageFilenames.push_back(sRGB);
+        }
+    }
+}
@@ -0,0 +1,183 @@
+// Decoding of the map server messages: valid messages round-trip, truncated and corrupted messages are rejected
+// without reading or allocating beyond the message.
+
+#include <iostream>
+#include <string>
+#include <cstring>
+
+#include "MapMessages.h"
+
+using namespace std;
+using namespace ORB_SLAM2;
+
+namespace
+{
+
+int gnFailures = 0;
+
+void Check(const bool bOK, const string &what)
+{
+    if(!bOK)
+    {
+        cerr << "FAILED: " << what << endl;
+        gnFailures++;
+    }
+}
+
+KeyFrameMessage MakeKeyFrameMessage()
+{
+    KeyFrameMessage m;
+    m.nId = 7;
+    m.timestamp = 12.5;
+    m.Tcw = cv::Mat::eye(4,4,CV_32F);
+    memset(&m.camera,0,sizeof(m.camera));
+    m.camera.fx = m.camera.fy = 500.f;
+    m.camera.cx = 320.f;
+    m.camera.cy = 240.f;
+    m.camera.maxX = 640.f;
+    m.camera.maxY = 480.f;
+    m.camera.nScaleLevels = m.camera.nScaleLevelsLine = 8;
+    m.camera.fScaleFactor = m.camera.fScaleFactorLine = 1.2f;
+
+    const int N = 4;
+    for(int i=0; i<N; i++)
+        m.features.vKeys.push_back(cv::KeyPoint(10.f*i,20.f*i,31.f,0.f,1.f,i%2));
+    m.features.Descriptors = cv::Mat(N,32,CV_8U,cv::Scalar(0x5a));
+
+    const int NL = 2;
+    m.features.vKeyLines.resize(NL);
+    for(int i=0; i<NL; i++)
+    {
+        m.features.vKeyLines[i].startPointX = 10.f*i;
+        m.features.vKeyLines[i].endPointX = 10.f*i+50.f;
+        m.features.vKeyLines[i].octave = i;
+        m.features.vLineFunctions.push_back(Eigen::Vector3d(0,1,-10.0*i));
+    }
+    m.features.LineDescriptors = cv::Mat(NL,32,CV_8U,cv::Scalar(0xa5));
+
+    m.features.BowVec.addWeight(3,0.5);
+    m.features.BowVec.addWeight(11,0.25);
+    m.features.FeatVec.addFeature(1,0);
+    m.features.FeatVec.addFeature(1,3);
+    m.features.FeatVec.addFeature(2,1);
+
+    m.vMapPointIds.assign(N,-1);
+    m.vMapPointIds[1] = 42;
+    m.vMapPointPos.assign(N,cv::Point3f(1.f,2.f,3.f));
+    m.vMapLineIds.assign(NL,-1);
+    m.vMapLinePos.assign(NL,cv::Vec6d(1,2,3,4,5,6));
+    return m;
+}
+
+// Every strict prefix of a valid message must be rejected
+template<typename TMessage>
+void CheckTruncations(const string &msg, const string &what)
+{
+    for(size_t n=0; n<msg.size(); n++)
+    {
+        TMessage m;
+        if(DecodeMapMessage(msg.substr(0,n),m))
+        {
+            Check(false,what+" truncated to "+to_string(n)+" bytes");
+            return;
+        }
+    }
+}
+
+}
+
+int main()
+{
+    // Round trip
+    const KeyFrameMessage kf = MakeKeyFrameMessage();
+    const string msgKF = EncodeMapMessage(kf);
+    {
+        KeyFrameMessage m;
+        Check(DecodeMapMessage(msgKF,m),"valid keyframe message");
+        Check(m.nId==kf.nId && m.features.vKeys.size()==kf.features.vKeys.size() &&
+              m.features.vKeyLines.size()==kf.features.vKeyLines.size() && m.features.BowVec==kf.features.BowVec &&
+              m.features.FeatVec.size()==kf.features.FeatVec.size() && m.vMapPointIds==kf.vMapPointIds,
+              "keyframe message round trip");
+    }
+
+    CheckTruncations<KeyFrameMessage>(msgKF,"keyframe message");
+
+    // Trailing data
+    {
+        KeyFrameMessage m;
+        Check(!DecodeMapMessage(msgKF+'\0',m),"keyframe message with trailing data");
+    }
+
+    // Feature index beyond the keypoints
+    {
+        KeyFrameMessage bad = MakeKeyFrameMessage();
+        bad.features.FeatVec.addFeature(5,bad.features.vKeys.size());
+        KeyFrameMessage m;
+        Check(!DecodeMapMessage(EncodeMapMessage(bad),m),"feature vector index beyond the keypoints");
+    }
+
+    // Huge counts in the features header (after type, id, timestamp, pose and camera)
+    {
+        const size_t offset = sizeof(uint32_t)+sizeof(uint64_t)+sizeof(double)+16*sizeof(float)+sizeof(AgentCamera);
+        for(size_t field=0; field<8; field++)
+        {
+            string corrupted = msgKF;
+            const uint32_t n = 0xffffffffu;
+            memcpy(&corrupted[offset+field*sizeof(uint32_t)],&n,sizeof(n));
+            KeyFrameMessage m;
+            Check(!DecodeMapMessage(corrupted,m),"features header field "+to_string(field)+" corrupted");
+        }
+    }
+
+    // Message of another type
+    {
+        KeyFrameMessage m;
+        Check(!DecodeMapMessage(EncodeHello(1),m),"hello decoded as a keyframe message");
+        Check(GetMapMessageType(string(2,'\0'))==MAP_MSG_INVALID,"type of a 2 byte message");
+    }
+
+    // Poses
+    PosesMessage poses;
+    poses.vKeyFrameIds.push_back(7);
+    poses.vTcw.push_back(cv::Mat::eye(4,4,CV_32F));
+    poses.vMapPointIds.push_back(42);
+    poses.vMapPointPos.push_back(cv::Point3f(1.f,2.f,3.f));
+    poses.vMapLineIds.push_back(3);
+    poses.vMapLinePos.push_back(cv::Vec6d(1,2,3,4,5,6));
+    const string msgPoses = EncodeMapMessage(poses);
+    {
+        PosesMessage m;
+        Check(DecodeMapMessage(msgPoses,m) && m.vKeyFrameIds==poses.vKeyFrameIds && m.vMapLineIds==poses.vMapLineIds,
+              "poses message round trip");
+    }
+    CheckTruncations<PosesMessage>(msgPoses,"poses message");
+    {
+        // Keyframe count beyond the message
+        string corrupted = msgPoses;
+        const uint32_t n = 1000;
+        memcpy(&corrupted[sizeof(uint32_t)],&n,sizeof(n));
+        PosesMessage m;
+        Check(!DecodeMapMessage(corrupted,m),"poses message with a corrupted keyframe count");
+    }
+
+    // Alignment
+    AlignmentMessage alignment;
+    alignment.nReferenceAgent = 1;
+    alignment.nAgents = 2;
+    alignment.Sws = cv::Mat::eye(4,4,CV_32F);
+    const string msgAlignment = EncodeMapMessage(alignment);
+    {
+        AlignmentMessage m;
+        Check(DecodeMapMessage(msgAlignment,m) && m.nAgents==2,"alignment message round trip");
+    }
+    CheckTruncations<AlignmentMessage>(msgAlignment,"alignment message");
+
+    if(gnFailures>0)
+    {
+        cerr << gnFailures << " checks failed" << endl;
+        return 1;
+    }
+
+    cout << "testMapMessages: all checks passed" << endl;
+    return 0;
+}
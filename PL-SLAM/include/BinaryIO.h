@@ -0,0 +1,84 @@
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <string>
+#include <cstring>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+// Appends plain values to a byte buffer. Host byte order: the buffers are read back on the same architecture
+// (feature cache files, map server messages).
+class BinaryWriter
+{
+public:
+    explicit BinaryWriter(std::string &buffer): mBuffer(buffer) {}
+
+    void Write(const void* pSrc, const size_t n)
+    {
+        mBuffer.append(static_cast<const char*>(pSrc),n);
+    }
+
+    template<typename T>
+    void Write(const T &v)
+    {
+        Write(&v,sizeof(T));
+    }
+
+    // Data only, the reader must know rows, cols and type
+    void WriteMat(const cv::Mat &M)
+    {
+        for(int i=0; i<M.rows; i++)
+            Write(M.ptr(i),M.cols*M.elemSize());
+    }
+
+protected:
+    std::string &mBuffer;
+};
+
+// Sequential reads of a byte buffer, every read is checked against its size
+class BinaryReader
+{
+public:
+    BinaryReader(const char* pData, const size_t n, const size_t pos = 0): mpData(pData), mN(n), mPos(pos) {}
+
+    bool Read(void* pDst, const size_t n)
+    {
+        if(mPos>mN || n>mN-mPos)
+            return false;
+        memcpy(pDst,mpData+mPos,n);
+        mPos += n;
+        return true;
+    }
+
+    template<typename T>
+    bool Read(T &v)
+    {
+        return Read(&v,sizeof(T));
+    }
+
+    bool ReadMat(cv::Mat &M, const int rows, const int cols, const int type)
+    {
+        if(rows==0)
+        {
+            M.release();
+            return true;
+        }
+        M.create(rows,cols,type);
+        return Read(M.data,M.total()*M.elemSize());
+    }
+
+    size_t Remaining() const { return mPos<mN ? mN-mPos : 0; }
+    size_t Position() const { return mPos; }
+    bool AtEnd() const { return mPos==mN; }
+
+protected:
+    const char* mpData;
+    size_t mN;
+    size_t mPos;
+};
+
+} //namespace ORB_SLAM
+
+#endif // BINARYIO_H
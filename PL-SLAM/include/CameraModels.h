@@ -0,0 +1,193 @@
+#ifndef CAMERAMODELS_H
+#define CAMERAMODELS_H
+
+#include <cmath>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+// Camera models, selected with Camera.type in the settings file
+enum CameraModelType
+{
+    CAMERA_PINHOLE = 0,         // pinhole with radial-tangential distortion k1 k2 p1 p2 [k3]
+    CAMERA_KANNALA_BRANDT = 1   // fisheye, Kannala-Brandt with k1 k2 k3 k4
+};
+
+// Pinhole camera with radial-tangential distortion (OpenCV model)
+class PinholeRadtan
+{
+public:
+    PinholeRadtan(const cv::Mat &K, const cv::Mat &DistCoef):
+        fx(K.at<float>(0,0)), fy(K.at<float>(1,1)), cx(K.at<float>(0,2)), cy(K.at<float>(1,2)),
+        k1(DistCoef.at<float>(0)), k2(DistCoef.at<float>(1)), p1(DistCoef.at<float>(2)), p2(DistCoef.at<float>(3)),
+        k3(DistCoef.total()>4 ? DistCoef.at<float>(4) : 0.0f)
+    {}
+
+    bool IsDistorted() const
+    {
+        return k1!=0.0f || k2!=0.0f || p1!=0.0f || p2!=0.0f || k3!=0.0f;
+    }
+
+    // Pixel to normalized coordinates (x/z, y/z). Same iterations as cv::undistortPoints.
+    bool Unproject(const float &u, const float &v, float &x, float &y) const
+    {
+        const float x0 = (u-cx)/fx;
+        const float y0 = (v-cy)/fy;
+        x = x0;
+        y = y0;
+        for(int j=0; j<5; j++)
+        {
+            const float r2 = x*x+y*y;
+            const float icdist = 1.0f/(1.0f+((k3*r2+k2)*r2+k1)*r2);
+            const float deltaX = 2.0f*p1*x*y+p2*(r2+2.0f*x*x);
+            const float deltaY = p1*(r2+2.0f*y*y)+2.0f*p2*x*y;
+            x = (x0-deltaX)*icdist;
+            y = (y0-deltaY)*icdist;
+        }
+        return true;
+    }
+
+    // Camera coordinates to pixel
+    bool Project(const float &X, const float &Y, const float &Z, float &u, float &v) const
+    {
+        if(Z<=0.0f)
+            return false;
+        const float x = X/Z;
+        const float y = Y/Z;
+        const float r2 = x*x+y*y;
+        const float radial = 1.0f+((k3*r2+k2)*r2+k1)*r2;
+        const float xd = x*radial+2.0f*p1*x*y+p2*(r2+2.0f*x*x);
+        const float yd = y*radial+p1*(r2+2.0f*y*y)+2.0f*p2*x*y;
+        u = fx*xd+cx;
+        v = fy*yd+cy;
+        return true;
+    }
+
+protected:
+    float fx, fy, cx, cy;
+    float k1, k2, p1, p2, k3;
+};
+
+// Kannala-Brandt fisheye camera (equidistant projection with polynomial distortion of the incidence angle)
+class KannalaBrandt8
+{
+public:
+    KannalaBrandt8(const cv::Mat &K, const cv::Mat &DistCoef):
+        fx(K.at<float>(0,0)), fy(K.at<float>(1,1)), cx(K.at<float>(0,2)), cy(K.at<float>(1,2)),
+        k1(DistCoef.at<float>(0)), k2(DistCoef.at<float>(1)), k3(DistCoef.at<float>(2)), k4(DistCoef.at<float>(3))
+    {}
+
+    bool IsDistorted() const
+    {
+        return true;
+    }
+
+    // Pixel to normalized coordinates (x/z, y/z). Fails for incidence angles beyond 90 degrees.
+    bool Unproject(const float &u, const float &v, float &x, float &y) const
+    {
+        const float mx = (u-cx)/fx;
+        const float my = (v-cy)/fy;
+        const float thetad = sqrt(mx*mx+my*my);
+        if(thetad<1e-8f)
+        {
+            x = mx;
+            y = my;
+            return true;
+        }
+
+        // Newton iterations on theta_d = theta*(1+k1*theta^2+k2*theta^4+k3*theta^6+k4*theta^8)
+        float theta = thetad;
+        for(int j=0; j<10; j++)
+        {
+            const float theta2 = theta*theta;
+            const float theta4 = theta2*theta2;
+            const float theta6 = theta4*theta2;
+            const float theta8 = theta4*theta4;
+            const float f = theta*(1.0f+k1*theta2+k2*theta4+k3*theta6+k4*theta8)-thetad;
+            const float fp = 1.0f+3.0f*k1*theta2+5.0f*k2*theta4+7.0f*k3*theta6+9.0f*k4*theta8;
+            theta -= f/fp;
+            if(fabs(f)<1e-6f)
+                break;
+        }
+
+        if(theta<=0.0f || theta>=0.5f*CV_PI)
+            return false;
+
+        const float scale = tan(theta)/thetad;
+        x = mx*scale;
+        y = my*scale;
+        return true;
+    }
+
+    // Camera coordinates to pixel
+    bool Project(const float &X, const float &Y, const float &Z, float &u, float &v) const
+    {
+        const float r = sqrt(X*X+Y*Y);
+        if(r<1e-8f)
+        {
+            if(Z<=0.0f)
+                return false;
+            u = cx;
+            v = cy;
+            return true;
+        }
+        const float theta = atan2(r,Z);
+        const float theta2 = theta*theta;
+        const float theta4 = theta2*theta2;
+        const float thetad = theta*(1.0f+k1*theta2+k2*theta4+k3*theta4*theta2+k4*theta4*theta4);
+        u = fx*thetad*X/r+cx;
+        v = fy*thetad*Y/r+cy;
+        return true;
+    }
+
+protected:
+    float fx, fy, cx, cy;
+    float k1, k2, k3, k4;
+};
+
+// Undistort pixels onto the pinhole camera K (the "undistorted" image used by the rest of the system).
+// vbValid is false for the points that cannot be undistorted (they are left unchanged).
+template<class TCamera>
+void UndistortPoints(const TCamera &camera, const cv::Mat &K, std::vector<cv::Point2f> &vPoints, std::vector<bool> &vbValid)
+{
+    const float fx = K.at<float>(0,0);
+    const float fy = K.at<float>(1,1);
+    const float cx = K.at<float>(0,2);
+    const float cy = K.at<float>(1,2);
+
+    vbValid.assign(vPoints.size(),true);
+    for(size_t i=0, iend=vPoints.size(); i<iend; i++)
+    {
+        float x, y;
+        if(!camera.Unproject(vPoints[i].x,vPoints[i].y,x,y))
+        {
+            vbValid[i] = false;
+            continue;
+        }
+        vPoints[i].x = fx*x+cx;
+        vPoints[i].y = fy*y+cy;
+    }
+}
+
+// Dispatch on the camera model type
+inline void UndistortPoints(const int nCameraModel, const cv::Mat &K, const cv::Mat &DistCoef,
+                            std::vector<cv::Point2f> &vPoints, std::vector<bool> &vbValid)
+{
+    if(nCameraModel==CAMERA_KANNALA_BRANDT)
+        UndistortPoints(KannalaBrandt8(K,DistCoef),K,vPoints,vbValid);
+    else
+        UndistortPoints(PinholeRadtan(K,DistCoef),K,vPoints,vbValid);
+}
+
+inline bool IsDistorted(const int nCameraModel, const cv::Mat &K, const cv::Mat &DistCoef)
+{
+    if(nCameraModel==CAMERA_KANNALA_BRANDT)
+        return KannalaBrandt8(K,DistCoef).IsDistorted();
+    return PinholeRadtan(K,DistCoef).IsDistorted();
+}
+
+} //namespace ORB_SLAM
+
+#endif // CAMERAMODELS_H
@@ -0,0 +1,101 @@
+#ifndef CAMERARIG_H
+#define CAMERARIG_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+
+#include "Frame.h"
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class MapPoint;
+class KeyFrame;
+class KeyFrameDatabase;
+
+// Monocular cameras rigidly mounted with the camera tracked by Tracking (camera 0), whose pose is the body pose.
+// The rig handles the other cameras: their frames are extracted concurrently with camera 0, matched against
+// their local map with the pose predicted from the body pose, and used together with camera 0 to optimize it.
+// Their keyframes share the map, local BA and keyframe database, attached to the keyframe of camera 0.
+class CameraRig
+{
+public:
+    // vTc0c: pose of each of the other cameras in the frame of camera 0. The rig owns the extractors.
+    // Starts one extraction worker per camera, alive until the rig is destroyed.
+    CameraRig(const std::vector<cv::Mat> &vTc0c, const std::vector<ORBextractor*> &vpORBextractors,
+              const std::vector<LINEextractor*> &vpLINEextractors);
+    ~CameraRig();
+
+    // Number of cameras, camera 0 included
+    int GetNumCameras() const;
+
+    // Hand the images of the other cameras to their workers and return (vImGray[i] is the image of camera i+1).
+    // WaitForFrames must be called before mvFrames is used or the next images are handed.
+    void StartExtraction(const std::vector<cv::Mat> &vImGray, const double timestamp, ORBVocabulary* pVoc,
+                         const FrameConfigPtr &pConfig, const float bf, const float thDepth);
+    void WaitForFrames();
+
+    // The frames of the other cameras share the id of the frame of camera 0
+    void AssignFrameId(Frame &CurrentFrame);
+
+    // Whether the frames of the other cameras were grabbed with this frame of camera 0
+    bool HasFrames(const Frame &CurrentFrame) const;
+
+    // Match the local map in the other cameras and optimize the body pose with all the cameras (part of the local
+    // map tracking of camera 0, before its inliers are counted). Returns the number of inliers in the other cameras.
+    int TrackLocalMap(Frame &CurrentFrame, const std::vector<MapPoint*> &vpLocalMapPoints);
+
+    // Keyframes of the other cameras, attached to the keyframe of camera 0. They are inserted in LocalMapping before it.
+    std::vector<KeyFrame*> CreateKeyFrames(KeyFrame* pKF, Map* pMap, KeyFrameDatabase* pKFDB);
+
+    void Reset();
+
+public:
+    // Current frames of the other cameras
+    std::vector<Frame> mvFrames;
+
+    // Extrinsics of the other cameras: Tcc0 from camera 0 to the camera and its inverse
+    std::vector<cv::Mat> mvTcc0;
+    std::vector<cv::Mat> mvTc0c;
+
+protected:
+    // Worker of camera i+1: extracts mvFrames[i] from each image handed by StartExtraction
+    void RunWorker(const int i);
+
+
+    // Map points of the last keyframe of the camera and of its covisible keyframes
+    std::vector<MapPoint*> LocalMapPoints(const int i, const std::vector<MapPoint*> &vpLocalMapPoints);
+
+    std::vector<ORBextractor*> mvpORBextractors;
+    std::vector<LINEextractor*> mvpLINEextractors;
+
+    // Last keyframe of each of the other cameras
+    std::vector<KeyFrame*> mvpLastKeyFrames;
+
+    // Id of the frame of camera 0 grabbed with mvFrames
+    long unsigned int mnFrameId;
+    bool mbHasFrames;
+
+    // Extraction workers, the images handed to them and whether each one is still to be extracted
+    std::vector<std::thread*> mvptWorkers;
+    std::mutex mMutexWorkers;
+    std::condition_variable mcvImages;
+    std::condition_variable mcvFrames;
+    std::vector<cv::Mat> mvImages;
+    std::vector<bool> mvbExtract;
+    double mTimestamp;
+    ORBVocabulary* mpVocabulary;
+    FrameConfigPtr mpFrameConfig;
+    float mbf;
+    float mThDepth;
+    int mnPendingFrames;
+    bool mbFinishWorkers;
+};
+
+} //namespace ORB_SLAM
+
+#endif // CAMERARIG_H
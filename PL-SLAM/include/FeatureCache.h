@@ -0,0 +1,70 @@
+#ifndef FEATURECACHE_H
+#define FEATURECACHE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/line_descriptor/descriptor.hpp>
+#include <Eigen/Core>
+
+#include "Thirdparty/DBoW2/DBoW2/BowVector.h"
+#include "Thirdparty/DBoW2/DBoW2/FeatureVector.h"
+#include "BinaryIO.h"
+
+namespace ORB_SLAM2
+{
+
+class ORBextractor;
+class LINEextractor;
+
+// Features of an image as output by the extractors (distorted keypoints, without those that cannot be undistorted,
+// keylines undistorted through the camera model), with their BoW vectors
+struct CachedFeatures
+{
+    std::vector<cv::KeyPoint> vKeys;
+    cv::Mat Descriptors;
+    std::vector<cv::line_descriptor::KeyLine> vKeyLines;
+    cv::Mat LineDescriptors;
+    std::vector<Eigen::Vector3d> vLineFunctions;
+    DBoW2::BowVector BowVec;
+    DBoW2::FeatureVector FeatVec;
+};
+
+// Binary encoding of the features, shared by the cache entries and the map server messages
+void EncodeFeatures(const CachedFeatures &features, BinaryWriter &w);
+// False if the data is truncated or not valid
+bool DecodeFeatures(BinaryReader &r, CachedFeatures &features);
+
+// On-disk cache of the features of the images, to rerun a sequence without extracting them again
+// (e.g. sweeps over back-end parameters). One binary file per image in the cache directory, named after
+// a hash of the image, of the mask and of the parameters of the extractors. Files are read with mmap.
+// Enabled with FeatureCache.path in the settings file. Safe to share between runs in parallel.
+class FeatureCache
+{
+public:
+    FeatureCache(const std::string &strPath);
+
+    // Key of an image for the given extractors and calibration (the cached keylines are undistorted).
+    // The vocabulary is not part of the key: clear the cache when changing it.
+    uint64_t ComputeKey(const cv::Mat &im, const cv::Mat &mask, ORBextractor* pORBextractor,
+                        LINEextractor* pLINEextractor, const int nCameraModel, const cv::Mat &K,
+                        const cv::Mat &DistCoef) const;
+
+    // False if the entry does not exist or is not valid
+    bool Load(const uint64_t nKey, CachedFeatures &features) const;
+
+    // Written to a temporary file and renamed, a concurrent reader never sees a partial entry
+    bool Save(const uint64_t nKey, const CachedFeatures &features) const;
+
+    const std::string& GetPath() const { return mstrPath; }
+
+protected:
+    std::string EntryFilename(const uint64_t nKey) const;
+
+    std::string mstrPath;
+};
+
+} //namespace ORB_SLAM
+
+#endif // FEATURECACHE_H
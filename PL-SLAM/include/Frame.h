@@ -22,6 +22,8 @@
 #define FRAME_H
 
 #include<vector>
+#include<atomic>
+#include<stdint.h>
 
 #include "MapPoint.h"
 #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
@@ -30,6 +32,8 @@
 #include "KeyFrame.h"
 #include "ORBextractor.h"
 #include "LineExtractor.h"
+#include "CameraModels.h"
+#include "FrameConfig.h"
 
 #include "MapLine.h"
 
@@ -47,6 +51,8 @@ namespace ORB_SLAM2
 class MapPoint;
 class KeyFrame;
 class MapLine;
+class FeatureCache;
+struct CachedFeatures;
 
 class Frame
 {
@@ -56,14 +62,23 @@ public:
     // Copy constructor.
     Frame(const Frame &frame);
 
+    // Move constructor and assignments. Handing a frame over moves its buffers, no deep copy.
+    Frame(Frame &&frame) = default;
+    Frame& operator=(const Frame &frame) = default;
+    Frame& operator=(Frame &&frame) = default;
+
     // Constructor for stereo cameras.
-    Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
+    Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, const FrameConfigPtr &pConfig, const float &bf, const float &thDepth);
 
     // Constructor for RGB-D cameras.
-    Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
+    Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, const FrameConfigPtr &pConfig, const float &bf, const float &thDepth);
 
     // Constructor for Monocular cameras.
-    Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* orbextractor,LINEextractor* lsdextractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, const cv::Mat &mask = cv::Mat());
+    Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* orbextractor,LINEextractor* lsdextractor,ORBVocabulary* voc, const FrameConfigPtr &pConfig, const float &bf, const float &thDepth, const cv::Mat &mask = cv::Mat());
+
+    // Constructor from the undistorted features of a keyframe of another process (map server): no image, no distortion.
+    // pConfig is built from the camera of the features (see FrameConfig).
+    Frame(const CachedFeatures &features, const FrameConfigPtr &pConfig, const double &timeStamp, ORBVocabulary* voc);
 
     // Extract ORB on the image. 0 for left image and 1 for right image.
     void ExtractORB(int flag, const cv::Mat &im);
@@ -132,14 +147,18 @@ public:
     // Frame timestamp.
     double mTimeStamp;
 
+    // Calibration, image bounds, grid and scale pyramids of the camera, shared with the other frames.
+    // The members below are copies of its values and pointers to its tables.
+    FrameConfigPtr mpConfig;
+
     // Calibration matrix and OpenCV distortion parameters.
     cv::Mat mK;
-    static float fx;
-    static float fy;
-    static float cx;
-    static float cy;
-    static float invfx;
-    static float invfy;
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+    float invfx;
+    float invfy;
     cv::Mat mDistCoef;
 
     // Stereo baseline multiplied by fx.
@@ -189,8 +208,8 @@ public:
     std::vector<MapLine*> mvpMapLines;  //mvpMapLines与keylines相关联
 
     // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
-    static float mfGridElementWidthInv;
-    static float mfGridElementHeightInv;
+    float mfGridElementWidthInv;
+    float mfGridElementHeightInv;
     // 每个格子分配的特征点数，将图像分成格子，保证提取的特征点比较均匀
     // FRAME_GRID_ROWS 48
     // FRAME_GRID_COLS 64
@@ -201,49 +220,59 @@ public:
     // Camera pose.
     cv::Mat mTcw;
 
-    // Current and Next Frame id.
-    static long unsigned int nNextId;
+    // Current and Next Frame id (atomic: the frames of a camera rig are created concurrently).
+    static std::atomic<long unsigned int> nNextId;
     long unsigned int mnId;
 
     // Reference Keyframe.
     KeyFrame* mpReferenceKF;
 
-    // Scale pyramid info.
+    // Scale pyramid info (tables of mpConfig, one entry per level).
     int mnScaleLevels;
     float mfScaleFactor;
     float mfLogScaleFactor;
-    vector<float> mvScaleFactors;
-    vector<float> mvInvScaleFactors;
-    vector<float> mvLevelSigma2;
-    vector<float> mvInvLevelSigma2;
+    const float* mvScaleFactors;
+    const float* mvInvScaleFactors;
+    const float* mvLevelSigma2;
+    const float* mvInvLevelSigma2;
 
     // Scale pyramid info for line
     int mnScaleLevelsLine;
     float mfScaleFactorLine;
     float mfLogScaleFactorLine;
-    vector<float> mvScaleFactorsLine;
-    vector<float> mvInvScaleFactorsLine;
-    vector<float> mvLevelSigma2Line;
-    vector<float> mvInvLevelSigma2Line;
+    const float* mvScaleFactorsLine;
+    const float* mvInvScaleFactorsLine;
+    const float* mvLevelSigma2Line;
+    const float* mvInvLevelSigma2Line;
 
-    // Undistorted Image Bounds (computed once).
-    static float mnMinX;
-    static float mnMaxX;
-    static float mnMinY;
-    static float mnMaxY;
+    // Undistorted Image Bounds.
+    float mnMinX;
+    float mnMaxX;
+    float mnMinY;
+    float mnMaxY;
 
-    static bool mbInitialComputations;
+    // Features of the monocular frames loaded from / saved to disk (NULL if disabled), set by Tracking from FeatureCache.path
+    static FeatureCache* mpFeatureCache;
 
 
 private:
 
     // Undistort keypoints given OpenCV distortion parameters.
     // Only for the RGB-D case. Stereo must be already rectified!
-    // (called in the constructor).
+    // Keypoints that cannot be undistorted are removed with their descriptors (called in the constructor).
     void UndistortKeyPoints();
 
-    // Computes image bounds for the undistorted image (called in the constructor).
-    void ComputeImageBounds(const cv::Mat &imLeft);
+    // Undistort the endpoints of the lines extracted on the raw image through the camera model and recompute their
+    // line functions. Lines that cannot be undistorted, or are no longer straight once undistorted, are removed.
+    void UndistortKeyLines();
+
+    // Copies the calibration, bounds and scale pyramids of pConfig (called in the constructor).
+    void SetConfig(const FrameConfigPtr &pConfig);
+
+    // Features of the image from the feature cache, if enabled and present (called in the constructor).
+    // nKey is computed once by the constructor for both.
+    bool LoadCachedFeatures(const uint64_t nKey);
+    void SaveCachedFeatures(const uint64_t nKey);
 
     // Assign keypoints to the grid for speed up feature matching (called in the constructor).
     void AssignFeaturesToGrid();
@@ -0,0 +1,71 @@
+#ifndef FRAMECONFIG_H
+#define FRAMECONFIG_H
+
+#include <vector>
+#include <memory>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+class ORBextractor;
+class LINEextractor;
+struct AgentCamera;
+
+// Configuration of the frames of one camera: calibration, undistorted image bounds, feature grid and scale pyramids
+// of the point and line extractors. Immutable once built and shared by pointer by the frames and keyframes, which
+// copy no table. Tracking builds it with the first image (and again after a calibration change); each camera, or
+// each agent of the map server, may have its own.
+class FrameConfig
+{
+public:
+    // Bounds of the undistorted image of the given size. pLINEextractor may be NULL (no line tables).
+    FrameConfig(ORBextractor* pORBextractor, LINEextractor* pLINEextractor, const cv::Mat &K, const cv::Mat &DistCoef,
+                const int nCameraModel, const cv::Size &imageSize);
+
+    // Camera of the undistorted features of a keyframe of another process: no distortion, no image
+    FrameConfig(const AgentCamera &camera);
+
+public:
+    // Calibration matrix and distortion parameters of the camera model (CameraModelType)
+    cv::Mat mK;
+    cv::Mat mDistCoef;
+    int mnCameraModel;
+    float fx, fy, cx, cy, invfx, invfy;
+
+    // Undistorted image bounds
+    float mnMinX, mnMaxX, mnMinY, mnMaxY;
+
+    // Inverse size of the cells of the feature grid (FRAME_GRID_COLS x FRAME_GRID_ROWS)
+    float mfGridElementWidthInv;
+    float mfGridElementHeightInv;
+
+    // Scale pyramid of the points
+    int mnScaleLevels;
+    float mfScaleFactor;
+    float mfLogScaleFactor;
+    std::vector<float> mvScaleFactors;
+    std::vector<float> mvInvScaleFactors;
+    std::vector<float> mvLevelSigma2;
+    std::vector<float> mvInvLevelSigma2;
+
+    // Scale pyramid of the lines
+    int mnScaleLevelsLine;
+    float mfScaleFactorLine;
+    float mfLogScaleFactorLine;
+    std::vector<float> mvScaleFactorsLine;
+    std::vector<float> mvInvScaleFactorsLine;
+    std::vector<float> mvLevelSigma2Line;
+    std::vector<float> mvInvLevelSigma2Line;
+
+protected:
+    void SetCalibration(const cv::Mat &K);
+    void ComputeImageBounds(const cv::Size &imageSize);
+    void ComputeGrid();
+};
+
+typedef std::shared_ptr<const FrameConfig> FrameConfigPtr;
+
+} //namespace ORB_SLAM
+
+#endif // FRAMECONFIG_H
@@ -31,12 +31,15 @@
 #include "ORBextractor.h"
 #include "Frame.h"
 #include "KeyFrameDatabase.h"
+#include "KeyFrameFeatures.h"
+#include "FrameConfig.h"
 
 //#include "line_descriptor_custom.hpp"
 //#include "line_descriptor/descriptor_custom.hpp"
 #include <opencv2/line_descriptor/descriptor.hpp>
 
 #include <mutex>
+#include "ProfiledMutex.h"
 
 using namespace cv;
 //using namespace line_descriptor;
@@ -51,6 +54,7 @@ class MapPoint;
 class Frame;
 class KeyFrameDatabase;
     class MapLine;  //自己添加的，仿照MapPoint
+struct MemoryReport;
 
 class KeyFrame
 {
@@ -123,6 +127,13 @@ public:
     // Compute Scene Depth (q=2 median). Used in monocular.
     float ComputeSceneMedianDepth(const int q);
 
+    // Approximate scene median depth, from a log-depth histogram of the MapPoints updated on observation changes
+    // and rebuilt after a pose change (no copy, no sort). -1 without MapPoints.
+    float GetSceneMedianDepth();
+
+    // Estimated memory of the keyframe, added to the report (images, features, grids and graph categories)
+    void AddMemoryUsage(MemoryReport &report);
+
     static bool weightComp( int a, int b){
         return a>b;
     }
@@ -142,6 +153,19 @@ public:
     MapLine* GetMapLine(const size_t &idx);
     void lineDescriptorMAD( vector<vector<DMatch>> line_matches, double &nn_mad, double &nn12_mad) const;
 
+    // Redundancy counters (used by keyframe culling)
+    // For each observed keypoint/keyline: number of other keyframes seeing the same MapPoint/MapLine
+    // in the same or finer scale. Negative if not observed. Updated by MapPoint/MapLine observation changes.
+    void SetPointRedundancy(const size_t &idx, const int &n);
+    void IncreasePointRedundancy(const size_t &idx, const int &n=1);
+    void SetLineRedundancy(const size_t &idx, const int &n);
+    void IncreaseLineRedundancy(const size_t &idx, const int &n=1);
+    int RedundantMapPoints(int &nMPs, const bool bOnlyClose);
+    int RedundantMapLines(int &nMLs);
+
+    // Number of other observations needed for a keypoint/keyline to be redundant
+    static const int nRedundancyTh;
+
 
     // The following variables are accesed from only 1 thread or never change (no mutex needed).
 public:
@@ -167,6 +191,7 @@ public:
     // Variables used by the local mapping
     long unsigned int mnBALocalForKF;
     long unsigned int mnBAFixedForKF;
+    long unsigned int mnLocalMapSnapshotForKF[2];   // one mark per LocalMapSnapshot::eBuilder
 
     // Variables used by the keyframe database
     long unsigned int mnLoopQuery;
@@ -181,6 +206,17 @@ public:
     cv::Mat mTcwBefGBA;
     long unsigned int mnBAGlobalForKF;
 
+    // Multi-camera rig, set before the keyframe is inserted in LocalMapping and never changed afterwards.
+    // Keyframe of the first camera taken at the same time (NULL for the first camera), extrinsics from the
+    // first camera to this one, and previous keyframe of the same camera (to triangulate its first map points).
+    // The keyframes of the other cameras are culled together with the keyframe of the first camera, mpPrevRigKF may
+    // then be bad: follow its own mpPrevRigKF.
+    KeyFrame* mpRigKF;
+    cv::Mat mTcc0;
+    KeyFrame* mpPrevRigKF;
+    // Keyframes of the other cameras taken at the same time (only in keyframes of the first camera)
+    std::vector<KeyFrame*> mvpRigKFs;
+
     // Calibration parameters
     const float fx, fy, cx, cy, invfx, invfy, mbf, mb, mThDepth;
 
@@ -190,17 +226,22 @@ public:
     // Number of KeyLines
     const int NL;
 
+    // Compact feature block: undistorted keypoints, keylines and descriptors in a single allocation.
+    // The members below are views over this block (keypoints and keylines are decoded on access).
+    const KeyFrameFeatures mFeatures;
+
     // KeyPoints, stereo coordinate and descriptors (all associated by an index)
+    // mvKeys (distorted) is only kept if there is distortion, otherwise it is empty.
     const std::vector<cv::KeyPoint> mvKeys;
-    const std::vector<cv::KeyPoint> mvKeysUn;
+    const CompactKeyPoints mvKeysUn;
     const std::vector<float> mvuRight; // negative value for monocular points
     const std::vector<float> mvDepth; // negative value for monocular points
     const cv::Mat mDescriptors;
 
     // KeyLines，自己添加的，仿照KeyPoints
-    const vector<KeyLine> mvKeyLines;
+    const CompactKeyLines mvKeyLines;
     const Mat mLineDescriptors;
-    vector<Vector3d> mvKeyLineFunctions;
+    const CompactKeyLineFunctions mvKeyLineFunctions;
 
     //BoW
     DBoW2::BowVector mBowVec;
@@ -209,21 +250,24 @@ public:
     // Pose relative to parent (this is computed when bad flag is activated)
     cv::Mat mTcp;
 
-    // Scale Point
+    // Calibration, image bounds and scale pyramids shared with the frames of the camera
+    const FrameConfigPtr mpConfig;
+
+    // Scale Point (tables of mpConfig)
     const int mnScaleLevels;
     const float mfScaleFactor;
     const float mfLogScaleFactor;
-    const std::vector<float> mvScaleFactors;
-    const std::vector<float> mvLevelSigma2;
-    const std::vector<float> mvInvLevelSigma2;
+    const float* const mvScaleFactors;
+    const float* const mvLevelSigma2;
+    const float* const mvInvLevelSigma2;
 
     // Scale Line
     const int mnScaleLevelsLine;
     const float mfScaleFactorLine;
     const float mfLogScaleFactorLine;
-    const std::vector<float> mvScaleFactorsLine;
-    const std::vector<float> mvLevelSigma2Line;
-    const std::vector<float> mvInvLevelSigma2Line;
+    const float* const mvScaleFactorsLine;
+    const float* const mvLevelSigma2Line;
+    const float* const mvInvLevelSigma2Line;
 
     // Image bounds and calibration
     const int mnMinX;
@@ -274,11 +318,35 @@ protected:
 
     float mHalfBaseline; // Only for visualization
 
+    // Redundancy counters and totals
+    void ChangePointRedundancy(const size_t &idx, const int &n);
+    void ChangeLineRedundancy(const size_t &idx, const int &n);
+    std::vector<int> mvnPointRedundancy;
+    std::vector<int> mvnLineRedundancy;
+    int mnObservedPoints;
+    int mnRedundantPoints;
+    int mnObservedClosePoints;
+    int mnRedundantClosePoints;
+    int mnObservedLines;
+    int mnRedundantLines;
+
+    // Scene depth histogram over log(depth) and bin of each keypoint (-1 if not inserted).
+    // Stale after a pose change, the MapPoints are inserted again by the next GetSceneMedianDepth.
+    void InsertSceneDepth(const size_t &idx, MapPoint* pMP);
+    void RemoveSceneDepth(const size_t &idx);
+    void RebuildSceneDepth();
+    std::vector<short> mvnSceneDepthBin;
+    std::vector<int> mvnSceneDepthHistogram;
+    int mnSceneDepthSamples;
+    bool mbSceneDepthStale;
+
     Map* mpMap;
 
-    std::mutex mMutexPose;
-    std::mutex mMutexConnections;
-    std::mutex mMutexFeatures;
+    ProfiledMutex mMutexPose{"KeyFrame::mMutexPose"};
+    ProfiledMutex mMutexConnections{"KeyFrame::mMutexConnections"};
+    ProfiledMutex mMutexFeatures{"KeyFrame::mMutexFeatures"};
+    ProfiledMutex mMutexRedundancy{"KeyFrame::mMutexRedundancy"};
+    ProfiledMutex mMutexSceneDepth{"KeyFrame::mMutexSceneDepth"};
 };
 
 } //namespace ORB_SLAM
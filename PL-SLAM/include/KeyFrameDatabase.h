@@ -30,6 +30,7 @@
 #include "ORBVocabulary.h"
 
 #include<mutex>
+#include"ProfiledMutex.h"
 
 
 namespace ORB_SLAM2
@@ -57,6 +58,13 @@ public:
    // Relocalization
    std::vector<KeyFrame*> DetectRelocalizationCandidates(Frame* F);
 
+   // Keyframes of the database sharing with pKF at least minRatio times the largest number of words shared with it
+   // (pKF and its connected keyframes excluded). Does not use the loop and relocalization query marks of the keyframes.
+   std::vector<KeyFrame*> GetKeyFramesSharingWords(KeyFrame* pKF, const float minRatio);
+
+   // Estimated memory of the inverted file
+   size_t MemoryUsage();
+
 protected:
 
   // Associated vocabulary
@@ -66,7 +74,7 @@ protected:
   std::vector<list<KeyFrame*> > mvInvertedFile;
 
   // Mutex
-  std::mutex mMutex;
+  ProfiledMutex mMutex{"KeyFrameDatabase::mMutex"};
 };
 
 } //namespace ORB_SLAM
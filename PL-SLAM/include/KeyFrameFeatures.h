@@ -0,0 +1,121 @@
+#ifndef KEYFRAMEFEATURES_H
+#define KEYFRAMEFEATURES_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/line_descriptor/descriptor.hpp>
+#include <Eigen/Core>
+
+namespace ORB_SLAM2
+{
+
+// Keypoint packed in 8 bytes (cv::KeyPoint takes 28 bytes). The detector response and class_id are not stored.
+struct PackedKeyPoint
+{
+    short x, y;             // fixed point, 1/8 pixel
+    unsigned short size;    // fixed point, 1/8 pixel
+    unsigned char octave;
+    unsigned char angle;    // 360/256 degrees per unit
+};
+
+// Keyline packed in 20 bytes (KeyLine takes ~80 bytes). The detector response, size and numOfPixels are not stored,
+// class_id is the index of the keyline.
+struct PackedKeyLine
+{
+    short sx, sy, ex, ey;   // endpoints, fixed point, 1/8 pixel
+    short osx, osy, oex, oey;   // endpoints in the octave image, fixed point, 1/8 pixel
+    unsigned short length;  // fixed point, 1/8 pixel
+    unsigned char octave;
+    unsigned char angle;    // 2*pi/256 radians per unit
+};
+
+// Read-only view of the packed keypoints, decoded on access: loops should decode each element once
+class CompactKeyPoints
+{
+public:
+    CompactKeyPoints(): mpKeys(NULL), mN(0) {}
+    CompactKeyPoints(const PackedKeyPoint* pKeys, const size_t &n): mpKeys(pKeys), mN(n) {}
+
+    cv::KeyPoint operator[](const size_t &i) const;
+    int Octave(const size_t &i) const { return mpKeys[i].octave; }
+    size_t size() const { return mN; }
+    bool empty() const { return mN==0; }
+
+    std::vector<cv::KeyPoint> ToVector() const;
+
+protected:
+    const PackedKeyPoint* mpKeys;
+    size_t mN;
+};
+
+// Read-only view of the packed keylines, decoded on access: loops should decode each element once
+class CompactKeyLines
+{
+public:
+    CompactKeyLines(): mpLines(NULL), mN(0) {}
+    CompactKeyLines(const PackedKeyLine* pLines, const size_t &n): mpLines(pLines), mN(n) {}
+
+    cv::line_descriptor::KeyLine operator[](const size_t &i) const;
+    int Octave(const size_t &i) const { return mpLines[i].octave; }
+    size_t size() const { return mN; }
+    bool empty() const { return mN==0; }
+
+    std::vector<cv::line_descriptor::KeyLine> ToVector() const;
+
+protected:
+    const PackedKeyLine* mpLines;
+    size_t mN;
+};
+
+// Line functions (normalized 2D line coefficients) derived on demand from the packed endpoints
+class CompactKeyLineFunctions
+{
+public:
+    CompactKeyLineFunctions(): mpLines(NULL), mN(0) {}
+    CompactKeyLineFunctions(const PackedKeyLine* pLines, const size_t &n): mpLines(pLines), mN(n) {}
+
+    Eigen::Vector3d operator[](const size_t &i) const;
+    size_t size() const { return mN; }
+    bool empty() const { return mN==0; }
+
+    std::vector<Eigen::Vector3d> ToVector() const;
+
+protected:
+    const PackedKeyLine* mpLines;
+    size_t mN;
+};
+
+// Undistorted keypoints, keylines and their descriptors of a KeyFrame, stored in a single contiguous block.
+// The descriptor matrices are headers over the block, the block must outlive them.
+class KeyFrameFeatures
+{
+public:
+    KeyFrameFeatures(const std::vector<cv::KeyPoint> &vKeysUn, const cv::Mat &descriptors,
+                     const std::vector<cv::line_descriptor::KeyLine> &vKeyLines, const cv::Mat &lineDescriptors);
+
+    CompactKeyPoints KeyPoints() const;
+    CompactKeyLines KeyLines() const;
+    CompactKeyLineFunctions KeyLineFunctions() const;
+    cv::Mat Descriptors() const;
+    cv::Mat LineDescriptors() const;
+
+    size_t MemoryUsage() const { return mBlock.size(); }
+
+protected:
+    // Non copyable, views point inside the block
+    KeyFrameFeatures(const KeyFrameFeatures&);
+    KeyFrameFeatures& operator=(const KeyFrameFeatures&);
+
+    std::vector<unsigned char> mBlock;
+
+    int mN, mNL;
+    int mnDescRows, mnDescCols, mnDescType;
+    int mnLineDescRows, mnLineDescCols, mnLineDescType;
+    size_t mnLineDescOffset;
+    size_t mnKeysOffset;
+    size_t mnLinesOffset;
+};
+
+} //namespace ORB_SLAM
+
+#endif // KEYFRAMEFEATURES_H
@@ -11,6 +11,7 @@
 #include "MapLine.h"
 #include "KeyFrame.h"
 #include "Frame.h"
+#include "MatcherCore.h"
 
 #include <thread>
 #include <mutex>
@@ -32,6 +33,10 @@ namespace ORB_SLAM2
         // 通过投影，对Local MapLine进行跟踪
         int SearchByProjection(Frame &F, const std::vector<MapLine*> &vpMapLines, const float th=3);
 
+        // 将参考关键帧的MapLines投影到当前帧（位姿已由点估计），在线段网格中局部搜索
+        // Used in Tracking::TrackReferenceKeyFrame instead of the brute-force SearchDouble
+        int SearchByProjection(KeyFrame* pKF, Frame &CurrentFrame, const float th);
+
         int SerachForInitialize(Frame &InitialFrame, Frame &CurrentFrame, vector<int> &LineMatches);
 
         // For Iniitialize
@@ -69,7 +74,10 @@ namespace ORB_SLAM2
 
         void lineDescriptorMAD(vector<vector<DMatch>> line_matches, double &nn_mad, double &nn12_mad) const;
 
-        void ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3);
+        // 线段方向的变化量（度），由端点计算，用于旋转一致性检验
+        static float LineRotation(const float &sx1, const float &sy1, const float &ex1, const float &ey1,
+                                  const float &sx2, const float &sy2, const float &ex2, const float &ey2);
+        static float LineRotation(const KeyLine &kl1, const KeyLine &kl2);
 
         float mfNNratio;
         bool mbCheckOrientation;
@@ -10,6 +10,7 @@
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <vector>
+#include <opencv2/line_descriptor/descriptor.hpp>
 
 #include "auxiliar.h"
 
@@ -20,8 +21,15 @@ namespace ORB_SLAM2{
 class LINEextractor
 {
 public:
+    // Line detectors, selected with LINEextractor.detector
+    enum DetectorType
+    {
+        LSD = 0,
+        EDLINES = 1     // EDLines of BinaryDescriptor, faster than LSD. Octaves are downsampled by sqrt(2).
+    };
+
     LINEextractor(){}
-    LINEextractor( int _numOctaves, float _scale, unsigned int _nLSDFeature, double _min_line_length);
+    LINEextractor( int _numOctaves, float _scale, unsigned int _nLSDFeature, double _min_line_length, int _detector = LSD);
     ~LINEextractor(){}
 
     void operator()( cv::InputArray image, cv::InputArray mask, std::vector<line_descriptor::KeyLine>& keylines, cv::OutputArray descriptors, std::vector<Eigen::Vector3d> &lineVec2d);
@@ -48,11 +56,26 @@ public:
         return mvInvLevelSigma2;
     }
 
+    int inline GetDetector(){
+        return detector;}
+
+    unsigned int inline GetNumFeatures(){
+        return nLSDFeature;}
+
+    double inline GetMinLineLength(){
+        return min_line_length;}
+
 protected:
     double min_line_length;
     int numOctaves;
     unsigned int nLSDFeature;
     float scale;
+    int detector;
+
+    // Created once and reused for every frame (EDLines keeps its gradient and edge buffers per octave)
+    cv::Ptr<line_descriptor::LSDDetector> mpLSD;
+    cv::Ptr<line_descriptor::BinaryDescriptor> mpEDLines;
+    cv::Ptr<line_descriptor::BinaryDescriptor> mpLBD;
 
     std::vector<float> mvScaleFactor;
     std::vector<float> mvInvScaleFactor;
@@ -0,0 +1,60 @@
+#ifndef LOCALMAPSNAPSHOT_H
+#define LOCALMAPSNAPSHOT_H
+
+#include <vector>
+#include <atomic>
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+class KeyFrame;
+class MapPoint;
+class MapLine;
+
+// Local map around a keyframe, built by LocalMapping once the keyframe is processed and read by Tracking.
+// Immutable once published. Positions are cached at build time and are only used for coarse visibility culling.
+class LocalMapSnapshot
+{
+public:
+    // Threads building snapshots, each one uses its own mnLocalMapSnapshotForKF marks
+    enum eBuilder
+    {
+        LOCAL_MAPPING=0,    // LocalMapping thread
+        LOCALIZATION=1      // Tracking thread in localization mode
+    };
+
+    // Only one thread may build snapshots for a given builder at a time
+    LocalMapSnapshot(KeyFrame* pKF, const unsigned long nVersion, const int nBigChangeIdx, const eBuilder builder);
+
+    // Whether pKF is one of the local keyframes
+    bool Contains(KeyFrame* pKF) const;
+
+    // Coarse check of a cached position against a camera pose: in front of the camera and not far outside the image
+    static bool MaybeVisible(const cv::Point3f &x3Dw, const cv::Mat &Rcw, const cv::Mat &tcw, const float fx, const float fy,
+                             const float cx, const float cy, const float minX, const float maxX, const float minY, const float maxY);
+
+public:
+    const unsigned long mnVersion;
+    const int mnBigChangeIdx;
+    KeyFrame* const mpKF;
+
+    std::vector<KeyFrame*> mvpKeyFrames;
+    std::vector<MapPoint*> mvpMapPoints;
+    std::vector<MapLine*> mvpMapLines;
+
+    // Cached world positions, aligned with mvpMapPoints and mvpMapLines (line start and end points)
+    std::vector<cv::Point3f> mvPointPos;
+    std::vector<cv::Point3f> mvLineStartPos;
+    std::vector<cv::Point3f> mvLineEndPos;
+
+protected:
+    static std::atomic<unsigned long> nNextMark;
+
+    // Local keyframes sorted by address, for Contains()
+    std::vector<KeyFrame*> mvpSortedKeyFrames;
+};
+
+} //namespace ORB_SLAM
+
+#endif // LOCALMAPSNAPSHOT_H
@@ -26,8 +26,11 @@
 #include "LoopClosing.h"
 #include "Tracking.h"
 #include "KeyFrameDatabase.h"
+#include "LocalMapSnapshot.h"
 
 #include <mutex>
+#include <memory>
+#include "ProfiledMutex.h"
 
 
 namespace ORB_SLAM2
@@ -68,14 +71,32 @@ public:
     bool isFinished();
 
     int KeyframesInQueue(){
-        unique_lock<std::mutex> lock(mMutexNewKFs);
+        unique_lock<ProfiledMutex> lock(mMutexNewKFs);
         return mlNewKeyFrames.size();
     }
 
+    // Last published local map, NULL until the first keyframe is processed
+    std::shared_ptr<const LocalMapSnapshot> GetLocalMapSnapshot();
+
 protected:
 
     bool CheckNewKeyFrames();
     void ProcessNewKeyFrame();
+
+    // Covisible keyframe of the current keyframe with a long enough baseline to triangulate
+    struct TriangulationNeighbor
+    {
+        KeyFrame* pKF;
+        cv::Mat Ow;
+        float medianDepth;  // approximate scene median depth, -1 if unknown
+        bool bLines;        // also a neighbor for the lines (the best covisible ones)
+    };
+
+    // Neighbors shared by CreateNewMapPoints and CreateNewMapLinesConstraint, selected before they run
+    void SelectTriangulationNeighbors();
+    std::vector<TriangulationNeighbor> mvTriangulationNeighbors;
+    size_t mnLineNeighborCandidates;    // best covisible keyframes for the lines, before the baseline check
+
     void CreateNewMapPoints();
     void CreateNewMapLines();
     void CreateNewMapLinesConstraint();
@@ -88,6 +109,9 @@ protected:
 
     void KeyFrameCulling();
 
+    // Build the local map of the current keyframe and publish it to Tracking
+    void PublishLocalMapSnapshot();
+
     cv::Mat ComputeF12(KeyFrame* &pKF1, KeyFrame* &pKF2);
 
     cv::Mat SkewSymmetricMatrix(const cv::Mat &v);
@@ -120,7 +144,7 @@ protected:
 
     std::list<MapLine*> mlpRecentAddedMapLines; //线特征
 
-    std::mutex mMutexNewKFs;
+    ProfiledMutex mMutexNewKFs{"LocalMapping::mMutexNewKFs"};
 
     bool mbAbortBA;
 
@@ -131,6 +155,10 @@ protected:
 
     bool mbAcceptKeyFrames;
     std::mutex mMutexAccept;
+
+    std::shared_ptr<const LocalMapSnapshot> mpLocalMapSnapshot;
+    unsigned long mnLocalMapSnapshotVersion;
+    std::mutex mMutexLocalMapSnapshot;
 };
 
 } //namespace ORB_SLAM
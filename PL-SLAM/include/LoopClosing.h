@@ -31,6 +31,7 @@
 
 #include <thread>
 #include <mutex>
+#include <list>
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 
 namespace ORB_SLAM2
@@ -51,7 +52,8 @@ public:
 
 public:
 
-    LoopClosing(Map* pMap, KeyFrameDatabase* pDB, ORBVocabulary* pVoc,const bool bFixScale);
+    // bScheduleQueries: skip and batch the loop queries (see ScheduleLoopQuery), else every keyframe is queried
+    LoopClosing(Map* pMap, KeyFrameDatabase* pDB, ORBVocabulary* pVoc,const bool bFixScale, const bool bScheduleQueries=true);
 
     void SetTracker(Tracking* pTracker);
 
@@ -82,10 +84,39 @@ public:
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
+    // Loop query scheduling.
+    // A keyframe is not queried if it is visually close to the last queried one (more similar to it than to its
+    // least similar covisible keyframe) and the camera moved less than this times the scene median depth since then
+    static const float QUERY_MIN_BASELINE;
+    // but at most this many consecutive keyframes are skipped, the consistency check needs regular queries
+    static const int QUERY_MAX_SKIPPED = 4;
+    // Keyframes closer than this times the scene median depth to an old keyframe may enter a mapped region and are
+    // always queried
+    static const float REVISIT_RADIUS;
+    // The old keyframes are searched among the keyframes sharing this ratio of the most words shared with the query
+    static const float REVISIT_MIN_COMMON_WORDS;
+    // When this many keyframes are waiting, only the most promising of them is queried
+    static const int QUERY_BATCH_SIZE = 3;
+
 protected:
 
     bool CheckNewKeyFrames();
 
+    // Takes the next keyframes of the queue and selects mpCurrentKF. The others are only added to the database.
+    // False if no keyframe has to be queried.
+    bool ScheduleLoopQuery();
+    // Estimated chance of a loop at the keyframe: BoW novelty with respect to its covisible keyframes, increased
+    // near old keyframes. Negative if it should not be queried.
+    float QueryPriority(KeyFrame* pKF, const float minScore, const cv::Mat &Ow, const float medianDepth);
+    // Distance from the camera center Ow of pKF to the nearest older keyframe that is not covisible and shares words
+    // with it (FLT_MAX if none)
+    float DistanceToOldKeyFrames(KeyFrame* pKF, const cv::Mat &Ow);
+    // Lowest BoW score of pKF to its covisible keyframes
+    float ComputeMinCovisibleScore(KeyFrame* pKF);
+    void AddToDatabase(KeyFrame* pKF);
+    // Keyframes of the last batch newer than the queried keyframe
+    void AddDeferredKeyFrames();
+
     bool DetectLoop();
 
     bool ComputeSim3();
@@ -119,6 +150,16 @@ protected:
     // Loop detector parameters
     float mnCovisibilityConsistencyTh;
 
+    // Loop query scheduler
+    bool mbScheduleQueries;
+    KeyFrame* mpLastQueryKF;
+    cv::Mat mLastOw;
+    // Camera motion since the last query, in median scene depths
+    float mfBaselineSinceQuery;
+    int mnSkippedKFs;
+    float mfCurrentMinScore;
+    std::list<KeyFrame*> mlpDeferredKFs;
+
     // Loop detector variables
     KeyFrame* mpCurrentKF;
     KeyFrame* mpMatchedKF;
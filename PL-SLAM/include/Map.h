@@ -26,6 +26,11 @@
 #include <set>
 
 #include <mutex>
+#include <memory>
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+#include "ProfiledMutex.h"
+#include "MapSnapshot.h"
 
 #include "MapLine.h"
 
@@ -39,12 +44,16 @@ class MapLine;
 class Map
 {
 public:
-    Map();
+    // bSnapshots: keep the states of the elements for GetSnapshot(). Costs a lock on every pose and position
+    // update, only enabled by the users of the snapshots (map checkpoints, map client).
+    Map(const bool bSnapshots = false);
 
     void AddKeyFrame(KeyFrame* pKF);
     void EraseKeyFrame(KeyFrame* pKF);
     void InformNewBigChange();
     int GetLastBigChangeIdx();
+    // Number of clear() calls (resets): pointers to elements obtained before a change of the index were deleted
+    int GetClearIdx();
     //---MapPoint---
     void AddMapPoint(MapPoint* pMP);
     void EraseMapPoint(MapPoint* pMP);
@@ -70,15 +79,29 @@ public:
 
     void clear();
 
+    // Copy-on-write snapshot of the keyframe poses and landmark positions, takes microseconds (shares the state chunks).
+    // Lock mMutexMapUpdate to get a snapshot consistent with loop corrections and bundle adjustments.
+    // Empty if the map was built without snapshots.
+    std::shared_ptr<const MapSnapshot> GetSnapshot();
+
+    // New pose/position of an element, called by the element itself (nothing without snapshots)
+    void UpdateSnapshotState(KeyFrame* pKF, const cv::Mat &Tcw);
+    void UpdateSnapshotState(MapPoint* pMP, const cv::Mat &Pos);
+    void UpdateSnapshotState(MapLine* pML, const Eigen::Matrix<double,6,1> &Pos);
+
     vector<KeyFrame*> mvpKeyFrameOrigins;
 
-    std::mutex mMutexMapUpdate;
+    ProfiledMutex mMutexMapUpdate{"Map::mMutexMapUpdate"};
 
     // This avoid that two points are created simultaneously in separate threads (id conflict)
-    std::mutex mMutexPointCreation;
+    ProfiledMutex mMutexPointCreation{"Map::mMutexPointCreation"};
 
     // 类比MapPoint
-    std::mutex mMutexLineCreation;
+    ProfiledMutex mMutexLineCreation{"Map::mMutexLineCreation"};
+
+    // Held by clear() while it deletes the elements. The threads other than Tracking, LocalMapping and LoopClosing
+    // (which are reset first) hold it while they dereference elements of the map. Lock it after mMutexMapUpdate.
+    ProfiledMutex mMutexMapClear{"Map::mMutexMapClear"};
 
 protected:
     //---MapPoint---
@@ -96,7 +119,16 @@ protected:
     // Index related to a big change in the map (loop closure, global BA)
     int mnBigChangeIdx;
 
-    std::mutex mMutexMap;
+    int mnClearIdx;
+
+    ProfiledMutex mMutexMap{"Map::mMutexMap"};
+
+    // States of the elements for the snapshots, indexed by mnId. Valid while the element is in the map.
+    // Only maintained with mbSnapshots.
+    const bool mbSnapshots;
+    CowStateArray<KeyFrameState> mKeyFrameStates{"Map::mKeyFrameStates"};
+    CowStateArray<MapPointState> mMapPointStates{"Map::mMapPointStates"};
+    CowStateArray<MapLineState> mMapLineStates{"Map::mMapLineStates"};
 };
 
 } //namespace ORB_SLAM
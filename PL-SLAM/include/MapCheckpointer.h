@@ -0,0 +1,62 @@
+#ifndef MAPCHECKPOINTER_H
+#define MAPCHECKPOINTER_H
+
+#include <string>
+#include <mutex>
+#include <memory>
+
+#include "Map.h"
+#include "MapSnapshot.h"
+
+namespace ORB_SLAM2
+{
+
+class Map;
+
+// Writes map checkpoints in its own thread while SLAM continues: takes a snapshot of the map (Map::GetSnapshot)
+// and serializes it in a new directory of strPath. Each checkpoint is written in a temporary directory and renamed
+// once complete, an interrupted checkpoint never replaces a previous one.
+class MapCheckpointer
+{
+public:
+    // fInterval: seconds between periodic checkpoints (0: only on request)
+    MapCheckpointer(Map* pMap, const std::string &strPath, const double fInterval);
+
+    // Main function
+    void Run();
+
+    // Asynchronous, a pending request is still served after RequestFinish()
+    void RequestCheckpoint();
+
+    void RequestFinish();
+
+    bool isFinished();
+
+    // Directory of the last checkpoint written (empty if none)
+    std::string GetLastCheckpoint();
+
+protected:
+    bool CheckRequest();
+    bool WriteCheckpoint(const std::shared_ptr<const MapSnapshot> &pSnapshot);
+
+    bool CheckFinish();
+    void SetFinish();
+
+    Map* mpMap;
+
+    std::string mstrPath;
+    double mfInterval;
+    int mnCheckpoints;
+
+    bool mbCheckpointRequested;
+    std::string mstrLastCheckpoint;
+    std::mutex mMutexRequest;
+
+    bool mbFinishRequested;
+    bool mbFinished;
+    std::mutex mMutexFinish;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPCHECKPOINTER_H
@@ -0,0 +1,90 @@
+#ifndef MAPCLIENT_H
+#define MAPCLIENT_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <opencv2/core/core.hpp>
+
+#include "Map.h"
+#include "MapMessages.h"
+#include "MapTransport.h"
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrame;
+
+// Streams the keyframes of the local map, with the map points and map lines they observe, to a map server
+// (MapServer) and receives the alignment of the local map in the map shared by the agents.
+// Runs in its own thread. Each connection is a new map for the server: the client reconnects and resends the map
+// if the server restarts or the local map is reset. The local map is never modified, the alignment is exposed to
+// the application and used to save the trajectory in the shared frame (System::SaveSharedKeyFrameTrajectoryTUM).
+class MapClient
+{
+public:
+    MapClient(Map* pMap, const std::string &strAddress, const unsigned int nAgentId);
+    ~MapClient();
+
+    // Main function
+    void Run();
+
+    void RequestFinish();
+
+    bool isFinished();
+
+    // False until the server merges the local map with the map of another agent.
+    // Sws: 4x4 [s*R t] from the local world frame to the shared frame (world frame of agent nReferenceAgent).
+    // The last alignment is kept once the client has finished.
+    bool GetSharedMapAlignment(cv::Mat &Sws, unsigned int &nReferenceAgent);
+
+    // Keyframes are sent once this many newer keyframes exist, after local mapping has refined them
+    static const unsigned int KEYFRAME_SEND_DELAY = 5;
+
+    // Elements of each kind per poses message, keeps the messages far below MapTransport::MAX_MESSAGE_SIZE
+    static const size_t POSES_PER_MESSAGE = 1<<18;
+
+protected:
+    bool Connect();
+    void Disconnect();
+
+    void SendNewKeyFrames();
+    // After a loop closure or a global BA: poses and positions changed since the previous poses update
+    // (map snapshots, the map is built with them in multi-agent mode)
+    void SendPoses();
+    void ReceiveAlignments();
+
+    // Call with Map::mMutexMapClear locked
+    KeyFrameMessage MakeKeyFrameMessage(KeyFrame* pKF);
+
+    bool CheckFinish();
+    void SetFinish();
+
+    Map* mpMap;
+    std::string mstrAddress;
+    unsigned int mnAgentId;
+
+    MapTransport* mpTransport;
+
+    // Keyframes are sent in id order, the ones below this id have been sent in this connection
+    long unsigned int mnNextKFid;
+    int mnLastBigChangeIdx;
+    // Map::GetClearIdx() at the connection, the map is cleared by a reset when it changes
+    int mnClearIdx;
+    // States at the last poses update (or at the connection), the next update sends the differences
+    std::shared_ptr<const MapSnapshot> mpPosesSnapshot;
+
+    cv::Mat mSws;
+    unsigned int mnReferenceAgent;
+    std::mutex mMutexAlignment;
+
+    bool mbFinishRequested;
+    bool mbFinished;
+    std::mutex mMutexFinish;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPCLIENT_H
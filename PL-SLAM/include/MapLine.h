@@ -13,6 +13,8 @@
 #include <opencv2/line_descriptor/descriptor.hpp>
 #include <opencv2/core/core.hpp>
 #include <mutex>
+#include "ProfiledMutex.h"
+#include "MatcherCore.h"
 #include <eigen3/Eigen/Core>
 #include <map>
 
@@ -86,6 +88,11 @@ public:
     void ComputeDistinctiveDescriptors();   //仿照orbslam，计算线特征最独特的描述子
 
     Mat GetDescriptor();
+    // Lock-free copy of the descriptor in buffer, for the matchers
+    LBDDescriptorView GetDescriptor(LBDDescriptorBuffer &buffer) const { return mLDescriptor.Load(buffer); }
+
+    // Estimated memory of the line (descriptors and observations)
+    size_t MemoryUsage();
 
     void UpdateAverageDir();    //pl-slam和ORB-SLAM的类似，计算线特征的平均方向
 
@@ -124,6 +131,7 @@ public:
     // Variables used by local mapping
     long unsigned int mnBALocalForKF;
     long unsigned int mnFuseCandidateForKF;
+    long unsigned int mnLocalMapSnapshotForKF[2];   // one mark per LocalMapSnapshot::eBuilder
 
     // Variables used by loop closing
     long unsigned int mnLoopLineForKF;
@@ -132,7 +140,7 @@ public:
     Mat mPosGBA;
     long unsigned int mnBAGlobalForKF;
 
-    static std::mutex mGlobalMutex;
+    static ProfiledMutex mGlobalMutex;
 
 public:
     // Position in absolute coordinates
@@ -146,7 +154,7 @@ public:
 
     Vector3d mNormalVector;  //MapPoint中，指的是该MapPoint的平均观测方向，这里指的是观测特征线段的方向
 
-    Mat mLDescriptor;   //通过ComputeDistinctiveDescriptors()得到的最优描述子
+    AtomicDescriptor<LBDDescriptor> mLDescriptor;   //通过ComputeDistinctiveDescriptors()得到的最优描述子
 
     KeyFrame* mpRefKF;  //参考关键帧
 
@@ -166,8 +174,8 @@ public:
 
     Map* mpMap;
 
-    mutex mMutexPos;
-    mutex mMutexFeatures;
+    ProfiledMutex mMutexPos{"MapLine::mMutexPos"};
+    ProfiledMutex mMutexFeatures{"MapLine::mMutexFeatures"};
 };
 
 }
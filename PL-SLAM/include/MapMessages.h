@@ -0,0 +1,88 @@
+#ifndef MAPMESSAGES_H
+#define MAPMESSAGES_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+#include "FeatureCache.h"
+
+namespace ORB_SLAM2
+{
+
+// Messages between the SLAM clients and the map server (see MapClient and MapServer)
+enum MapMessageType
+{
+    MAP_MSG_INVALID = 0,
+    MAP_MSG_HELLO = 1,          // client -> server, first message of a client: its agent id
+    MAP_MSG_KEYFRAME = 2,       // client -> server: a keyframe with the landmarks it observes
+    MAP_MSG_POSES = 3,          // client -> server: poses and positions after a loop closure or a global BA
+    MAP_MSG_ALIGNMENT = 4       // server -> client: transformation of the agent map into the shared map
+};
+
+// Camera of an agent, sent with each keyframe
+struct AgentCamera
+{
+    float fx, fy, cx, cy;
+    // Undistorted image bounds
+    float minX, maxX, minY, maxY;
+    int32_t nScaleLevels;
+    float fScaleFactor;
+    int32_t nScaleLevelsLine;
+    float fScaleFactorLine;
+};
+
+struct KeyFrameMessage
+{
+    uint64_t nId;
+    double timestamp;
+    cv::Mat Tcw;
+    AgentCamera camera;
+
+    // Undistorted keypoints and keylines with their descriptors and BoW vectors
+    CachedFeatures features;
+
+    // Landmark observed by each keypoint / keyline (-1 if none) and its world position
+    std::vector<int64_t> vMapPointIds;
+    std::vector<cv::Point3f> vMapPointPos;
+    std::vector<int64_t> vMapLineIds;
+    std::vector<cv::Vec6d> vMapLinePos;
+};
+
+struct PosesMessage
+{
+    std::vector<uint64_t> vKeyFrameIds;
+    std::vector<cv::Mat> vTcw;
+    std::vector<uint64_t> vMapPointIds;
+    std::vector<cv::Point3f> vMapPointPos;
+    std::vector<uint64_t> vMapLineIds;
+    std::vector<cv::Vec6d> vMapLinePos;
+};
+
+struct AlignmentMessage
+{
+    // Agent whose world frame is the shared frame
+    uint32_t nReferenceAgent;
+    // Agents merged in the shared map
+    uint32_t nAgents;
+    // 4x4 [s*R t], from the agent world frame to the shared frame
+    cv::Mat Sws;
+};
+
+MapMessageType GetMapMessageType(const std::string &msg);
+
+std::string EncodeHello(const uint32_t nAgentId);
+std::string EncodeMapMessage(const KeyFrameMessage &m);
+std::string EncodeMapMessage(const PosesMessage &m);
+std::string EncodeMapMessage(const AlignmentMessage &m);
+
+// False if the message is of another type, truncated or not valid
+bool DecodeHello(const std::string &msg, uint32_t &nAgentId);
+bool DecodeMapMessage(const std::string &msg, KeyFrameMessage &m);
+bool DecodeMapMessage(const std::string &msg, PosesMessage &m);
+bool DecodeMapMessage(const std::string &msg, AlignmentMessage &m);
+
+} //namespace ORB_SLAM
+
+#endif // MAPMESSAGES_H
@@ -27,6 +27,8 @@
 
 #include<opencv2/core/core.hpp>
 #include<mutex>
+#include"ProfiledMutex.h"
+#include"MatcherCore.h"
 
 #include <eigen3/Eigen/Core>
 using namespace Eigen;
@@ -76,6 +78,11 @@ public:
     void ComputeDistinctiveDescriptors();
 
     cv::Mat GetDescriptor();
+    // Lock-free copy of the descriptor in buffer, for the matchers
+    ORBDescriptorView GetDescriptor(ORBDescriptorBuffer &buffer) const { return mDescriptor.Load(buffer); }
+
+    // Estimated memory of the point (position, descriptor and observations)
+    size_t MemoryUsage();
 
     void UpdateNormalAndDepth();
 
@@ -104,6 +111,7 @@ public:
     // Variables used by local mapping
     long unsigned int mnBALocalForKF;
     long unsigned int mnFuseCandidateForKF;
+    long unsigned int mnLocalMapSnapshotForKF[2];   // one mark per LocalMapSnapshot::eBuilder
 
     // Variables used by loop closing
     long unsigned int mnLoopPointForKF;
@@ -113,7 +121,7 @@ public:
     long unsigned int mnBAGlobalForKF;
 
 
-    static std::mutex mGlobalMutex;
+    static ProfiledMutex mGlobalMutex;
 
 protected:    
 
@@ -127,7 +135,7 @@ protected:
      cv::Mat mNormalVector;
 
      // Best descriptor to fast matching
-     cv::Mat mDescriptor;
+     AtomicDescriptor<ORBDescriptor> mDescriptor;
 
      // Reference KeyFrame
      KeyFrame* mpRefKF;
@@ -146,8 +154,8 @@ protected:
 
      Map* mpMap;
 
-     std::mutex mMutexPos;
-     std::mutex mMutexFeatures;
+     ProfiledMutex mMutexPos{"MapPoint::mMutexPos"};
+     ProfiledMutex mMutexFeatures{"MapPoint::mMutexFeatures"};
 };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,143 @@
+#ifndef MAPSERVER_H
+#define MAPSERVER_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+#include "Map.h"
+#include "KeyFrame.h"
+#include "KeyFrameDatabase.h"
+#include "ORBVocabulary.h"
+#include "MapMessages.h"
+#include "MapTransport.h"
+#include "FrameConfig.h"
+
+#include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
+
+namespace ORB_SLAM2
+{
+
+// Rebuilds the map of each SLAM client (MapClient) from the keyframes, map points and map lines it streams and
+// merges the maps of the agents that visit the same places. Place recognition across agents queries a
+// KeyFrameDatabase shared by all the maps and is verified like a loop closure (BoW matches, Sim3 RANSAC, Sim3
+// optimization). A shared map is expressed in the world frame of one of its agents (the reference), each agent
+// receives the transformation of its map into the shared frame whenever it changes.
+// Maps are kept after their client disconnects, a new connection of the same agent replaces its map.
+class MapServer
+{
+public:
+    // bFixScale: the clients have stereo or depth (SE3 alignments), Sim3 for monocular clients
+    MapServer(ORBVocabulary* pVoc, MapTransportListener* pListener, const bool bFixScale);
+    ~MapServer();
+
+    // Main function: accepts the clients and processes their messages
+    void Run();
+
+    void RequestFinish();
+
+    bool isFinished();
+
+    // For each shared map, in strPath/shared_map_<reference agent>: keyframe trajectory of each agent (TUM format),
+    // point cloud (PLY) and map lines, in the shared frame. Call after the server has finished.
+    bool SaveSharedMaps(const std::string &strPath);
+
+    // A match is accepted with this many inliers after the Sim3 optimization. Stricter than loop closing,
+    // there is no temporal consistency check of the candidates.
+    static const int MERGE_MIN_INLIERS = 40;
+
+    // Largest number of scale levels accepted in the camera of a keyframe
+    static const int MAX_SCALE_LEVELS = 32;
+
+protected:
+    struct Connection;
+
+    struct Agent
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        unsigned int nId;
+        Map* pMap;
+        // NULL once disconnected
+        Connection* pConnection;
+
+        // Elements by their id in the client
+        std::map<uint64_t,KeyFrame*> mKeyFrames;
+        std::map<uint64_t,MapPoint*> mMapPoints;
+        std::map<uint64_t,MapLine*> mMapLines;
+
+        // Camera of the last keyframe and its frame configuration
+        AgentCamera camera;
+        FrameConfigPtr pFrameConfig;
+
+        // Shared map: reference agent and transformation from this map to its world frame
+        Agent* pReference;
+        g2o::Sim3 Sws;
+    };
+
+    struct Connection
+    {
+        MapTransport* pTransport;
+        std::thread* pThread;
+        // Set by the hello message
+        Agent* pAgent;
+    };
+
+    struct Message
+    {
+        Connection* pConnection;
+        std::string data;
+        // Last message of a connection
+        bool bClosed;
+    };
+
+    // Thread of each connection, queues its messages
+    void ReceiveMessages(Connection* pConnection);
+    bool GetNextMessage(Message &message);
+
+    void ProcessMessage(Message &message);
+    void AddAgent(Connection* pConnection, const unsigned int nAgentId);
+    void RemoveAgent(Agent* pAgent);
+    void AddKeyFrame(Agent* pAgent, const KeyFrameMessage &m);
+    // Whether the camera, octaves, descriptors and BoW words of a decoded keyframe can be used without going out of
+    // bounds (decoding only checks sizes)
+    bool IsValidKeyFrame(const KeyFrameMessage &m) const;
+    void UpdatePoses(Agent* pAgent, const PosesMessage &m);
+
+    // Search the maps of the other shared maps for the place of pKF, merges them on success
+    void DetectMerge(Agent* pAgent, KeyFrame* pKF);
+    // S12: from the world frame of pAgent1 to the world frame of pAgent2
+    void MergeMaps(Agent* pAgent1, Agent* pAgent2, const g2o::Sim3 &S12);
+    // Rebases a shared map on another of its agents
+    void SetReference(Agent* pOldReference, Agent* pNewReference);
+    void SendAlignments(Agent* pReference);
+
+    std::vector<Agent*> GetSharedMap(Agent* pReference);
+
+    bool CheckFinish();
+    void SetFinish();
+
+    ORBVocabulary* mpVocabulary;
+    KeyFrameDatabase* mpKeyFrameDB;
+    MapTransportListener* mpListener;
+    bool mbFixScale;
+
+    std::vector<Agent*> mvpAgents;
+    std::map<KeyFrame*,Agent*> mKeyFrameAgents;
+    std::list<Connection*> mlpConnections;
+
+    std::list<Message> mlMessages;
+    std::mutex mMutexMessages;
+
+    bool mbFinishRequested;
+    bool mbFinished;
+    std::mutex mMutexFinish;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPSERVER_H
@@ -0,0 +1,128 @@
+#ifndef MAPSNAPSHOT_H
+#define MAPSNAPSHOT_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <mutex>
+#include "ProfiledMutex.h"
+
+namespace ORB_SLAM2
+{
+
+// State versions of the map elements kept for the snapshots
+struct KeyFrameState
+{
+    double timestamp;
+    float Tcw[12];      // [R|t] row by row
+    bool bRigCamera;    // keyframe of another camera of a rig, not part of the trajectory
+};
+
+struct MapPointState
+{
+    float pos[3];
+};
+
+struct MapLineState
+{
+    double pos[6];      // start and end points
+};
+
+// States of the map elements indexed by element id, stored in chunks shared with the snapshots (copy-on-write).
+// Taking a snapshot copies the chunk pointers only. A write first copies its chunk if a snapshot still holds it:
+// snapshots never change and writers never wait for a snapshot to be serialized.
+template<typename T>
+class CowStateArray
+{
+public:
+    static const size_t CHUNK_SIZE = 256;
+
+    struct Chunk
+    {
+        Chunk(): mvStates() { std::fill(mvbValid,mvbValid+CHUNK_SIZE,false); }
+
+        T mvStates[CHUNK_SIZE];
+        // Element in the map
+        bool mvbValid[CHUNK_SIZE];
+    };
+
+    typedef std::vector<std::shared_ptr<const Chunk> > SharedChunks;
+
+    explicit CowStateArray(const char* name): mMutex(name) {}
+
+    void Update(const size_t id, const T &state)
+    {
+        std::unique_lock<ProfiledMutex> lock(mMutex);
+        Writable(id)->mvStates[id%CHUNK_SIZE] = state;
+    }
+
+    void SetValid(const size_t id, const bool bValid)
+    {
+        std::unique_lock<ProfiledMutex> lock(mMutex);
+        if(!bValid && id/CHUNK_SIZE>=mvpChunks.size())
+            return;
+        Writable(id)->mvbValid[id%CHUNK_SIZE] = bValid;
+    }
+
+    SharedChunks Share()
+    {
+        std::unique_lock<ProfiledMutex> lock(mMutex);
+        return SharedChunks(mvpChunks.begin(),mvpChunks.end());
+    }
+
+    void Clear()
+    {
+        std::unique_lock<ProfiledMutex> lock(mMutex);
+        mvpChunks.clear();
+    }
+
+protected:
+    Chunk* Writable(const size_t id)
+    {
+        const size_t c = id/CHUNK_SIZE;
+        if(c>=mvpChunks.size())
+            mvpChunks.resize(c+1);
+
+        std::shared_ptr<Chunk> &pChunk = mvpChunks[c];
+        if(!pChunk)
+            pChunk = std::make_shared<Chunk>();
+        else if(pChunk.use_count()>1)   // held by a snapshot (snapshots only release chunks concurrently)
+            pChunk = std::make_shared<Chunk>(*pChunk);
+        return pChunk.get();
+    }
+
+    std::vector<std::shared_ptr<Chunk> > mvpChunks;
+    ProfiledMutex mMutex;
+};
+
+// Immutable copy of the keyframe poses and landmark positions of the map, see Map::GetSnapshot().
+// Holds no pointer to the map elements: it can be serialized from any thread while SLAM continues.
+class MapSnapshot
+{
+public:
+    MapSnapshot(const CowStateArray<KeyFrameState>::SharedChunks &vKeyFrames,
+                const CowStateArray<MapPointState>::SharedChunks &vMapPoints,
+                const CowStateArray<MapLineState>::SharedChunks &vMapLines, const int nBigChangeIdx);
+
+    size_t KeyFramesInSnapshot() const;
+    size_t MapPointsInSnapshot() const;
+    size_t MapLinesInSnapshot() const;
+
+    // Same formats as System::SaveKeyFrameTrajectoryTUM and System::SavePointCloud
+    bool SaveKeyFrameTrajectoryTUM(const std::string &filename) const;
+    bool SavePointCloud(const std::string &filename) const;
+    // One line per map line: start and end points
+    bool SaveMapLines(const std::string &filename) const;
+
+public:
+    const CowStateArray<KeyFrameState>::SharedChunks mvKeyFrames;
+    const CowStateArray<MapPointState>::SharedChunks mvMapPoints;
+    const CowStateArray<MapLineState>::SharedChunks mvMapLines;
+
+    const int mnBigChangeIdx;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPSNAPSHOT_H
@@ -0,0 +1,88 @@
+#ifndef MAPTRANSPORT_H
+#define MAPTRANSPORT_H
+
+#include <string>
+#include <mutex>
+#include <stdint.h>
+
+namespace ORB_SLAM2
+{
+
+// Channel between a SLAM client and the map server. Carries whole messages (see MapMessages.h), in order.
+// Send and Receive can be called concurrently from different threads.
+class MapTransport
+{
+public:
+    virtual ~MapTransport() {}
+
+    // Blocking. False if the channel is closed.
+    virtual bool Send(const std::string &msg) = 0;
+
+    // Waits at most timeoutMs for a message. False on timeout or if the channel is closed (see IsOpen).
+    virtual bool Receive(std::string &msg, const int timeoutMs) = 0;
+
+    virtual bool IsOpen() = 0;
+
+    virtual void Close() = 0;
+};
+
+// Server side of a transport: accepts the channels of the clients
+class MapTransportListener
+{
+public:
+    virtual ~MapTransportListener() {}
+
+    // Waits at most timeoutMs for a client. NULL on timeout, the caller owns the channel.
+    virtual MapTransport* Accept(const int timeoutMs) = 0;
+};
+
+// Unix-domain stream socket, for clients and server on the same machine.
+// Messages are framed by their 32-bit length.
+class UnixSocketTransport : public MapTransport
+{
+public:
+    // Takes ownership of the connected socket
+    explicit UnixSocketTransport(const int fd);
+    ~UnixSocketTransport();
+
+    // NULL if no server listens at strPath
+    static UnixSocketTransport* Connect(const std::string &strPath);
+
+    bool Send(const std::string &msg);
+    bool Receive(std::string &msg, const int timeoutMs);
+    bool IsOpen();
+    void Close();
+
+    // Larger messages close the channel (a keyframe takes ~100KB)
+    static const uint32_t MAX_MESSAGE_SIZE = 64u<<20;
+
+protected:
+    void CloseSocket();
+
+    int mFd;
+    bool mbOpen;
+    std::mutex mMutexOpen;
+    std::mutex mMutexSend;
+    std::mutex mMutexReceive;
+};
+
+class UnixSocketListener : public MapTransportListener
+{
+public:
+    ~UnixSocketListener();
+
+    // Replaces a stale socket file at strPath. NULL on error.
+    static UnixSocketListener* Listen(const std::string &strPath);
+
+    MapTransport* Accept(const int timeoutMs);
+
+protected:
+    UnixSocketListener(const int fd, const std::string &strPath);
+
+    int mFd;
+    std::string mstrPath;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPTRANSPORT_H
@@ -0,0 +1,297 @@
+#ifndef MATCHERCORE_H
+#define MATCHERCORE_H
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <atomic>
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+// Binary descriptor types, the width is known at compile time
+struct ORBDescriptor
+{
+    enum { BYTES = 32 };    // 256 bits
+};
+
+struct LBDDescriptor
+{
+    enum { BYTES = 32 };    // 256 bits
+};
+
+// Read-only view on one binary descriptor (a row of a descriptor matrix). No cv::Mat header is created.
+template<class TDescriptor>
+class DescriptorView
+{
+public:
+    enum { BYTES = TDescriptor::BYTES };
+
+    DescriptorView(): mpData(NULL) {}
+    explicit DescriptorView(const unsigned char* pData): mpData(pData) {}
+    explicit DescriptorView(const cv::Mat &desc): mpData(desc.empty() ? NULL : desc.ptr<unsigned char>()) {}
+
+    // Row idx of a descriptor matrix (one descriptor per row)
+    static DescriptorView Row(const cv::Mat &descriptors, const size_t &idx)
+    {
+        return DescriptorView(descriptors.ptr<unsigned char>(idx));
+    }
+
+    bool empty() const { return mpData==NULL; }
+    const unsigned char* data() const { return mpData; }
+
+protected:
+    const unsigned char* mpData;
+};
+
+typedef DescriptorView<ORBDescriptor> ORBDescriptorView;
+typedef DescriptorView<LBDDescriptor> LBDDescriptorView;
+
+// Local copy of one descriptor (see AtomicDescriptor)
+template<class TDescriptor>
+struct DescriptorBuffer
+{
+    DescriptorView<TDescriptor> View() const { return DescriptorView<TDescriptor>(reinterpret_cast<const unsigned char*>(mWords)); }
+
+    uint64_t mWords[TDescriptor::BYTES/8];
+};
+
+typedef DescriptorBuffer<ORBDescriptor> ORBDescriptorBuffer;
+typedef DescriptorBuffer<LBDDescriptor> LBDDescriptorBuffer;
+
+// Descriptor of a map element, replaced by ComputeDistinctiveDescriptors while the matchers of the other threads
+// read it. Published with a sequence counter: readers copy it without taking a lock or touching a reference count,
+// and retry if a write overlapped. Writers must be serialized by the caller.
+template<class TDescriptor>
+class AtomicDescriptor
+{
+public:
+    AtomicDescriptor(): mnSeq(0)
+    {
+        for(int i=0; i<WORDS; i++)
+            mWords[i].store(0,std::memory_order_relaxed);
+    }
+
+    void Store(const DescriptorView<TDescriptor> &desc)
+    {
+        const unsigned int seq = mnSeq.load(std::memory_order_relaxed);
+        mnSeq.store(seq+1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for(int i=0; i<WORDS; i++)
+        {
+            uint64_t w;
+            memcpy(&w,desc.data()+8*i,8);
+            mWords[i].store(w,std::memory_order_relaxed);
+        }
+
+        mnSeq.store(seq+2,std::memory_order_release);
+    }
+
+    // Copies the descriptor in buffer. Empty view if it has never been stored.
+    DescriptorView<TDescriptor> Load(DescriptorBuffer<TDescriptor> &buffer) const
+    {
+        unsigned int seq1, seq2;
+        do
+        {
+            seq1 = mnSeq.load(std::memory_order_acquire);
+            for(int i=0; i<WORDS; i++)
+                buffer.mWords[i] = mWords[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            seq2 = mnSeq.load(std::memory_order_relaxed);
+        } while(seq1!=seq2 || (seq1&1));
+
+        return seq1==0 ? DescriptorView<TDescriptor>() : buffer.View();
+    }
+
+    // 1 x BYTES CV_8U copy, empty if never stored
+    cv::Mat ToMat() const
+    {
+        DescriptorBuffer<TDescriptor> buffer;
+        const DescriptorView<TDescriptor> desc = Load(buffer);
+        if(desc.empty())
+            return cv::Mat();
+        return cv::Mat(1,TDescriptor::BYTES,CV_8U,const_cast<unsigned char*>(desc.data())).clone();
+    }
+
+protected:
+    enum { WORDS = TDescriptor::BYTES/8 };
+
+    std::atomic<unsigned int> mnSeq;
+    std::atomic<uint64_t> mWords[WORDS];
+};
+
+// Hamming distance between two descriptors, unrolled for the descriptor width
+template<class TDescriptor>
+inline int HammingDistance(const DescriptorView<TDescriptor> &a, const DescriptorView<TDescriptor> &b)
+{
+    const unsigned char* pa = a.data();
+    const unsigned char* pb = b.data();
+
+    int dist=0;
+    for(int i=0; i<TDescriptor::BYTES; i+=8)
+    {
+        uint64_t va, vb;
+        memcpy(&va,pa+i,8);
+        memcpy(&vb,pb+i,8);
+        dist += __builtin_popcountll(va^vb);
+    }
+
+    return dist;
+}
+
+// Best and second best candidates of a query descriptor
+struct BestMatch
+{
+    BestMatch(): bestDist(256), bestDist2(256), bestIdx(-1), bestLevel(-1), bestLevel2(-1) {}
+
+    // Ratio test to the second match (only if best and second are in the same scale level)
+    bool Accept(const int th, const float nnratio) const
+    {
+        if(bestDist>th)
+            return false;
+        return !(bestLevel==bestLevel2 && bestDist>nnratio*bestDist2);
+    }
+
+    int bestDist;
+    int bestDist2;
+    int bestIdx;
+    int bestLevel;
+    int bestLevel2;
+};
+
+// Search the best and second best match of a query descriptor among candidate rows of a descriptor matrix.
+// skip(idx) discards a candidate, level(idx) returns its scale level.
+template<class TDescriptor, class TSkip, class TLevel>
+inline BestMatch SearchBestMatch(const DescriptorView<TDescriptor> &query, const std::vector<size_t> &vIndices,
+                                 const cv::Mat &descriptors, TSkip skip, TLevel level)
+{
+    BestMatch best;
+
+    if(query.empty() || descriptors.empty())
+        return best;
+
+    for(std::vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
+    {
+        const size_t idx = *vit;
+
+        if(skip(idx))
+            continue;
+
+        const int dist = HammingDistance(query, DescriptorView<TDescriptor>::Row(descriptors,idx));
+
+        if(dist<best.bestDist)
+        {
+            best.bestDist2=best.bestDist;
+            best.bestDist=dist;
+            best.bestLevel2=best.bestLevel;
+            best.bestLevel=level(idx);
+            best.bestIdx=idx;
+        }
+        else if(dist<best.bestDist2)
+        {
+            best.bestLevel2=level(idx);
+            best.bestDist2=dist;
+        }
+    }
+
+    return best;
+}
+
+// Rotation histogram to check the rotation consistency of a set of matches
+class RotationHistogram
+{
+public:
+    RotationHistogram(const int L): mL(L), mfFactor(1.0f/L), mvHist(L)
+    {
+        for(int i=0; i<mL; i++)
+            mvHist[i].reserve(500);
+    }
+
+    // rot: angle difference of the match in degrees, idx: index stored for the match
+    void Add(float rot, const int idx)
+    {
+        if(rot<0.0)
+            rot+=360.0f;
+        int bin = round(rot*mfFactor);
+        if(bin==mL)
+            bin=0;
+        assert(bin>=0 && bin<mL);
+        mvHist[bin].push_back(idx);
+    }
+
+    void ComputeThreeMaxima(int &ind1, int &ind2, int &ind3) const
+    {
+        int max1=0;
+        int max2=0;
+        int max3=0;
+
+        for(int i=0; i<mL; i++)
+        {
+            const int s = mvHist[i].size();
+            if(s>max1)
+            {
+                max3=max2;
+                max2=max1;
+                max1=s;
+                ind3=ind2;
+                ind2=ind1;
+                ind1=i;
+            }
+            else if(s>max2)
+            {
+                max3=max2;
+                max2=s;
+                ind3=ind2;
+                ind2=i;
+            }
+            else if(s>max3)
+            {
+                max3=s;
+                ind3=i;
+            }
+        }
+
+        if(max2<0.1f*(float)max1)
+        {
+            ind2=-1;
+            ind3=-1;
+        }
+        else if(max3<0.1f*(float)max1)
+        {
+            ind3=-1;
+        }
+    }
+
+    // Indices of the matches outside the three main rotation bins
+    std::vector<int> GetInconsistent() const
+    {
+        int ind1=-1;
+        int ind2=-1;
+        int ind3=-1;
+
+        ComputeThreeMaxima(ind1,ind2,ind3);
+
+        std::vector<int> vIdx;
+        for(int i=0; i<mL; i++)
+        {
+            if(i==ind1 || i==ind2 || i==ind3)
+                continue;
+            vIdx.insert(vIdx.end(),mvHist[i].begin(),mvHist[i].end());
+        }
+        return vIdx;
+    }
+
+protected:
+    int mL;
+    float mfFactor;
+    std::vector<std::vector<int> > mvHist;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MATCHERCORE_H
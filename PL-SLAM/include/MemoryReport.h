@@ -0,0 +1,61 @@
+#ifndef MEMORYREPORT_H
+#define MEMORYREPORT_H
+
+#include <string>
+#include <cstddef>
+
+#include "ORBVocabulary.h"
+
+namespace ORB_SLAM2
+{
+
+// Estimated memory usage of the system per category, in bytes, with the peak of each category over the sampled
+// reports (System::GetMemoryReport calls): growth between two reports is not seen.
+// The sizes are estimated from the containers (element counts and capacities), not measured on the heap:
+// allocator overhead is not included.
+struct MemoryReport
+{
+    enum Category
+    {
+        KEYFRAME_IMAGES = 0,    // grayscale images kept by the keyframes
+        KEYFRAME_FEATURES,      // keypoints, keylines, descriptors and BoW vectors of the keyframes
+        KEYFRAME_GRIDS,         // feature grids of the keyframes
+        KEYFRAME_GRAPH,         // observations, covisibility graph and spanning tree of the keyframes
+        MAP_POINTS,
+        MAP_LINES,
+        KEYFRAME_DATABASE,      // inverted file
+        VOCABULARY,
+        OPTIMIZER,              // g2o graph of the last optimization
+        NUM_CATEGORIES
+    };
+
+    MemoryReport();
+
+    size_t Total() const;
+    // Sum of the sampled peaks of the categories, which may have been reached at different times
+    size_t PeakTotal() const;
+
+    static const char* CategoryName(const int category);
+
+    // Single log line: total and every category in MB, with the sampled peaks
+    std::string ToString() const;
+
+    size_t mvBytes[NUM_CATEGORIES];
+    size_t mvPeakBytes[NUM_CATEGORIES];
+
+    size_t mnKeyFrames;
+    size_t mnMapPoints;
+    size_t mnMapLines;
+};
+
+// Estimated size of the vocabulary tree (nodes, descriptors and words)
+size_t VocabularyMemoryUsage(const ORBVocabulary* pVoc);
+
+// Optimizer graphs only exist during an optimization: the optimizers record the estimated size of each graph
+// they build, the report shows the last one and the largest one
+void RecordOptimizerMemoryUsage(const size_t nBytes);
+size_t GetOptimizerMemoryUsage(size_t &nPeakBytes);
+
+} //namespace ORB_SLAM
+
+#endif // MEMORYREPORT_H
@@ -82,6 +82,15 @@ public:
         return mvInvLevelSigma2;
     }
 
+    int inline GetNumFeatures(){
+        return nfeatures;}
+
+    int inline GetIniThFAST(){
+        return iniThFAST;}
+
+    int inline GetMinThFAST(){
+        return minThFAST;}
+
     std::vector<cv::Mat> mvImagePyramid;
 
 protected:
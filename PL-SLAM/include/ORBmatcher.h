@@ -29,6 +29,7 @@
 #include"MapPoint.h"
 #include"KeyFrame.h"
 #include"Frame.h"
+#include"MatcherCore.h"
 
 
 namespace ORB_SLAM2
@@ -95,8 +96,6 @@ protected:
 
     float RadiusByViewingCos(const float &viewCos);
 
-    void ComputeThreeMaxima(std::vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3);
-
     float mfNNratio;
     bool mbCheckOrientation;
 };
@@ -30,6 +30,8 @@
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 
 #include "lineEdge.h"
+#include "rigEdge.h"
+#include "floatEdge.h"
 
 namespace ORB_SLAM2
 {
@@ -64,6 +66,9 @@ public:
 
     int static PoseOptimizationWithLines(Frame *pFrame);
 
+    // 多相机：优化第一个相机的位姿(机体位姿)，其他相机的点观测通过外参Tcc0一起参与优化
+    int static PoseOptimizationRig(Frame *pFrame, const std::vector<Frame*> &vpRigFrames, const std::vector<cv::Mat> &vTcc0);
+
     // if bFixScale is true, 6DoF optimization (stereo,rgbd), 7DoF otherwise (mono)
     void static OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
@@ -74,6 +79,12 @@ public:
     // if bFixScale is true, optimize SE3 (stereo,rgbd), Sim3 otherwise (mono)
     static int OptimizeSim3(KeyFrame* pKF1, KeyFrame* pKF2, std::vector<MapPoint *> &vpMatches1,
                             g2o::Sim3 &g2oS12, const float th2, const bool bFixScale);
+
+    // Line edges of the local BA evaluated in float (Optimizer.floatLocalBA, default set by the FLOAT_LOCAL_BA build option)
+    static bool mbFloatLocalBA;
+    // Log the largest differences between the float line edges and the double ones after each local BA
+    // (Optimizer.validateFloatLocalBA)
+    static bool mbValidateFloatLocalBA;
 };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,88 @@
+#ifndef PROFILEDMUTEX_H
+#define PROFILEDMUTEX_H
+
+#include <mutex>
+#include <string>
+#include <ostream>
+
+#ifdef PROFILE_LOCKS
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#endif
+
+namespace ORB_SLAM2
+{
+
+#ifdef PROFILE_LOCKS
+
+// Lock statistics of all the mutexes sharing a name (e.g. the mMutexFeatures of every MapPoint),
+// split by call site. Updated without locks, sites are claimed in a fixed table.
+struct LockStats
+{
+    struct Site
+    {
+        std::atomic<void*> address;
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> contended;
+        std::atomic<uint64_t> waitNs;
+        std::atomic<uint64_t> holdNs;
+        std::atomic<uint64_t> maxWaitNs;
+        std::atomic<uint64_t> maxHoldNs;
+    };
+
+    // The last site collects the call sites that do not fit in the table
+    static const int NUM_SITES = 64;
+
+    explicit LockStats(const std::string &name);
+
+    Site* GetSite(void* address);
+
+    const std::string mName;
+    Site mvSites[NUM_SITES];
+};
+
+// Mutex recording the time spent waiting for it and holding it, per name and per call site.
+// The call site is the function that locks it (unique_lock is inlined into the caller).
+class ProfiledMutex
+{
+public:
+    explicit ProfiledMutex(const char* name);
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+protected:
+    ProfiledMutex(const ProfiledMutex&);
+    ProfiledMutex& operator=(const ProfiledMutex&);
+
+    void Acquired(void* address, const uint64_t waitNs, const bool bContended);
+
+    std::mutex mMutex;
+    LockStats* mpStats;
+
+    // Written by the owner only
+    LockStats::Site* mpSite;
+    std::chrono::steady_clock::time_point mLockTime;
+};
+
+#else
+
+// Lock profiling disabled (PROFILE_LOCKS not defined): a plain std::mutex, the name is dropped
+class ProfiledMutex : public std::mutex
+{
+public:
+    explicit ProfiledMutex(const char*) {}
+};
+
+#endif
+
+bool LockProfilingEnabled();
+
+// Contention summary of the profiled mutexes, one line per lock name and per call site, sorted by wait time
+void WriteLockProfile(std::ostream &os);
+
+} //namespace ORB_SLAM
+
+#endif // PROFILEDMUTEX_H
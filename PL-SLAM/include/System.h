@@ -38,6 +38,9 @@
 #include "LoopClosing.h"
 #include "KeyFrameDatabase.h"
 #include "ORBVocabulary.h"
+#include "MemoryReport.h"
+#include "MapCheckpointer.h"
+#include "MapClient.h"
 #include "Viewer.h"
 
 namespace ORB_SLAM2
@@ -81,6 +84,11 @@ public:
     // Returns the camera pose (empty if tracking fails).
     cv::Mat TrackMonocular(const cv::Mat &im, const double &timestamp);
 
+    // Proccess the images of a monocular camera rig (Rig.nCameras in the settings file), grabbed at the same time.
+    // vIms[0] is the camera tracked as in TrackMonocular, its pose is the body pose.
+    // Returns the pose of camera 0 (empty if tracking fails).
+    cv::Mat TrackMultiCamera(const std::vector<cv::Mat> &vIms, const double &timestamp);
+
     // This stops local mapping thread (map building) and performs only camera tracking.
     void ActivateLocalizationMode();
     // This resumes local mapping thread and performs SLAM again.
@@ -121,6 +129,16 @@ public:
     void SaveTrajectoryKITTI(const string &filename);
 
     void SavePointCloud(const string &filename);
+
+    // Writes a checkpoint of the map (keyframe trajectory, point cloud and map lines) in the background,
+    // from a copy-on-write snapshot: tracking and mapping are not paused. Can be called while running.
+    // Directory and periodic checkpoints: System.checkpointPath and System.checkpointInterval in the settings file,
+    // disabled if neither is set.
+    void SaveMapCheckpoint();
+
+    // Lock contention per mutex and call site (tab separated). Does nothing unless built with PROFILE_LOCKS.
+    // Call first Shutdown()
+    void SaveLockProfile(const string &filename);
     void ShowPointCloud();
 
     // TODO: Save/Load functions
@@ -133,8 +151,27 @@ public:
     std::vector<MapPoint*> GetTrackedMapPoints();
     std::vector<cv::KeyPoint> GetTrackedKeyPointsUn();
 
+    // Estimated memory per category (keyframes, map, keyframe database, vocabulary, optimizer) with the
+    // peaks of the reports sampled since the system started. Walks the whole map: do not call it every frame.
+    MemoryReport GetMemoryReport();
+
+    // Multi-agent mode (MapServer.address in the settings file): false until the map server merges this map with
+    // the map of another agent. Sws: 4x4 [s*R t] from the world frame of this map to the shared frame (world frame
+    // of agent nReferenceAgent). The local map is not modified. Still available after Shutdown().
+    bool GetSharedMapAlignment(cv::Mat &Sws, unsigned int &nReferenceAgent);
+
+    // Same as SaveKeyFrameTrajectoryTUM, in the shared frame of GetSharedMapAlignment (comparable with the trajectories
+    // of the other agents). Does nothing if the map is not merged. Call first Shutdown()
+    void SaveSharedKeyFrameTrajectoryTUM(const string &filename);
+
 private:
 
+    // Called after each frame, requests a report every mnMemoryReportInterval frames
+    void LogMemoryReport();
+
+    // Logs GetMemoryReport() when requested, in its own thread: the report walks the whole map
+    void RunMemoryReports();
+
     // Input sensor
     eSensor mSensor;
 
@@ -171,6 +208,14 @@ private:
     std::thread* mptLoopClosing;
     std::thread* mptViewer;
 
+    // Map checkpoints, written in their own thread (NULL if disabled)
+    MapCheckpointer* mpCheckpointer;
+    std::thread* mptCheckpointer;
+
+    // Client of the map server, NULL if MapServer.address is not set
+    MapClient* mpMapClient;
+    std::thread* mptMapClient;
+
     // Reset flag
     std::mutex mMutexReset;
     bool mbReset;
@@ -187,6 +232,18 @@ private:
     std::vector<MapLine*> mTrackedMapLines;
     std::vector<KeyLine> mTrackedKeyLines;
     std::mutex mMutexState;
+
+    // Memory report
+    int mnMemoryReportInterval;
+    int mnFramesSinceMemoryReport;
+    std::vector<size_t> mvMemoryPeakBytes;
+    std::mutex mMutexMemoryReport;
+
+    // Memory report thread, only started if System.memoryReportInterval>0
+    std::thread* mptMemoryReport;
+    bool mbMemoryReportRequested;
+    bool mbMemoryReportFinishRequested;
+    std::mutex mMutexMemoryReportRequest;
 };
 
 }// namespace ORB_SLAM
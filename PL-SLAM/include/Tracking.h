@@ -43,8 +43,12 @@
 #include "ExtractLineSegment.h"
 #include "MapLine.h"
 #include "LSDmatcher.h"
+#include "LocalMapSnapshot.h"
+#include "CameraRig.h"
 
 #include <mutex>
+#include <memory>
+#include <list>
 
 namespace ORB_SLAM2
 {
@@ -67,6 +71,8 @@ public:
     cv::Mat GrabImageStereo(const cv::Mat &imRectLeft,const cv::Mat &imRectRight, const double &timestamp);
     cv::Mat GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp);
     cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp);
+    // Multi-camera rig: one image per camera, vIms[0] is the tracked camera (body frame)
+    cv::Mat GrabImageMultiCamera(const std::vector<cv::Mat> &vIms, const double &timestamp);
 
     void SetLocalMapper(LocalMapping* pLocalMapper);
     void SetLoopClosing(LoopClosing* pLoopClosing);
@@ -148,14 +154,20 @@ protected:
     void CreateInitialMapMonocular();
     void CreateInitialMapMonoWithLine();
 
+    const FrameConfigPtr &GetFrameConfig(const cv::Mat &im);
+
     void CheckReplacedInLastFrame();
     bool TrackReferenceKeyFrame();
     void UpdateLastFrame();
+    void SetLastFrame();
+    void RotateFrames();
     bool TrackWithMotionModel();
 
     bool Relocalization();
 
     void UpdateLocalMap();
+    bool UpdateLocalMapFromSnapshot();
+    std::shared_ptr<const LocalMapSnapshot> GetLocalizationSnapshot(KeyFrame* pKF);
     void UpdateLocalPoints();
     void UpdateLocalLines();
     void UpdateLocalKeyFrames();
@@ -190,6 +202,9 @@ protected:
     // Line
     LINEextractor* mpLSDextractorLeft;
 
+    // Other cameras of a multi-camera rig (NULL with a single camera)
+    CameraRig* mpRig;
+
     //BoW
     ORBVocabulary* mpORBVocabulary;
     KeyFrameDatabase* mpKeyFrameDB;
@@ -202,6 +217,20 @@ protected:
     std::vector<KeyFrame*> mvpLocalKeyFrames;
     std::vector<MapPoint*> mvpLocalMapPoints;
     std::vector<MapLine*> mvpLocalMapLines;
+
+    // Local map published by LocalMapping. Version 0 means the local map was rebuilt by tracking.
+    // Landmarks and keyframes of the snapshot are marked with mnTrackReferenceForFrame=mnLocalMapSnapshotFrameId.
+    std::shared_ptr<const LocalMapSnapshot> mpLocalMapSnapshot;
+    unsigned long mnLocalMapSnapshotVersion;
+    long unsigned int mnLocalMapSnapshotFrameId;
+
+    // Localization mode: local map of the recently used keyframes, built on first use (the map does not change).
+    // At most LOCALIZATION_SNAPSHOTS are kept, the least recently used one is dropped first (front of the list).
+    typedef std::pair<std::shared_ptr<const LocalMapSnapshot>,std::list<KeyFrame*>::iterator> LocalizationSnapshotEntry;
+    static const size_t LOCALIZATION_SNAPSHOTS = 64;
+    std::map<KeyFrame*,LocalizationSnapshotEntry> mmLocalizationSnapshots;
+    std::list<KeyFrame*> mlLocalizationSnapshotsLRU;
+    int mnLocalizationSnapshotsBigChangeIdx;
     
     // System
     System* mpSystem;
@@ -219,6 +248,12 @@ protected:
     cv::Mat mDistCoef;
     float mbf;
 
+    // Camera model of mDistCoef (CameraModelType), from Camera.type
+    int mnCameraModel;
+
+    // Calibration and scale pyramids shared by the frames, built with the first image (see GetFrameConfig)
+    FrameConfigPtr mpFrameConfig;
+
     //自己添加的，两个用于纠正畸变的映射矩阵
     Mat mUndistX, mUndistY;
 
@@ -226,6 +261,9 @@ protected:
     int mMinFrames;
     int mMaxFrames;
 
+    // Localization mode: frames between relocalization attempts when tracking visual odometry points
+    int mnRelocIntervalVO;
+
     // Threshold close/far points
     // Points seen as close by the stereo/RGBD sensor are considered reliable
     // and inserted from just one frame. Far points requiere a match in two keyframes.
@@ -241,8 +279,11 @@ protected:
     //Last Frame, KeyFrame and Relocalisation Info
     KeyFrame* mpLastKeyFrame;
     Frame mLastFrame;
+    // mCurrentFrame is moved to mLastFrame when the next frame is grabbed
+    bool mbLastFrameIsCurrent;
     unsigned int mnLastKeyFrameId;
     unsigned int mnLastRelocFrameId;
+    unsigned int mnLastRelocTryFrameId;
 
     //Motion Model
     cv::Mat mVelocity;
@@ -0,0 +1,136 @@
+//
+// Local BA edges evaluated in single precision: residuals and Jacobians are computed in float from the double
+// vertex estimates and written back to the double buffers of g2o, where the Hessian is accumulated.
+// Same measurement, information and vertices as the double edges they derive from.
+// Only the line edges have a float version: g2o::EdgeSE3ProjectXYZ is already analytic and the conversions of a
+// per-edge float evaluation cost more than they save.
+//
+
+#ifndef ORB_SLAM2_FLOATEDGE_H
+#define ORB_SLAM2_FLOATEDGE_H
+
+#include <algorithm>
+#include <new>
+#include <Eigen/Core>
+#include "Thirdparty/g2o/g2o/core/jacobian_workspace.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+#include "lineEdge.h"
+
+// Point of a vertex in the camera frame of a pose vertex, in float
+inline Eigen::Vector3f ToFloatCamera(const g2o::HyperGraph::Vertex* pPose, const g2o::HyperGraph::Vertex* pPoint)
+{
+    const g2o::SE3Quat &T = static_cast<const g2o::VertexSE3Expmap*>(pPose)->estimate();
+    const Eigen::Vector3f Xw = static_cast<const g2o::VertexSBAPointXYZ*>(pPoint)->estimate().cast<float>();
+    return T.rotation().cast<float>()._transformVector(Xw) + T.translation().cast<float>();
+}
+
+// Camera pose of a vertex in float
+inline void ToFloatPose(const g2o::HyperGraph::Vertex* pPose, Eigen::Matrix3f &R, Eigen::Vector3f &t)
+{
+    const g2o::SE3Quat &T = static_cast<const g2o::VertexSE3Expmap*>(pPose)->estimate();
+    R = T.rotation().cast<float>().toRotationMatrix();
+    t = T.translation().cast<float>();
+}
+
+// Largest difference between two matrices, relative to the largest coefficient of the reference
+template<typename M1, typename M2>
+inline double RelativeDifference(const M1 &A, const M2 &Ref)
+{
+    const double scale = std::max(1e-12,Ref.cwiseAbs().maxCoeff());
+    return (A-Ref).cwiseAbs().maxCoeff()/scale;
+}
+
+// Distance of a projected line endpoint to the observed line, float version of EdgeLineProjectXYZ
+// with the same analytic Jacobians as EdgeLineProjectXYZ
+class EdgeLineProjectXYZFloat : public EdgeLineProjectXYZ
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    EdgeLineProjectXYZFloat() {}
+
+    virtual void computeError()
+    {
+        const Eigen::Vector3f Xc = ToFloatCamera(vertex(1),vertex(0));
+        const Eigen::Vector3f l = _measurement.cast<float>();
+
+        const float invz = 1.f/Xc[2];
+        const float u = (float)fx*Xc[0]*invz + (float)cx;
+        const float v = (float)fy*Xc[1]*invz + (float)cy;
+        _error(0) = l[0]*u + l[1]*v + l[2];
+        _error(1) = 0.0;
+        _error(2) = 0.0;
+    }
+
+    virtual void linearizeOplus()
+    {
+        Eigen::Matrix3f R;
+        Eigen::Vector3f t;
+        ToFloatPose(vertex(1),R,t);
+        const Eigen::Vector3f Xc = R*static_cast<const g2o::VertexSBAPointXYZ*>(_vertices[0])->estimate().cast<float>()+t;
+        const Eigen::Vector3f l = _measurement.cast<float>();
+
+        const float x = Xc[0];
+        const float y = Xc[1];
+        const float z = Xc[2];
+        const float invz = 1.f/z;
+        const float lfx = l[0]*(float)fx;
+        const float lfy = l[1]*(float)fy;
+
+        // Derivative of the residual with respect to the point in the camera frame
+        const Eigen::RowVector3f g(lfx*invz, lfy*invz, -(lfx*x+lfy*y)*invz*invz);
+
+        _jacobianOplusXi.setZero();
+        _jacobianOplusXi.row(0) = (g*R).cast<double>();
+
+        _jacobianOplusXj.setZero();
+        _jacobianOplusXj(0,0) = -g[1]*z + g[2]*y;
+        _jacobianOplusXj(0,1) = g[0]*z - g[2]*x;
+        _jacobianOplusXj(0,2) = -g[0]*y + g[1]*x;
+        _jacobianOplusXj(0,3) = g[0];
+        _jacobianOplusXj(0,4) = g[1];
+        _jacobianOplusXj(0,5) = g[2];
+    }
+
+    // Largest differences with the double edge (same analytic Jacobians): residual and Jacobians (relative).
+    // The Jacobians of fixed vertices are not compared.
+    void CompareWithDouble(double &maxErrorDiff, double &maxJacobianDiff)
+    {
+        EdgeLineProjectXYZ ref;
+        ref.setVertex(0,_vertices[0]);
+        ref.setVertex(1,_vertices[1]);
+        ref.setMeasurement(_measurement);
+        ref.fx = fx;
+        ref.fy = fy;
+        ref.cx = cx;
+        ref.cy = cy;
+
+        g2o::JacobianWorkspace workspace;
+        workspace.updateSize(this);
+        workspace.allocate();
+
+        // The workspace overload maps the Jacobians of this edge onto the local workspace: the previous mapping
+        // is restored before returning so the edge never points into freed memory
+        double* pJacobianXi = _jacobianOplusXi.data();
+        double* pJacobianXj = _jacobianOplusXj.data();
+
+        // Through the base class: the workspace overload maps the Jacobians, it is hidden here
+        computeError();
+        static_cast<g2o::OptimizableGraph::Edge*>(this)->linearizeOplus(workspace);
+        const Eigen::Vector3d e = _error;
+        const Eigen::Matrix3d Ji = _jacobianOplusXi;
+        const Eigen::Matrix<double,3,6> Jj = _jacobianOplusXj;
+
+        ref.computeError();
+        static_cast<g2o::OptimizableGraph::Edge*>(&ref)->linearizeOplus(workspace);
+        maxErrorDiff = std::max(maxErrorDiff,(e-ref.error()).cwiseAbs().maxCoeff());
+        if(!static_cast<const g2o::OptimizableGraph::Vertex*>(_vertices[0])->fixed())
+            maxJacobianDiff = std::max(maxJacobianDiff,RelativeDifference(Ji,ref.jacobianOplusXi()));
+        if(!static_cast<const g2o::OptimizableGraph::Vertex*>(_vertices[1])->fixed())
+            maxJacobianDiff = std::max(maxJacobianDiff,RelativeDifference(Jj,ref.jacobianOplusXj()));
+
+        new (&_jacobianOplusXi) JacobianXiOplusType(pJacobianXi, Dimension, Di);
+        new (&_jacobianOplusXj) JacobianXjOplusType(pJacobianXj, Dimension, Dj);
+    }
+};
+
+#endif //ORB_SLAM2_FLOATEDGE_H
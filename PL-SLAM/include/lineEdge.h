@@ -22,6 +22,25 @@ using namespace Eigen;
 
 typedef Matrix<double, 6, 6> Matrix6d;
 
+// Derivative of the distance of the projected endpoint to the observed line l (l0*u+l1*v+l2, normalized), with
+// respect to the endpoint Xc in the camera frame
+inline RowVector3d LineErrorGradient(const Vector3d &Xc, const Vector3d &l, const double fx, const double fy)
+{
+    const double invz = 1.0/Xc[2];
+    const double lfx = l[0]*fx;
+    const double lfy = l[1]*fy;
+    return RowVector3d(lfx*invz, lfy*invz, -(lfx*Xc[0]+lfy*Xc[1])*invz*invz);
+}
+
+// Derivative of the same distance with respect to the pose increment [w v] of g2o::VertexSE3Expmap
+// (Xc -> Xc + w x Xc + v)
+inline Matrix<double, 1, 6> LineErrorPoseJacobian(const Vector3d &Xc, const RowVector3d &g)
+{
+    Matrix<double, 1, 6> J;
+    J << -g[1]*Xc[2] + g[2]*Xc[1], g[0]*Xc[2] - g[2]*Xc[0], -g[0]*Xc[1] + g[1]*Xc[0], g[0], g[1], g[2];
+    return J;
+}
+
 class EdgeLineProjectXYZOnlyPoseNew : public BaseUnaryEdge<1, float, g2o::VertexSE3Expmap>
 {
 public:
@@ -36,26 +55,13 @@ public:
         _error(0) = obs(0) * proj(0) + obs(1) * proj(1) + obs(2);  //线段投影端点到观测直线距离
     }
 
-    /*virtual void linearizeOplus()
+    virtual void linearizeOplus()
     {
-        VertexSE3Expmap * vi = static_cast<VertexSE3Expmap *>(_vertices[0]);
-        Vector3d xyz_trans = vi->estimate().map(Xw);
-
-        double x = xyz_trans[0];
-        double y = xyz_trans[1];
-        double invz = 1.0/xyz_trans[2];
-        double invz_2 = invz * invz;
+        const VertexSE3Expmap* vi = static_cast<const VertexSE3Expmap*>(_vertices[0]);
+        const Vector3d Xc = vi->estimate().map(Xw);
 
-        double lx = Func(0);
-        double ly = Func(1);
-
-        _jacobianOplusXi(0,0) = -fy*ly - fx*lx*x*y*invz_2 - fy*ly*y*y*invz_2;
-        _jacobianOplusXi(0,1) = fx*lx + fx*lx*x*x*invz_2 + fy*ly*x*y*invz_2;
-        _jacobianOplusXi(0,2) = -fx*lx*y*invz + fy*ly*x*invz;
-        _jacobianOplusXi(0,3) = fx*lx*invz;
-        _jacobianOplusXi(0.4) = fy*ly*invz;
-        _jacobianOplusXi(0,5) = -(fx*lx*x+fy*ly*y)*invz_2;
-    }*/
+        _jacobianOplusXi = LineErrorPoseJacobian(Xc,LineErrorGradient(Xc,Func,fx,fy));
+    }
 
     bool read(std::istream& is)
     {
@@ -132,27 +138,15 @@ public:
         _error(2) = 0; 
     }
 
-    /*virtual void linearizeOplus()
+    virtual void linearizeOplus()
     {
-        VertexSE3Expmap * vi = static_cast<VertexSE3Expmap *>(_vertices[0]);
-        Vector3d xyz_trans = vi->estimate().map(Xw);
-
-        double x = xyz_trans[0];
-        double y = xyz_trans[1];
-        double invz = 1.0/xyz_trans[2];
-        double invz_2 = invz * invz;
-
-        double lx = _measurement(0);
-        double ly = _measurement(1);
+        const VertexSE3Expmap* vi = static_cast<const VertexSE3Expmap*>(_vertices[0]);
+        const Vector3d Xc = vi->estimate().map(Xw);
 
-        _jacobianOplusXi(0,0) = -fy*ly - fx*lx*x*y*invz_2 - fy*ly*y*y*invz_2;
-        _jacobianOplusXi(0,1) = fx*lx + fx*lx*x*x*invz_2 + fy*ly*x*y*invz_2;
-        _jacobianOplusXi(0,2) = -fx*lx*y*invz + fy*ly*x*invz;
-        _jacobianOplusXi(0,3) = fx*lx*invz;
-        _jacobianOplusXi(0.4) = fy*ly*invz;
-        _jacobianOplusXi(0,5) = -(fx*lx*x+fy*ly*y)*invz_2;
-
-    }*/
+        // Only the first component of the error is used
+        _jacobianOplusXi.setZero();
+        _jacobianOplusXi.row(0) = LineErrorPoseJacobian(Xc,LineErrorGradient(Xc,_measurement,fx,fy));
+    }
 
     bool read(std::istream& is)
     {
@@ -228,42 +222,22 @@ public:
         _error(2) = 0.0;
     }
 
-    /*virtual void linearizeOplus()
+    virtual void linearizeOplus()
     {
         // 位姿顶点
-        VertexSE3Expmap *vj = static_cast<VertexSE3Expmap *>(_vertices[1]);
-        SE3Quat T(vj->estimate());
-        VertexSBAPointXYZ *vi = static_cast<VertexSBAPointXYZ *>(_vertices[0]);
-        Vector3d xyz = vi->estimate();
-        Vector3d xyz_trans = T.map(xyz);    //线段端点的世界坐标系转换到相机坐标系下
-
-        double x = xyz_trans[0];
-        double y = xyz_trans[1];
-        double invz = 1.0/xyz_trans[2];
-        double invz_2 = invz * invz;
-
-        double lx = _measurement(0);
-        double ly = _measurement(1);
-
-        // 雅克比没有负号的
-        _jacobianOplusXj(0,0) = -fy*ly - fx*lx*x*y*invz_2 - fy*ly*y*y*invz_2;
-        _jacobianOplusXj(0,1) = fx*lx + fx*lx*x*x*invz_2 + fy*ly*x*y*invz_2;
-        _jacobianOplusXj(0,2) = -fx*lx*y*invz + fy*ly*x*invz;
-        _jacobianOplusXj(0,3) = fx*lx*invz;
-        _jacobianOplusXj(0.4) = fy*ly*invz;
-        _jacobianOplusXj(0,5) = -(fx*lx*x+fy*ly*y)*invz_2;
-
-        Matrix<double, 3, 3, Eigen::ColMajor> tmp;
-        tmp = Eigen::Matrix3d::Zero();
-        tmp(0,0) = fx*lx;
-        tmp(0,1) = fy*ly;
-        tmp(0,2) = -(fx*lx*x+fy*ly*y)*invz;
-
-        Matrix<double, 3, 3> R;
-        R = T.rotation().toRotationMatrix();
-
-        _jacobianOplusXi = 1. * invz * tmp * R;
-    }*/
+        const VertexSE3Expmap* vj = static_cast<const VertexSE3Expmap*>(_vertices[1]);
+        const VertexSBAPointXYZ* vi = static_cast<const VertexSBAPointXYZ*>(_vertices[0]);
+        const SE3Quat &T = vj->estimate();
+        const Vector3d Xc = T.map(vi->estimate());    //线段端点的世界坐标系转换到相机坐标系下
+        const RowVector3d g = LineErrorGradient(Xc,_measurement,fx,fy);
+
+        // Only the first component of the error is used
+        _jacobianOplusXi.setZero();
+        _jacobianOplusXi.row(0) = g*T.rotation().toRotationMatrix();
+
+        _jacobianOplusXj.setZero();
+        _jacobianOplusXj.row(0) = LineErrorPoseJacobian(Xc,g);
+    }
 
     bool read(std::istream& is)
     {
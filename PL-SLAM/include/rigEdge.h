@@ -0,0 +1,148 @@
+//
+// Edges for a multi-camera rig: the pose vertex is the pose of the first camera of the rig (body frame),
+// the observation is made by another camera of the rig, with known extrinsics Tcc0.
+//
+
+#ifndef ORB_SLAM2_RIGEDGE_H
+#define ORB_SLAM2_RIGEDGE_H
+
+#include <iostream>
+#include <Eigen/Core>
+#include "Thirdparty/g2o/g2o/core/base_unary_edge.h"
+#include "Thirdparty/g2o/g2o/core/base_binary_edge.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+
+// Projection of a fixed world point in a rig camera, only the body pose is optimized
+class EdgeSE3ProjectXYZOnlyPoseRig : public g2o::BaseUnaryEdge<2, Eigen::Vector2d, g2o::VertexSE3Expmap>
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    EdgeSE3ProjectXYZOnlyPoseRig() {}
+
+    virtual void computeError()
+    {
+        const g2o::VertexSE3Expmap* v1 = static_cast<const g2o::VertexSE3Expmap*>(_vertices[0]);
+        _error = _measurement - cam_project(Tcc0.map(v1->estimate().map(Xw)));
+    }
+
+    virtual void linearizeOplus()
+    {
+        const g2o::VertexSE3Expmap* vi = static_cast<const g2o::VertexSE3Expmap*>(_vertices[0]);
+        const Eigen::Vector3d X0 = vi->estimate().map(Xw);    // 第一个相机坐标系下的点
+
+        Eigen::Matrix<double,3,6> dX0;
+        dX0 << 0.0, X0[2], -X0[1], 1.0, 0.0, 0.0,
+               -X0[2], 0.0, X0[0], 0.0, 1.0, 0.0,
+               X0[1], -X0[0], 0.0, 0.0, 0.0, 1.0;
+
+        _jacobianOplusXi = -proj_jacobian(Tcc0.map(X0))*Tcc0.rotation().toRotationMatrix()*dX0;
+    }
+
+    bool isDepthPositive()
+    {
+        const g2o::VertexSE3Expmap* v1 = static_cast<const g2o::VertexSE3Expmap*>(_vertices[0]);
+        return Tcc0.map(v1->estimate().map(Xw))(2)>0.0;
+    }
+
+    bool read(std::istream& is)
+    {
+        return false;
+    }
+
+    bool write(std::ostream& os) const
+    {
+        return false;
+    }
+
+    Eigen::Vector2d cam_project(const Eigen::Vector3d &Xc) const
+    {
+        Eigen::Vector2d res;
+        res[0] = fx*Xc[0]/Xc[2] + cx;
+        res[1] = fy*Xc[1]/Xc[2] + cy;
+        return res;
+    }
+
+    Eigen::Matrix<double,2,3> proj_jacobian(const Eigen::Vector3d &Xc) const
+    {
+        const double invz = 1.0/Xc[2];
+        Eigen::Matrix<double,2,3> J;
+        J << fx*invz, 0.0, -fx*Xc[0]*invz*invz,
+             0.0, fy*invz, -fy*Xc[1]*invz*invz;
+        return J;
+    }
+
+    Eigen::Vector3d Xw;     // 地图点的世界坐标
+    g2o::SE3Quat Tcc0;      // 第一个相机到观测相机的变换
+    double fx, fy, cx, cy;
+};
+
+// Projection of a map point in a rig camera, the point and the body pose are optimized
+class EdgeSE3ProjectXYZRig : public g2o::BaseBinaryEdge<2, Eigen::Vector2d, g2o::VertexSBAPointXYZ, g2o::VertexSE3Expmap>
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+    EdgeSE3ProjectXYZRig() {}
+
+    virtual void computeError()
+    {
+        const g2o::VertexSE3Expmap* v1 = static_cast<const g2o::VertexSE3Expmap*>(_vertices[1]);
+        const g2o::VertexSBAPointXYZ* v2 = static_cast<const g2o::VertexSBAPointXYZ*>(_vertices[0]);
+        _error = _measurement - cam_project(Tcc0.map(v1->estimate().map(v2->estimate())));
+    }
+
+    virtual void linearizeOplus()
+    {
+        const g2o::VertexSE3Expmap* vj = static_cast<const g2o::VertexSE3Expmap*>(_vertices[1]);
+        const g2o::VertexSBAPointXYZ* vi = static_cast<const g2o::VertexSBAPointXYZ*>(_vertices[0]);
+        const g2o::SE3Quat T(vj->estimate());
+        const Eigen::Vector3d X0 = T.map(vi->estimate());
+
+        Eigen::Matrix<double,3,6> dX0;
+        dX0 << 0.0, X0[2], -X0[1], 1.0, 0.0, 0.0,
+               -X0[2], 0.0, X0[0], 0.0, 1.0, 0.0,
+               X0[1], -X0[0], 0.0, 0.0, 0.0, 1.0;
+
+        const Eigen::Matrix<double,2,3> J = -proj_jacobian(Tcc0.map(X0))*Tcc0.rotation().toRotationMatrix();
+        _jacobianOplusXi = J*T.rotation().toRotationMatrix();
+        _jacobianOplusXj = J*dX0;
+    }
+
+    bool isDepthPositive()
+    {
+        const g2o::VertexSE3Expmap* v1 = static_cast<const g2o::VertexSE3Expmap*>(_vertices[1]);
+        const g2o::VertexSBAPointXYZ* v2 = static_cast<const g2o::VertexSBAPointXYZ*>(_vertices[0]);
+        return Tcc0.map(v1->estimate().map(v2->estimate()))(2)>0.0;
+    }
+
+    bool read(std::istream& is)
+    {
+        return false;
+    }
+
+    bool write(std::ostream& os) const
+    {
+        return false;
+    }
+
+    Eigen::Vector2d cam_project(const Eigen::Vector3d &Xc) const
+    {
+        Eigen::Vector2d res;
+        res[0] = fx*Xc[0]/Xc[2] + cx;
+        res[1] = fy*Xc[1]/Xc[2] + cy;
+        return res;
+    }
+
+    Eigen::Matrix<double,2,3> proj_jacobian(const Eigen::Vector3d &Xc) const
+    {
+        const double invz = 1.0/Xc[2];
+        Eigen::Matrix<double,2,3> J;
+        J << fx*invz, 0.0, -fx*Xc[0]*invz*invz,
+             0.0, fy*invz, -fy*Xc[1]*invz*invz;
+        return J;
+    }
+
+    g2o::SE3Quat Tcc0;      // 第一个相机到观测相机的变换
+    double fx, fy, cx, cy;
+};
+
+#endif //ORB_SLAM2_RIGEDGE_H
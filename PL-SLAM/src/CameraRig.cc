@@ -0,0 +1,280 @@
+#include "CameraRig.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "ORBmatcher.h"
+#include "Optimizer.h"
+
+#include <unordered_set>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+CameraRig::CameraRig(const vector<cv::Mat> &vTc0c, const vector<ORBextractor*> &vpORBextractors,
+                     const vector<LINEextractor*> &vpLINEextractors):
+    mvFrames(vTc0c.size()), mvpORBextractors(vpORBextractors), mvpLINEextractors(vpLINEextractors),
+    mvpLastKeyFrames(vTc0c.size(),static_cast<KeyFrame*>(NULL)), mnFrameId(0), mbHasFrames(false),
+    mvImages(vTc0c.size()), mvbExtract(vTc0c.size(),false), mTimestamp(0), mpVocabulary(static_cast<ORBVocabulary*>(NULL)), mbf(0), mThDepth(0),
+    mnPendingFrames(0), mbFinishWorkers(false)
+{
+    for(size_t i=0; i<vTc0c.size(); i++)
+    {
+        cv::Mat Tc0c;
+        vTc0c[i].convertTo(Tc0c,CV_32F);
+        mvTc0c.push_back(Tc0c);
+
+        cv::Mat Tcc0 = cv::Mat::eye(4,4,CV_32F);
+        const cv::Mat Rcc0 = Tc0c.rowRange(0,3).colRange(0,3).t();
+        Rcc0.copyTo(Tcc0.rowRange(0,3).colRange(0,3));
+        cv::Mat tcc0 = -Rcc0*Tc0c.rowRange(0,3).col(3);
+        tcc0.copyTo(Tcc0.rowRange(0,3).col(3));
+        mvTcc0.push_back(Tcc0);
+    }
+
+    for(size_t i=0; i<vTc0c.size(); i++)
+        mvptWorkers.push_back(new thread(&CameraRig::RunWorker, this, i));
+}
+
+CameraRig::~CameraRig()
+{
+    {
+        unique_lock<mutex> lock(mMutexWorkers);
+        mbFinishWorkers = true;
+    }
+    mcvImages.notify_all();
+    for(size_t i=0; i<mvptWorkers.size(); i++)
+    {
+        mvptWorkers[i]->join();
+        delete mvptWorkers[i];
+    }
+
+    for(size_t i=0; i<mvpORBextractors.size(); i++)
+        delete mvpORBextractors[i];
+    for(size_t i=0; i<mvpLINEextractors.size(); i++)
+        delete mvpLINEextractors[i];
+}
+
+int CameraRig::GetNumCameras() const
+{
+    return mvTcc0.size()+1;
+}
+
+void CameraRig::StartExtraction(const vector<cv::Mat> &vImGray, const double timestamp, ORBVocabulary* pVoc,
+                                const FrameConfigPtr &pConfig, const float bf, const float thDepth)
+{
+    {
+        unique_lock<mutex> lock(mMutexWorkers);
+        for(size_t i=0; i<mvImages.size(); i++)
+        {
+            mvImages[i] = vImGray[i];
+            mvbExtract[i] = true;
+        }
+        mTimestamp = timestamp;
+        mpVocabulary = pVoc;
+        mpFrameConfig = pConfig;
+        mbf = bf;
+        mThDepth = thDepth;
+        mnPendingFrames = mvImages.size();
+    }
+    mcvImages.notify_all();
+}
+
+void CameraRig::WaitForFrames()
+{
+    unique_lock<mutex> lock(mMutexWorkers);
+    while(mnPendingFrames>0)
+        mcvFrames.wait(lock);
+}
+
+void CameraRig::RunWorker(const int i)
+{
+    while(1)
+    {
+        cv::Mat im;
+        double timestamp;
+        ORBVocabulary* pVoc;
+        FrameConfigPtr pConfig;
+        float bf, thDepth;
+        {
+            unique_lock<mutex> lock(mMutexWorkers);
+            while(!mvbExtract[i] && !mbFinishWorkers)
+                mcvImages.wait(lock);
+            if(mbFinishWorkers)
+                break;
+
+            im = mvImages[i];
+            timestamp = mTimestamp;
+            pVoc = mpVocabulary;
+            pConfig = mpFrameConfig;
+            bf = mbf;
+            thDepth = mThDepth;
+        }
+
+        mvFrames[i] = Frame(im,timestamp,mvpORBextractors[i],mvpLINEextractors[i],pVoc,pConfig,bf,thDepth);
+
+        {
+            unique_lock<mutex> lock(mMutexWorkers);
+            mvImages[i].release();
+            mvbExtract[i] = false;
+            mnPendingFrames--;
+        }
+        mcvFrames.notify_one();
+    }
+}
+
+void CameraRig::AssignFrameId(Frame &CurrentFrame)
+{
+    long unsigned int nId = CurrentFrame.mnId;
+    for(size_t i=0; i<mvFrames.size(); i++)
+        nId = min(nId,mvFrames[i].mnId);
+
+    CurrentFrame.mnId = nId;
+    for(size_t i=0; i<mvFrames.size(); i++)
+        mvFrames[i].mnId = nId;
+
+    Frame::nNextId = nId+1;
+
+    mnFrameId = nId;
+    mbHasFrames = true;
+}
+
+bool CameraRig::HasFrames(const Frame &CurrentFrame) const
+{
+    return mbHasFrames && mnFrameId==CurrentFrame.mnId;
+}
+
+vector<MapPoint*> CameraRig::LocalMapPoints(const int i, const vector<MapPoint*> &vpLocalMapPoints)
+{
+    // The last keyframe of the camera that was not culled
+    vector<KeyFrame*> vpKFs;
+    KeyFrame* pLastKF = mvpLastKeyFrames[i];
+    while(pLastKF && pLastKF->isBad())
+        pLastKF = pLastKF->mpPrevRigKF;
+    if(pLastKF)
+    {
+        vpKFs = pLastKF->GetBestCovisibilityKeyFrames(10);
+        vpKFs.push_back(pLastKF);
+    }
+
+    unordered_set<MapPoint*> spAdded;
+    vector<MapPoint*> vpMPs;
+    for(size_t k=0; k<vpKFs.size(); k++)
+    {
+        const vector<MapPoint*> vpKFMPs = vpKFs[k]->GetMapPointMatches();
+        for(size_t j=0; j<vpKFMPs.size(); j++)
+        {
+            MapPoint* pMP = vpKFMPs[j];
+            if(pMP && !pMP->isBad() && spAdded.insert(pMP).second)
+                vpMPs.push_back(pMP);
+        }
+    }
+
+    // The local map of camera 0, for the cameras overlapping with it
+    for(size_t j=0; j<vpLocalMapPoints.size(); j++)
+    {
+        MapPoint* pMP = vpLocalMapPoints[j];
+        if(!pMP->isBad() && spAdded.insert(pMP).second)
+            vpMPs.push_back(pMP);
+    }
+
+    return vpMPs;
+}
+
+int CameraRig::TrackLocalMap(Frame &CurrentFrame, const vector<MapPoint*> &vpLocalMapPoints)
+{
+    vector<Frame*> vpFrames;
+    vpFrames.reserve(mvFrames.size());
+
+    int nMatches = 0;
+    for(size_t i=0; i<mvFrames.size(); i++)
+    {
+        Frame &F = mvFrames[i];
+        F.SetPose(mvTcc0[i]*CurrentFrame.mTcw);
+        F.mpReferenceKF = CurrentFrame.mpReferenceKF;
+
+        const vector<MapPoint*> vpMPs = LocalMapPoints(i,vpLocalMapPoints);
+
+        // The flags filled by isInFrustum are shared, each camera is projected and matched in turn
+        int nToMatch = 0;
+        for(size_t j=0; j<vpMPs.size(); j++)
+        {
+            if(F.isInFrustum(vpMPs[j],0.5))
+            {
+                vpMPs[j]->IncreaseVisible();
+                nToMatch++;
+            }
+        }
+
+        if(nToMatch>0)
+        {
+            // The predicted pose also carries the error of the extrinsics, coarser search than camera 0
+            ORBmatcher matcher(0.8);
+            nMatches += matcher.SearchByProjection(F,vpMPs,3);
+        }
+
+        vpFrames.push_back(&F);
+    }
+
+    if(nMatches<10)
+    {
+        for(size_t i=0; i<mvFrames.size(); i++)
+            fill(mvFrames[i].mvpMapPoints.begin(),mvFrames[i].mvpMapPoints.end(),static_cast<MapPoint*>(NULL));
+        return 0;
+    }
+
+    Optimizer::PoseOptimizationRig(&CurrentFrame,vpFrames,mvTcc0);
+
+    // Outliers are discarded, they are not passed to the keyframes of the other cameras
+    int nInliers = 0;
+    for(size_t i=0; i<mvFrames.size(); i++)
+    {
+        Frame &F = mvFrames[i];
+        for(int j=0; j<F.N; j++)
+        {
+            if(!F.mvpMapPoints[j])
+                continue;
+
+            if(F.mvbOutlier[j])
+            {
+                F.mvpMapPoints[j] = static_cast<MapPoint*>(NULL);
+                F.mvbOutlier[j] = false;
+            }
+            else
+            {
+                F.mvpMapPoints[j]->IncreaseFound();
+                nInliers++;
+            }
+        }
+    }
+
+    return nInliers;
+}
+
+vector<KeyFrame*> CameraRig::CreateKeyFrames(KeyFrame *pKF, Map *pMap, KeyFrameDatabase *pKFDB)
+{
+    vector<KeyFrame*> vpRigKFs;
+    vpRigKFs.reserve(mvFrames.size());
+
+    for(size_t i=0; i<mvFrames.size(); i++)
+    {
+        KeyFrame* pRigKF = new KeyFrame(mvFrames[i],pMap,pKFDB);
+        pRigKF->mpRigKF = pKF;
+        pRigKF->mTcc0 = mvTcc0[i].clone();
+        pRigKF->mpPrevRigKF = mvpLastKeyFrames[i];
+        pRigKF->ChangeParent(pKF);
+
+        mvpLastKeyFrames[i] = pRigKF;
+        vpRigKFs.push_back(pRigKF);
+    }
+
+    return vpRigKFs;
+}
+
+void CameraRig::Reset()
+{
+    fill(mvpLastKeyFrames.begin(),mvpLastKeyFrames.end(),static_cast<KeyFrame*>(NULL));
+    mbHasFrames = false;
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,343 @@
+#include "FeatureCache.h"
+#include "ORBextractor.h"
+#include "LineExtractor.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace cv::line_descriptor;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+const uint32_t FEATURE_CACHE_MAGIC = 0x43464c50;    // "PLFC"
+const uint32_t FEATURE_CACHE_VERSION = 5;
+
+struct FeatureCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+};
+
+struct FeaturesHeader
+{
+    uint32_t nKeys;
+    uint32_t nDescCols;
+    int32_t nDescType;
+    uint32_t nLines;
+    uint32_t nLineDescCols;
+    int32_t nLineDescType;
+    uint32_t nBowWords;
+    uint32_t nFeatNodes;
+};
+
+// 64-bit FNV-1a
+class Hasher
+{
+public:
+    Hasher(): mHash(14695981039346656037ULL) {}
+
+    void Add(const void* pData, const size_t n)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(pData);
+        for(size_t i=0; i<n; i++)
+        {
+            mHash ^= p[i];
+            mHash *= 1099511628211ULL;
+        }
+    }
+
+    template<typename T>
+    void Add(const T &v)
+    {
+        Add(&v,sizeof(T));
+    }
+
+    void Add(const cv::Mat &im)
+    {
+        const int32_t dims[3] = {im.rows, im.cols, im.type()};
+        Add(dims,sizeof(dims));
+        const size_t rowBytes = im.cols*im.elemSize();
+        for(int i=0; i<im.rows; i++)
+            Add(im.ptr(i),rowBytes);
+    }
+
+    uint64_t Get() const { return mHash; }
+
+protected:
+    uint64_t mHash;
+};
+
+}
+
+FeatureCache::FeatureCache(const string &strPath): mstrPath(strPath)
+{
+    if(!mstrPath.empty() && mstrPath[mstrPath.size()-1]=='/')
+        mstrPath.erase(mstrPath.size()-1);
+
+    if(mkdir(mstrPath.c_str(),0755)!=0 && errno!=EEXIST)
+        cerr << "FeatureCache: cannot create " << mstrPath << endl;
+}
+
+uint64_t FeatureCache::ComputeKey(const cv::Mat &im, const cv::Mat &mask, ORBextractor* pORBextractor,
+                                  LINEextractor* pLINEextractor, const int nCameraModel, const cv::Mat &K,
+                                  const cv::Mat &DistCoef) const
+{
+    Hasher h;
+    h.Add(FEATURE_CACHE_VERSION);
+    h.Add(im);
+    if(!mask.empty())
+        h.Add(mask);
+
+    h.Add(pORBextractor->GetNumFeatures());
+    h.Add(pORBextractor->GetScaleFactor());
+    h.Add(pORBextractor->GetLevels());
+    h.Add(pORBextractor->GetIniThFAST());
+    h.Add(pORBextractor->GetMinThFAST());
+
+    h.Add(pLINEextractor->GetNumFeatures());
+    h.Add(pLINEextractor->GetScaleFactor());
+    h.Add(pLINEextractor->GetLevels());
+    h.Add(pLINEextractor->GetMinLineLength());
+    h.Add(pLINEextractor->GetDetector());
+
+    h.Add((int32_t)nCameraModel);
+    h.Add(K);
+    h.Add(DistCoef);
+
+    return h.Get();
+}
+
+string FeatureCache::EntryFilename(const uint64_t nKey) const
+{
+    stringstream ss;
+    ss << mstrPath << "/" << hex << setw(16) << setfill('0') << nKey << ".feat";
+    return ss.str();
+}
+
+bool FeatureCache::Load(const uint64_t nKey, CachedFeatures &features) const
+{
+    const string filename = EntryFilename(nKey);
+    const int fd = open(filename.c_str(),O_RDONLY);
+    if(fd<0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd,&st)!=0 || st.st_size<(off_t)sizeof(FeatureCacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    const size_t n = st.st_size;
+    void* pData = mmap(NULL,n,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(pData==MAP_FAILED)
+        return false;
+
+    BinaryReader r(static_cast<const char*>(pData),n);
+    FeatureCacheHeader header;
+    const bool bOK = r.Read(header) && header.magic==FEATURE_CACHE_MAGIC && header.version==FEATURE_CACHE_VERSION &&
+                     header.key==nKey && DecodeFeatures(r,features) && r.AtEnd();
+
+    munmap(pData,n);
+
+    if(!bOK)
+        cerr << "FeatureCache: ignoring invalid entry " << filename << endl;
+
+    return bOK;
+}
+
+bool FeatureCache::Save(const uint64_t nKey, const CachedFeatures &features) const
+{
+    const string filename = EntryFilename(nKey);
+    stringstream ss;
+    ss << filename << ".tmp" << getpid() << "_" << this_thread::get_id();
+    const string tmpname = ss.str();
+
+    ofstream f(tmpname.c_str(),ios::binary);
+    if(!f.is_open())
+        return false;
+
+    FeatureCacheHeader header;
+    memset(&header,0,sizeof(header));
+    header.magic = FEATURE_CACHE_MAGIC;
+    header.version = FEATURE_CACHE_VERSION;
+    header.key = nKey;
+
+    string buffer;
+    BinaryWriter w(buffer);
+    w.Write(header);
+    EncodeFeatures(features,w);
+    f.write(buffer.data(),buffer.size());
+
+    f.close();
+    if(f.fail() || rename(tmpname.c_str(),filename.c_str())!=0)
+    {
+        remove(tmpname.c_str());
+        cerr << "FeatureCache: cannot write " << filename << endl;
+        return false;
+    }
+
+    return true;
+}
+
+void EncodeFeatures(const CachedFeatures &features, BinaryWriter &w)
+{
+    FeaturesHeader header;
+    memset(&header,0,sizeof(header));
+    header.nKeys = features.vKeys.size();
+    header.nDescCols = features.Descriptors.cols;
+    header.nDescType = features.Descriptors.type();
+    header.nLines = features.vKeyLines.size();
+    header.nLineDescCols = features.LineDescriptors.cols;
+    header.nLineDescType = features.LineDescriptors.type();
+    header.nBowWords = features.BowVec.size();
+    header.nFeatNodes = features.FeatVec.size();
+    w.Write(header);
+
+    for(size_t i=0; i<features.vKeys.size(); i++)
+    {
+        const cv::KeyPoint &kp = features.vKeys[i];
+        const float v[5] = {kp.pt.x, kp.pt.y, kp.size, kp.angle, kp.response};
+        w.Write(v,sizeof(v));
+        w.Write((int32_t)kp.octave);
+        w.Write((int32_t)kp.class_id);
+    }
+    w.WriteMat(features.Descriptors);
+
+    for(size_t i=0; i<features.vKeyLines.size(); i++)
+    {
+        const KeyLine &kl = features.vKeyLines[i];
+        const float v[14] = {kl.angle, kl.response, kl.size, kl.pt.x, kl.pt.y,
+                             kl.startPointX, kl.startPointY, kl.endPointX, kl.endPointY,
+                             kl.sPointInOctaveX, kl.sPointInOctaveY, kl.ePointInOctaveX, kl.ePointInOctaveY,
+                             kl.lineLength};
+        const int32_t nv[3] = {kl.class_id, kl.octave, kl.numOfPixels};
+        const Eigen::Vector3d &lv = features.vLineFunctions[i];
+        const double l[3] = {lv(0), lv(1), lv(2)};
+        w.Write(v,sizeof(v));
+        w.Write(nv,sizeof(nv));
+        w.Write(l,sizeof(l));
+    }
+    w.WriteMat(features.LineDescriptors);
+
+    for(DBoW2::BowVector::const_iterator vit=features.BowVec.begin(), vend=features.BowVec.end(); vit!=vend; vit++)
+    {
+        w.Write((uint32_t)vit->first);
+        w.Write((double)vit->second);
+    }
+
+    for(DBoW2::FeatureVector::const_iterator fit=features.FeatVec.begin(), fend=features.FeatVec.end(); fit!=fend; fit++)
+    {
+        w.Write((uint32_t)fit->first);
+        w.Write((uint32_t)fit->second.size());
+        for(size_t j=0; j<fit->second.size(); j++)
+            w.Write((uint32_t)fit->second[j]);
+    }
+}
+
+bool DecodeFeatures(BinaryReader &r, CachedFeatures &features)
+{
+    FeaturesHeader header;
+    if(!r.Read(header))
+        return false;
+
+    // Counts of corrupted data must not make us allocate more than the data could hold
+    const size_t n = r.Remaining();
+    bool bOK = header.nKeys<=n && header.nLines<=n && header.nBowWords<=n && header.nFeatNodes<=n &&
+               header.nDescType==CV_8U && header.nLineDescType==CV_8U && header.nDescCols<=n && header.nLineDescCols<=n;
+
+    if(bOK)
+    {
+        features.vKeys.resize(header.nKeys);
+        for(uint32_t i=0; i<header.nKeys && bOK; i++)
+        {
+            float v[5];
+            int32_t octave, class_id;
+            bOK = r.Read(v,sizeof(v)) && r.Read(octave) && r.Read(class_id);
+            features.vKeys[i] = cv::KeyPoint(v[0],v[1],v[2],v[3],v[4],octave,class_id);
+        }
+        bOK = bOK && r.ReadMat(features.Descriptors,header.nKeys,header.nDescCols,header.nDescType);
+    }
+
+    if(bOK)
+    {
+        features.vKeyLines.resize(header.nLines);
+        features.vLineFunctions.resize(header.nLines);
+        for(uint32_t i=0; i<header.nLines && bOK; i++)
+        {
+            KeyLine &kl = features.vKeyLines[i];
+            float v[14];
+            int32_t nv[3];
+            double l[3];
+            bOK = r.Read(v,sizeof(v)) && r.Read(nv,sizeof(nv)) && r.Read(l,sizeof(l));
+            kl.angle = v[0];
+            kl.response = v[1];
+            kl.size = v[2];
+            kl.pt = cv::Point2f(v[3],v[4]);
+            kl.startPointX = v[5];
+            kl.startPointY = v[6];
+            kl.endPointX = v[7];
+            kl.endPointY = v[8];
+            kl.sPointInOctaveX = v[9];
+            kl.sPointInOctaveY = v[10];
+            kl.ePointInOctaveX = v[11];
+            kl.ePointInOctaveY = v[12];
+            kl.lineLength = v[13];
+            kl.class_id = nv[0];
+            kl.octave = nv[1];
+            kl.numOfPixels = nv[2];
+            features.vLineFunctions[i] << l[0], l[1], l[2];
+        }
+        bOK = bOK && r.ReadMat(features.LineDescriptors,header.nLines,header.nLineDescCols,header.nLineDescType);
+    }
+
+    if(bOK)
+    {
+        features.BowVec.clear();
+        for(uint32_t i=0; i<header.nBowWords && bOK; i++)
+        {
+            uint32_t wordId;
+            double value;
+            bOK = r.Read(wordId) && r.Read(value);
+            features.BowVec.insert(features.BowVec.end(),make_pair(wordId,value));
+        }
+
+        features.FeatVec.clear();
+        for(uint32_t i=0; i<header.nFeatNodes && bOK; i++)
+        {
+            uint32_t nodeId, nIdx;
+            bOK = r.Read(nodeId) && r.Read(nIdx) && nIdx<=header.nKeys;
+            if(!bOK)
+                break;
+            vector<unsigned int> &vIdx = features.FeatVec[nodeId];
+            vIdx.resize(nIdx);
+            for(uint32_t j=0; j<nIdx && bOK; j++)
+            {
+                uint32_t idx;
+                bOK = r.Read(idx) && idx<header.nKeys;
+                vIdx[j] = idx;
+            }
+        }
+    }
+
+    return bOK;
+}
+
+} //namespace ORB_SLAM
@@ -24,40 +24,33 @@
 #include <thread>
 #include "LocalMapping.h"
 #include "lineIterator.h"
+#include "FeatureCache.h"
 #include <unordered_set>
 
 namespace ORB_SLAM2
 {
 
-long unsigned int Frame::nNextId=0;
-bool Frame::mbInitialComputations=true;
-float Frame::cx, Frame::cy, Frame::fx, Frame::fy, Frame::invfx, Frame::invfy;
-float Frame::mnMinX, Frame::mnMinY, Frame::mnMaxX, Frame::mnMaxY;
-float Frame::mfGridElementWidthInv, Frame::mfGridElementHeightInv;
+std::atomic<long unsigned int> Frame::nNextId(0);
+FeatureCache* Frame::mpFeatureCache=static_cast<FeatureCache*>(NULL);
 
 Frame::Frame()
-{}
+{
+    SetConfig(FrameConfigPtr());
+}
 
 //Copy Constructor
 Frame::Frame(const Frame &frame)
     :mpORBvocabulary(frame.mpORBvocabulary), mpORBextractorLeft(frame.mpORBextractorLeft), mpORBextractorRight(frame.mpORBextractorRight),
-     mTimeStamp(frame.mTimeStamp), mK(frame.mK.clone()), mDistCoef(frame.mDistCoef.clone()),
-     mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mvKeys(frame.mvKeys),
+     mTimeStamp(frame.mTimeStamp), mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mvKeys(frame.mvKeys),
      mvKeysRight(frame.mvKeysRight), mvKeysUn(frame.mvKeysUn),  mvuRight(frame.mvuRight),
      mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec),
      mDescriptors(frame.mDescriptors.clone()), mDescriptorsRight(frame.mDescriptorsRight.clone()),
      mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mnId(frame.mnId),
-     mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
-     mfScaleFactor(frame.mfScaleFactor), mfLogScaleFactor(frame.mfLogScaleFactor),
-     mvScaleFactors(frame.mvScaleFactors), mvInvScaleFactors(frame.mvInvScaleFactors),
-     mvLevelSigma2(frame.mvLevelSigma2), mvInvLevelSigma2(frame.mvInvLevelSigma2),
-     mnScaleLevelsLine(frame.mnScaleLevelsLine),
-     mfScaleFactorLine(frame.mfScaleFactorLine), mfLogScaleFactorLine(frame.mfLogScaleFactorLine),
-     mvScaleFactorsLine(frame.mvScaleFactorsLine), mvInvScaleFactorsLine(frame.mvInvScaleFactorsLine),
-     mvLevelSigma2Line(frame.mvLevelSigma2Line), mvInvLevelSigma2Line(frame.mvInvLevelSigma2Line),
-     mLdesc(frame.mLdesc), NL(frame.NL), mvKeylinesUn(frame.mvKeylinesUn), mvpMapLines(frame.mvpMapLines),  //线特征相关的类成员变量
+     mpReferenceKF(frame.mpReferenceKF), mLdesc(frame.mLdesc), NL(frame.NL), mvKeylinesUn(frame.mvKeylinesUn), mvpMapLines(frame.mvpMapLines),  //线特征相关的类成员变量
      mvbLineOutlier(frame.mvbLineOutlier), mvKeyLineFunctions(frame.mvKeyLineFunctions), ImageGray(frame.ImageGray.clone())
 {
+    SetConfig(frame.mpConfig);
+
     // Points
     for(int i=0;i<FRAME_GRID_COLS;i++)
         for(int j=0; j<FRAME_GRID_ROWS; j++)
@@ -73,21 +66,15 @@ Frame::Frame(const Frame &frame)
 }
 
 /// 双目初始化
-Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
-    :mpORBvocabulary(voc),mpORBextractorLeft(extractorLeft),mpORBextractorRight(extractorRight), mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
+Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, const FrameConfigPtr &pConfig, const float &bf, const float &thDepth)
+    :mpORBvocabulary(voc),mpORBextractorLeft(extractorLeft),mpORBextractorRight(extractorRight), mTimeStamp(timeStamp), mbf(bf), mThDepth(thDepth),
      mpReferenceKF(static_cast<KeyFrame*>(NULL))
 {
     // Frame ID
     mnId=nNextId++;
 
-    // Scale Level Info
-    mnScaleLevels = mpORBextractorLeft->GetLevels();
-    mfScaleFactor = mpORBextractorLeft->GetScaleFactor();
-    mfLogScaleFactor = log(mfScaleFactor);
-    mvScaleFactors = mpORBextractorLeft->GetScaleFactors();
-    mvInvScaleFactors = mpORBextractorLeft->GetInverseScaleFactors();
-    mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
-    mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
+    // Calibration and scale level info
+    SetConfig(pConfig);
 
     // ORB extraction
     thread threadLeft(&Frame::ExtractORB,this,0,imLeft);
@@ -107,48 +94,23 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
     mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));    
     mvbOutlier = vector<bool>(N,false);
 
-
-    // This is done only for the first Frame (or after a change in the calibration)
-    if(mbInitialComputations)
-    {
-        ComputeImageBounds(imLeft);
-
-        mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/(mnMaxX-mnMinX);
-        mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/(mnMaxY-mnMinY);
-
-        fx = K.at<float>(0,0);
-        fy = K.at<float>(1,1);
-        cx = K.at<float>(0,2);
-        cy = K.at<float>(1,2);
-        invfx = 1.0f/fx;
-        invfy = 1.0f/fy;
-
-        mbInitialComputations=false;
-    }
-
     mb = mbf/fx;
 
     AssignFeaturesToGrid();
 }
 
 /// RGBD初始化建立frame
-Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, const FrameConfigPtr &pConfig, const float &bf, const float &thDepth)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
-     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth)
+     mTimeStamp(timeStamp), mbf(bf), mThDepth(thDepth)
 {
     imGray.copyTo(ImageGray);
 
     // Frame ID
     mnId=nNextId++;
 
-    // Scale Level Info
-    mnScaleLevels = mpORBextractorLeft->GetLevels();
-    mfScaleFactor = mpORBextractorLeft->GetScaleFactor();    
-    mfLogScaleFactor = log(mfScaleFactor);
-    mvScaleFactors = mpORBextractorLeft->GetScaleFactors();
-    mvInvScaleFactors = mpORBextractorLeft->GetInverseScaleFactors();
-    mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
-    mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
+    // Calibration and scale level info
+    SetConfig(pConfig);
 
     // ORB extraction
     ExtractORB(0,imGray);
@@ -165,24 +127,6 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeSt
     mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));
     mvbOutlier = vector<bool>(N,false);
 
-    // This is done only for the first Frame (or after a change in the calibration)
-    if(mbInitialComputations)
-    {
-        ComputeImageBounds(imGray);
-
-        mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnMaxX-mnMinX);
-        mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnMaxY-mnMinY);
-
-        fx = K.at<float>(0,0);
-        fy = K.at<float>(1,1);
-        cx = K.at<float>(0,2);
-        cy = K.at<float>(1,2);
-        invfx = 1.0f/fx;
-        invfy = 1.0f/fy;
-
-        mbInitialComputations=false;
-    }
-
     mb = mbf/fx;
 
     AssignFeaturesToGrid();
@@ -190,50 +134,46 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeSt
 
 
 /// 单目初始化建立frame
-Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* orbextractor,LINEextractor* lsdextractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, const cv::Mat &mask)
+Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* orbextractor,LINEextractor* lsdextractor,ORBVocabulary* voc, const FrameConfigPtr &pConfig, const float &bf, const float &thDepth, const cv::Mat &mask)
     :mpORBvocabulary(voc),mpORBextractorLeft(orbextractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)), mpLSDextractorLeft(lsdextractor), 
-     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth)
+     mTimeStamp(timeStamp), mbf(bf), mThDepth(thDepth)
 {
     // Frame ID
     mnId=nNextId++;
 
     imGray.copyTo(ImageGray);
 
-    // Scale Level Info for point
-    mnScaleLevels = mpORBextractorLeft->GetLevels();
-    mfScaleFactor = mpORBextractorLeft->GetScaleFactor();
-    mfLogScaleFactor = log(mfScaleFactor);
-    mvScaleFactors = mpORBextractorLeft->GetScaleFactors();
-    mvInvScaleFactors = mpORBextractorLeft->GetInverseScaleFactors();
-    mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
-    mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
-
-    // Scale Level Info for line
-    mnScaleLevelsLine = mpLSDextractorLeft->GetLevels();
-    mfScaleFactorLine = mpLSDextractorLeft->GetScaleFactor();
-    mfLogScaleFactorLine = log(mfScaleFactor);
-    mvScaleFactorsLine = mpLSDextractorLeft->GetScaleFactors();
-    mvInvScaleFactorsLine = mpLSDextractorLeft->GetInverseScaleFactors();
-    mvLevelSigma2Line = mpLSDextractorLeft->GetScaleSigmaSquares();
-    mvInvLevelSigma2Line = mpLSDextractorLeft->GetInverseScaleSigmaSquares();
-
-    cv::Mat mUndistX, mUndistY, mImGray_remap;
-    initUndistortRectifyMap(mK, mDistCoef, Mat_<double>::eye(3,3), mK, Size(imGray.cols, imGray.rows), CV_32F, mUndistX, mUndistY);
-    cv::remap(imGray, mImGray_remap, mUndistX, mUndistY, cv::INTER_LINEAR);
-
-    thread threadPoint(&Frame::ExtractORB, this, 0, imGray);
-    thread threadLine(&Frame::ExtractLSD, this, mImGray_remap, mask);
-    threadPoint.join();
-    threadLine.join();
+    // Calibration and scale level info for points and lines
+    SetConfig(pConfig);
+
+    const uint64_t nCacheKey = mpFeatureCache ? mpFeatureCache->ComputeKey(imGray,mask,mpORBextractorLeft,mpLSDextractorLeft,
+                                                                          mpConfig->mnCameraModel,mK,mDistCoef) : 0;
+    // Points and lines are extracted on the raw image, the mask is in its coordinates
+    const bool bCached = LoadCachedFeatures(nCacheKey);
+    if(!bCached)
+    {
+        thread threadPoint(&Frame::ExtractORB, this, 0, imGray);
+        thread threadLine(&Frame::ExtractLSD, this, imGray, mask);
+        threadPoint.join();
+        threadLine.join();
+    }
 
-    NL = mvKeylinesUn.size(); //特征线的数量
     N = mvKeys.size();
 
+    // Before the cache entry is saved: the keypoints that cannot be undistorted are not cached, nor their BoW
+    UndistortKeyPoints();
+
+    // The cached keylines are already undistorted
+    if(!bCached)
+    {
+        UndistortKeyLines();
+        SaveCachedFeatures(nCacheKey);
+    }
+
+    NL = mvKeylinesUn.size(); //特征线的数量
+
     if(mvKeys.empty())
         return;
-        
-    //mvKeysUn = mvKeys;
-    UndistortKeyPoints();
 
     // Set no stereo information
     mvuRight = vector<float>(N,-1);
@@ -245,24 +185,6 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* orbex
     mvpMapLines = vector<MapLine*>(NL,static_cast<MapLine*>(NULL));
     mvbLineOutlier = vector<bool>(NL,false);
 
-    // This is done only for the first Frame (or after a change in the calibration)
-    if(mbInitialComputations)
-    {
-        ComputeImageBounds(imGray);
-
-        mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnMaxX-mnMinX);
-        mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnMaxY-mnMinY);
-
-        fx = K.at<float>(0,0);
-        fy = K.at<float>(1,1);
-        cx = K.at<float>(0,2);
-        cy = K.at<float>(1,2);
-        invfx = 1.0f/fx;
-        invfy = 1.0f/fy;
-
-        mbInitialComputations=false;
-    }
-
     mb = mbf/fx;
 
     //AssignFeaturesToGrid();
@@ -275,6 +197,82 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* orbex
 
 }
 
+Frame::Frame(const CachedFeatures &features, const FrameConfigPtr &pConfig, const double &timeStamp, ORBVocabulary* voc)
+    :mpORBvocabulary(voc),mpORBextractorLeft(static_cast<ORBextractor*>(NULL)),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
+     mpLSDextractorLeft(static_cast<LINEextractor*>(NULL)), mTimeStamp(timeStamp), mbf(0), mb(0), mThDepth(0)
+{
+    // Frame ID
+    mnId=nNextId++;
+
+    SetConfig(pConfig);
+
+    mvKeys = features.vKeys;
+    mvKeysUn = features.vKeys;
+    mDescriptors = features.Descriptors;
+    mvKeylinesUn = features.vKeyLines;
+    mLdesc = features.LineDescriptors;
+    mvKeyLineFunctions = features.vLineFunctions;
+    mBowVec = features.BowVec;
+    mFeatVec = features.FeatVec;
+
+    N = mvKeysUn.size();
+    NL = mvKeylinesUn.size();
+
+    mvuRight = vector<float>(N,-1);
+    mvDepth = vector<float>(N,-1);
+    mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));
+    mvbOutlier = vector<bool>(N,false);
+    mvpMapLines = vector<MapLine*>(NL,static_cast<MapLine*>(NULL));
+    mvbLineOutlier = vector<bool>(NL,false);
+
+    AssignFeaturesToGrid();
+    AssignFeaturesToGridForLine();
+}
+
+void Frame::SetConfig(const FrameConfigPtr &pConfig)
+{
+    mpConfig = pConfig;
+    if(!pConfig)
+    {
+        mvScaleFactors = mvInvScaleFactors = mvLevelSigma2 = mvInvLevelSigma2 = static_cast<const float*>(NULL);
+        mvScaleFactorsLine = mvInvScaleFactorsLine = mvLevelSigma2Line = mvInvLevelSigma2Line = static_cast<const float*>(NULL);
+        return;
+    }
+
+    // Shallow copies, the calibration is never modified
+    mK = pConfig->mK;
+    mDistCoef = pConfig->mDistCoef;
+    fx = pConfig->fx;
+    fy = pConfig->fy;
+    cx = pConfig->cx;
+    cy = pConfig->cy;
+    invfx = pConfig->invfx;
+    invfy = pConfig->invfy;
+
+    mnMinX = pConfig->mnMinX;
+    mnMaxX = pConfig->mnMaxX;
+    mnMinY = pConfig->mnMinY;
+    mnMaxY = pConfig->mnMaxY;
+    mfGridElementWidthInv = pConfig->mfGridElementWidthInv;
+    mfGridElementHeightInv = pConfig->mfGridElementHeightInv;
+
+    mnScaleLevels = pConfig->mnScaleLevels;
+    mfScaleFactor = pConfig->mfScaleFactor;
+    mfLogScaleFactor = pConfig->mfLogScaleFactor;
+    mvScaleFactors = pConfig->mvScaleFactors.data();
+    mvInvScaleFactors = pConfig->mvInvScaleFactors.data();
+    mvLevelSigma2 = pConfig->mvLevelSigma2.data();
+    mvInvLevelSigma2 = pConfig->mvInvLevelSigma2.data();
+
+    mnScaleLevelsLine = pConfig->mnScaleLevelsLine;
+    mfScaleFactorLine = pConfig->mfScaleFactorLine;
+    mfLogScaleFactorLine = pConfig->mfLogScaleFactorLine;
+    mvScaleFactorsLine = pConfig->mvScaleFactorsLine.data();
+    mvInvScaleFactorsLine = pConfig->mvInvScaleFactorsLine.data();
+    mvLevelSigma2Line = pConfig->mvLevelSigma2Line.data();
+    mvInvLevelSigma2Line = pConfig->mvInvLevelSigma2Line.data();
+}
+
 void Frame::AssignFeaturesToGrid()
 {
     int nReserve = 0.5f*N/(FRAME_GRID_COLS*FRAME_GRID_ROWS);
@@ -333,6 +331,44 @@ void Frame::ExtractLSD(const cv::Mat &im, const cv::Mat &mask)
     (*mpLSDextractorLeft)(im,mask,mvKeylinesUn, mLdesc, mvKeyLineFunctions);
 }
 
+bool Frame::LoadCachedFeatures(const uint64_t nKey)
+{
+    if(!mpFeatureCache)
+        return false;
+
+    CachedFeatures features;
+    if(!mpFeatureCache->Load(nKey,features))
+        return false;
+
+    mvKeys.swap(features.vKeys);
+    mDescriptors = features.Descriptors;
+    mvKeylinesUn.swap(features.vKeyLines);
+    mLdesc = features.LineDescriptors;
+    mvKeyLineFunctions.swap(features.vLineFunctions);
+    mBowVec.swap(features.BowVec);
+    mFeatVec.swap(features.FeatVec);
+    return true;
+}
+
+void Frame::SaveCachedFeatures(const uint64_t nKey)
+{
+    if(!mpFeatureCache)
+        return;
+
+    // The BoW vectors are stored with the features, so that the next runs do not compute them either
+    ComputeBoW();
+
+    CachedFeatures features;
+    features.vKeys = mvKeys;
+    features.Descriptors = mDescriptors;
+    features.vKeyLines = mvKeylinesUn;
+    features.LineDescriptors = mLdesc;
+    features.vLineFunctions = mvKeyLineFunctions;
+    features.BowVec = mBowVec;
+    features.FeatVec = mFeatVec;
+    mpFeatureCache->Save(nKey,features);
+}
+
 // 根据两个匹配的特征线计算特征线的3D坐标, frame1是当前帧，frame2是前一帧
 void Frame::ComputeLine3D(Frame &frame1, Frame &frame2)
 {
@@ -914,63 +950,141 @@ void Frame::ComputeBoW()
 
 void Frame::UndistortKeyPoints()
 {
-    if(mDistCoef.at<float>(0)==0.0)
+    if(!IsDistorted(mpConfig->mnCameraModel,mK,mDistCoef))
     {
         mvKeysUn=mvKeys;
         return;
     }
 
-    // Fill matrix with points
-    cv::Mat mat(N,2,CV_32F);    //N是关键点的个数
+    vector<cv::Point2f> vPoints(N);
     for(int i=0; i<N; i++)
-    {
-        mat.at<float>(i,0)=mvKeys[i].pt.x;
-        mat.at<float>(i,1)=mvKeys[i].pt.y;
-    }
+        vPoints[i]=mvKeys[i].pt;
 
     // Undistort points
-    mat=mat.reshape(2);
-    cv::undistortPoints(mat,mat,mK,mDistCoef,cv::Mat(),mK);
-    mat=mat.reshape(1);
+    vector<bool> vbValid;
+    UndistortPoints(mpConfig->mnCameraModel,mK,mDistCoef,vPoints,vbValid);
 
     // Fill undistorted keypoint vector
     mvKeysUn.resize(N); //没有畸变的特征点
+    int nKept=0;
     for(int i=0; i<N; i++)
     {
+        if(!vbValid[i])
+            continue;
         cv::KeyPoint kp = mvKeys[i];
-        kp.pt.x=mat.at<float>(i,0);
-        kp.pt.y=mat.at<float>(i,1);
-        mvKeysUn[i]=kp;
+        kp.pt=vPoints[i];
+        mvKeysUn[nKept]=kp;
+        mvKeys[nKept]=mvKeys[i];
+        nKept++;
+    }
+
+    // Keypoints that cannot be undistorted (fisheye beyond 90 degrees) are removed with their descriptors
+    if(nKept<N)
+    {
+        cv::Mat descriptors(nKept,mDescriptors.cols,mDescriptors.type());
+        for(int i=0, j=0; i<N; i++)
+            if(vbValid[i])
+                mDescriptors.row(i).copyTo(descriptors.row(j++));
+        mDescriptors = descriptors;
+
+        mvKeys.resize(nKept);
+        mvKeysUn.resize(nKept);
+        N = nKept;
+
+        // The BoW vectors of a cache entry would index the removed keypoints
+        mBowVec.clear();
+        mFeatVec.clear();
     }
 }
 
-void Frame::ComputeImageBounds(const cv::Mat &imLeft)
+void Frame::UndistortKeyLines()
 {
-    if(mDistCoef.at<float>(0)!=0.0)
+    if(mvKeylinesUn.empty() || !IsDistorted(mpConfig->mnCameraModel,mK,mDistCoef))
+        return;
+
+    // Endpoints and samples along each segment of the raw image, undistorted together through the camera model
+    const float SAMPLE_STEP = 10.0f;
+    const int MAX_SAMPLES = 16;
+    const int nLines = mvKeylinesUn.size();
+    vector<int> vFirstPoint(nLines+1);
+    vector<cv::Point2f> vPoints;
+    vPoints.reserve(4*nLines);
+    for(int i=0; i<nLines; i++)
     {
-        cv::Mat mat(4,2,CV_32F);
-        mat.at<float>(0,0)=0.0; mat.at<float>(0,1)=0.0;
-        mat.at<float>(1,0)=imLeft.cols; mat.at<float>(1,1)=0.0;
-        mat.at<float>(2,0)=0.0; mat.at<float>(2,1)=imLeft.rows;
-        mat.at<float>(3,0)=imLeft.cols; mat.at<float>(3,1)=imLeft.rows;
-
-        // Undistort corners
-        mat=mat.reshape(2);
-        cv::undistortPoints(mat,mat,mK,mDistCoef,cv::Mat(),mK);
-        mat=mat.reshape(1);
-
-        mnMinX = min(mat.at<float>(0,0),mat.at<float>(2,0));
-        mnMaxX = max(mat.at<float>(1,0),mat.at<float>(3,0));
-        mnMinY = min(mat.at<float>(0,1),mat.at<float>(1,1));
-        mnMaxY = max(mat.at<float>(2,1),mat.at<float>(3,1));
+        const KeyLine &kl = mvKeylinesUn[i];
+        const int nSamples = max(1,min(MAX_SAMPLES,static_cast<int>(kl.lineLength*mvScaleFactorsLine[kl.octave]/SAMPLE_STEP)));
+        vFirstPoint[i] = vPoints.size();
+        vPoints.push_back(cv::Point2f(kl.startPointX,kl.startPointY));
+        vPoints.push_back(cv::Point2f(kl.endPointX,kl.endPointY));
+        for(int j=1; j<=nSamples; j++)
+        {
+            const float t = static_cast<float>(j)/(nSamples+1);
+            vPoints.push_back(cv::Point2f(kl.startPointX+t*(kl.endPointX-kl.startPointX),
+                                          kl.startPointY+t*(kl.endPointY-kl.startPointY)));
+        }
+    }
+    vFirstPoint[nLines] = vPoints.size();
 
+    vector<bool> vbValid;
+    UndistortPoints(mpConfig->mnCameraModel,mK,mDistCoef,vPoints,vbValid);
+
+    // 去畸变后的端点，同时更新线段的长度、角度和直线方程
+    // The matchers and the line edges assume straight segments of the undistorted image: a segment is removed if it
+    // cannot be undistorted, or if its undistorted samples are more than a pixel (at its octave) off the endpoint line
+    int nKept=0;
+    for(int i=0; i<nLines; i++)
+    {
+        const int i0 = vFirstPoint[i];
+        const int i1 = vFirstPoint[i+1];
+
+        bool bValid = true;
+        for(int j=i0; j<i1 && bValid; j++)
+            bValid = vbValid[j];
+        if(!bValid)
+            continue;
+
+        const cv::Point2f &sp = vPoints[i0];
+        const cv::Point2f &ep = vPoints[i0+1];
+        Eigen::Vector3d sp_l; sp_l << sp.x, sp.y, 1.0;
+        Eigen::Vector3d ep_l; ep_l << ep.x, ep.y, 1.0;
+        Eigen::Vector3d lineV = sp_l.cross(ep_l);
+        const double norm = sqrt(lineV(0)*lineV(0)+lineV(1)*lineV(1));
+        if(norm<1e-6)
+            continue;
+        lineV = lineV / norm;
+
+        KeyLine kl = mvKeylinesUn[i];
+        const float maxDist = mvScaleFactorsLine[kl.octave];
+        for(int j=i0+2; j<i1 && bValid; j++)
+            bValid = fabs(lineV(0)*vPoints[j].x+lineV(1)*vPoints[j].y+lineV(2))<=maxDist;
+        if(!bValid)
+            continue;
+
+        const float invScale = 1.0f/mvScaleFactorsLine[kl.octave];
+        kl.startPointX = sp.x;
+        kl.startPointY = sp.y;
+        kl.endPointX = ep.x;
+        kl.endPointY = ep.y;
+        kl.sPointInOctaveX = sp.x*invScale;
+        kl.sPointInOctaveY = sp.y*invScale;
+        kl.ePointInOctaveX = ep.x*invScale;
+        kl.ePointInOctaveY = ep.y*invScale;
+        kl.pt = cv::Point2f(0.5f*(sp.x+ep.x),0.5f*(sp.y+ep.y));
+        kl.lineLength = sqrt((ep.x-sp.x)*(ep.x-sp.x)+(ep.y-sp.y)*(ep.y-sp.y))*invScale;
+        kl.angle = atan2(ep.y-sp.y,ep.x-sp.x);
+
+        mvKeylinesUn[nKept] = kl;
+        mvKeyLineFunctions[nKept] = lineV;
+        if(nKept!=i)
+            mLdesc.row(i).copyTo(mLdesc.row(nKept));
+        nKept++;
     }
-    else
+
+    if(nKept<nLines)
     {
-        mnMinX = 0.0f;
-        mnMaxX = imLeft.cols;
-        mnMinY = 0.0f;
-        mnMaxY = imLeft.rows;
+        mvKeylinesUn.resize(nKept);
+        mvKeyLineFunctions.resize(nKept);
+        mLdesc = mLdesc.rowRange(0,nKept).clone();
     }
 }
 
@@ -1033,7 +1147,7 @@ void Frame::ComputeStereoMatches()
         int bestDist = ORBmatcher::TH_HIGH;
         size_t bestIdxR = 0;
 
-        const cv::Mat &dL = mDescriptors.row(iL);
+        const ORBDescriptorView dL = ORBDescriptorView::Row(mDescriptors,iL);
 
         // Compare descriptor to right keypoints
         for(size_t iC=0; iC<vCandidates.size(); iC++)
@@ -1048,8 +1162,8 @@ void Frame::ComputeStereoMatches()
 
             if(uR>=minU && uR<=maxU)
             {
-                const cv::Mat &dR = mDescriptorsRight.row(iR);
-                const int dist = ORBmatcher::DescriptorDistance(dL,dR);
+                const ORBDescriptorView dR = ORBDescriptorView::Row(mDescriptorsRight,iR);
+                const int dist = HammingDistance(dL,dR);
 
                 if(dist<bestDist)
                 {
@@ -0,0 +1,172 @@
+#include "FrameConfig.h"
+#include "Frame.h"
+#include "ORBextractor.h"
+#include "LineExtractor.h"
+#include "CameraModels.h"
+#include "MapMessages.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+// Same pyramid as the extractors
+void ComputeScalePyramid(const int nLevels, const float scaleFactor, vector<float> &vScaleFactors,
+                         vector<float> &vInvScaleFactors, vector<float> &vLevelSigma2, vector<float> &vInvLevelSigma2)
+{
+    vScaleFactors.resize(nLevels);
+    vInvScaleFactors.resize(nLevels);
+    vLevelSigma2.resize(nLevels);
+    vInvLevelSigma2.resize(nLevels);
+    for(int i=0; i<nLevels; i++)
+    {
+        vScaleFactors[i] = i==0 ? 1.0f : vScaleFactors[i-1]*scaleFactor;
+        vLevelSigma2[i] = vScaleFactors[i]*vScaleFactors[i];
+        vInvScaleFactors[i] = 1.0f/vScaleFactors[i];
+        vInvLevelSigma2[i] = 1.0f/vLevelSigma2[i];
+    }
+}
+
+}
+
+FrameConfig::FrameConfig(ORBextractor *pORBextractor, LINEextractor *pLINEextractor, const cv::Mat &K, const cv::Mat &DistCoef,
+                         const int nCameraModel, const cv::Size &imageSize):
+    mDistCoef(DistCoef.clone()), mnCameraModel(nCameraModel)
+{
+    SetCalibration(K);
+    ComputeImageBounds(imageSize);
+    ComputeGrid();
+
+    mnScaleLevels = pORBextractor->GetLevels();
+    mfScaleFactor = pORBextractor->GetScaleFactor();
+    mfLogScaleFactor = log(mfScaleFactor);
+    mvScaleFactors = pORBextractor->GetScaleFactors();
+    mvInvScaleFactors = pORBextractor->GetInverseScaleFactors();
+    mvLevelSigma2 = pORBextractor->GetScaleSigmaSquares();
+    mvInvLevelSigma2 = pORBextractor->GetInverseScaleSigmaSquares();
+
+    if(pLINEextractor)
+    {
+        mnScaleLevelsLine = pLINEextractor->GetLevels();
+        mfScaleFactorLine = pLINEextractor->GetScaleFactor();
+        mfLogScaleFactorLine = log(mfScaleFactorLine);
+        mvScaleFactorsLine = pLINEextractor->GetScaleFactors();
+        mvInvScaleFactorsLine = pLINEextractor->GetInverseScaleFactors();
+        mvLevelSigma2Line = pLINEextractor->GetScaleSigmaSquares();
+        mvInvLevelSigma2Line = pLINEextractor->GetInverseScaleSigmaSquares();
+    }
+    else
+    {
+        mnScaleLevelsLine = 0;
+        mfScaleFactorLine = 1.0f;
+        mfLogScaleFactorLine = 0.0f;
+    }
+}
+
+FrameConfig::FrameConfig(const AgentCamera &camera):
+    mnCameraModel(CAMERA_PINHOLE)
+{
+    cv::Mat K = cv::Mat::eye(3,3,CV_32F);
+    K.at<float>(0,0) = camera.fx;
+    K.at<float>(1,1) = camera.fy;
+    K.at<float>(0,2) = camera.cx;
+    K.at<float>(1,2) = camera.cy;
+    SetCalibration(K);
+
+    mnMinX = camera.minX;
+    mnMaxX = camera.maxX;
+    mnMinY = camera.minY;
+    mnMaxY = camera.maxY;
+    ComputeGrid();
+
+    mnScaleLevels = camera.nScaleLevels;
+    mfScaleFactor = camera.fScaleFactor;
+    mfLogScaleFactor = log(mfScaleFactor);
+    ComputeScalePyramid(mnScaleLevels,mfScaleFactor,mvScaleFactors,mvInvScaleFactors,mvLevelSigma2,mvInvLevelSigma2);
+
+    mnScaleLevelsLine = camera.nScaleLevelsLine;
+    mfScaleFactorLine = camera.fScaleFactorLine;
+    mfLogScaleFactorLine = log(mfScaleFactorLine);
+    ComputeScalePyramid(mnScaleLevelsLine,mfScaleFactorLine,mvScaleFactorsLine,mvInvScaleFactorsLine,
+                        mvLevelSigma2Line,mvInvLevelSigma2Line);
+}
+
+void FrameConfig::SetCalibration(const cv::Mat &K)
+{
+    mK = K.clone();
+    fx = K.at<float>(0,0);
+    fy = K.at<float>(1,1);
+    cx = K.at<float>(0,2);
+    cy = K.at<float>(1,2);
+    invfx = 1.0f/fx;
+    invfy = 1.0f/fy;
+}
+
+void FrameConfig::ComputeImageBounds(const cv::Size &imageSize)
+{
+    if(IsDistorted(mnCameraModel,mK,mDistCoef))
+    {
+        // Walk the image border, one sample per pixel: a barrel distortion moves the middle of the sides
+        // out less than the corners, a pincushion one more
+        const int w = imageSize.width;
+        const int h = imageSize.height;
+        vector<cv::Point2f> vBorder;
+        vBorder.reserve(2*(w+h)+4);
+        for(int u=0; u<=w; u++)
+        {
+            vBorder.push_back(cv::Point2f(u,0.0f));
+            vBorder.push_back(cv::Point2f(u,h));
+        }
+        for(int v=1; v<h; v++)
+        {
+            vBorder.push_back(cv::Point2f(0.0f,v));
+            vBorder.push_back(cv::Point2f(w,v));
+        }
+
+        vector<bool> vbValid;
+        UndistortPoints(mnCameraModel,mK,mDistCoef,vBorder,vbValid);
+
+        // A wide fisheye cannot be undistorted up to the corners, only the valid samples bound the image
+        mnMinX = mnMinY = numeric_limits<float>::max();
+        mnMaxX = mnMaxY = -numeric_limits<float>::max();
+        for(size_t i=0; i<vBorder.size(); i++)
+        {
+            if(!vbValid[i])
+                continue;
+            mnMinX = min(mnMinX,vBorder[i].x);
+            mnMaxX = max(mnMaxX,vBorder[i].x);
+            mnMinY = min(mnMinY,vBorder[i].y);
+            mnMaxY = max(mnMaxY,vBorder[i].y);
+        }
+
+        // No valid sample (the border is all beyond 90 degrees): bounds of the raw image
+        if(mnMinX>=mnMaxX || mnMinY>=mnMaxY)
+        {
+            mnMinX = 0.0f;
+            mnMaxX = w;
+            mnMinY = 0.0f;
+            mnMaxY = h;
+        }
+    }
+    else
+    {
+        mnMinX = 0.0f;
+        mnMaxX = imageSize.width;
+        mnMinY = 0.0f;
+        mnMaxY = imageSize.height;
+    }
+}
+
+void FrameConfig::ComputeGrid()
+{
+    mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnMaxX-mnMinX);
+    mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnMaxY-mnMinY);
+}
+
+} //namespace ORB_SLAM
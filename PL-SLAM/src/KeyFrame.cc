@@ -21,23 +21,48 @@
 #include "KeyFrame.h"
 #include "Converter.h"
 #include "ORBmatcher.h"
+#include "MemoryReport.h"
 #include <unordered_set>
+#include <cmath>
 #include<mutex>
 
 namespace ORB_SLAM2
 {
 
 long unsigned int KeyFrame::nNextId=0;
+const int KeyFrame::nRedundancyTh=3;
+
+namespace
+{
+
+// Scene depth histogram: 256 bins from 1 mm to 10 km, about 6% of depth per bin
+const int SCENE_DEPTH_BINS = 256;
+const float SCENE_DEPTH_LOG_MIN = log(1e-3f);
+const float SCENE_DEPTH_LOG_MAX = log(1e4f);
+const float SCENE_DEPTH_BIN_WIDTH = (SCENE_DEPTH_LOG_MAX-SCENE_DEPTH_LOG_MIN)/SCENE_DEPTH_BINS;
+
+int SceneDepthBin(const float z)
+{
+    // Closer points and points behind the camera fall in the first bin
+    if(z<=0)
+        return 0;
+    const int bin = floor((log(z)-SCENE_DEPTH_LOG_MIN)/SCENE_DEPTH_BIN_WIDTH);
+    return max(0,min(bin,SCENE_DEPTH_BINS-1));
+}
+
+}
 
 KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mnFrameId(F.mnId),  mTimeStamp(F.mTimeStamp), mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
     mfGridElementWidthInv(F.mfGridElementWidthInv), mfGridElementHeightInv(F.mfGridElementHeightInv),
-    mnTrackReferenceForFrame(0), mnFuseTargetForKF(0), mnBALocalForKF(0), mnBAFixedForKF(0),
+    mnTrackReferenceForFrame(0), mnFuseTargetForKF(0), mnBALocalForKF(0), mnBAFixedForKF(0), mnLocalMapSnapshotForKF(),
     mnLoopQuery(0), mnLoopWords(0), mnRelocQuery(0), mnRelocWords(0), mnBAGlobalForKF(0),
+    mpRigKF(NULL), mpPrevRigKF(NULL),
     fx(F.fx), fy(F.fy), cx(F.cx), cy(F.cy), invfx(F.invfx), invfy(F.invfy),
-    mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mvKeys(F.mvKeys), mvKeysUn(F.mvKeysUn),
-    mvuRight(F.mvuRight), mvDepth(F.mvDepth), mDescriptors(F.mDescriptors.clone()),
-    mBowVec(F.mBowVec), mFeatVec(F.mFeatVec), mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
+    mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mFeatures(F.mvKeysUn, F.mDescriptors, F.mvKeylinesUn, F.mLdesc),
+    mvKeys((F.mDistCoef.empty() || !IsDistorted(F.mpConfig->mnCameraModel,F.mK,F.mDistCoef)) ? std::vector<cv::KeyPoint>() : F.mvKeys),
+    mvKeysUn(mFeatures.KeyPoints()), mvuRight(F.mvuRight), mvDepth(F.mvDepth), mDescriptors(mFeatures.Descriptors()),
+    mBowVec(F.mBowVec), mFeatVec(F.mFeatVec), mpConfig(F.mpConfig), mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
     mfLogScaleFactor(F.mfLogScaleFactor), mvScaleFactors(F.mvScaleFactors), mvLevelSigma2(F.mvLevelSigma2),
     mvInvLevelSigma2(F.mvInvLevelSigma2),mnScaleLevelsLine(F.mnScaleLevelsLine), mfScaleFactorLine(F.mfScaleFactorLine),
     mfLogScaleFactorLine(F.mfLogScaleFactorLine), mvScaleFactorsLine(F.mvScaleFactorsLine), mvLevelSigma2Line(F.mvLevelSigma2Line),
@@ -45,7 +70,8 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mnMaxY(F.mnMaxY), mK(F.mK), mvpMapPoints(F.mvpMapPoints), mpKeyFrameDB(pKFDB),
     mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
     mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap),
-    NL(F.NL), mvKeyLines(F.mvKeylinesUn), mvKeyLineFunctions(F.mvKeyLineFunctions), mLineDescriptors(F.mLdesc),
+    NL(F.NL), mvKeyLines(mFeatures.KeyLines()), mLineDescriptors(mFeatures.LineDescriptors()),
+    mvKeyLineFunctions(mFeatures.KeyLineFunctions()),
     mvpMapLines(F.mvpMapLines), ImageGray(F.ImageGray.clone())
 {
     mnId=nNextId++;
@@ -68,77 +94,108 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
             mGridForLine[i][j] = F.mGridForLine[i][j];
     }
 
+    // Redundancy counters, filled as MapPoints/MapLines add observations of this keyframe
+    mvnPointRedundancy = vector<int>(N,-1);
+    mvnLineRedundancy = vector<int>(NL,-1);
+    mnObservedPoints = mnRedundantPoints = 0;
+    mnObservedClosePoints = mnRedundantClosePoints = 0;
+    mnObservedLines = mnRedundantLines = 0;
+
+    // Scene depth histogram, built by the first GetSceneMedianDepth
+    mvnSceneDepthBin = vector<short>(N,-1);
+    mvnSceneDepthHistogram = vector<int>(SCENE_DEPTH_BINS,0);
+    mnSceneDepthSamples = 0;
+    mbSceneDepthStale = true;
+
     SetPose(F.mTcw);
 }
 
 void KeyFrame::ComputeBoW()
 {
-    if(mBowVec.empty() || mFeatVec.empty())
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        // Feature vector associate features with nodes in the 4th level (from leaves up)
-        // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        if(!mBowVec.empty() && !mFeatVec.empty())
+            return;
     }
+
+    vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
+    // Feature vector associate features with nodes in the 4th level (from leaves up)
+    // We assume the vocabulary tree has 6 levels, change the 4 otherwise
+    DBoW2::BowVector BowVec;
+    DBoW2::FeatureVector FeatVec;
+    mpORBvocabulary->transform(vCurrentDesc,BowVec,FeatVec,4);
+
+    // Set under the lock, read by the memory reports
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
+    mBowVec.swap(BowVec);
+    mFeatVec.swap(FeatVec);
 }
 
 void KeyFrame::SetPose(const cv::Mat &Tcw_)
 {
-    unique_lock<mutex> lock(mMutexPose);
-    Tcw_.copyTo(Tcw);
-    cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
-    cv::Mat tcw = Tcw.rowRange(0,3).col(3);
-    cv::Mat Rwc = Rcw.t();
-    Ow = -Rwc*tcw;
+    {
+        unique_lock<ProfiledMutex> lock(mMutexPose);
+        Tcw_.copyTo(Tcw);
+        cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
+        cv::Mat tcw = Tcw.rowRange(0,3).col(3);
+        cv::Mat Rwc = Rcw.t();
+        Ow = -Rwc*tcw;
+
+        Twc = cv::Mat::eye(4,4,Tcw.type());
+        Rwc.copyTo(Twc.rowRange(0,3).colRange(0,3));
+        Ow.copyTo(Twc.rowRange(0,3).col(3));
+        cv::Mat center = (cv::Mat_<float>(4,1) << mHalfBaseline, 0 , 0, 1);
+        Cw = Twc*center;
+
+        mpMap->UpdateSnapshotState(this,Tcw);
+    }
 
-    Twc = cv::Mat::eye(4,4,Tcw.type());
-    Rwc.copyTo(Twc.rowRange(0,3).colRange(0,3));
-    Ow.copyTo(Twc.rowRange(0,3).col(3));
-    cv::Mat center = (cv::Mat_<float>(4,1) << mHalfBaseline, 0 , 0, 1);
-    Cw = Twc*center;
+    // All the depths changed (not locked with the pose, RebuildSceneDepth locks the pose)
+    unique_lock<ProfiledMutex> lock(mMutexSceneDepth);
+    mbSceneDepthStale = true;
 }
 
 cv::Mat KeyFrame::GetPose()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return Tcw.clone();
 }
 
 cv::Mat KeyFrame::GetPoseInverse()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return Twc.clone();
 }
 
 cv::Mat KeyFrame::GetCameraCenter()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return Ow.clone();
 }
 
 cv::Mat KeyFrame::GetStereoCenter()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return Cw.clone();
 }
 
 
 cv::Mat KeyFrame::GetRotation()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return Tcw.rowRange(0,3).colRange(0,3).clone();
 }
 
 cv::Mat KeyFrame::GetTranslation()
 {
-    unique_lock<mutex> lock(mMutexPose);
+    unique_lock<ProfiledMutex> lock(mMutexPose);
     return Tcw.rowRange(0,3).col(3).clone();
 }
 
 void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
 {
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
         if(!mConnectedKeyFrameWeights.count(pKF))
             mConnectedKeyFrameWeights[pKF]=weight;
         else if(mConnectedKeyFrameWeights[pKF]!=weight)
@@ -152,7 +209,7 @@ void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
 
 void KeyFrame::UpdateBestCovisibles()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     vector<pair<int,KeyFrame*> > vPairs;
     vPairs.reserve(mConnectedKeyFrameWeights.size());
     for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
@@ -173,7 +230,7 @@ void KeyFrame::UpdateBestCovisibles()
 
 set<KeyFrame*> KeyFrame::GetConnectedKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     set<KeyFrame*> s;
     for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin();mit!=mConnectedKeyFrameWeights.end();mit++)
         s.insert(mit->first);
@@ -182,13 +239,13 @@ set<KeyFrame*> KeyFrame::GetConnectedKeyFrames()
 
 vector<KeyFrame*> KeyFrame::GetVectorCovisibleKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     return mvpOrderedConnectedKeyFrames;
 }
 
 vector<KeyFrame*> KeyFrame::GetBestCovisibilityKeyFrames(const int &N)
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     if((int)mvpOrderedConnectedKeyFrames.size()<N)
         return mvpOrderedConnectedKeyFrames;
     else
@@ -198,7 +255,7 @@ vector<KeyFrame*> KeyFrame::GetBestCovisibilityKeyFrames(const int &N)
 
 vector<KeyFrame*> KeyFrame::GetCovisiblesByWeight(const int &w)
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
 
     if(mvpOrderedConnectedKeyFrames.empty())
         return vector<KeyFrame*>();
@@ -215,7 +272,7 @@ vector<KeyFrame*> KeyFrame::GetCovisiblesByWeight(const int &w)
 
 int KeyFrame::GetWeight(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     if(mConnectedKeyFrameWeights.count(pKF))
         return mConnectedKeyFrameWeights[pKF];
     else
@@ -224,32 +281,42 @@ int KeyFrame::GetWeight(KeyFrame *pKF)
 
 void KeyFrame::AddMapPoint(MapPoint *pMP, const size_t &idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    mvpMapPoints[idx]=pMP;
+    {
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        mvpMapPoints[idx]=pMP;
+    }
+    InsertSceneDepth(idx,pMP);
 }
 
 void KeyFrame::EraseMapPointMatch(const size_t &idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    mvpMapPoints[idx]=static_cast<MapPoint*>(NULL);
+    {
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        mvpMapPoints[idx]=static_cast<MapPoint*>(NULL);
+    }
+    RemoveSceneDepth(idx);
 }
 
 void KeyFrame::EraseMapPointMatch(MapPoint* pMP)
 {
     int idx = pMP->GetIndexInKeyFrame(this);
     if(idx>=0)
+    {
         mvpMapPoints[idx]=static_cast<MapPoint*>(NULL);
+        RemoveSceneDepth(idx);
+    }
 }
 
 
 void KeyFrame::ReplaceMapPointMatch(const size_t &idx, MapPoint* pMP)
 {
     mvpMapPoints[idx]=pMP;
+    InsertSceneDepth(idx,pMP);
 }
 
 set<MapPoint*> KeyFrame::GetMapPoints()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     set<MapPoint*> s;
     for(size_t i=0, iend=mvpMapPoints.size(); i<iend; i++)
     {
@@ -264,7 +331,7 @@ set<MapPoint*> KeyFrame::GetMapPoints()
 
 int KeyFrame::TrackedMapPoints(const int &minObs)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
 
     int nPoints=0;
     const bool bCheckObs = minObs>0;
@@ -291,13 +358,13 @@ int KeyFrame::TrackedMapPoints(const int &minObs)
 
 vector<MapPoint*> KeyFrame::GetMapPointMatches()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return mvpMapPoints;
 }
 
 MapPoint* KeyFrame::GetMapPoint(const size_t &idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return mvpMapPoints[idx];
 }
 
@@ -309,7 +376,7 @@ void KeyFrame::UpdateConnections()
     vector<MapLine*> vpML;
 
     {
-        unique_lock<mutex> lockMPs(mMutexFeatures);
+        unique_lock<ProfiledMutex> lockMPs(mMutexFeatures);
         vpMP = mvpMapPoints;
         vpML = mvpMapLines;
     }
@@ -398,7 +465,7 @@ void KeyFrame::UpdateConnections()
     }
 
     {
-        unique_lock<mutex> lockCon(mMutexConnections);
+        unique_lock<ProfiledMutex> lockCon(mMutexConnections);
 
         // mspConnectedKeyFrames = spConnectedKeyFrames;
         mConnectedKeyFrameWeights = KFcounter;
@@ -407,8 +474,12 @@ void KeyFrame::UpdateConnections()
 
         if(mbFirstConnection && mnId!=0)
         {
-            mpParent = mvpOrderedConnectedKeyFrames.front();
-            mpParent->AddChild(this);
+            // Keyframes of the other cameras of a rig are attached to the keyframe of the first camera when created
+            if(!mpParent)
+            {
+                mpParent = mvpOrderedConnectedKeyFrames.front();
+                mpParent->AddChild(this);
+            }
             mbFirstConnection = false;
         }
 
@@ -417,64 +488,64 @@ void KeyFrame::UpdateConnections()
 
 void KeyFrame::AddChild(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     mspChildrens.insert(pKF);
 }
 
 void KeyFrame::EraseChild(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     mspChildrens.erase(pKF);
 }
 
 void KeyFrame::ChangeParent(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     mpParent = pKF;
     pKF->AddChild(this);
 }
 
 set<KeyFrame*> KeyFrame::GetChilds()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     return mspChildrens;
 }
 
 KeyFrame* KeyFrame::GetParent()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     return mpParent;
 }
 
 bool KeyFrame::hasChild(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     return mspChildrens.count(pKF);
 }
 
 void KeyFrame::AddLoopEdge(KeyFrame *pKF)
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     mbNotErase = true;
     mspLoopEdges.insert(pKF);
 }
 
 set<KeyFrame*> KeyFrame::GetLoopEdges()
 {
-    unique_lock<mutex> lockCon(mMutexConnections);
+    unique_lock<ProfiledMutex> lockCon(mMutexConnections);
     return mspLoopEdges;
 }
 
 void KeyFrame::SetNotErase()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     mbNotErase = true;
 }
 
 void KeyFrame::SetErase()
 {
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
         if(mspLoopEdges.empty())
         {
             mbNotErase = false;
@@ -490,7 +561,7 @@ void KeyFrame::SetErase()
 void KeyFrame::SetBadFlag()
 {   
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
         if(mnId==0)
             return;
         else if(mbNotErase)
@@ -507,8 +578,8 @@ void KeyFrame::SetBadFlag()
         if(mvpMapPoints[i])
             mvpMapPoints[i]->EraseObservation(this);
     {
-        unique_lock<mutex> lock(mMutexConnections);
-        unique_lock<mutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
 
         mConnectedKeyFrameWeights.clear();
         mvpOrderedConnectedKeyFrames.clear();
@@ -583,7 +654,7 @@ void KeyFrame::SetBadFlag()
 
 bool KeyFrame::isBad()
 {
-    unique_lock<mutex> lock(mMutexConnections);
+    unique_lock<ProfiledMutex> lock(mMutexConnections);
     return mbBad;
 }
 
@@ -591,7 +662,7 @@ void KeyFrame::EraseConnection(KeyFrame* pKF)
 {
     bool bUpdate = false;
     {
-        unique_lock<mutex> lock(mMutexConnections);
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
         if(mConnectedKeyFrameWeights.count(pKF))
         {
             mConnectedKeyFrameWeights.erase(pKF);
@@ -648,25 +719,23 @@ vector<size_t> KeyFrame::GetLinesInArea(const float &x1, const float &y1, const
 {
     vector<size_t> vIndices;
 
-    vector<KeyLine> vkl = this->mvKeyLines;
-
     float delta1x = x1-x2;
     float delta1y = y1-y2;
     float norm_delta1 = sqrt(delta1x*delta1x + delta1y*delta1y);
     delta1x /= norm_delta1;
     delta1y /= norm_delta1;
 
-    for(size_t i=0; i<vkl.size(); i++)
+    for(size_t i=0; i<mvKeyLines.size(); i++)
     {
-        KeyLine keyline = vkl[i];
+        const KeyLine keyline = mvKeyLines[i];
 
         // 1.对比中点距离
         float distance = (0.5*(x1+x2)-keyline.pt.x)*(0.5*(x1+x2)-keyline.pt.x)+(0.5*(y1+y2)-keyline.pt.y)*(0.5*(y1+y2)-keyline.pt.y);
         if(distance > r*r)
             continue;
 
-        float delta2x = vkl[i].startPointX - vkl[i].endPointX;
-        float delta2y = vkl[i].startPointY - vkl[i].endPointY;
+        float delta2x = keyline.startPointX - keyline.endPointX;
+        float delta2y = keyline.startPointY - keyline.endPointY;
         float norm_delta2 = sqrt(delta2x*delta2x + delta2y*delta2y);
         delta2x /= norm_delta2;
         delta2y /= norm_delta2;
@@ -767,13 +836,14 @@ cv::Mat KeyFrame::UnprojectStereo(int i)
     const float z = mvDepth[i];
     if(z>0)
     {
-        const float u = mvKeys[i].pt.x;
-        const float v = mvKeys[i].pt.y;
+        const cv::KeyPoint kp = mvKeys.empty() ? mvKeysUn[i] : mvKeys[i];
+        const float u = kp.pt.x;
+        const float v = kp.pt.y;
         const float x = (u-cx)*z*invfx;
         const float y = (v-cy)*z*invfy;
         cv::Mat x3Dc = (cv::Mat_<float>(3,1) << x, y, z);
 
-        unique_lock<mutex> lock(mMutexPose);
+        unique_lock<ProfiledMutex> lock(mMutexPose);
         return Twc.rowRange(0,3).colRange(0,3)*x3Dc+Twc.rowRange(0,3).col(3);
     }
     else
@@ -790,8 +860,8 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
     vector<MapPoint*> vpMapPoints;
     cv::Mat Tcw_;
     {
-        unique_lock<mutex> lock(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPose);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPose);
         vpMapPoints = mvpMapPoints;
         Tcw_ = Tcw.clone();
     }
@@ -803,30 +873,180 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
     float zcw = Tcw_.at<float>(2,3);
     for(int i=0; i<N; i++)
     {
-        if(mvpMapPoints[i])
+        if(vpMapPoints[i])
         {
-            MapPoint* pMP = mvpMapPoints[i];
+            MapPoint* pMP = vpMapPoints[i];
             cv::Mat x3Dw = pMP->GetWorldPos();
             float z = Rcw2.dot(x3Dw)+zcw;
             vDepths.push_back(z);
         }
     }
 
+    // No map points yet (keyframe of a rig camera)
+    if(vDepths.empty())
+        return -1;
+
     sort(vDepths.begin(),vDepths.end());
 
     return vDepths[(vDepths.size()-1)/q];
 }
 
+float KeyFrame::GetSceneMedianDepth()
+{
+    unique_lock<ProfiledMutex> lock(mMutexSceneDepth);
+    if(mbSceneDepthStale)
+        RebuildSceneDepth();
+
+    // No map points yet (keyframe of a rig camera)
+    if(mnSceneDepthSamples==0)
+        return -1;
+
+    // Same rank as ComputeSceneMedianDepth(2), interpolated inside its bin
+    const int nRank = (mnSceneDepthSamples-1)/2;
+    int nBefore = 0;
+    for(int bin=0; bin<SCENE_DEPTH_BINS; bin++)
+    {
+        const int n = mvnSceneDepthHistogram[bin];
+        if(nBefore+n>nRank)
+            return exp(SCENE_DEPTH_LOG_MIN+(bin+(nRank-nBefore+0.5f)/n)*SCENE_DEPTH_BIN_WIDTH);
+        nBefore += n;
+    }
+
+    return -1;
+}
+
+void KeyFrame::InsertSceneDepth(const size_t &idx, MapPoint* pMP)
+{
+    // The whole histogram is rebuilt anyway
+    {
+        unique_lock<ProfiledMutex> lock(mMutexSceneDepth);
+        if(mbSceneDepthStale)
+            return;
+    }
+
+    float r0, r1, r2, tz;
+    {
+        unique_lock<ProfiledMutex> lock(mMutexPose);
+        r0 = Tcw.at<float>(2,0);
+        r1 = Tcw.at<float>(2,1);
+        r2 = Tcw.at<float>(2,2);
+        tz = Tcw.at<float>(2,3);
+    }
+    const cv::Mat x3Dw = pMP->GetWorldPos();
+    const int bin = SceneDepthBin(r0*x3Dw.at<float>(0)+r1*x3Dw.at<float>(1)+r2*x3Dw.at<float>(2)+tz);
+
+    // A pose change in between made the histogram stale
+    unique_lock<ProfiledMutex> lock(mMutexSceneDepth);
+    if(mbSceneDepthStale)
+        return;
+
+    if(mvnSceneDepthBin[idx]>=0)
+    {
+        mvnSceneDepthHistogram[mvnSceneDepthBin[idx]]--;
+        mnSceneDepthSamples--;
+    }
+    mvnSceneDepthBin[idx] = bin;
+    mvnSceneDepthHistogram[bin]++;
+    mnSceneDepthSamples++;
+}
+
+void KeyFrame::RemoveSceneDepth(const size_t &idx)
+{
+    unique_lock<ProfiledMutex> lock(mMutexSceneDepth);
+    if(mbSceneDepthStale || mvnSceneDepthBin[idx]<0)
+        return;
+
+    mvnSceneDepthHistogram[mvnSceneDepthBin[idx]]--;
+    mnSceneDepthSamples--;
+    mvnSceneDepthBin[idx] = -1;
+}
+
+// mMutexSceneDepth must be held by the caller. The MapPoints that moved since their insertion (e.g. by a BA that kept
+// this keyframe fixed) are only updated here, the histogram is approximate.
+void KeyFrame::RebuildSceneDepth()
+{
+    const cv::Mat Tcw_ = GetPose();
+    const float r0 = Tcw_.at<float>(2,0);
+    const float r1 = Tcw_.at<float>(2,1);
+    const float r2 = Tcw_.at<float>(2,2);
+    const float tz = Tcw_.at<float>(2,3);
+
+    fill(mvnSceneDepthHistogram.begin(),mvnSceneDepthHistogram.end(),0);
+    fill(mvnSceneDepthBin.begin(),mvnSceneDepthBin.end(),-1);
+    mnSceneDepthSamples = 0;
+
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
+    for(int i=0; i<N; i++)
+    {
+        MapPoint* pMP = mvpMapPoints[i];
+        if(!pMP)
+            continue;
+        const cv::Mat x3Dw = pMP->GetWorldPos();
+        const int bin = SceneDepthBin(r0*x3Dw.at<float>(0)+r1*x3Dw.at<float>(1)+r2*x3Dw.at<float>(2)+tz);
+        mvnSceneDepthBin[i] = bin;
+        mvnSceneDepthHistogram[bin]++;
+        mnSceneDepthSamples++;
+    }
+
+    mbSceneDepthStale = false;
+}
+
+void KeyFrame::AddMemoryUsage(MemoryReport &report)
+{
+    // Map nodes are counted as the value plus the 3 pointers and color of a red-black tree node
+    const size_t nodeBytes = 4*sizeof(void*);
+    size_t nGraph = 0;
+    {
+        // The BoW vectors are set by LocalMapping after the keyframe is in the map
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+
+        report.mvBytes[MemoryReport::KEYFRAME_IMAGES] += ImageGray.total()*ImageGray.elemSize();
+
+        size_t nFeatures = mFeatures.MemoryUsage() + mvKeys.capacity()*sizeof(cv::KeyPoint) +
+                           (mvuRight.capacity()+mvDepth.capacity())*sizeof(float);
+        nFeatures += mBowVec.size()*(sizeof(DBoW2::BowVector::value_type)+nodeBytes);
+        for(DBoW2::FeatureVector::const_iterator fit=mFeatVec.begin(), fend=mFeatVec.end(); fit!=fend; fit++)
+            nFeatures += sizeof(DBoW2::FeatureVector::value_type)+nodeBytes + fit->second.capacity()*sizeof(unsigned int);
+        report.mvBytes[MemoryReport::KEYFRAME_FEATURES] += nFeatures;
+
+        size_t nGrids = 0;
+        for(size_t i=0; i<mGrid.size(); i++)
+            for(size_t j=0; j<mGrid[i].size(); j++)
+                nGrids += sizeof(vector<size_t>) + mGrid[i][j].capacity()*sizeof(size_t);
+        for(size_t i=0; i<mGridForLine.size(); i++)
+            for(size_t j=0; j<mGridForLine[i].size(); j++)
+                nGrids += sizeof(vector<size_t>) + mGridForLine[i][j].capacity()*sizeof(size_t);
+        report.mvBytes[MemoryReport::KEYFRAME_GRIDS] += nGrids;
+
+        nGraph += mvpMapPoints.capacity()*sizeof(MapPoint*) + mvpMapLines.capacity()*sizeof(MapLine*);
+    }
+    {
+        unique_lock<ProfiledMutex> lock(mMutexRedundancy);
+        nGraph += (mvnPointRedundancy.capacity()+mvnLineRedundancy.capacity())*sizeof(int);
+    }
+    {
+        unique_lock<ProfiledMutex> lock(mMutexSceneDepth);
+        nGraph += mvnSceneDepthBin.capacity()*sizeof(short) + mvnSceneDepthHistogram.capacity()*sizeof(int);
+    }
+    {
+        unique_lock<ProfiledMutex> lock(mMutexConnections);
+        nGraph += mConnectedKeyFrameWeights.size()*(sizeof(pair<KeyFrame*,int>)+nodeBytes) +
+                  mvpOrderedConnectedKeyFrames.capacity()*sizeof(KeyFrame*) + mvOrderedWeights.capacity()*sizeof(int) +
+                  (mspChildrens.size()+mspLoopEdges.size())*(sizeof(KeyFrame*)+nodeBytes);
+    }
+    report.mvBytes[MemoryReport::KEYFRAME_GRAPH] += sizeof(KeyFrame) + nGraph;
+}
+
     //针对自己添加的MapLine相关的函数
     void KeyFrame::AddMapLine(MapLine *pML, const size_t &idx)
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         mvpMapLines[idx]=pML;
     }
 
     void KeyFrame::EraseMapLineMatch(const size_t &idx)
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         mvpMapLines[idx]= static_cast<MapLine*>(NULL);
     }
 
@@ -844,7 +1064,7 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
 
     set<MapLine*> KeyFrame::GetMapLines()
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         set<MapLine*> s;
         for(size_t i=0, iend=mvpMapLines.size(); i<iend; i++)
         {
@@ -859,13 +1079,13 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
 
     vector<MapLine*> KeyFrame::GetMapLineMatches()
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         return mvpMapLines;
     }
 
     int KeyFrame::TrackedMapLines(const int &minObs)
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
 
         int nLines = 0;
         const bool bCheckObs = minObs>0;
@@ -891,10 +1111,86 @@ float KeyFrame::ComputeSceneMedianDepth(const int q)
 
     MapLine* KeyFrame::GetMapLine(const size_t &idx)
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         return mvpMapLines[idx];
     }
 
+    void KeyFrame::SetPointRedundancy(const size_t &idx, const int &n)
+    {
+        unique_lock<ProfiledMutex> lock(mMutexRedundancy);
+        ChangePointRedundancy(idx, n);
+    }
+
+    void KeyFrame::IncreasePointRedundancy(const size_t &idx, const int &n)
+    {
+        unique_lock<ProfiledMutex> lock(mMutexRedundancy);
+        if(mvnPointRedundancy[idx]<0)
+            return;
+        ChangePointRedundancy(idx, mvnPointRedundancy[idx]+n);
+    }
+
+    void KeyFrame::SetLineRedundancy(const size_t &idx, const int &n)
+    {
+        unique_lock<ProfiledMutex> lock(mMutexRedundancy);
+        ChangeLineRedundancy(idx, n);
+    }
+
+    void KeyFrame::IncreaseLineRedundancy(const size_t &idx, const int &n)
+    {
+        unique_lock<ProfiledMutex> lock(mMutexRedundancy);
+        if(mvnLineRedundancy[idx]<0)
+            return;
+        ChangeLineRedundancy(idx, mvnLineRedundancy[idx]+n);
+    }
+
+    // mMutexRedundancy must be held by the caller
+    void KeyFrame::ChangePointRedundancy(const size_t &idx, const int &n)
+    {
+        const int nBefore = mvnPointRedundancy[idx];
+        const int dObserved = (n>=0) - (nBefore>=0);
+        const int dRedundant = (n>=nRedundancyTh) - (nBefore>=nRedundancyTh);
+
+        mnObservedPoints += dObserved;
+        mnRedundantPoints += dRedundant;
+
+        // Only close stereo points are considered for stereo/RGB-D culling
+        if(mvDepth[idx]>=0 && mvDepth[idx]<=mThDepth)
+        {
+            mnObservedClosePoints += dObserved;
+            mnRedundantClosePoints += dRedundant;
+        }
+
+        mvnPointRedundancy[idx] = n;
+    }
+
+    // mMutexRedundancy must be held by the caller
+    void KeyFrame::ChangeLineRedundancy(const size_t &idx, const int &n)
+    {
+        const int nBefore = mvnLineRedundancy[idx];
+        mnObservedLines += (n>=0) - (nBefore>=0);
+        mnRedundantLines += (n>=nRedundancyTh) - (nBefore>=nRedundancyTh);
+        mvnLineRedundancy[idx] = n;
+    }
+
+    int KeyFrame::RedundantMapPoints(int &nMPs, const bool bOnlyClose)
+    {
+        unique_lock<ProfiledMutex> lock(mMutexRedundancy);
+        if(bOnlyClose)
+        {
+            nMPs = mnObservedClosePoints;
+            return mnRedundantClosePoints;
+        }
+        nMPs = mnObservedPoints;
+        return mnRedundantPoints;
+    }
+
+    int KeyFrame::RedundantMapLines(int &nMLs)
+    {
+        unique_lock<ProfiledMutex> lock(mMutexRedundancy);
+        nMLs = mnObservedLines;
+        return mnRedundantLines;
+    }
+
     void KeyFrame::lineDescriptorMAD(vector<vector<DMatch>> line_matches, double &nn_mad, double &nn12_mad) const
     {
         vector<vector<DMatch>> matches_nn, matches_12;
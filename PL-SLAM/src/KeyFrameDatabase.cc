@@ -24,6 +24,7 @@
 #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
 
 #include<mutex>
+#include<unordered_map>
 
 using namespace std;
 
@@ -39,7 +40,7 @@ KeyFrameDatabase::KeyFrameDatabase (const ORBVocabulary &voc):
 
 void KeyFrameDatabase::add(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutex);
+    unique_lock<ProfiledMutex> lock(mMutex);
 
     for(DBoW2::BowVector::const_iterator vit= pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
         mvInvertedFile[vit->first].push_back(pKF);
@@ -47,7 +48,7 @@ void KeyFrameDatabase::add(KeyFrame *pKF)
 
 void KeyFrameDatabase::erase(KeyFrame* pKF)
 {
-    unique_lock<mutex> lock(mMutex);
+    unique_lock<ProfiledMutex> lock(mMutex);
 
     // Erase elements in the Inverse File for the entry
     for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
@@ -72,6 +73,55 @@ void KeyFrameDatabase::clear()
     mvInvertedFile.resize(mpVoc->size());
 }
 
+vector<KeyFrame*> KeyFrameDatabase::GetKeyFramesSharingWords(KeyFrame* pKF, const float minRatio)
+{
+    // Discard keyframes connected to the query keyframe before taking the largest number of common words,
+    // as in DetectLoopCandidates: they share most words with pKF and would raise the threshold for the others
+    set<KeyFrame*> spConnectedKeyFrames = pKF->GetConnectedKeyFrames();
+    spConnectedKeyFrames.insert(pKF);
+
+    unordered_map<KeyFrame*,int> mCommonWords;
+    {
+        unique_lock<ProfiledMutex> lock(mMutex);
+
+        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
+        {
+            const list<KeyFrame*> &lKFs = mvInvertedFile[vit->first];
+            for(list<KeyFrame*>::const_iterator lit=lKFs.begin(), lend=lKFs.end(); lit!=lend; lit++)
+            {
+                if(!spConnectedKeyFrames.count(*lit))
+                    mCommonWords[*lit]++;
+            }
+        }
+    }
+
+    int maxCommonWords=0;
+    for(unordered_map<KeyFrame*,int>::const_iterator mit=mCommonWords.begin(), mend=mCommonWords.end(); mit!=mend; mit++)
+        maxCommonWords = max(maxCommonWords,mit->second);
+
+    const int minCommonWords = maxCommonWords*minRatio;
+    vector<KeyFrame*> vpKFs;
+    for(unordered_map<KeyFrame*,int>::const_iterator mit=mCommonWords.begin(), mend=mCommonWords.end(); mit!=mend; mit++)
+    {
+        if(mit->second>=minCommonWords)
+            vpKFs.push_back(mit->first);
+    }
+
+    return vpKFs;
+}
+
+size_t KeyFrameDatabase::MemoryUsage()
+{
+    unique_lock<ProfiledMutex> lock(mMutex);
+
+    // List nodes hold the value and two pointers
+    size_t nEntries = 0;
+    for(size_t i=0; i<mvInvertedFile.size(); i++)
+        nEntries += mvInvertedFile[i].size();
+
+    return mvInvertedFile.capacity()*sizeof(list<KeyFrame*>) + nEntries*(sizeof(KeyFrame*)+2*sizeof(void*));
+}
+
 
 vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float minScore)
 {
@@ -81,7 +131,7 @@ vector<KeyFrame*> KeyFrameDatabase::DetectLoopCandidates(KeyFrame* pKF, float mi
     // Search all keyframes that share a word with current keyframes
     // Discard keyframes connected to the query keyframe
     {
-        unique_lock<mutex> lock(mMutex);
+        unique_lock<ProfiledMutex> lock(mMutex);
 
         for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit != vend; vit++)
         {
@@ -202,7 +252,7 @@ vector<KeyFrame*> KeyFrameDatabase::DetectRelocalizationCandidates(Frame *F)
 
     // Search all keyframes that share a word with current frame
     {
-        unique_lock<mutex> lock(mMutex);
+        unique_lock<ProfiledMutex> lock(mMutex);
 
         for(DBoW2::BowVector::const_iterator vit=F->mBowVec.begin(), vend=F->mBowVec.end(); vit != vend; vit++)
         {
@@ -0,0 +1,199 @@
+#include "KeyFrameFeatures.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace cv::line_descriptor;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+const float FIXED_SCALE = 8.0f;
+const float INV_FIXED_SCALE = 1.0f/FIXED_SCALE;
+const float ANGLE_TO_BYTE_DEG = 256.0f/360.0f;
+const float ANGLE_TO_BYTE_RAD = 256.0f/(2.0f*CV_PI);
+
+inline short ToFixed(const float &v)
+{
+    return static_cast<short>(max(-32768.0f,min(32767.0f,floor(v*FIXED_SCALE+0.5f))));
+}
+
+inline unsigned short ToFixedUnsigned(const float &v)
+{
+    return static_cast<unsigned short>(max(0.0f,min(65535.0f,floor(v*FIXED_SCALE+0.5f))));
+}
+
+inline unsigned char ToOctave(const int &octave)
+{
+    return static_cast<unsigned char>(max(0,min(255,octave)));
+}
+
+// Align offsets in the block to 8 bytes
+inline size_t Align(const size_t &offset)
+{
+    return (offset+7) & ~static_cast<size_t>(7);
+}
+}
+
+cv::KeyPoint CompactKeyPoints::operator[](const size_t &i) const
+{
+    const PackedKeyPoint &pk = mpKeys[i];
+    return cv::KeyPoint(pk.x*INV_FIXED_SCALE, pk.y*INV_FIXED_SCALE, pk.size*INV_FIXED_SCALE,
+                        pk.angle/ANGLE_TO_BYTE_DEG, 0, pk.octave);
+}
+
+vector<cv::KeyPoint> CompactKeyPoints::ToVector() const
+{
+    vector<cv::KeyPoint> vKeys;
+    vKeys.reserve(mN);
+    for(size_t i=0; i<mN; i++)
+        vKeys.push_back((*this)[i]);
+    return vKeys;
+}
+
+KeyLine CompactKeyLines::operator[](const size_t &i) const
+{
+    const PackedKeyLine &pl = mpLines[i];
+    KeyLine kl;
+    kl.startPointX = pl.sx*INV_FIXED_SCALE;
+    kl.startPointY = pl.sy*INV_FIXED_SCALE;
+    kl.endPointX = pl.ex*INV_FIXED_SCALE;
+    kl.endPointY = pl.ey*INV_FIXED_SCALE;
+    kl.sPointInOctaveX = pl.osx*INV_FIXED_SCALE;
+    kl.sPointInOctaveY = pl.osy*INV_FIXED_SCALE;
+    kl.ePointInOctaveX = pl.oex*INV_FIXED_SCALE;
+    kl.ePointInOctaveY = pl.oey*INV_FIXED_SCALE;
+    kl.pt = cv::Point2f(0.5f*(kl.startPointX+kl.endPointX), 0.5f*(kl.startPointY+kl.endPointY));
+    kl.lineLength = pl.length*INV_FIXED_SCALE;
+    kl.angle = pl.angle/ANGLE_TO_BYTE_RAD;
+    if(kl.angle>CV_PI)
+        kl.angle -= 2.0f*CV_PI;
+    kl.octave = pl.octave;
+    kl.class_id = i;
+    // Not stored
+    kl.response = 0;
+    kl.size = 0;
+    kl.numOfPixels = 0;
+    return kl;
+}
+
+vector<KeyLine> CompactKeyLines::ToVector() const
+{
+    vector<KeyLine> vKeyLines;
+    vKeyLines.reserve(mN);
+    for(size_t i=0; i<mN; i++)
+        vKeyLines.push_back((*this)[i]);
+    return vKeyLines;
+}
+
+Eigen::Vector3d CompactKeyLineFunctions::operator[](const size_t &i) const
+{
+    // Same computation as LINEextractor, on the stored endpoints
+    const PackedKeyLine &pl = mpLines[i];
+    const Eigen::Vector3d sp(pl.sx*INV_FIXED_SCALE, pl.sy*INV_FIXED_SCALE, 1.0);
+    const Eigen::Vector3d ep(pl.ex*INV_FIXED_SCALE, pl.ey*INV_FIXED_SCALE, 1.0);
+    Eigen::Vector3d lineV = sp.cross(ep);
+    lineV = lineV / sqrt(lineV(0)*lineV(0)+lineV(1)*lineV(1));
+    return lineV;
+}
+
+vector<Eigen::Vector3d> CompactKeyLineFunctions::ToVector() const
+{
+    vector<Eigen::Vector3d> vFunctions;
+    vFunctions.reserve(mN);
+    for(size_t i=0; i<mN; i++)
+        vFunctions.push_back((*this)[i]);
+    return vFunctions;
+}
+
+KeyFrameFeatures::KeyFrameFeatures(const vector<cv::KeyPoint> &vKeysUn, const cv::Mat &descriptors,
+                                   const vector<KeyLine> &vKeyLines, const cv::Mat &lineDescriptors):
+    mN(vKeysUn.size()), mNL(vKeyLines.size()), mnDescRows(descriptors.rows), mnDescCols(descriptors.cols),
+    mnDescType(descriptors.type()), mnLineDescRows(lineDescriptors.rows), mnLineDescCols(lineDescriptors.cols),
+    mnLineDescType(lineDescriptors.type())
+{
+    const size_t descBytes = descriptors.empty() ? 0 : descriptors.rows*descriptors.cols*descriptors.elemSize();
+    const size_t lineDescBytes = lineDescriptors.empty() ? 0 : lineDescriptors.rows*lineDescriptors.cols*lineDescriptors.elemSize();
+
+    // Layout: [ORB descriptors][line descriptors][keypoints][keylines]
+    mnLineDescOffset = Align(descBytes);
+    mnKeysOffset = Align(mnLineDescOffset+lineDescBytes);
+    mnLinesOffset = Align(mnKeysOffset+mN*sizeof(PackedKeyPoint));
+    mBlock.resize(mnLinesOffset+mNL*sizeof(PackedKeyLine));
+
+    if(descBytes>0)
+    {
+        cv::Mat dst(descriptors.rows, descriptors.cols, descriptors.type(), &mBlock[0]);
+        descriptors.copyTo(dst);
+    }
+
+    if(lineDescBytes>0)
+    {
+        cv::Mat dst(lineDescriptors.rows, lineDescriptors.cols, lineDescriptors.type(), &mBlock[mnLineDescOffset]);
+        lineDescriptors.copyTo(dst);
+    }
+
+    PackedKeyPoint* pKeys = reinterpret_cast<PackedKeyPoint*>(mBlock.data()+mnKeysOffset);
+    for(int i=0; i<mN; i++)
+    {
+        const cv::KeyPoint &kp = vKeysUn[i];
+        float angle = kp.angle<0 ? 0 : kp.angle*ANGLE_TO_BYTE_DEG;
+        pKeys[i].x = ToFixed(kp.pt.x);
+        pKeys[i].y = ToFixed(kp.pt.y);
+        pKeys[i].size = ToFixedUnsigned(kp.size);
+        pKeys[i].octave = ToOctave(kp.octave);
+        pKeys[i].angle = static_cast<unsigned char>(static_cast<int>(floor(angle+0.5f)) & 255);
+    }
+
+    PackedKeyLine* pLines = reinterpret_cast<PackedKeyLine*>(mBlock.data()+mnLinesOffset);
+    for(int i=0; i<mNL; i++)
+    {
+        const KeyLine &kl = vKeyLines[i];
+        float angle = kl.angle<0 ? kl.angle+2.0f*CV_PI : kl.angle;
+        pLines[i].sx = ToFixed(kl.startPointX);
+        pLines[i].sy = ToFixed(kl.startPointY);
+        pLines[i].ex = ToFixed(kl.endPointX);
+        pLines[i].ey = ToFixed(kl.endPointY);
+        pLines[i].osx = ToFixed(kl.sPointInOctaveX);
+        pLines[i].osy = ToFixed(kl.sPointInOctaveY);
+        pLines[i].oex = ToFixed(kl.ePointInOctaveX);
+        pLines[i].oey = ToFixed(kl.ePointInOctaveY);
+        pLines[i].length = ToFixedUnsigned(kl.lineLength);
+        pLines[i].octave = ToOctave(kl.octave);
+        pLines[i].angle = static_cast<unsigned char>(static_cast<int>(floor(angle*ANGLE_TO_BYTE_RAD+0.5f)) & 255);
+    }
+}
+
+CompactKeyPoints KeyFrameFeatures::KeyPoints() const
+{
+    return CompactKeyPoints(reinterpret_cast<const PackedKeyPoint*>(mBlock.data()+mnKeysOffset), mN);
+}
+
+CompactKeyLines KeyFrameFeatures::KeyLines() const
+{
+    return CompactKeyLines(reinterpret_cast<const PackedKeyLine*>(mBlock.data()+mnLinesOffset), mNL);
+}
+
+CompactKeyLineFunctions KeyFrameFeatures::KeyLineFunctions() const
+{
+    return CompactKeyLineFunctions(reinterpret_cast<const PackedKeyLine*>(mBlock.data()+mnLinesOffset), mNL);
+}
+
+cv::Mat KeyFrameFeatures::Descriptors() const
+{
+    if(mnDescRows==0 || mnDescCols==0)
+        return cv::Mat();
+    return cv::Mat(mnDescRows, mnDescCols, mnDescType, const_cast<unsigned char*>(mBlock.data()));
+}
+
+cv::Mat KeyFrameFeatures::LineDescriptors() const
+{
+    if(mnLineDescRows==0 || mnLineDescCols==0)
+        return cv::Mat();
+    return cv::Mat(mnLineDescRows, mnLineDescCols, mnLineDescType, const_cast<unsigned char*>(mBlock.data()+mnLineDescOffset));
+}
+
+} //namespace ORB_SLAM
@@ -32,6 +32,8 @@ namespace ORB_SLAM2
         
         int nmatches = 0;
 
+        RotationHistogram rotHist(HISTO_LENGTH);
+
         thread thread12(&LSDmatcher::FrameBFMatch, this, ldesc1, ldesc2, std :: ref(tempMatches1), TH_LOW);
         thread thread21(&LSDmatcher::FrameBFMatch, this, ldesc2, ldesc1, std :: ref(tempMatches2), TH_LOW);
         thread12.join();
@@ -47,6 +49,9 @@ namespace ORB_SLAM2
                     if(!mapLine)
                         continue;
                     CurrentFrame.mvpMapLines[j] = mapLine;
+
+                    if(mbCheckOrientation)
+                        rotHist.Add(LineRotation(LastFrame.mvKeylinesUn[i],CurrentFrame.mvKeylinesUn[j]),j);
                 
                     /////////////////////////////////////////////////////////////////////////////////////////////////////
                     cv::Point Point_1, Point_2;
@@ -64,6 +69,17 @@ namespace ORB_SLAM2
             }
         }
 
+        // 根据线段方向变化剔除误匹配
+        if(mbCheckOrientation)
+        {
+            const vector<int> vInconsistent = rotHist.GetInconsistent();
+            for(size_t k=0, kend=vInconsistent.size(); k<kend; k++)
+            {
+                CurrentFrame.mvpMapLines[vInconsistent[k]]=static_cast<MapLine*>(NULL);
+                nmatches--;
+            }
+        }
+
         cv::imwrite("./matchResultTrack.jpg", pic_Temp);
 
         return nmatches;
@@ -77,10 +93,7 @@ int LSDmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
     pic.copyTo(pic_Temp);
 
     // Rotation Histogram (to check rotation consistency)
-    vector<int> rotHist[HISTO_LENGTH];  //HISTO_LENGTH=30
-    for(int i=0;i<HISTO_LENGTH;i++)
-        rotHist[i].reserve(500);
-    const float factor = 1.0f/HISTO_LENGTH;
+    RotationHistogram rotHist(HISTO_LENGTH);
 
     const cv::Mat Rcw = CurrentFrame.mTcw.rowRange(0,3).colRange(0,3);
     const cv::Mat tcw = CurrentFrame.mTcw.rowRange(0,3).col(3);
@@ -120,7 +133,8 @@ int LSDmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                 if(vIndices2.empty())
                     continue;
 
-                const cv::Mat dML = pML->GetDescriptor();
+                LBDDescriptorBuffer bufferML;
+                const LBDDescriptorView dML = pML->GetDescriptor(bufferML);
 
                 int bestDist = 256;
                 int bestIdx2 = -1;
@@ -132,9 +146,9 @@ int LSDmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                         if(CurrentFrame.mvpMapLines[i2]->Observations()>0)
                             continue;
 
-                    const cv::Mat &d = CurrentFrame.mLdesc.row(i2);
+                    const LBDDescriptorView d = LBDDescriptorView::Row(CurrentFrame.mLdesc,i2);
 
-                    const int dist = DescriptorDistance(dML,d);
+                    const int dist = HammingDistance(dML,d);
 
                     float max_ =  std::max(LastFrame.mvKeylinesUn[i].lineLength , CurrentFrame.mvKeylinesUn[i2].lineLength);
                     float min_ =  std::min(LastFrame.mvKeylinesUn[i].lineLength , CurrentFrame.mvKeylinesUn[i2].lineLength);
@@ -154,6 +168,9 @@ int LSDmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                     CurrentFrame.mvpMapLines[bestIdx2]=pML;
                     nmatches++;
 
+                    if(mbCheckOrientation)
+                        rotHist.Add(LineRotation(LastFrame.mvKeylinesUn[i],CurrentFrame.mvKeylinesUn[bestIdx2]),bestIdx2);
+
                     /////////////////////////////////////////////////////////////////////////////////////////////////////
                     cv::Point Point_1, Point_2;
                     KeyLine line_1 = LastFrame.mvKeylinesUn[i];
@@ -170,52 +187,20 @@ int LSDmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
         }
     }
 
-    cv::imwrite("./matchResultTrack.jpg", pic_Temp);
-
-    return nmatches;
-}
-
-void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3)
-{
-    int max1=0;
-    int max2=0;
-    int max3=0;
-
-    for(int i=0; i<L; i++)
+    //Apply rotation consistency
+    if(mbCheckOrientation)
     {
-        const int s = histo[i].size();
-        if(s>max1)
-        {
-            max3=max2;
-            max2=max1;
-            max1=s;
-            ind3=ind2;
-            ind2=ind1;
-            ind1=i;
-        }
-        else if(s>max2)
+        const vector<int> vInconsistent = rotHist.GetInconsistent();
+        for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
         {
-            max3=max2;
-            max2=s;
-            ind3=ind2;
-            ind2=i;
-        }
-        else if(s>max3)
-        {
-            max3=s;
-            ind3=i;
+            CurrentFrame.mvpMapLines[vInconsistent[j]]=static_cast<MapLine*>(NULL);
+            nmatches--;
         }
     }
 
-    if(max2<0.1f*(float)max1)
-    {
-        ind2=-1;
-        ind3=-1;
-    }
-    else if(max3<0.1f*(float)max1)
-    {
-        ind3=-1;
-    }
+    cv::imwrite("./matchResultTrack.jpg", pic_Temp);
+
+    return nmatches;
 }
 
     int LSDmatcher::SearchByProjection(Frame &F, const std::vector<MapLine *> &vpMapLines, const float th)
@@ -224,6 +209,9 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
 
         const bool bFactor = th!=1.0;
 
+        // 投影线段与匹配线段的方向变化应当一致
+        RotationHistogram rotHist(HISTO_LENGTH);
+
         for(size_t iML=0; iML<vpMapLines.size(); iML++)
         {
             MapLine* pML = vpMapLines[iML];
@@ -256,47 +244,18 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
             if(vIndices.empty())
                 continue;
 
-            const cv::Mat MLdescriptor = pML->GetDescriptor();
-
-            int bestDist=256;
-            int bestLevel= -1;
-            int bestDist2=256;
-            int bestLevel2 = -1;
-            int bestIdx =-1 ;
-
-            for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
-            {
-                const size_t idx = *vit;
-
-                if(F.mvpMapLines[idx])
-                    if(F.mvpMapLines[idx]->Observations()>0)
-                        continue;
-
-                const cv::Mat &d = F.mLdesc.row(idx);
+            LBDDescriptorBuffer bufferML;
+            const LBDDescriptorView MLdescriptor = pML->GetDescriptor(bufferML);
 
-                const int dist = DescriptorDistance(MLdescriptor, d);
-
-                // 根据描述子寻找描述子距离最小和次小的特征点
-                if(dist<bestDist)
-                {
-                    bestDist2 = bestDist;
-                    bestDist = dist;
-                    bestLevel2 = bestLevel;
-                    bestLevel = F.mvKeylinesUn[idx].octave;
-                    bestIdx = idx;
-                }
-                else if(dist < bestDist2)
-                {
-                    bestLevel2 = F.mvKeylinesUn[idx].octave;
-                    bestDist2 = dist;
-                }
-            }
+            // 根据描述子寻找描述子距离最小和次小的特征线
+            const BestMatch best = SearchBestMatch(MLdescriptor, vIndices, F.mLdesc,
+                [&](const size_t idx) { return F.mvpMapLines[idx] && F.mvpMapLines[idx]->Observations()>0; },
+                [&](const size_t idx) { return F.mvKeylinesUn[idx].octave; });
 
             // Apply ratio to second match (only if best and second are in the same scale level)
-            if(bestDist <= TH_HIGH)
+            if(best.Accept(TH_HIGH,mfNNratio))
             {
-                if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
-                    continue;
+                const int bestIdx = best.bestIdx;
 
                 /*KeyLine keyline = F.mvKeylinesUn[bestIdx];
 
@@ -331,6 +290,81 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
 
                 F.mvpMapLines[bestIdx]=pML;
                 nmatches++;
+
+                if(mbCheckOrientation)
+                {
+                    const KeyLine &kl = F.mvKeylinesUn[bestIdx];
+                    rotHist.Add(LineRotation(pML->mTrackProjX1, pML->mTrackProjY1, pML->mTrackProjX2, pML->mTrackProjY2,
+                                             kl.startPointX, kl.startPointY, kl.endPointX, kl.endPointY), bestIdx);
+                }
+            }
+        }
+
+        if(mbCheckOrientation)
+        {
+            const vector<int> vInconsistent = rotHist.GetInconsistent();
+            for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
+            {
+                F.mvpMapLines[vInconsistent[j]]=static_cast<MapLine*>(NULL);
+                nmatches--;
+            }
+        }
+
+        return nmatches;
+    }
+
+    int LSDmatcher::SearchByProjection(KeyFrame *pKF, Frame &CurrentFrame, const float th)
+    {
+        int nmatches = 0;
+
+        RotationHistogram rotHist(HISTO_LENGTH);
+
+        const vector<MapLine*> vpMapLinesKF = pKF->GetMapLineMatches();
+
+        for(size_t i=0; i<vpMapLinesKF.size(); i++)
+        {
+            MapLine* pML = vpMapLinesKF[i];
+            if(!pML || pML->isBad())
+                continue;
+
+            // 投影到当前帧，得到投影端点、预测的尺度和视角
+            if(!CurrentFrame.isInFrustum(pML,0.5))
+                continue;
+
+            const int &nPredictLevel = pML->mnTrackScaleLevel;
+            const float r = th*RadiusByViewingCos(pML->mTrackViewCos);
+
+            vector<size_t> vIndices = CurrentFrame.GetFeaturesInAreaForLine(pML->mTrackProjX1, pML->mTrackProjY1,
+                                                                           pML->mTrackProjX2, pML->mTrackProjY2,
+                                                                           r, nPredictLevel-1, nPredictLevel+1);
+            if(vIndices.empty())
+                continue;
+
+            LBDDescriptorBuffer bufferML;
+            const LBDDescriptorView MLdescriptor = pML->GetDescriptor(bufferML);
+
+            const BestMatch best = SearchBestMatch(MLdescriptor, vIndices, CurrentFrame.mLdesc,
+                [&](const size_t idx) { return CurrentFrame.mvpMapLines[idx]!=static_cast<MapLine*>(NULL); },
+                [&](const size_t idx) { return CurrentFrame.mvKeylinesUn[idx].octave; });
+
+            if(best.Accept(TH_HIGH,mfNNratio))
+            {
+                const int bestIdx = best.bestIdx;
+                CurrentFrame.mvpMapLines[bestIdx]=pML;
+                nmatches++;
+
+                if(mbCheckOrientation)
+                    rotHist.Add(LineRotation(pKF->mvKeyLines[i],CurrentFrame.mvKeylinesUn[bestIdx]),bestIdx);
+            }
+        }
+
+        if(mbCheckOrientation)
+        {
+            const vector<int> vInconsistent = rotHist.GetInconsistent();
+            for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
+            {
+                CurrentFrame.mvpMapLines[vInconsistent[j]]=static_cast<MapLine*>(NULL);
+                nmatches--;
             }
         }
 
@@ -357,6 +391,9 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
         CurrentFrame.lineDescriptorMAD(lmatches, nn_dist_th, nn12_dist_th);
         nn12_dist_th = nn12_dist_th*0.5;
         sort(lmatches.begin(), lmatches.end(), sort_descriptor_by_queryIdx());
+
+        RotationHistogram rotHist(HISTO_LENGTH);
+
         for(int i=0; i<lmatches.size(); i++)
         {
             int qdx = lmatches[i][0].queryIdx;
@@ -366,6 +403,19 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
             {
                 LineMatches[qdx] = tdx;
                 nmatches++;
+
+                if(mbCheckOrientation)
+                    rotHist.Add(LineRotation(InitialFrame.mvKeylinesUn[qdx],CurrentFrame.mvKeylinesUn[tdx]),qdx);
+            }
+        }
+
+        if(mbCheckOrientation)
+        {
+            const vector<int> vInconsistent = rotHist.GetInconsistent();
+            for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
+            {
+                LineMatches[vInconsistent[j]] = -1;
+                nmatches--;
             }
         }
 
@@ -389,6 +439,8 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
         
         int nmatches = 0;
 
+        RotationHistogram rotHist(HISTO_LENGTH);
+
         thread thread12(&LSDmatcher::FrameBFMatch, this, ldesc1, ldesc2, std :: ref(tempMatches1), TH_LOW);
         thread thread21(&LSDmatcher::FrameBFMatch, this, ldesc2, ldesc1, std :: ref(tempMatches2), TH_LOW);
         thread12.join();
@@ -405,10 +457,15 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
                     CurrentFrame.mvpMapLines[i]=pML;
                     nmatches++;
 
+                    // Decoded once from the packed keylines
+                    const KeyLine line_1 = KF->mvKeyLines[j];
+                    const KeyLine &line_2 = CurrentFrame.mvKeylinesUn[i];
+
+                    if(mbCheckOrientation)
+                        rotHist.Add(LineRotation(line_1,line_2),i);
+
                     /////////////////////////////////////////////////////////////////////////////////////////////////////
                     cv::Point Point_1, Point_2;
-                    KeyLine line_1 = KF->mvKeyLines[j];
-                    KeyLine line_2 = CurrentFrame.mvKeylinesUn[i];
                     Point_1.x = (line_1.startPointX + line_1.endPointX)/2.0;
                     Point_1.y = (line_1.startPointY + line_1.endPointY)/2.0;
                     Point_2.x = (line_2.startPointX + line_2.endPointX)/2.0 + CurrentFrame.ImageGray.cols;
@@ -419,6 +476,16 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
             }
         }
 
+        if(mbCheckOrientation)
+        {
+            const vector<int> vInconsistent = rotHist.GetInconsistent();
+            for(size_t k=0, kend=vInconsistent.size(); k<kend; k++)
+            {
+                CurrentFrame.mvpMapLines[vInconsistent[k]]=static_cast<MapLine*>(NULL);
+                nmatches--;
+            }
+        }
+
         cv::imwrite("./matchResultTrack.jpg", pic_Temp);
 
         return nmatches;
@@ -442,6 +509,8 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
         thread12.join();
         thread21.join();
 
+        RotationHistogram rotHist(HISTO_LENGTH);
+
         for(int i = 0; i<tempMatches1.size(); i++)
         {
             int j= tempMatches1[i];
@@ -450,10 +519,23 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
                     tempMatches1[i] = -1;
                 }else{
                     nmatches++;
+
+                    if(mbCheckOrientation)
+                        rotHist.Add(LineRotation(InitialFrame.mvKeylinesUn[i],CurrentFrame.mvKeylinesUn[j]),i);
                 }
             }
         }
 
+        if(mbCheckOrientation)
+        {
+            const vector<int> vInconsistent = rotHist.GetInconsistent();
+            for(size_t k=0, kend=vInconsistent.size(); k<kend; k++)
+            {
+                tempMatches1[vInconsistent[k]] = -1;
+                nmatches--;
+            }
+        }
+
         LineMatches = tempMatches1;
 
         return nmatches;
@@ -651,22 +733,30 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
         nn12_mad = 1.4826 * matches_12[int(matches_12.size()/2)][0].distance;
     }
 
+    // Hamming distance between two LBD descriptors
     int LSDmatcher::DescriptorDistance(const Mat &a, const Mat &b)
     {
-        const int *pa = a.ptr<int32_t>();
-        const int *pb = b.ptr<int32_t>();
+        return HammingDistance(LBDDescriptorView(a),LBDDescriptorView(b));
+    }
 
-        int dist=0;
+    // 线段没有方向（端点顺序可能互换），方向变化以180度为周期，乘2后映射到直方图的360度范围
+    float LSDmatcher::LineRotation(const float &sx1, const float &sy1, const float &ex1, const float &ey1,
+                                   const float &sx2, const float &sy2, const float &ex2, const float &ey2)
+    {
+        const float a1 = atan2(ey1-sy1, ex1-sx1);
+        const float a2 = atan2(ey2-sy2, ex2-sx2);
 
-        for(int i=0; i<8; i++, pa++, pb++)
-        {
-            unsigned  int v = *pa ^ *pb;
-            v = v - ((v >> 1) & 0x55555555);
-            v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-            dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-        }
+        float rot = fmod((a1-a2)*180.0f/PI, 180.0f);
+        if(rot<0.0f)
+            rot+=180.0f;
 
-        return dist;
+        return 2.0f*rot;
+    }
+
+    float LSDmatcher::LineRotation(const KeyLine &kl1, const KeyLine &kl2)
+    {
+        return LineRotation(kl1.startPointX, kl1.startPointY, kl1.endPointX, kl1.endPointY,
+                            kl2.startPointX, kl2.startPointY, kl2.endPointX, kl2.endPointY);
     }
 
     int LSDmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2,
@@ -687,6 +777,8 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
         
         int nmatches = 0;
 
+        RotationHistogram rotHist(HISTO_LENGTH);
+
         thread thread12(&LSDmatcher::FrameBFMatch, this, ldesc1, ldesc2, std :: ref(tempMatches1), TH_LOW);
         thread thread21(&LSDmatcher::FrameBFMatch, this, ldesc2, ldesc1, std :: ref(tempMatches2), TH_LOW);
         thread12.join();
@@ -701,13 +793,18 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
                     if(pKF1->GetMapLine(i) || pKF2->GetMapLine(j))
                         continue;
 
+                    // Decoded once from the packed keylines
+                    const KeyLine line_1 = pKF1->mvKeyLines[i];
+                    const KeyLine line_2 = pKF2->mvKeyLines[j];
+
+                    if(mbCheckOrientation)
+                        rotHist.Add(LineRotation(line_1,line_2),vMatchedPairs.size());
+
                     vMatchedPairs.push_back(make_pair(i, j));
                     nmatches++;
 
                      /////////////////////////////////////////////////////////////////////////////////////////////////////
                     cv::Point Point_1, Point_2;
-                    KeyLine line_1 = pKF1->mvKeyLines[i];
-                    KeyLine line_2 = pKF2->mvKeyLines[j];
                     Point_1.x = (line_1.startPointX + line_1.endPointX)/2.0;
                     Point_1.y = (line_1.startPointY + line_1.endPointY)/2.0;
                     Point_2.x = (line_2.startPointX + line_2.endPointX)/2.0 + pKF2->ImageGray.cols;
@@ -719,6 +816,26 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
             }
         }
 
+        if(mbCheckOrientation)
+        {
+            const vector<int> vInconsistent = rotHist.GetInconsistent();
+            if(!vInconsistent.empty())
+            {
+                vector<bool> vbInconsistent(vMatchedPairs.size(),false);
+                for(size_t k=0, kend=vInconsistent.size(); k<kend; k++)
+                    vbInconsistent[vInconsistent[k]] = true;
+
+                size_t nKept = 0;
+                for(size_t k=0, kend=vMatchedPairs.size(); k<kend; k++)
+                {
+                    if(!vbInconsistent[k])
+                        vMatchedPairs[nKept++] = vMatchedPairs[k];
+                }
+                vMatchedPairs.resize(nKept);
+                nmatches = nKept;
+            }
+        }
+
         cv::imwrite("./matchResultLocalMapping.jpg", pic_Temp);
 
         return nmatches;
@@ -741,6 +858,8 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
         
         int nmatches = 0;
 
+        RotationHistogram rotHist(HISTO_LENGTH);
+
         thread thread12(&LSDmatcher::FrameBFMatch, this, ldesc1, ldesc2, std :: ref(tempMatches1), TH_HIGH);
         thread thread21(&LSDmatcher::FrameBFMatch, this, ldesc2, ldesc1, std :: ref(tempMatches2), TH_HIGH);
         thread12.join();
@@ -759,10 +878,15 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
                 vMatchedPairs[i] = j;
                 nmatches++;
 
+                // Decoded once from the packed keylines
+                const KeyLine line_1 = pKF1->mvKeyLines[i];
+                const KeyLine line_2 = pKF2->mvKeyLines[j];
+
+                if(mbCheckOrientation)
+                    rotHist.Add(LineRotation(line_1,line_2),i);
+
                 /////////////////////////////////////////////////////////////////////////////////////////////////////
                 cv::Point Point_1, Point_2;
-                KeyLine line_1 = pKF1->mvKeyLines[i];
-                KeyLine line_2 = pKF2->mvKeyLines[j];
                 Point_1.x = (line_1.startPointX + line_1.endPointX)/2.0;
                 Point_1.y = (line_1.startPointY + line_1.endPointY)/2.0;
                 Point_2.x = (line_2.startPointX + line_2.endPointX)/2.0 + pKF2->ImageGray.cols;
@@ -772,6 +896,16 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
             }
         }
 
+        if(mbCheckOrientation)
+        {
+            const vector<int> vInconsistent = rotHist.GetInconsistent();
+            for(size_t k=0, kend=vInconsistent.size(); k<kend; k++)
+            {
+                vMatchedPairs[vInconsistent[k]] = -1;
+                nmatches--;
+            }
+        }
+
         cv::imwrite("./matchResultLocalMapping.jpg", pic_Temp);
 
         return nmatches;
@@ -794,14 +928,16 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
         
         int nmatches = 0;
  
-        vector<KeyLine> kls1 = pKF1->mvKeyLines;
-        vector<KeyLine> kls2 = pKF2->mvKeyLines;
-        vector<Eigen::Vector3d> kls1func = pKF1->mvKeyLineFunctions;
-        vector<Eigen::Vector3d> kls2func = pKF2->mvKeyLineFunctions;
+        vector<KeyLine> kls1 = pKF1->mvKeyLines.ToVector();
+        vector<KeyLine> kls2 = pKF2->mvKeyLines.ToVector();
+        vector<Eigen::Vector3d> kls1func = pKF1->mvKeyLineFunctions.ToVector();
+        vector<Eigen::Vector3d> kls2func = pKF2->mvKeyLineFunctions.ToVector();
 
         cv::Mat F21 = ComputeF12(pKF2, pKF1);
         cv::Mat F12 = ComputeF12(pKF1, pKF2);
 
+        RotationHistogram rotHist(HISTO_LENGTH);
+
         thread thread12(&LSDmatcher::FrameBFMatchNew, this, ldesc1, ldesc2, std :: ref(tempMatches1), kls1, kls2, kls2func, F21, TH_LOW);
         thread thread21(&LSDmatcher::FrameBFMatchNew, this, ldesc2, ldesc1, std :: ref(tempMatches2), kls2, kls1, kls1func, F12, TH_LOW);
         thread12.join();
@@ -820,10 +956,13 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
                 vMatchedPairs[i] = j;
                 nmatches++;
 
+                if(mbCheckOrientation)
+                    rotHist.Add(LineRotation(kls1[i],kls2[j]),i);
+
                 /////////////////////////////////////////////////////////////////////////////////////////////////////
                 cv::Point Point_1, Point_2;
-                KeyLine line_1 = pKF1->mvKeyLines[i];
-                KeyLine line_2 = pKF2->mvKeyLines[j];
+                const KeyLine &line_1 = kls1[i];
+                const KeyLine &line_2 = kls2[j];
                 Point_1.x = (line_1.startPointX + line_1.endPointX)/2.0;
                 Point_1.y = (line_1.startPointY + line_1.endPointY)/2.0;
                 Point_2.x = (line_2.startPointX + line_2.endPointX)/2.0 + pKF2->ImageGray.cols;
@@ -833,6 +972,16 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
             }
         }
 
+        if(mbCheckOrientation)
+        {
+            const vector<int> vInconsistent = rotHist.GetInconsistent();
+            for(size_t k=0, kend=vInconsistent.size(); k<kend; k++)
+            {
+                vMatchedPairs[vInconsistent[k]] = -1;
+                nmatches--;
+            }
+        }
+
         cv::imwrite("./matchResultLocalMapping.jpg", pic_Temp);
 
         return nmatches;
@@ -948,7 +1097,8 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
             if(vIndices.empty())
                 continue;
 
-            Mat CurrentLineDesc = pML->mLDescriptor;        //MapLine[i]对应的线特征描述子
+            LBDDescriptorBuffer bufferML;
+            const LBDDescriptorView CurrentLineDesc = pML->GetDescriptor(bufferML);        //MapLine[i]对应的线特征描述子
 
             int bestDist = 256;
             int bestIdx = -1;
@@ -963,11 +1113,9 @@ void LSDmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
                 if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                     continue;
 
-                const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-                if(CurrentLineDesc.empty() || dKF.empty())
+                if(CurrentLineDesc.empty() || pKF->mLineDescriptors.empty())
                     continue;
-                const int dist = DescriptorDistance(CurrentLineDesc,dKF);
+                const int dist = HammingDistance(CurrentLineDesc,LBDDescriptorView::Row(pKF->mLineDescriptors,idx));
 
                  if(dist<bestDist)
                 {
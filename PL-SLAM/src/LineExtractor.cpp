@@ -2,8 +2,28 @@
 #include <opencv2/line_descriptor/descriptor.hpp>
 
 namespace ORB_SLAM2{
-LINEextractor::LINEextractor( int _numOctaves, float _scale, unsigned int _nLSDFeature, double _min_line_length):numOctaves(_numOctaves), scale(_scale), nLSDFeature(_nLSDFeature), min_line_length(_min_line_length)
+LINEextractor::LINEextractor( int _numOctaves, float _scale, unsigned int _nLSDFeature, double _min_line_length, int _detector):numOctaves(_numOctaves), scale(_scale), nLSDFeature(_nLSDFeature), min_line_length(_min_line_length), detector(_detector)
 {
+    if(detector==EDLINES)
+    {
+        // EDLines builds its own pyramid with a fixed factor, the scale factors must agree with it
+        if(numOctaves>1 && fabs(scale-sqrt(2.0f))>1e-3)
+        {
+            cerr << "LINEextractor: EDLines uses a scale factor of sqrt(2) between octaves, " << scale << " ignored" << endl;
+            scale = sqrt(2.0f);
+        }
+
+        line_descriptor::BinaryDescriptor::Params params;
+        params.numOfOctave_ = numOctaves;
+        mpEDLines = line_descriptor::BinaryDescriptor::createBinaryDescriptor(params);
+    }
+    else
+    {
+        mpLSD = line_descriptor::LSDDetector::createLSDDetector();
+    }
+
+    mpLBD = line_descriptor::BinaryDescriptor::createBinaryDescriptor();
+
     mvScaleFactor.resize(numOctaves);
     mvLevelSigma2.resize(numOctaves);
     mvScaleFactor[0]=1.0f;
@@ -36,8 +56,18 @@ void LINEextractor::operator()( cv::InputArray _image, cv::InputArray _mask, std
     //assert(mask.type() == CV_8UC1 && !mask.empty());
 
     // detect line feature
-    Ptr<line_descriptor::LSDDetector> lsd = line_descriptor::LSDDetector::createLSDDetector();
-    lsd->detect(image, _keylines, scale, numOctaves, mask);
+    _keylines.clear();
+    if(detector==EDLINES)
+        mpEDLines->detect(image, _keylines, mask);
+    else
+        mpLSD->detect(image, _keylines, scale, numOctaves, mask);
+
+    if(_keylines.empty())
+    {
+        _descriptors.release();
+        _lineVec2d.clear();
+        return;
+    }
 
     // filter lines
     sort(_keylines.begin(), _keylines.end(), sort_lines_by_response());
@@ -74,8 +104,7 @@ void LINEextractor::operator()( cv::InputArray _image, cv::InputArray _mask, std
         descriptors = _descriptors.getMat();
     }
     
-    Ptr<BinaryDescriptor> lbd = BinaryDescriptor::createBinaryDescriptor();
-    lbd->compute(image, _keylines, descriptors);     //计算特征线段的描述子
+    mpLBD->compute(image, _keylines, descriptors);     //计算特征线段的描述子
 
     // 计算特征线段所在直线的系数
     _lineVec2d.clear();
@@ -0,0 +1,154 @@
+#include "LocalMapSnapshot.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "MapLine.h"
+
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+std::atomic<unsigned long> LocalMapSnapshot::nNextMark(1);
+
+LocalMapSnapshot::LocalMapSnapshot(KeyFrame *pKF, const unsigned long nVersion, const int nBigChangeIdx, const eBuilder builder):
+    mnVersion(nVersion), mnBigChangeIdx(nBigChangeIdx), mpKF(pKF)
+{
+    // Same selection as Tracking::UpdateLocalKeyFrames, voted by the map points of the keyframe
+    map<KeyFrame*,int> keyframeCounter;
+    const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
+    for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
+    {
+        MapPoint* pMP = vpMPs[i];
+        if(!pMP || pMP->isBad())
+            continue;
+
+        const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+        for(map<KeyFrame*,size_t>::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
+            keyframeCounter[it->first]++;
+    }
+
+    // A new mark for each build (a keyframe can be built again in localization mode), new objects start with a zero mark
+    const long unsigned int nMark = nNextMark++;
+    const int b = builder;
+
+    mvpKeyFrames.reserve(3*keyframeCounter.size()+1);
+    mvpKeyFrames.push_back(pKF);
+    pKF->mnLocalMapSnapshotForKF[b] = nMark;
+
+    for(map<KeyFrame*,int>::const_iterator it=keyframeCounter.begin(), itEnd=keyframeCounter.end(); it!=itEnd; it++)
+    {
+        KeyFrame* pKFi = it->first;
+        if(pKFi->isBad() || pKFi->mnLocalMapSnapshotForKF[b]==nMark)
+            continue;
+        mvpKeyFrames.push_back(pKFi);
+        pKFi->mnLocalMapSnapshotForKF[b] = nMark;
+    }
+
+    // Neighbors, children and parent of the included keyframes
+    for(size_t i=0; i<mvpKeyFrames.size(); i++)
+    {
+        // Limit the number of keyframes
+        if(mvpKeyFrames.size()>80)
+            break;
+
+        KeyFrame* pKFi = mvpKeyFrames[i];
+
+        const vector<KeyFrame*> vNeighs = pKFi->GetBestCovisibilityKeyFrames(10);
+        for(vector<KeyFrame*>::const_iterator itNeighKF=vNeighs.begin(), itEndNeighKF=vNeighs.end(); itNeighKF!=itEndNeighKF; itNeighKF++)
+        {
+            KeyFrame* pNeighKF = *itNeighKF;
+            if(!pNeighKF->isBad() && pNeighKF->mnLocalMapSnapshotForKF[b]!=nMark)
+            {
+                mvpKeyFrames.push_back(pNeighKF);
+                pNeighKF->mnLocalMapSnapshotForKF[b] = nMark;
+                break;
+            }
+        }
+
+        const set<KeyFrame*> spChilds = pKFi->GetChilds();
+        for(set<KeyFrame*>::const_iterator sit=spChilds.begin(), send=spChilds.end(); sit!=send; sit++)
+        {
+            KeyFrame* pChildKF = *sit;
+            if(!pChildKF->isBad() && pChildKF->mnLocalMapSnapshotForKF[b]!=nMark)
+            {
+                mvpKeyFrames.push_back(pChildKF);
+                pChildKF->mnLocalMapSnapshotForKF[b] = nMark;
+                break;
+            }
+        }
+
+        KeyFrame* pParent = pKFi->GetParent();
+        if(pParent && pParent->mnLocalMapSnapshotForKF[b]!=nMark)
+        {
+            mvpKeyFrames.push_back(pParent);
+            pParent->mnLocalMapSnapshotForKF[b] = nMark;
+        }
+    }
+
+    // Landmarks observed by the local keyframes
+    for(size_t i=0, iend=mvpKeyFrames.size(); i<iend; i++)
+    {
+        KeyFrame* pKFi = mvpKeyFrames[i];
+
+        const vector<MapPoint*> vpKFMPs = pKFi->GetMapPointMatches();
+        for(vector<MapPoint*>::const_iterator itMP=vpKFMPs.begin(), itEndMP=vpKFMPs.end(); itMP!=itEndMP; itMP++)
+        {
+            MapPoint* pMP = *itMP;
+            if(!pMP || pMP->mnLocalMapSnapshotForKF[b]==nMark || pMP->isBad())
+                continue;
+            pMP->mnLocalMapSnapshotForKF[b] = nMark;
+
+            const cv::Mat x3Dw = pMP->GetWorldPos();
+            mvpMapPoints.push_back(pMP);
+            mvPointPos.push_back(cv::Point3f(x3Dw.at<float>(0),x3Dw.at<float>(1),x3Dw.at<float>(2)));
+        }
+
+        const vector<MapLine*> vpKFMLs = pKFi->GetMapLineMatches();
+        for(vector<MapLine*>::const_iterator itML=vpKFMLs.begin(), itEndML=vpKFMLs.end(); itML!=itEndML; itML++)
+        {
+            MapLine* pML = *itML;
+            if(!pML || pML->mnLocalMapSnapshotForKF[b]==nMark || pML->isBad())
+                continue;
+            pML->mnLocalMapSnapshotForKF[b] = nMark;
+
+            const Vector6d pos = pML->GetWorldPos();
+            mvpMapLines.push_back(pML);
+            mvLineStartPos.push_back(cv::Point3f(pos(0),pos(1),pos(2)));
+            mvLineEndPos.push_back(cv::Point3f(pos(3),pos(4),pos(5)));
+        }
+    }
+
+    mvpSortedKeyFrames = mvpKeyFrames;
+    sort(mvpSortedKeyFrames.begin(),mvpSortedKeyFrames.end());
+}
+
+bool LocalMapSnapshot::Contains(KeyFrame *pKF) const
+{
+    return binary_search(mvpSortedKeyFrames.begin(),mvpSortedKeyFrames.end(),pKF);
+}
+
+bool LocalMapSnapshot::MaybeVisible(const cv::Point3f &x3Dw, const cv::Mat &Rcw, const cv::Mat &tcw, const float fx, const float fy,
+                                    const float cx, const float cy, const float minX, const float maxX, const float minY, const float maxY)
+{
+    // Rcw and tcw can be non continuous views of Tcw
+    const float z = Rcw.at<float>(2,0)*x3Dw.x+Rcw.at<float>(2,1)*x3Dw.y+Rcw.at<float>(2,2)*x3Dw.z+tcw.at<float>(2);
+    if(z<=0.0f)
+        return false;
+
+    const float invz = 1.0f/z;
+    const float x = Rcw.at<float>(0,0)*x3Dw.x+Rcw.at<float>(0,1)*x3Dw.y+Rcw.at<float>(0,2)*x3Dw.z+tcw.at<float>(0);
+    const float y = Rcw.at<float>(1,0)*x3Dw.x+Rcw.at<float>(1,1)*x3Dw.y+Rcw.at<float>(1,2)*x3Dw.z+tcw.at<float>(1);
+    const float u = fx*x*invz+cx;
+    const float v = fy*y*invz+cy;
+
+    // Half an image of margin, the cached position may be slightly outdated
+    const float marginX = 0.5f*(maxX-minX);
+    const float marginY = 0.5f*(maxY-minY);
+
+    return u>=minX-marginX && u<=maxX+marginX && v>=minY-marginY && v<=maxY+marginY;
+}
+
+} //namespace ORB_SLAM
@@ -24,6 +24,7 @@
 #include "Optimizer.h"
 
 #include<mutex>
+#include<algorithm>
 
 #define PI 3.1415926
 
@@ -31,8 +32,9 @@ namespace ORB_SLAM2
 {
 
 LocalMapping::LocalMapping(Map *pMap, const float bMonocular):
-    mbMonocular(bMonocular), mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
-    mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true)
+    mnLineNeighborCandidates(0), mbMonocular(bMonocular), mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
+    mbAbortBA(false), mbStopped(false), mbStopRequested(false), mbNotStop(false), mbAcceptKeyFrames(true),
+    mnLocalMapSnapshotVersion(0)
 {
 }
 
@@ -72,6 +74,7 @@ void LocalMapping::Run()
             threadCullLine.join();
 
             // 相机运动过程中与相邻关键帧通过三角化恢复出一些MapPoints
+            SelectTriangulationNeighbors();
             thread threadCreateP(&LocalMapping::CreateNewMapPoints, this);
             //thread threadCreateL(&LocalMapping::CreateNewMapLines, this);
             thread threadCreateL(&LocalMapping::CreateNewMapLinesConstraint, this);
@@ -79,7 +82,8 @@ void LocalMapping::Run()
             threadCreateL.join();
 
             // 已经处理完关键帧队列中最后一个关键帧
-            if(!CheckNewKeyFrames())
+            // The keyframes of a camera rig are queued together, each of them needs its connections
+            if(!CheckNewKeyFrames() || mpCurrentKeyFrame->mpRigKF)
             {
                 // Find more matches in neighbor keyframes and fuse point duplications
                 // 检查并融合当前关键帧与相邻帧（两级相邻）重复的MapPoints,一级重复的MapLines
@@ -103,6 +107,9 @@ void LocalMapping::Run()
                 // Tracking中先把关键帧交给LocalMapping线程，并且在Tracking中InsertKeyFrame函数的条件比较松，交给LocalMapping线程的关键帧会比较密
                 // 在这里再删除冗余的关键帧
                 KeyFrameCulling();
+
+                // 发布当前关键帧的局部地图，Tracking不必每帧重建
+                PublishLocalMapSnapshot();
             }
 
             // 将当前帧插入到闭环检测队列中
@@ -135,7 +142,7 @@ void LocalMapping::Run()
 
 void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexNewKFs);
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
     mlNewKeyFrames.push_back(pKF);
     mbAbortBA=true;
 }
@@ -143,7 +150,7 @@ void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
 
 bool LocalMapping::CheckNewKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexNewKFs);
+    unique_lock<ProfiledMutex> lock(mMutexNewKFs);
     return(!mlNewKeyFrames.empty());
 }
 
@@ -159,7 +166,7 @@ void LocalMapping::ProcessNewKeyFrame()
     // step1：从缓冲队列中取出一帧关键帧
     // Tracking线程向LocalMapping中插入的关键帧在该队列中
     {
-        unique_lock<mutex> lock(mMutexNewKFs);
+        unique_lock<ProfiledMutex> lock(mMutexNewKFs);
         // 从列表中获取一个等待被插入的关键帧
         mpCurrentKeyFrame = mlNewKeyFrames.front();
         mlNewKeyFrames.pop_front();
@@ -324,18 +331,72 @@ void LocalMapping::MapLineCulling()
 }
 
 /**
- * @brief 相机运动过程中和共视程度比较高的关键帧通过三角化恢复出一些MapPoints
+ * @brief 选择用于三角化的相邻关键帧，CreateNewMapPoints和CreateNewMapLinesConstraint共用
+ *
+ * 基线检查只做一次，场景深度中值来自关键帧的深度直方图（不排序）
  */
-void LocalMapping::CreateNewMapPoints()
+void LocalMapping::SelectTriangulationNeighbors()
 {
-    // Retrieve neighbor keyframes in covisibility graph
-    int nn = 10;
-    if(mbMonocular)
-        nn=20;
+    // Retrieve neighbor keyframes in covisibility graph, the lines use the best ones
+    const int nnPoints = mbMonocular ? 20 : 10;
+    const int nnLines = mbMonocular ? 10 : 5;
+
+    // 在当前关键帧的共视关键帧中找到共视程度最高的nn帧相邻帧vpNeighKFs
+    vector<KeyFrame*> vpNeighKFs = mpCurrentKeyFrame->GetBestCovisibilityKeyFrames(nnPoints);
+    const size_t nLineNeighs = min(vpNeighKFs.size(),static_cast<size_t>(nnLines));
+    mnLineNeighborCandidates = nLineNeighs;
+
+    // A rig camera that does not overlap with the others starts its map from its previous keyframe
+    // (the last one not culled)
+    KeyFrame* pPrevRigKF = mpCurrentKeyFrame->mpPrevRigKF;
+    while(pPrevRigKF && pPrevRigKF->isBad())
+        pPrevRigKF = pPrevRigKF->mpPrevRigKF;
+    if(pPrevRigKF && find(vpNeighKFs.begin(),vpNeighKFs.end(),pPrevRigKF)==vpNeighKFs.end())
+        vpNeighKFs.push_back(pPrevRigKF);
 
-    // -step1: 在当前关键帧的共视关键帧中找到共视程度最高的nn帧相邻的vpNeighKFs
-    const vector<KeyFrame*> vpNeighKFs = mpCurrentKeyFrame->GetBestCovisibilityKeyFrames(nn);
+    // 得到当前关键帧在世界坐标系中的坐标
+    const cv::Mat Ow1 = mpCurrentKeyFrame->GetCameraCenter();
+
+    mvTriangulationNeighbors.clear();
+    mvTriangulationNeighbors.reserve(vpNeighKFs.size());
+    for(size_t i=0; i<vpNeighKFs.size(); i++)
+    {
+        KeyFrame* pKF2 = vpNeighKFs[i];
+
+        TriangulationNeighbor neighbor;
+        neighbor.pKF = pKF2;
+        neighbor.Ow = pKF2->GetCameraCenter();  // 邻接关键帧在世界坐标系中的坐标
+        neighbor.bLines = i<nLineNeighs;
+
+        // 邻接关键帧的场景深度中值，单目的基线检查和线段的三角化才用到
+        // Rig keyframe without map points yet, use the scene depth seen by the first camera
+        neighbor.medianDepth = -1;
+        if(mbMonocular || neighbor.bLines)
+        {
+            neighbor.medianDepth = pKF2->GetSceneMedianDepth();
+            if(neighbor.medianDepth<0 && pKF2->mpRigKF)
+                neighbor.medianDepth = pKF2->mpRigKF->GetSceneMedianDepth();
+        }
+
+        // Check first that baseline is not too short
+        const float baseline = cv::norm(neighbor.Ow-Ow1); //基线长度，两个关键帧的位移长度
+        if(!mbMonocular)
+        {
+            if(baseline<pKF2->mb)   //如果是双目相机，关键帧间距太小时，不生成3D点
+                continue;
+        }
+        else if(neighbor.medianDepth<0 || baseline/neighbor.medianDepth<0.01) //如果特别远，则不考虑当前邻接的关键帧
+            continue;
+
+        mvTriangulationNeighbors.push_back(neighbor);
+    }
+}
 
+/**
+ * @brief 相机运动过程中和共视程度比较高的关键帧通过三角化恢复出一些MapPoints
+ */
+void LocalMapping::CreateNewMapPoints()
+{
     ORBmatcher matcher(0.6,false);
 
     cv::Mat Rcw1 = mpCurrentKeyFrame->GetRotation();
@@ -360,33 +421,16 @@ void LocalMapping::CreateNewMapPoints()
     int nnew=0;
 
     // Search matches with epipolar restriction and triangulate
-    // -step2：遍历相邻关键帧vpNeighKFs,根据对极约束寻找匹配对，并且三角化
-    for(size_t i=0; i<vpNeighKFs.size(); i++)
+    // -step2：遍历相邻关键帧（基线已在SelectTriangulationNeighbors中检查）,根据对极约束寻找匹配对，并且三角化
+    for(size_t i=0; i<mvTriangulationNeighbors.size(); i++)
     {
-        if(i>0 && CheckNewKeyFrames())
+        // The keyframes of a rig are queued before the keyframe of camera 0, they are always triangulated with all
+        // their neighbors (the previous keyframe of the camera last)
+        if(i>0 && !mpCurrentKeyFrame->mpRigKF && CheckNewKeyFrames())
             return;
 
-        KeyFrame* pKF2 = vpNeighKFs[i];
-
-        // Check first that baseline is not too short
-        cv::Mat Ow2 = pKF2->GetCameraCenter();  // 邻接关键帧在世界坐标系中的坐标
-        cv::Mat vBaseline = Ow2-Ow1;    //基线向量，两个关键帧间的相机位移
-        const float baseline = cv::norm(vBaseline); //基线长度，两个关键帧的位移长度
-
-        // step3：判断两个关键帧之间的位移是不是足够长，如果太短就没必要计算
-        if(!mbMonocular)
-        {
-            if(baseline<pKF2->mb)   //如果是双目相机，关键帧间距太小时，不生成3D点
-            continue;
-        }
-        else
-        {
-            const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);  //邻接关键帧的场景深度中值
-            const float ratioBaselineDepth = baseline/medianDepthKF2;   //两个关键帧的位移长度与场景深度的比值
-
-            if(ratioBaselineDepth<0.01) //如果特别远，则不考虑当前邻接的关键帧，不生成3D点
-                continue;
-        }
+        KeyFrame* pKF2 = mvTriangulationNeighbors[i].pKF;
+        const cv::Mat &Ow2 = mvTriangulationNeighbors[i].Ow;
 
         // Compute Fundamental Matrix
         // -step4：根据两个关键帧的位姿计算它们之间的基本矩阵
@@ -636,7 +680,7 @@ void LocalMapping::CreateNewMapLines()
     // step2: 遍历相邻关键帧vpNeighKFs
     for(size_t i=0; i<vpNeighKFs.size(); i++)
     {
-        if(i>0 && CheckNewKeyFrames())
+        if(i>0 && !mpCurrentKeyFrame->mpRigKF && CheckNewKeyFrames())
             return;
 
         KeyFrame* pKF2 = vpNeighKFs[i];
@@ -659,7 +703,7 @@ void LocalMapping::CreateNewMapLines()
         else
         {
             // 邻接关键帧的场景深度中值
-            const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
+            const float medianDepthKF2 = pKF2->GetSceneMedianDepth();
             // baseline 与景深的比例
             const float ratioBaselineDepth = baseline/medianDepthKF2;
             // 如果特别远（比例特别小），那么不考虑当前邻接的关键帧，不生成3D点
@@ -810,7 +854,7 @@ void LocalMapping::CreateNewMapLines()
 
             // 判断起始点是否离两个相机中心太近
             // 邻接关键帧的场景深度中值
-            const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
+            const float medianDepthKF2 = pKF2->GetSceneMedianDepth();
             cv::Mat v1 = s3D - Ow1;
             float distance1 = cv::norm(v1);
             const float ratio1 = distance1/medianDepthKF2;
@@ -874,14 +918,19 @@ void LocalMapping::CreateNewMapLines()
 
 void LocalMapping::CreateNewMapLinesConstraint()
 {
-    // Retrieve neighbor keyframes in covisibility graph
-    int nn=5;
-    if(mbMonocular)
-        nn=10;
-    //step1：在当前关键帧的共视关键帧中找到共视成都最高的nn帧相邻帧vpNeighKFs
-    const vector<KeyFrame*> vpNeighKFs = mpCurrentKeyFrame->GetBestCovisibilityKeyFrames(nn);
-    
-    if(vpNeighKFs.size() < 2)
+    //step1：共视程度最高的相邻帧中基线足够长的（SelectTriangulationNeighbors）
+    vector<KeyFrame*> vpNeighKFs;
+    vector<float> vMedianDepths;
+    for(size_t i=0; i<mvTriangulationNeighbors.size(); i++)
+    {
+        if(!mvTriangulationNeighbors[i].bLines)
+            continue;
+        vpNeighKFs.push_back(mvTriangulationNeighbors[i].pKF);
+        vMedianDepths.push_back(mvTriangulationNeighbors[i].medianDepth);
+    }
+
+    // Same as before the neighbors were shared: count the best covisible keyframes before the baseline check
+    if(mnLineNeighborCandidates < 2)
         return;
 
     LSDmatcher lmatcher(0.8);    //建立线特征匹配
@@ -908,6 +957,10 @@ void LocalMapping::CreateNewMapLinesConstraint()
 
     const float ratioFactor = 1.5f*mpCurrentKeyFrame->mfScaleFactorLine;
 
+    // The lines of the current keyframe are used with every pair of neighbors, decoded once
+    const vector<KeyLine> vKeyLines1 = mpCurrentKeyFrame->mvKeyLines.ToVector();
+    const vector<Vector3d> vKeyLineFunctions1 = mpCurrentKeyFrame->mvKeyLineFunctions.ToVector();
+
     int nnew = 0;
 
     // Search matches with epipolar restriction and triangulate
@@ -920,37 +973,11 @@ void LocalMapping::CreateNewMapLinesConstraint()
 
     for(size_t i=0; i<vpNeighKFs.size(); i++)
     {
-        if(i>1 && CheckNewKeyFrames())
+        if(i>1 && !mpCurrentKeyFrame->mpRigKF && CheckNewKeyFrames())
             return;
 
         KeyFrame* pKF2 = vpNeighKFs[i];
 
-        // Check first that baseline is not too short
-        // 邻接的关键帧在世界坐标系中的坐标
-        cv::Mat Ow2 = pKF2->GetCameraCenter();
-        // 基线向量，两个关键帧间的相机位移
-        cv::Mat vBaseline = Ow2 - Ow1;
-        // 基线长度
-        const float baseline = cv::norm(vBaseline);
-
-        // step3：判断相机运动的基线是不是足够长
-        if(!mbMonocular)
-        {
-            // 如果是立体相机，关键帧间距太小时不生成3D点
-            if(baseline<pKF2->mb)
-                continue;
-        }
-        else
-        {
-            // 邻接关键帧的场景深度中值
-            const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
-            // baseline 与景深的比例
-            const float ratioBaselineDepth = baseline/medianDepthKF2;
-            // 如果特别远（比例特别小），那么不考虑当前邻接的关键帧，不生成3D点
-            if(ratioBaselineDepth<0.01)
-                continue;
-        }
-
         // Search matches that fulfill epipolar constraint
         // step5：通过极线约束限制匹配时的搜索单位，进行特征点匹配
         cv::Mat pic = DrawLines(mpCurrentKeyFrame, pKF2);
@@ -1044,10 +1071,10 @@ void LocalMapping::CreateNewMapLinesConstraint()
                 if(mpCurrentKeyFrame->GetMapLine(ikl) || pKF2->GetMapLine(idx1) || pKF3->GetMapLine(idx2))
                     continue;
 
-                const KeyLine &keyline1 = mpCurrentKeyFrame->mvKeyLines[ikl];
+                const KeyLine &keyline1 = vKeyLines1[ikl];
                 const KeyLine &keyline2 = pKF2->mvKeyLines[idx1];
                 const KeyLine &keyline3 = pKF3->mvKeyLines[idx2];
-                const Vector3d keyline1_function = mpCurrentKeyFrame->mvKeyLineFunctions[ikl];
+                const Vector3d &keyline1_function = vKeyLineFunctions1[ikl];
                 const Vector3d keyline2_function = pKF2->mvKeyLineFunctions[idx1];
                 const Vector3d keyline3_function = pKF3->mvKeyLineFunctions[idx2];
                 const Mat klF1 = (Mat_<float>(3,1) << keyline1_function(0),
@@ -1206,7 +1233,7 @@ void LocalMapping::CreateNewMapLinesConstraint()
 
                 // 判断起始点是否离两个相机中心太近
                 // 邻接关键帧的场景深度中值
-                const float medianDepthKF2 = pKF2->ComputeSceneMedianDepth(2);
+                const float medianDepthKF2 = vMedianDepths[i];
                 cv::Mat v1 = s3D - Ow1;
                 float distance1 = cv::norm(v1);
                 const float ratio1 = distance1/medianDepthKF2;
@@ -1759,7 +1786,7 @@ void LocalMapping::RequestStop()
 {
     unique_lock<mutex> lock(mMutexStop);
     mbStopRequested = true;
-    unique_lock<mutex> lock2(mMutexNewKFs);
+    unique_lock<ProfiledMutex> lock2(mMutexNewKFs);
     mbAbortBA = true;
 }
 
@@ -1835,9 +1862,10 @@ void LocalMapping::InterruptBA()
 void LocalMapping::KeyFrameCulling()
 {
     // Check redundant keyframes (only local keyframes)
-    // A keyframe is considered redundant if the 90% of the MapPoints it sees, are seen
+    // A keyframe is considered redundant if the 90% of the MapPoints and MapLines it sees, are seen
     // in at least other 3 keyframes (in the same or finer scale)
     // We only consider close stereo points
+    // The redundancy counters are maintained by MapPoint/MapLine when observations are added or erased
     vector<KeyFrame*> vpLocalKeyFrames = mpCurrentKeyFrame->GetVectorCovisibleKeyFrames();
 
     for(vector<KeyFrame*>::iterator vit=vpLocalKeyFrames.begin(), vend=vpLocalKeyFrames.end(); vit!=vend; vit++)
@@ -1845,59 +1873,57 @@ void LocalMapping::KeyFrameCulling()
         KeyFrame* pKF = *vit;
         if(pKF->mnId==0)
             continue;
-        const vector<MapPoint*> vpMapPoints = pKF->GetMapPointMatches();
 
-        int nObs = 3;
-        const int thObs=nObs;
-        int nRedundantObservations=0;
-        int nMPs=0;
-        for(size_t i=0, iend=vpMapPoints.size(); i<iend; i++)
+        // The keyframe of the first camera of a rig carries the pose of the keyframes of the other cameras: they are
+        // culled together, on the landmarks seen by all of them
+        if(pKF->mpRigKF || pKF==mpCurrentKeyFrame->mpRigKF)
+            continue;
+
+        int nMPs=0, nMLs=0;
+        int nRedundantPoints = pKF->RedundantMapPoints(nMPs,!mbMonocular);
+        int nRedundantLines = pKF->RedundantMapLines(nMLs);
+        for(size_t i=0; i<pKF->mvpRigKFs.size(); i++)
         {
-            MapPoint* pMP = vpMapPoints[i];
-            if(pMP)
-            {
-                if(!pMP->isBad())
-                {
-                    if(!mbMonocular)
-                    {
-                        if(pKF->mvDepth[i]>pKF->mThDepth || pKF->mvDepth[i]<0)
-                            continue;
-                    }
-
-                    nMPs++;
-                    if(pMP->Observations()>thObs)
-                    {
-                        const int &scaleLevel = pKF->mvKeysUn[i].octave;
-                        const map<KeyFrame*, size_t> observations = pMP->GetObservations();
-                        int nObs=0;
-                        for(map<KeyFrame*, size_t>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
-                        {
-                            KeyFrame* pKFi = mit->first;
-                            if(pKFi==pKF)
-                                continue;
-                            const int &scaleLeveli = pKFi->mvKeysUn[mit->second].octave;
-
-                            if(scaleLeveli<=scaleLevel+1)
-                            {
-                                nObs++;
-                                if(nObs>=thObs)
-                                    break;
-                            }
-                        }
-                        if(nObs>=thObs)
-                        {
-                            nRedundantObservations++;
-                        }
-                    }
-                }
-            }
-        }  
+            KeyFrame* pRigKF = pKF->mvpRigKFs[i];
+            if(pRigKF->isBad())
+                continue;
+            int nRigMPs=0, nRigMLs=0;
+            nRedundantPoints += pRigKF->RedundantMapPoints(nRigMPs,!mbMonocular);
+            nRedundantLines += pRigKF->RedundantMapLines(nRigMLs);
+            nMPs += nRigMPs;
+            nMLs += nRigMLs;
+        }
 
-        if(nRedundantObservations>0.9*nMPs)
+        if(nRedundantPoints+nRedundantLines>0.9*(nMPs+nMLs))
+        {
+            for(size_t i=0; i<pKF->mvpRigKFs.size(); i++)
+                pKF->mvpRigKFs[i]->SetBadFlag();
             pKF->SetBadFlag();
+        }
     }
 }
 
+void LocalMapping::PublishLocalMapSnapshot()
+{
+    if(mpCurrentKeyFrame->isBad())
+        return;
+
+    // Built outside the lock, Tracking keeps using the previous snapshot meanwhile
+    std::shared_ptr<const LocalMapSnapshot> pSnapshot =
+            std::make_shared<const LocalMapSnapshot>(mpCurrentKeyFrame, mnLocalMapSnapshotVersion+1, mpMap->GetLastBigChangeIdx(),
+                                                     LocalMapSnapshot::LOCAL_MAPPING);
+
+    unique_lock<mutex> lock(mMutexLocalMapSnapshot);
+    mpLocalMapSnapshot = pSnapshot;
+    mnLocalMapSnapshotVersion++;
+}
+
+std::shared_ptr<const LocalMapSnapshot> LocalMapping::GetLocalMapSnapshot()
+{
+    unique_lock<mutex> lock(mMutexLocalMapSnapshot);
+    return mpLocalMapSnapshot;
+}
+
 cv::Mat LocalMapping::SkewSymmetricMatrix(const cv::Mat &v)
 {
     return (cv::Mat_<float>(3,3) <<             0, -v.at<float>(2), v.at<float>(1),
@@ -1931,6 +1957,10 @@ void LocalMapping::ResetIfRequested()
         mlNewKeyFrames.clear();
         mlpRecentAddedMapPoints.clear();    // 点特征
         mlpRecentAddedMapLines.clear();     // 线特征
+        {
+            unique_lock<mutex> lockSnapshot(mMutexLocalMapSnapshot);
+            mpLocalMapSnapshot.reset();
+        }
         mbResetRequested=false;
     }
 }
@@ -1970,8 +2000,8 @@ cv::Mat LocalMapping::DrawLines(KeyFrame* KF1, KeyFrame* KF2)
         cv::cvtColor(KF2->ImageGray, mImRGBTemp, cv::COLOR_GRAY2BGR);
         cv::Mat cubemapMatch_rgb(nRows, nCols * 2, mImRGBTemp.type());
 
-        drawKeylines(mImRGBPrevTemp, KF1->mvKeyLines, mImRGBPrevTemp, Scalar(200, 0, 0));
-        drawKeylines(mImRGBTemp, KF2->mvKeyLines, mImRGBTemp, Scalar(0, 200, 0));
+        drawKeylines(mImRGBPrevTemp, KF1->mvKeyLines.ToVector(), mImRGBPrevTemp, Scalar(200, 0, 0));
+        drawKeylines(mImRGBTemp, KF2->mvKeyLines.ToVector(), mImRGBTemp, Scalar(0, 200, 0));
 
         for(int i = 0; i < KF1->mvKeyLines.size(); i++){
             cv::Point origin;
@@ -30,15 +30,21 @@
 
 #include<mutex>
 #include<thread>
+#include<cfloat>
 
 
 namespace ORB_SLAM2
 {
 
-LoopClosing::LoopClosing(Map *pMap, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale):
+const float LoopClosing::QUERY_MIN_BASELINE = 0.3f;
+const float LoopClosing::REVISIT_RADIUS = 1.0f;
+const float LoopClosing::REVISIT_MIN_COMMON_WORDS = 0.5f;
+
+LoopClosing::LoopClosing(Map *pMap, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale, const bool bScheduleQueries):
     mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
-    mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
-    mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0)
+    mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mbScheduleQueries(bScheduleQueries), mpLastQueryKF(NULL),
+    mfBaselineSinceQuery(0), mnSkippedKFs(0), mfCurrentMinScore(1), mpMatchedKF(NULL), mLastLoopKFid(0),
+    mbRunningGBA(false), mbFinishedGBA(true), mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0)
 {
     mnCovisibilityConsistencyTh = 3;
 }
@@ -63,8 +69,9 @@ void LoopClosing::Run()
         // Check if there are keyframes in the queue
         if(CheckNewKeyFrames())
         {
+            // Select the keyframe to query, the others are only added to the database
             // Detect loop candidates and check covisibility consistency
-            if(DetectLoop())
+            if(ScheduleLoopQuery() && DetectLoop())
             {
                // Compute similarity transformation [sR|t]
                // In the stereo/RGBD case s=1
@@ -74,6 +81,8 @@ void LoopClosing::Run()
                    CorrectLoop();
                }
             }
+
+            AddDeferredKeyFrames();
         }       
 
         ResetIfRequested();
@@ -100,36 +109,147 @@ bool LoopClosing::CheckNewKeyFrames()
     return(!mlpLoopKeyFrameQueue.empty());
 }
 
-bool LoopClosing::DetectLoop()
+bool LoopClosing::ScheduleLoopQuery()
 {
+    list<KeyFrame*> lpKFs;
     {
         unique_lock<mutex> lock(mMutexLoopQueue);
-        mpCurrentKF = mlpLoopKeyFrameQueue.front();
-        mlpLoopKeyFrameQueue.pop_front();
+        // Loop closing is behind local mapping: the waiting keyframes are scheduled together
+        if(mbScheduleQueries && mlpLoopKeyFrameQueue.size()>=static_cast<size_t>(QUERY_BATCH_SIZE))
+            lpKFs.swap(mlpLoopKeyFrameQueue);
+        else
+        {
+            lpKFs.push_back(mlpLoopKeyFrameQueue.front());
+            mlpLoopKeyFrameQueue.pop_front();
+        }
+
         // Avoid that a keyframe can be erased while it is being process by this thread
-        mpCurrentKF->SetNotErase();
+        for(list<KeyFrame*>::iterator lit=lpKFs.begin(), lend=lpKFs.end(); lit!=lend; lit++)
+            (*lit)->SetNotErase();
     }
 
-    //If the map contains less than 10 KF or less than 10 KF have passed from last loop detection
-    if(mpCurrentKF->mnId<mLastLoopKFid+10)
+    // Camera motion since the last query at each keyframe of the batch
+    vector<float> vBaselines;
+    vBaselines.reserve(lpKFs.size());
+
+    KeyFrame* pBestKF = static_cast<KeyFrame*>(NULL);
+    float bestPriority = 0;
+    float bestMinScore = 1;
+    size_t bestIdx = 0;
+
+    size_t i=0;
+    for(list<KeyFrame*>::iterator lit=lpKFs.begin(), lend=lpKFs.end(); lit!=lend; lit++, i++)
     {
-        mpKeyFrameDB->add(mpCurrentKF);
-        mpCurrentKF->SetErase();
+        KeyFrame* pKF = *lit;
+
+        const cv::Mat Ow = pKF->GetCameraCenter();
+        const float medianDepth = pKF->GetSceneMedianDepth();
+        if(!mLastOw.empty() && medianDepth>0)
+            mfBaselineSinceQuery += cv::norm(Ow-mLastOw)/medianDepth;
+        mLastOw = Ow;
+        vBaselines.push_back(mfBaselineSinceQuery);
+
+        //If the map contains less than 10 KF or less than 10 KF have passed from last loop detection
+        if(pKF->mnId<mLastLoopKFid+10)
+            continue;
+
+        mnSkippedKFs++;
+
+        // Compute reference BoW similarity score
+        // This is the lowest score to a connected keyframe in the covisibility graph
+        // We will impose loop candidates to have a higher similarity than this
+        const float minScore = ComputeMinCovisibleScore(pKF);
+
+        const float priority = QueryPriority(pKF,minScore,Ow,medianDepth);
+        if(priority>=0 && (!pBestKF || priority>bestPriority))
+        {
+            pBestKF = pKF;
+            bestPriority = priority;
+            bestMinScore = minScore;
+            bestIdx = i;
+        }
+    }
+
+    // The other keyframes are not queried. The ones after the queried keyframe are added after its query,
+    // the recent keyframes that are not covisible must not become its loop candidates.
+    mpCurrentKF = pBestKF;
+    i=0;
+    for(list<KeyFrame*>::iterator lit=lpKFs.begin(), lend=lpKFs.end(); lit!=lend; lit++, i++)
+    {
+        if(*lit==pBestKF)
+            continue;
+        if(pBestKF && i>bestIdx)
+            mlpDeferredKFs.push_back(*lit);
+        else
+            AddToDatabase(*lit);
+    }
+
+    if(!pBestKF)
         return false;
+
+    mpLastQueryKF = pBestKF;
+    mfCurrentMinScore = bestMinScore;
+    mfBaselineSinceQuery -= vBaselines[bestIdx];
+    mnSkippedKFs = lpKFs.size()-1-bestIdx;
+
+    return true;
+}
+
+float LoopClosing::QueryPriority(KeyFrame *pKF, const float minScore, const cv::Mat &Ow, const float medianDepth)
+{
+    // Keyframes that do not look like their covisible keyframes first
+    const float novelty = 1.f-minScore;
+
+    if(!mbScheduleQueries)
+        return novelty;
+
+    // Close to an old keyframe: the camera may be entering a mapped region
+    if(medianDepth>0 && DistanceToOldKeyFrames(pKF,Ow)<REVISIT_RADIUS*medianDepth)
+        return 1.f+novelty;
+
+    // Nothing new to look for since the last query
+    if(mpLastQueryKF && !mpLastQueryKF->isBad() && mnSkippedKFs<=QUERY_MAX_SKIPPED && mfBaselineSinceQuery<QUERY_MIN_BASELINE)
+    {
+        const float score = mpORBVocabulary->score(pKF->mBowVec, mpLastQueryKF->mBowVec);
+        if(score>=minScore)
+            return -1.f;
     }
 
-    // Compute reference BoW similarity score
-    // This is the lowest score to a connected keyframe in the covisibility graph
-    // We will impose loop candidates to have a higher similarity than this
-    const vector<KeyFrame*> vpConnectedKeyFrames = mpCurrentKF->GetVectorCovisibleKeyFrames();
-    const DBoW2::BowVector &CurrentBowVec = mpCurrentKF->mBowVec;
+    return novelty;
+}
+
+float LoopClosing::DistanceToOldKeyFrames(KeyFrame *pKF, const cv::Mat &Ow)
+{
+    // A keyframe at the same place sees the same words: only the keyframes of the database sharing many words with
+    // pKF are checked, not the whole map. The connected keyframes are not returned.
+    float minDist = FLT_MAX;
+    const vector<KeyFrame*> vpKFs = mpKeyFrameDB->GetKeyFramesSharingWords(pKF,REVISIT_MIN_COMMON_WORDS);
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKFi = vpKFs[i];
+        // Same 10 keyframes window as between two loops
+        if(pKFi->mnId+10>pKF->mnId || pKFi->isBad())
+            continue;
+
+        const float dist = cv::norm(pKFi->GetCameraCenter()-Ow);
+        if(dist<minDist)
+            minDist = dist;
+    }
+
+    return minDist;
+}
+
+float LoopClosing::ComputeMinCovisibleScore(KeyFrame *pKF)
+{
+    const vector<KeyFrame*> vpConnectedKeyFrames = pKF->GetVectorCovisibleKeyFrames();
+    const DBoW2::BowVector &CurrentBowVec = pKF->mBowVec;
     float minScore = 1;
     for(size_t i=0; i<vpConnectedKeyFrames.size(); i++)
     {
-        KeyFrame* pKF = vpConnectedKeyFrames[i];
-        if(pKF->isBad())
+        KeyFrame* pKFi = vpConnectedKeyFrames[i];
+        if(pKFi->isBad())
             continue;
-        const DBoW2::BowVector &BowVec = pKF->mBowVec;
+        const DBoW2::BowVector &BowVec = pKFi->mBowVec;
 
         float score = mpORBVocabulary->score(CurrentBowVec, BowVec);
 
@@ -137,7 +257,26 @@ bool LoopClosing::DetectLoop()
             minScore = score;
     }
 
+    return minScore;
+}
+
+void LoopClosing::AddToDatabase(KeyFrame *pKF)
+{
+    mpKeyFrameDB->add(pKF);
+    pKF->SetErase();
+}
+
+void LoopClosing::AddDeferredKeyFrames()
+{
+    for(list<KeyFrame*>::iterator lit=mlpDeferredKFs.begin(), lend=mlpDeferredKFs.end(); lit!=lend; lit++)
+        AddToDatabase(*lit);
+    mlpDeferredKFs.clear();
+}
+
+bool LoopClosing::DetectLoop()
+{
     // Query the database imposing the minimum score
+    const float minScore = mfCurrentMinScore;
     vector<KeyFrame*> vpCandidateKFs = mpKeyFrameDB->DetectLoopCandidates(mpCurrentKF, minScore);
 
     // If there are no loop candidates, just add new keyframe and return false
@@ -440,79 +579,137 @@ void LoopClosing::CorrectLoop()
     cv::Mat Twc = mpCurrentKF->GetPoseInverse();
 
 
+    // The corrections are staged without the map mutex (Local Mapping is stopped), tracking only waits for the commit
+    for(vector<KeyFrame*>::iterator vit=mvpCurrentConnectedKFs.begin(), vend=mvpCurrentConnectedKFs.end(); vit!=vend; vit++)
     {
-        // Get Map Mutex
-        unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+        KeyFrame* pKFi = *vit;
 
-        for(vector<KeyFrame*>::iterator vit=mvpCurrentConnectedKFs.begin(), vend=mvpCurrentConnectedKFs.end(); vit!=vend; vit++)
+        cv::Mat Tiw = pKFi->GetPose();
+
+        if(pKFi!=mpCurrentKF)
         {
-            KeyFrame* pKFi = *vit;
+            cv::Mat Tic = Tiw*Twc;
+            cv::Mat Ric = Tic.rowRange(0,3).colRange(0,3);
+            cv::Mat tic = Tic.rowRange(0,3).col(3);
+            g2o::Sim3 g2oSic(Converter::toMatrix3d(Ric),Converter::toVector3d(tic),1.0);
+            g2o::Sim3 g2oCorrectedSiw = g2oSic*mg2oScw;
+            //Pose corrected with the Sim3 of the loop closure
+            CorrectedSim3[pKFi]=g2oCorrectedSiw;
+        }
 
-            cv::Mat Tiw = pKFi->GetPose();
+        cv::Mat Riw = Tiw.rowRange(0,3).colRange(0,3);
+        cv::Mat tiw = Tiw.rowRange(0,3).col(3);
+        g2o::Sim3 g2oSiw(Converter::toMatrix3d(Riw),Converter::toVector3d(tiw),1.0);
+        //Pose without correction
+        NonCorrectedSim3[pKFi]=g2oSiw;
+    }
 
-            if(pKFi!=mpCurrentKF)
-            {
-                cv::Mat Tic = Tiw*Twc;
-                cv::Mat Ric = Tic.rowRange(0,3).colRange(0,3);
-                cv::Mat tic = Tic.rowRange(0,3).col(3);
-                g2o::Sim3 g2oSic(Converter::toMatrix3d(Ric),Converter::toVector3d(tic),1.0);
-                g2o::Sim3 g2oCorrectedSiw = g2oSic*mg2oScw;
-                //Pose corrected with the Sim3 of the loop closure
-                CorrectedSim3[pKFi]=g2oCorrectedSiw;
-            }
+    // Correct all MapPoints and MapLines observed by current keyframe and neighbors, so that they align with the other side of the loop.
+    // Each landmark is corrected with the first keyframe that observes it, the positions are then computed in parallel.
+    vector<KeyFrame*> vpCorrectedKFs;
+    vector<cv::Mat> vCorrectedTiw;
+    vector<MapPoint*> vpCorrectedMPs;
+    vector<int> vMPCorrectionKF;
+    vector<MapLine*> vpCorrectedMLs;
+    vector<int> vMLCorrectionKF;
+    for(KeyFrameAndPose::iterator mit=CorrectedSim3.begin(), mend=CorrectedSim3.end(); mit!=mend; mit++)
+    {
+        KeyFrame* pKFi = mit->first;
+        const int nKF = vpCorrectedKFs.size();
+        vpCorrectedKFs.push_back(pKFi);
 
-            cv::Mat Riw = Tiw.rowRange(0,3).colRange(0,3);
-            cv::Mat tiw = Tiw.rowRange(0,3).col(3);
-            g2o::Sim3 g2oSiw(Converter::toMatrix3d(Riw),Converter::toVector3d(tiw),1.0);
-            //Pose without correction
-            NonCorrectedSim3[pKFi]=g2oSiw;
+        vector<MapPoint*> vpMPsi = pKFi->GetMapPointMatches();
+        for(size_t iMP=0, endMPi = vpMPsi.size(); iMP<endMPi; iMP++)
+        {
+            MapPoint* pMPi = vpMPsi[iMP];
+            if(!pMPi)
+                continue;
+            if(pMPi->isBad())
+                continue;
+            if(pMPi->mnCorrectedByKF==mpCurrentKF->mnId)
+                continue;
+
+            pMPi->mnCorrectedByKF = mpCurrentKF->mnId;
+            pMPi->mnCorrectedReference = pKFi->mnId;
+            vpCorrectedMPs.push_back(pMPi);
+            vMPCorrectionKF.push_back(nKF);
         }
 
-        // Correct all MapPoints obsrved by current keyframe and neighbors, so that they align with the other side of the loop
-        for(KeyFrameAndPose::iterator mit=CorrectedSim3.begin(), mend=CorrectedSim3.end(); mit!=mend; mit++)
+        vector<MapLine*> vpMLsi = pKFi->GetMapLineMatches();
+        for(size_t iML=0, endMLi = vpMLsi.size(); iML<endMLi; iML++)
         {
-            KeyFrame* pKFi = mit->first;
-            g2o::Sim3 g2oCorrectedSiw = mit->second;
-            g2o::Sim3 g2oCorrectedSwi = g2oCorrectedSiw.inverse();
+            MapLine* pMLi = vpMLsi[iML];
+            if(!pMLi)
+                continue;
+            if(pMLi->isBad())
+                continue;
+            if(pMLi->mnCorrectedByKF==mpCurrentKF->mnId)
+                continue;
 
-            g2o::Sim3 g2oSiw =NonCorrectedSim3[pKFi];
+            pMLi->mnCorrectedByKF = mpCurrentKF->mnId;
+            pMLi->mnCorrectedReference = pKFi->mnId;
+            vpCorrectedMLs.push_back(pMLi);
+            vMLCorrectionKF.push_back(nKF);
+        }
 
-            vector<MapPoint*> vpMPsi = pKFi->GetMapPointMatches();
-            for(size_t iMP=0, endMPi = vpMPsi.size(); iMP<endMPi; iMP++)
-            {
-                MapPoint* pMPi = vpMPsi[iMP];
-                if(!pMPi)
-                    continue;
-                if(pMPi->isBad())
-                    continue;
-                if(pMPi->mnCorrectedByKF==mpCurrentKF->mnId)
-                    continue;
+        // Update keyframe pose with corrected Sim3. First transform Sim3 to SE3 (scale translation)
+        g2o::Sim3 g2oCorrectedSiw = mit->second;
+        Eigen::Matrix3d eigR = g2oCorrectedSiw.rotation().toRotationMatrix();
+        Eigen::Vector3d eigt = g2oCorrectedSiw.translation();
+        double s = g2oCorrectedSiw.scale();
 
-                // Project with non-corrected pose and project back with corrected pose
-                cv::Mat P3Dw = pMPi->GetWorldPos();
-                Eigen::Matrix<double,3,1> eigP3Dw = Converter::toVector3d(P3Dw);
-                Eigen::Matrix<double,3,1> eigCorrectedP3Dw = g2oCorrectedSwi.map(g2oSiw.map(eigP3Dw));
+        eigt *=(1./s); //[R t/s;0 1]
 
-                cv::Mat cvCorrectedP3Dw = Converter::toCvMat(eigCorrectedP3Dw);
-                pMPi->SetWorldPos(cvCorrectedP3Dw);
-                pMPi->mnCorrectedByKF = mpCurrentKF->mnId;
-                pMPi->mnCorrectedReference = pKFi->mnId;
-                pMPi->UpdateNormalAndDepth();
-            }
+        vCorrectedTiw.push_back(Converter::toCvSE3(eigR,eigt));
+    }
 
-            // Update keyframe pose with corrected Sim3. First transform Sim3 to SE3 (scale translation)
-            Eigen::Matrix3d eigR = g2oCorrectedSiw.rotation().toRotationMatrix();
-            Eigen::Vector3d eigt = g2oCorrectedSiw.translation();
-            double s = g2oCorrectedSiw.scale();
+    // Project with non-corrected pose and project back with corrected pose
+    vector<g2o::Sim3,Eigen::aligned_allocator<g2o::Sim3> > vSiw, vCorrectedSwi;
+    vSiw.reserve(vpCorrectedKFs.size());
+    vCorrectedSwi.reserve(vpCorrectedKFs.size());
+    for(size_t i=0; i<vpCorrectedKFs.size(); i++)
+    {
+        vSiw.push_back(NonCorrectedSim3[vpCorrectedKFs[i]]);
+        vCorrectedSwi.push_back(CorrectedSim3[vpCorrectedKFs[i]].inverse());
+    }
 
-            eigt *=(1./s); //[R t/s;0 1]
+    vector<cv::Mat> vMPCorrectedPos(vpCorrectedMPs.size());
+    const int nMPs = vpCorrectedMPs.size();
+    #pragma omp parallel for
+    for(int i=0; i<nMPs; i++)
+    {
+        const int nKF = vMPCorrectionKF[i];
+        Eigen::Matrix<double,3,1> eigP3Dw = Converter::toVector3d(vpCorrectedMPs[i]->GetWorldPos());
+        Eigen::Matrix<double,3,1> eigCorrectedP3Dw = vCorrectedSwi[nKF].map(vSiw[nKF].map(eigP3Dw));
+        vMPCorrectedPos[i] = Converter::toCvMat(eigCorrectedP3Dw);
+    }
+
+    vector<Vector6d,Eigen::aligned_allocator<Vector6d> > vMLCorrectedPos(vpCorrectedMLs.size());
+    const int nMLs = vpCorrectedMLs.size();
+    #pragma omp parallel for
+    for(int i=0; i<nMLs; i++)
+    {
+        const int nKF = vMLCorrectionKF[i];
+        const Vector6d Pos = vpCorrectedMLs[i]->GetWorldPos();
+        vMLCorrectedPos[i] << vCorrectedSwi[nKF].map(vSiw[nKF].map(Pos.head(3))), vCorrectedSwi[nKF].map(vSiw[nKF].map(Pos.tail(3)));
+    }
+
+    {
+        // Get Map Mutex, commit the staged corrections
+        unique_lock<ProfiledMutex> lock(mpMap->mMutexMapUpdate);
+
+        for(size_t i=0; i<vpCorrectedMPs.size(); i++)
+            vpCorrectedMPs[i]->SetWorldPos(vMPCorrectedPos[i]);
 
-            cv::Mat correctedTiw = Converter::toCvSE3(eigR,eigt);
+        for(size_t i=0; i<vpCorrectedMLs.size(); i++)
+            vpCorrectedMLs[i]->SetWorldPos(vMLCorrectedPos[i]);
 
-            pKFi->SetPose(correctedTiw);
+        for(size_t i=0; i<vpCorrectedKFs.size(); i++)
+        {
+            vpCorrectedKFs[i]->SetPose(vCorrectedTiw[i]);
 
             // Make sure connections are updated
-            pKFi->UpdateConnections();
+            vpCorrectedKFs[i]->UpdateConnections();
         }
 
         // Start Loop Fusion
@@ -536,6 +733,12 @@ void LoopClosing::CorrectLoop()
 
     }
 
+    for(size_t i=0; i<vpCorrectedMPs.size(); i++)
+        vpCorrectedMPs[i]->UpdateNormalAndDepth();
+
+    for(size_t i=0; i<vpCorrectedMLs.size(); i++)
+        vpCorrectedMLs[i]->UpdateAverageDir();
+
     // Project MapPoints observed in the neighborhood of the loop keyframe
     // into the current keyframe and neighbors using corrected poses.
     // Fuse duplications.
@@ -599,7 +802,7 @@ void LoopClosing::SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap)
         matcher.Fuse(pKF,cvScw,mvpLoopMapPoints,4,vpReplacePoints);
 
         // Get Map Mutex
-        unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+        unique_lock<ProfiledMutex> lock(mpMap->mMutexMapUpdate);
         const int nLP = mvpLoopMapPoints.size();
         for(int i=0; i<nLP;i++)
         {
@@ -638,6 +841,12 @@ void LoopClosing::ResetIfRequested()
     {
         mlpLoopKeyFrameQueue.clear();
         mLastLoopKFid=0;
+
+        mlpDeferredKFs.clear();
+        mpLastQueryKF=static_cast<KeyFrame*>(NULL);
+        mLastOw.release();
+        mfBaselineSinceQuery=0;
+        mnSkippedKFs=0;
         mbResetRequested=false;
     }
 }
@@ -671,39 +880,52 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
                 usleep(1000);
             }
 
-            // Get Map Mutex
-            unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+            // The corrections are staged without the map mutex, Local Mapping is stopped so the spanning tree
+            // and the poses do not change meanwhile. Tracking only waits for the commit.
 
-            // Correct keyframes starting at map first keyframe
-            list<KeyFrame*> lpKFtoCheck(mpMap->mvpKeyFrameOrigins.begin(),mpMap->mvpKeyFrameOrigins.end());
-
-            while(!lpKFtoCheck.empty())
+            // Correct keyframes starting at map first keyframe, one spanning tree level at a time.
+            // A child only depends on its parent, the keyframes of a level are corrected in parallel.
+            vector<KeyFrame*> vpKFsToCorrect(mpMap->mvpKeyFrameOrigins.begin(),mpMap->mvpKeyFrameOrigins.end());
+            vector<KeyFrame*> vpParents(vpKFsToCorrect.size(),static_cast<KeyFrame*>(NULL));
+            size_t nLevelBegin = 0;
+            while(nLevelBegin<vpKFsToCorrect.size())
             {
-                KeyFrame* pKF = lpKFtoCheck.front();
-                const set<KeyFrame*> sChilds = pKF->GetChilds();
-                cv::Mat Twc = pKF->GetPoseInverse();
-                for(set<KeyFrame*>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+                const size_t nLevelEnd = vpKFsToCorrect.size();
+
+                const int nLevel = nLevelEnd-nLevelBegin;
+                #pragma omp parallel for
+                for(int i=0; i<nLevel; i++)
                 {
-                    KeyFrame* pChild = *sit;
-                    if(pChild->mnBAGlobalForKF!=nLoopKF)
+                    KeyFrame* pKF = vpKFsToCorrect[nLevelBegin+i];
+                    KeyFrame* pParent = vpParents[nLevelBegin+i];
+                    if(pParent && pKF->mnBAGlobalForKF!=nLoopKF)
                     {
-                        cv::Mat Tchildc = pChild->GetPose()*Twc;
-                        pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;//*Tcorc*pKF->mTcwGBA;
-                        pChild->mnBAGlobalForKF=nLoopKF;
-
+                        cv::Mat Tchildc = pKF->GetPose()*pParent->GetPoseInverse();
+                        pKF->mTcwGBA = Tchildc*pParent->mTcwGBA;//*Tcorc*pKF->mTcwGBA;
+                        pKF->mnBAGlobalForKF=nLoopKF;
                     }
-                    lpKFtoCheck.push_back(pChild);
+                    pKF->mTcwBefGBA = pKF->GetPose();
                 }
 
-                pKF->mTcwBefGBA = pKF->GetPose();
-                pKF->SetPose(pKF->mTcwGBA);
-                lpKFtoCheck.pop_front();
+                for(size_t i=nLevelBegin; i<nLevelEnd; i++)
+                {
+                    const set<KeyFrame*> sChilds = vpKFsToCorrect[i]->GetChilds();
+                    for(set<KeyFrame*>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+                    {
+                        vpKFsToCorrect.push_back(*sit);
+                        vpParents.push_back(vpKFsToCorrect[i]);
+                    }
+                }
+                nLevelBegin = nLevelEnd;
             }
 
-            // Correct MapPoints
+            // Correct MapPoints, partitioned across threads
             const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
+            vector<cv::Mat> vMPCorrectedPos(vpMPs.size());
 
-            for(size_t i=0; i<vpMPs.size(); i++)
+            const int nMPs = vpMPs.size();
+            #pragma omp parallel for
+            for(int i=0; i<nMPs; i++)
             {
                 MapPoint* pMP = vpMPs[i];
 
@@ -713,7 +935,7 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
                 if(pMP->mnBAGlobalForKF==nLoopKF)
                 {
                     // If optimized by Global BA, just update
-                    pMP->SetWorldPos(pMP->mPosGBA);
+                    vMPCorrectedPos[i] = pMP->mPosGBA;
                 }
                 else
                 {
@@ -729,15 +951,72 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
                     cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
 
                     // Backproject using corrected camera
-                    cv::Mat Twc = pRefKF->GetPoseInverse();
-                    cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
-                    cv::Mat twc = Twc.rowRange(0,3).col(3);
+                    cv::Mat Rwc = pRefKF->mTcwGBA.rowRange(0,3).colRange(0,3).t();
+                    cv::Mat twc = -Rwc*pRefKF->mTcwGBA.rowRange(0,3).col(3);
+
+                    vMPCorrectedPos[i] = Rwc*Xc+twc;
+                }
+            }
+
+            // Correct MapLines, both endpoints as the MapPoints
+            const vector<MapLine*> vpMLs = mpMap->GetAllMapLines();
+            vector<Vector6d,Eigen::aligned_allocator<Vector6d> > vMLCorrectedPos(vpMLs.size());
+            vector<char> vbMLCorrected(vpMLs.size(),false);
+
+            const int nMLs = vpMLs.size();
+            #pragma omp parallel for
+            for(int i=0; i<nMLs; i++)
+            {
+                MapLine* pML = vpMLs[i];
+
+                if(pML->isBad())
+                    continue;
+
+                if(pML->mnBAGlobalForKF==nLoopKF)
+                {
+                    for(int j=0; j<6; j++)
+                        vMLCorrectedPos[i](j) = pML->mPosGBA.at<float>(j);
+                }
+                else
+                {
+                    KeyFrame* pRefKF = pML->GetReferenceKeyFrame();
 
-                    pMP->SetWorldPos(Rwc*Xc+twc);
+                    if(!pRefKF || pRefKF->mnBAGlobalForKF!=nLoopKF)
+                        continue;
+
+                    cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
+                    cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
+                    cv::Mat Rwc = pRefKF->mTcwGBA.rowRange(0,3).colRange(0,3).t();
+                    cv::Mat twc = -Rwc*pRefKF->mTcwGBA.rowRange(0,3).col(3);
+
+                    const Vector6d Pos = pML->GetWorldPos();
+                    vMLCorrectedPos[i] << Converter::toVector3d(Rwc*(Rcw*Converter::toCvMat(Vector3d(Pos.head(3)))+tcw)+twc),
+                                          Converter::toVector3d(Rwc*(Rcw*Converter::toCvMat(Vector3d(Pos.tail(3)))+tcw)+twc);
+                }
+                vbMLCorrected[i] = true;
+            }
+
+            {
+                // Get Map Mutex, commit the staged corrections
+                unique_lock<ProfiledMutex> lock(mpMap->mMutexMapUpdate);
+
+                for(size_t i=0; i<vpKFsToCorrect.size(); i++)
+                    vpKFsToCorrect[i]->SetPose(vpKFsToCorrect[i]->mTcwGBA);
+
+                for(size_t i=0; i<vpMPs.size(); i++)
+                {
+                    if(!vMPCorrectedPos[i].empty())
+                        vpMPs[i]->SetWorldPos(vMPCorrectedPos[i]);
                 }
-            }            
 
-            mpMap->InformNewBigChange();
+                for(size_t i=0; i<vpMLs.size(); i++)
+                {
+                    if(vbMLCorrected[i])
+                        vpMLs[i]->SetWorldPos(vMLCorrectedPos[i]);
+                }
+
+                mpMap->InformNewBigChange();
+            }
 
             mpLocalMapper->Release();
 
@@ -25,28 +25,37 @@
 namespace ORB_SLAM2
 {
 
-Map::Map():mnMaxKFid(0),mnBigChangeIdx(0)
+Map::Map(const bool bSnapshots):mnMaxKFid(0),mnBigChangeIdx(0),mnClearIdx(0),mbSnapshots(bSnapshots)
 {
 }
 
 void Map::AddKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    // The rig link is set after the pose of the keyframe
+    UpdateSnapshotState(pKF,pKF->GetPose());
+
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mspKeyFrames.insert(pKF);
     if(pKF->mnId>mnMaxKFid)
         mnMaxKFid=pKF->mnId;
+    if(mbSnapshots)
+        mKeyFrameStates.SetValid(pKF->mnId,true);
 }
 
 void Map::AddMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mspMapPoints.insert(pMP);
+    if(mbSnapshots)
+        mMapPointStates.SetValid(pMP->mnId,true);
 }
 
 void Map::EraseMapPoint(MapPoint *pMP)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mspMapPoints.erase(pMP);
+    if(mbSnapshots)
+        mMapPointStates.SetValid(pMP->mnId,false);
 
     // TODO: This only erase the pointer.
     // Delete the MapPoint
@@ -54,8 +63,10 @@ void Map::EraseMapPoint(MapPoint *pMP)
 
 void Map::EraseKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mspKeyFrames.erase(pKF);
+    if(mbSnapshots)
+        mKeyFrameStates.SetValid(pKF->mnId,false);
 
     // TODO: This only erase the pointer.
     // Delete the MapPoint
@@ -63,60 +74,68 @@ void Map::EraseKeyFrame(KeyFrame *pKF)
 
 void Map::SetReferenceMapPoints(const vector<MapPoint *> &vpMPs)
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mvpReferenceMapPoints = vpMPs;
 }
 
 void Map::InformNewBigChange()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     mnBigChangeIdx++;
 }
 
 int Map::GetLastBigChangeIdx()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mnBigChangeIdx;
 }
 
+int Map::GetClearIdx()
+{
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    return mnClearIdx;
+}
+
 vector<KeyFrame*> Map::GetAllKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return vector<KeyFrame*>(mspKeyFrames.begin(),mspKeyFrames.end());
 }
 
 vector<MapPoint*> Map::GetAllMapPoints()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return vector<MapPoint*>(mspMapPoints.begin(),mspMapPoints.end());
 }
 
 long unsigned int Map::MapPointsInMap()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mspMapPoints.size();
 }
 
 long unsigned int Map::KeyFramesInMap()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mspKeyFrames.size();
 }
 
 vector<MapPoint*> Map::GetReferenceMapPoints()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mvpReferenceMapPoints;
 }
 
 long unsigned int Map::GetMaxKFid()
 {
-    unique_lock<mutex> lock(mMutexMap);
+    unique_lock<ProfiledMutex> lock(mMutexMap);
     return mnMaxKFid;
 }
 
 void Map::clear()
 {
+    unique_lock<ProfiledMutex> lock(mMutexMapClear);
+
     for(set<MapPoint*>::iterator sit=mspMapPoints.begin(), send=mspMapPoints.end(); sit!=send; sit++)
         delete *sit;
 
@@ -133,19 +152,72 @@ void Map::clear()
     mvpReferenceMapPoints.clear();
     mvpReferenceMapLines.clear();
     mvpKeyFrameOrigins.clear();
+
+    mKeyFrameStates.Clear();
+    mMapPointStates.Clear();
+    mMapLineStates.Clear();
+
+    unique_lock<ProfiledMutex> lock2(mMutexMap);
+    mnClearIdx++;
+}
+
+shared_ptr<const MapSnapshot> Map::GetSnapshot()
+{
+    unique_lock<ProfiledMutex> lock(mMutexMap);
+    return make_shared<MapSnapshot>(mKeyFrameStates.Share(),mMapPointStates.Share(),mMapLineStates.Share(),mnBigChangeIdx);
+}
+
+void Map::UpdateSnapshotState(KeyFrame *pKF, const cv::Mat &Tcw)
+{
+    if(!mbSnapshots)
+        return;
+
+    KeyFrameState state;
+    state.timestamp = pKF->mTimeStamp;
+    for(int i=0; i<3; i++)
+        for(int j=0; j<4; j++)
+            state.Tcw[4*i+j] = Tcw.at<float>(i,j);
+    state.bRigCamera = pKF->mpRigKF!=NULL;
+    mKeyFrameStates.Update(pKF->mnId,state);
+}
+
+void Map::UpdateSnapshotState(MapPoint *pMP, const cv::Mat &Pos)
+{
+    if(!mbSnapshots)
+        return;
+
+    MapPointState state;
+    for(int i=0; i<3; i++)
+        state.pos[i] = Pos.at<float>(i);
+    mMapPointStates.Update(pMP->mnId,state);
+}
+
+void Map::UpdateSnapshotState(MapLine *pML, const Eigen::Matrix<double,6,1> &Pos)
+{
+    if(!mbSnapshots)
+        return;
+
+    MapLineState state;
+    for(int i=0; i<6; i++)
+        state.pos[i] = Pos(i);
+    mMapLineStates.Update(pML->mnId,state);
 }
 
     //-----MapLine相关函数------
     void Map::AddMapLine(MapLine *pML)
     {
-        unique_lock<mutex> lock(mMutexMap);
+        unique_lock<ProfiledMutex> lock(mMutexMap);
         mspMapLines.insert(pML);
+        if(mbSnapshots)
+            mMapLineStates.SetValid(pML->mnId,true);
     }
 
     void Map::EraseMapLine(MapLine *pML)
     {
-        unique_lock<mutex> lock(mMutexMap);
+        unique_lock<ProfiledMutex> lock(mMutexMap);
         mspMapLines.erase(pML);
+        if(mbSnapshots)
+            mMapLineStates.SetValid(pML->mnId,false);
     }
 
     /**
@@ -154,25 +226,25 @@ void Map::clear()
      */
     void Map::SetReferenceMapLines(const std::vector<MapLine *> &vpMLs)
     {
-        unique_lock<mutex> lock(mMutexMap);
+        unique_lock<ProfiledMutex> lock(mMutexMap);
         mvpReferenceMapLines = vpMLs;
     }
 
     vector<MapLine*> Map::GetAllMapLines()
     {
-        unique_lock<mutex> lock(mMutexMap);
+        unique_lock<ProfiledMutex> lock(mMutexMap);
         return vector<MapLine*>(mspMapLines.begin(), mspMapLines.end());
     }
 
     vector<MapLine*> Map::GetReferenceMapLines()
     {
-        unique_lock<mutex> lock(mMutexMap);
+        unique_lock<ProfiledMutex> lock(mMutexMap);
         return mvpReferenceMapLines;
     }
 
     long unsigned int Map::MapLinesInMap()
     {
-        unique_lock<mutex> lock(mMutexMap);
+        unique_lock<ProfiledMutex> lock(mMutexMap);
         return mspMapLines.size();
     }
 
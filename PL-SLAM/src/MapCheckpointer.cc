@@ -0,0 +1,155 @@
+#include "MapCheckpointer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+MapCheckpointer::MapCheckpointer(Map *pMap, const string &strPath, const double fInterval):
+    mpMap(pMap), mstrPath(strPath), mfInterval(fInterval), mnCheckpoints(0), mbCheckpointRequested(false),
+    mbFinishRequested(false), mbFinished(false)
+{
+    if(!mstrPath.empty() && mstrPath[mstrPath.size()-1]=='/')
+        mstrPath.erase(mstrPath.size()-1);
+}
+
+void MapCheckpointer::Run()
+{
+    chrono::steady_clock::time_point tLast = chrono::steady_clock::now();
+
+    while(1)
+    {
+        // Read before the request, so that a request made before RequestFinish() is served
+        const bool bFinish = CheckFinish();
+
+        bool bCheckpoint = CheckRequest();
+        const double elapsed = chrono::duration_cast<chrono::duration<double> >(chrono::steady_clock::now()-tLast).count();
+        if(mfInterval>0 && elapsed>=mfInterval)
+            bCheckpoint = true;
+
+        if(bCheckpoint)
+        {
+            shared_ptr<const MapSnapshot> pSnapshot;
+            {
+                // Loop corrections and bundle adjustments update the map under this lock,
+                // it is held just for the time to share the state chunks
+                unique_lock<ProfiledMutex> lock(mpMap->mMutexMapUpdate);
+                pSnapshot = mpMap->GetSnapshot();
+            }
+
+            WriteCheckpoint(pSnapshot);
+            tLast = chrono::steady_clock::now();
+        }
+
+        if(bFinish)
+            break;
+
+        usleep(50000);
+    }
+
+    SetFinish();
+}
+
+bool MapCheckpointer::WriteCheckpoint(const shared_ptr<const MapSnapshot> &pSnapshot)
+{
+    const chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+
+    const time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp,sizeof(stamp),"%Y%m%d_%H%M%S",localtime(&now));
+
+    stringstream ss;
+    ss << mstrPath << "/checkpoint_" << stamp << "_" << setw(4) << setfill('0') << mnCheckpoints++;
+    const string strDir = ss.str();
+    const string strTmpDir = strDir + ".tmp";
+
+    if(mkdir(mstrPath.c_str(),0755)!=0 && errno!=EEXIST)
+    {
+        cerr << "MapCheckpointer: cannot create " << mstrPath << endl;
+        return false;
+    }
+
+    if(mkdir(strTmpDir.c_str(),0755)!=0)
+    {
+        cerr << "MapCheckpointer: cannot create " << strTmpDir << endl;
+        return false;
+    }
+
+    const bool bOK = pSnapshot->SaveKeyFrameTrajectoryTUM(strTmpDir+"/KeyFrameTrajectory.txt") &&
+                     pSnapshot->SavePointCloud(strTmpDir+"/PointCloud.ply") &&
+                     pSnapshot->SaveMapLines(strTmpDir+"/MapLines.txt");
+
+    if(!bOK || rename(strTmpDir.c_str(),strDir.c_str())!=0)
+    {
+        cerr << "MapCheckpointer: cannot write " << strDir << endl;
+        return false;
+    }
+
+    {
+        unique_lock<mutex> lock(mMutexRequest);
+        mstrLastCheckpoint = strDir;
+    }
+
+    const double t = chrono::duration_cast<chrono::duration<double> >(chrono::steady_clock::now()-t0).count();
+    cout << "Map checkpoint saved to " << strDir << " (" << pSnapshot->KeyFramesInSnapshot() << " KFs, "
+         << pSnapshot->MapPointsInSnapshot() << " MPs, " << pSnapshot->MapLinesInSnapshot() << " MLs) in "
+         << t << " s" << endl;
+
+    return true;
+}
+
+void MapCheckpointer::RequestCheckpoint()
+{
+    unique_lock<mutex> lock(mMutexRequest);
+    mbCheckpointRequested = true;
+}
+
+bool MapCheckpointer::CheckRequest()
+{
+    unique_lock<mutex> lock(mMutexRequest);
+    const bool bRequested = mbCheckpointRequested;
+    mbCheckpointRequested = false;
+    return bRequested;
+}
+
+string MapCheckpointer::GetLastCheckpoint()
+{
+    unique_lock<mutex> lock(mMutexRequest);
+    return mstrLastCheckpoint;
+}
+
+void MapCheckpointer::RequestFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+}
+
+bool MapCheckpointer::CheckFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinishRequested;
+}
+
+void MapCheckpointer::SetFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+bool MapCheckpointer::isFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+} //namespace ORB_SLAM
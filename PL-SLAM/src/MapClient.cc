@@ -0,0 +1,388 @@
+#include "MapClient.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "MapLine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+bool SameState(const KeyFrameState &a, const KeyFrameState &b)
+{
+    return memcmp(a.Tcw,b.Tcw,sizeof(a.Tcw))==0;
+}
+
+bool SameState(const MapPointState &a, const MapPointState &b)
+{
+    return memcmp(a.pos,b.pos,sizeof(a.pos))==0;
+}
+
+bool SameState(const MapLineState &a, const MapLineState &b)
+{
+    return memcmp(a.pos,b.pos,sizeof(a.pos))==0;
+}
+
+// Ids of the elements in the map whose state differs between two snapshots. A chunk not written in between is shared
+// by both snapshots and skipped.
+template<typename T>
+vector<size_t> ChangedStates(const typename CowStateArray<T>::SharedChunks &vOld,
+                             const typename CowStateArray<T>::SharedChunks &vNew)
+{
+    typedef typename CowStateArray<T>::Chunk Chunk;
+    const size_t CHUNK_SIZE = CowStateArray<T>::CHUNK_SIZE;
+
+    vector<size_t> vIds;
+    for(size_t c=0; c<vNew.size(); c++)
+    {
+        const Chunk* pNew = vNew[c].get();
+        const Chunk* pOld = c<vOld.size() ? vOld[c].get() : static_cast<const Chunk*>(NULL);
+        if(!pNew || pNew==pOld)
+            continue;
+
+        for(size_t j=0; j<CHUNK_SIZE; j++)
+        {
+            if(pNew->mvbValid[j] && !(pOld && pOld->mvbValid[j] && SameState(pOld->mvStates[j],pNew->mvStates[j])))
+                vIds.push_back(c*CHUNK_SIZE+j);
+        }
+    }
+    return vIds;
+}
+
+template<typename T>
+const T& GetState(const typename CowStateArray<T>::SharedChunks &vChunks, const size_t id)
+{
+    const size_t CHUNK_SIZE = CowStateArray<T>::CHUNK_SIZE;
+    return vChunks[id/CHUNK_SIZE]->mvStates[id%CHUNK_SIZE];
+}
+
+}
+
+MapClient::MapClient(Map *pMap, const string &strAddress, const unsigned int nAgentId):
+    mpMap(pMap), mstrAddress(strAddress), mnAgentId(nAgentId), mpTransport(static_cast<MapTransport*>(NULL)),
+    mnNextKFid(0), mnLastBigChangeIdx(0), mnClearIdx(0), mnReferenceAgent(0), mbFinishRequested(false), mbFinished(false)
+{
+}
+
+MapClient::~MapClient()
+{
+    delete mpTransport;
+}
+
+void MapClient::Run()
+{
+    chrono::steady_clock::time_point tLastAttempt;
+    bool bAttempted = false;
+    bool bLoggedFailure = false;
+
+    while(1)
+    {
+        if(!mpTransport)
+        {
+            // Retry every 2 s, the server may start after the clients
+            const chrono::steady_clock::time_point tNow = chrono::steady_clock::now();
+            if(!bAttempted || tNow-tLastAttempt>chrono::seconds(2))
+            {
+                bAttempted = true;
+                tLastAttempt = tNow;
+                if(Connect())
+                {
+                    cout << "MapClient: agent " << mnAgentId << " connected to the map server at " << mstrAddress << endl;
+                    bLoggedFailure = false;
+                }
+                else if(!bLoggedFailure)
+                {
+                    cerr << "MapClient: no map server at " << mstrAddress << ", retrying" << endl;
+                    bLoggedFailure = true;
+                }
+            }
+        }
+        else
+        {
+            // A reset of the local map starts a new map on the server
+            if(mpMap->GetClearIdx()!=mnClearIdx)
+                Disconnect();
+            else
+            {
+                ReceiveAlignments();
+                SendNewKeyFrames();
+
+                const int nBigChangeIdx = mpMap->GetLastBigChangeIdx();
+                if(nBigChangeIdx!=mnLastBigChangeIdx)
+                {
+                    mnLastBigChangeIdx = nBigChangeIdx;
+                    SendPoses();
+                }
+
+                if(!mpTransport->IsOpen())
+                {
+                    cerr << "MapClient: connection to the map server lost" << endl;
+                    Disconnect();
+                }
+            }
+        }
+
+        if(CheckFinish())
+            break;
+
+        usleep(100000);
+    }
+
+    // The last alignment stays available, to save the trajectory in the shared frame after Shutdown()
+    delete mpTransport;
+    mpTransport = static_cast<MapTransport*>(NULL);
+    SetFinish();
+}
+
+bool MapClient::Connect()
+{
+    mpTransport = UnixSocketTransport::Connect(mstrAddress);
+    if(!mpTransport)
+        return false;
+
+    if(!mpTransport->Send(EncodeHello(mnAgentId)))
+    {
+        Disconnect();
+        return false;
+    }
+
+    mnNextKFid = 0;
+    mnLastBigChangeIdx = mpMap->GetLastBigChangeIdx();
+    mnClearIdx = mpMap->GetClearIdx();
+    {
+        unique_lock<ProfiledMutex> lock(mpMap->mMutexMapUpdate);
+        mpPosesSnapshot = mpMap->GetSnapshot();
+    }
+    return true;
+}
+
+void MapClient::Disconnect()
+{
+    delete mpTransport;
+    mpTransport = static_cast<MapTransport*>(NULL);
+    mnNextKFid = 0;
+    mpPosesSnapshot.reset();
+
+    unique_lock<mutex> lock(mMutexAlignment);
+    mSws.release();
+}
+
+void MapClient::SendNewKeyFrames()
+{
+    // The messages are built under the map clear lock, a reset cannot delete the keyframes and landmarks they read.
+    // They are sent after releasing it, the reset does not wait for the server.
+    vector<string> vMessages;
+    {
+        unique_lock<ProfiledMutex> lock(mpMap->mMutexMapClear);
+
+        // Reset since the last check: the keyframes are from a new map, Run() reconnects first
+        if(mpMap->GetClearIdx()!=mnClearIdx)
+            return;
+
+        vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
+        sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
+        const long unsigned int nMaxKFid = mpMap->GetMaxKFid();
+
+        for(size_t i=0; i<vpKFs.size(); i++)
+        {
+            KeyFrame* pKF = vpKFs[i];
+            if(pKF->mnId<mnNextKFid)
+                continue;
+            if(pKF->mnId+KEYFRAME_SEND_DELAY>nMaxKFid)
+                break;
+
+            // Culled keyframes are never sent
+            mnNextKFid = pKF->mnId+1;
+            if(pKF->isBad())
+                continue;
+
+            vMessages.push_back(EncodeMapMessage(MakeKeyFrameMessage(pKF)));
+        }
+    }
+
+    for(size_t i=0; i<vMessages.size(); i++)
+    {
+        if(!mpTransport->Send(vMessages[i]))
+            return;
+    }
+}
+
+void MapClient::SendPoses()
+{
+    shared_ptr<const MapSnapshot> pSnapshot;
+    {
+        unique_lock<ProfiledMutex> lock(mpMap->mMutexMapUpdate);
+        pSnapshot = mpMap->GetSnapshot();
+    }
+
+    // Only the keyframes sent so far, the server ignores the landmarks it has not received
+    vector<size_t> vKFIds = ChangedStates<KeyFrameState>(mpPosesSnapshot->mvKeyFrames,pSnapshot->mvKeyFrames);
+    vKFIds.erase(remove_if(vKFIds.begin(),vKFIds.end(),[this](const size_t id){ return id>=mnNextKFid; }),vKFIds.end());
+    const vector<size_t> vMPIds = ChangedStates<MapPointState>(mpPosesSnapshot->mvMapPoints,pSnapshot->mvMapPoints);
+    const vector<size_t> vMLIds = ChangedStates<MapLineState>(mpPosesSnapshot->mvMapLines,pSnapshot->mvMapLines);
+
+    mpPosesSnapshot = pSnapshot;
+
+    const size_t nMax = max(vKFIds.size(),max(vMPIds.size(),vMLIds.size()));
+    for(size_t i0=0; i0<nMax; i0+=POSES_PER_MESSAGE)
+    {
+        PosesMessage m;
+
+        for(size_t i=i0; i<vKFIds.size() && i<i0+POSES_PER_MESSAGE; i++)
+        {
+            const KeyFrameState &state = GetState<KeyFrameState>(pSnapshot->mvKeyFrames,vKFIds[i]);
+            cv::Mat Tcw = cv::Mat::eye(4,4,CV_32F);
+            for(int r=0; r<3; r++)
+                for(int c=0; c<4; c++)
+                    Tcw.at<float>(r,c) = state.Tcw[4*r+c];
+            m.vKeyFrameIds.push_back(vKFIds[i]);
+            m.vTcw.push_back(Tcw);
+        }
+
+        for(size_t i=i0; i<vMPIds.size() && i<i0+POSES_PER_MESSAGE; i++)
+        {
+            const MapPointState &state = GetState<MapPointState>(pSnapshot->mvMapPoints,vMPIds[i]);
+            m.vMapPointIds.push_back(vMPIds[i]);
+            m.vMapPointPos.push_back(cv::Point3f(state.pos[0],state.pos[1],state.pos[2]));
+        }
+
+        for(size_t i=i0; i<vMLIds.size() && i<i0+POSES_PER_MESSAGE; i++)
+        {
+            const MapLineState &state = GetState<MapLineState>(pSnapshot->mvMapLines,vMLIds[i]);
+            m.vMapLineIds.push_back(vMLIds[i]);
+            m.vMapLinePos.push_back(cv::Vec6d(state.pos[0],state.pos[1],state.pos[2],state.pos[3],state.pos[4],state.pos[5]));
+        }
+
+        if(!mpTransport->Send(EncodeMapMessage(m)))
+            return;
+    }
+}
+
+void MapClient::ReceiveAlignments()
+{
+    string msg;
+    while(mpTransport->Receive(msg,0))
+    {
+        AlignmentMessage m;
+        if(!DecodeMapMessage(msg,m))
+        {
+            cerr << "MapClient: ignoring an invalid message from the map server" << endl;
+            continue;
+        }
+
+        unique_lock<mutex> lock(mMutexAlignment);
+        if(m.nAgents<2)
+        {
+            // The other agents of the shared map were removed
+            mSws.release();
+            continue;
+        }
+
+        cout << "MapClient: map of agent " << mnAgentId << " merged in the shared map of agent " << m.nReferenceAgent
+             << " (" << m.nAgents << " agents)" << endl;
+        mSws = m.Sws.clone();
+        mnReferenceAgent = m.nReferenceAgent;
+    }
+}
+
+KeyFrameMessage MapClient::MakeKeyFrameMessage(KeyFrame *pKF)
+{
+    KeyFrameMessage m;
+    m.nId = pKF->mnId;
+    m.timestamp = pKF->mTimeStamp;
+    m.Tcw = pKF->GetPose();
+
+    m.camera.fx = pKF->fx;
+    m.camera.fy = pKF->fy;
+    m.camera.cx = pKF->cx;
+    m.camera.cy = pKF->cy;
+    m.camera.minX = pKF->mnMinX;
+    m.camera.maxX = pKF->mnMaxX;
+    m.camera.minY = pKF->mnMinY;
+    m.camera.maxY = pKF->mnMaxY;
+    m.camera.nScaleLevels = pKF->mnScaleLevels;
+    m.camera.fScaleFactor = pKF->mfScaleFactor;
+    m.camera.nScaleLevelsLine = pKF->mnScaleLevelsLine;
+    m.camera.fScaleFactorLine = pKF->mfScaleFactorLine;
+
+    m.features.vKeys = pKF->mvKeysUn.ToVector();
+    m.features.Descriptors = pKF->mDescriptors;
+    m.features.vKeyLines = pKF->mvKeyLines.ToVector();
+    m.features.LineDescriptors = pKF->mLineDescriptors;
+    m.features.vLineFunctions = pKF->mvKeyLineFunctions.ToVector();
+    m.features.BowVec = pKF->mBowVec;
+    m.features.FeatVec = pKF->mFeatVec;
+
+    const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
+    m.vMapPointIds.resize(vpMPs.size(),-1);
+    m.vMapPointPos.resize(vpMPs.size());
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPoint* pMP = vpMPs[i];
+        if(!pMP || pMP->isBad())
+            continue;
+        const cv::Mat pos = pMP->GetWorldPos();
+        m.vMapPointIds[i] = pMP->mnId;
+        m.vMapPointPos[i] = cv::Point3f(pos.at<float>(0),pos.at<float>(1),pos.at<float>(2));
+    }
+
+    const vector<MapLine*> vpMLs = pKF->GetMapLineMatches();
+    m.vMapLineIds.resize(vpMLs.size(),-1);
+    m.vMapLinePos.resize(vpMLs.size());
+    for(size_t i=0; i<vpMLs.size(); i++)
+    {
+        MapLine* pML = vpMLs[i];
+        if(!pML || pML->isBad())
+            continue;
+        const Vector6d pos = pML->GetWorldPos();
+        m.vMapLineIds[i] = pML->mnId;
+        m.vMapLinePos[i] = cv::Vec6d(pos(0),pos(1),pos(2),pos(3),pos(4),pos(5));
+    }
+
+    return m;
+}
+
+bool MapClient::GetSharedMapAlignment(cv::Mat &Sws, unsigned int &nReferenceAgent)
+{
+    unique_lock<mutex> lock(mMutexAlignment);
+    if(mSws.empty())
+        return false;
+    Sws = mSws.clone();
+    nReferenceAgent = mnReferenceAgent;
+    return true;
+}
+
+void MapClient::RequestFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+}
+
+bool MapClient::CheckFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinishRequested;
+}
+
+void MapClient::SetFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+bool MapClient::isFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+} //namespace ORB_SLAM
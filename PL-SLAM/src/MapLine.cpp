@@ -10,12 +10,12 @@
 
 namespace ORB_SLAM2
 {
-    mutex MapLine::mGlobalMutex;
+    ProfiledMutex MapLine::mGlobalMutex("MapLine::mGlobalMutex");
     long unsigned int MapLine::nNextId=0;
 
 MapLine::MapLine(Vector6d &Pos, KeyFrame *pRefKF, Map *pMap):
     mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
-    mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopLineForKF(0), mnCorrectedByKF(0),
+    mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLocalMapSnapshotForKF(), mnLoopLineForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
     mpReplaced(static_cast<MapLine*>(NULL)), mpMap(pMap)
 {
@@ -26,13 +26,16 @@ MapLine::MapLine(Vector6d &Pos, KeyFrame *pRefKF, Map *pMap):
     mNormalVector << 0, 0, 0;
 
     // MapLines can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
-    unique_lock<mutex> lock(mpMap->mMutexPointCreation);
+    unique_lock<ProfiledMutex> lock(mpMap->mMutexPointCreation);
     mnId = nNextId++;
+    lock.unlock();
+
+    mpMap->UpdateSnapshotState(this,mWorldPos);
 }
 
 MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
     mnFirstKFid(-1), mnFirstFrame(pFrame->mnId), nObs(0), mnTrackReferenceForFrame(0), mnLastFrameSeen(0),
-    mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopLineForKF(0), mnCorrectedByKF(0),
+    mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLocalMapSnapshotForKF(), mnLoopLineForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(static_cast<KeyFrame*>(NULL)), mnVisible(1),
     mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap)
 {
@@ -58,46 +61,65 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
     mfMaxDistance = dist*levelScaleFactor;
     mfMinDistance = mfMaxDistance/pFrame->mvScaleFactorsLine[nLevels-1];
 
-    pFrame->mLdesc.row(idxF).copyTo(mLDescriptor);
+    mLDescriptor.Store(LBDDescriptorView::Row(pFrame->mLdesc,idxF));
 
     // MapLines can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
-    unique_lock<mutex> lock(mpMap->mMutexLineCreation);
+    unique_lock<ProfiledMutex> lock(mpMap->mMutexLineCreation);
     mnId = nNextId++;
+    lock.unlock();
+
+    mpMap->UpdateSnapshotState(this,mWorldPos);
 }
 
 
     void MapLine::SetWorldPos(const Vector6d &Pos)
     {
-        unique_lock<mutex> lock2(mGlobalMutex);
-        unique_lock<mutex> lock(mMutexPos);
+        unique_lock<ProfiledMutex> lock2(mGlobalMutex);
+        unique_lock<ProfiledMutex> lock(mMutexPos);
         mWorldPos = Pos;
         mWorldVector = Pos.head(3) - Pos.tail(3);
         mWorldVector.normalize();
+        mpMap->UpdateSnapshotState(this,mWorldPos);
     }
 
     Vector6d MapLine::GetWorldPos()
     {
-        unique_lock<mutex> lock(mMutexPos);
+        unique_lock<ProfiledMutex> lock(mMutexPos);
         return mWorldPos;
     }
 
     Vector3d MapLine::GetNormal()
     {
-        unique_lock<mutex> lock(mMutexPos);
+        unique_lock<ProfiledMutex> lock(mMutexPos);
         return mNormalVector;
     }
 
     KeyFrame* MapLine::GetReferenceKeyFrame()
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         return mpRefKF;
     }
 
     void MapLine::AddObservation(KeyFrame *pKF, size_t idx)
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         if(mObservations.count(pKF))
             return;
+
+        // 更新冗余计数：同一尺度或更精细尺度下观测到该MapLine的其他关键帧数目（用于KeyFrameCulling）
+        const int level = pKF->mvKeyLines.Octave(idx);
+        int nRedundant=0;
+        for(map<KeyFrame*,size_t>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+        {
+            KeyFrame* pKFi = mit->first;
+            const int leveli = pKFi->mvKeyLines.Octave(mit->second);
+            if(level<=leveli+1)
+                pKFi->IncreaseLineRedundancy(mit->second);
+            if(leveli<=level+1)
+                nRedundant++;
+        }
+        pKF->SetLineRedundancy(idx,nRedundant);
+
         //记录下能观测到该MapLine的KF和该MapPoint在KF中的索引
         mObservations[pKF]=idx;
 
@@ -108,7 +130,7 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
     {
         bool bBad = false;
         {
-            unique_lock<mutex> lock(mMutexFeatures);
+            unique_lock<ProfiledMutex> lock(mMutexFeatures);
             if(mObservations.count(pKF))
             {
                 int idx = mObservations[pKF];
@@ -119,6 +141,14 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
 
                 mObservations.erase(pKF);
 
+                const int level = pKF->mvKeyLines.Octave(idx);
+                for(map<KeyFrame*,size_t>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+                {
+                    if(level<=mit->first->mvKeyLines.Octave(mit->second)+1)
+                        mit->first->IncreaseLineRedundancy(mit->second,-1);
+                }
+                pKF->SetLineRedundancy(idx,-1);
+
                 // 如果该keyFrame是参考帧，该Frame被删除后重新指定RefFrame
                 if(mpRefKF==pKF)
                     mpRefKF=mObservations.begin()->first;
@@ -135,19 +165,19 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
 
     map<KeyFrame*, size_t> MapLine::GetObservations()
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         return mObservations;
     }
 
     int MapLine::Observations()
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         return nObs;
     }
 
     int MapLine::GetIndexInKeyFrame(KeyFrame *pKF)
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         if(mObservations.count(pKF))
             return mObservations[pKF];
         else
@@ -156,7 +186,7 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
 
     bool MapLine::IsInKeyFrame(KeyFrame *pKF)
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         return (mObservations.count(pKF));
     }
 
@@ -165,8 +195,8 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
     {
         map<KeyFrame*, size_t> obs;
         {
-            unique_lock<mutex> lock1(mMutexFeatures);
-            unique_lock<mutex> lock2(mMutexPos);
+            unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+            unique_lock<ProfiledMutex> lock2(mMutexPos);
             mbBad=true;
             obs = mObservations;    //把mObservations转存到obs，obs和mObservations里存的是指针，赋值过程为浅拷贝
             mObservations.clear();  //把mObservations指向的内存释放，obs作为局部变量之后自动删除
@@ -175,6 +205,7 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
         for(map<KeyFrame*, size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
         {
             KeyFrame* pKF = mit->first;
+            pKF->SetLineRedundancy(mit->second,-1);
             pKF->EraseMapLineMatch(mit->second);    //告诉可以观测到该MapLine的KeyFrame，该MapLine被删除了
         }
 
@@ -184,8 +215,8 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
     //没有经过MapLineCulling检测的MapLines
     bool MapLine::isBad()
     {
-        unique_lock<mutex> lock(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPos);
         return mbBad;
     }
 
@@ -197,8 +228,8 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
         int nvisible, nfound;
         map<KeyFrame*, size_t> obs;
         {
-            unique_lock<mutex> lock1(mMutexFeatures);
-            unique_lock<mutex> lock2(mMutexPos);
+            unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+            unique_lock<ProfiledMutex> lock2(mMutexPos);
             obs=mObservations;
             mObservations.clear();
             mbBad=true;
@@ -211,6 +242,7 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
         for(map<KeyFrame*, size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
         {
             KeyFrame* pKF = mit->first;
+            pKF->SetLineRedundancy(mit->second,-1);
 
             if(!pML->IsInKeyFrame(pKF))
             {
@@ -230,37 +262,37 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
 
     MapLine* MapLine::GetReplaced()
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPos);
         return mpReplaced;
     }
 
     void MapLine::IncreaseVisible(int n)
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         mnVisible+=n;
     }
 
     void MapLine::IncreaseFound(int n)
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         mnFound+=n;
     }
 
     float MapLine::GetFoundRatio()
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         return static_cast<float>(mnFound/mnVisible);
     }
 
     void MapLine::ComputeDistinctiveDescriptors()
     {
         // Retrieve all observed descriptors
-        vector<Mat> vDescriptors;
+        vector<LBDDescriptorView> vDescriptors;
 
         map<KeyFrame*, size_t> observations;
         {
-            unique_lock<mutex> lock1(mMutexFeatures);
+            unique_lock<ProfiledMutex> lock1(mMutexFeatures);
             if(mbBad)
                 return ;
             observations = mObservations;
@@ -277,7 +309,7 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
             KeyFrame* pKF = mit->first;
 
             if(!pKF->isBad())
-                vDescriptors.push_back(pKF->mLineDescriptors.row(mit->second));
+                vDescriptors.push_back(LBDDescriptorView::Row(pKF->mLineDescriptors,mit->second));
         }
 
         if(vDescriptors.empty())
@@ -294,7 +326,7 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
             Distances[i][i]=0;
             for(size_t j=0; j<NL; j++)
             {
-                int distij = norm(vDescriptors[i], vDescriptors[j], NORM_HAMMING);
+                int distij = HammingDistance(vDescriptors[i], vDescriptors[j]);
                 Distances[i][j]=distij;
                 Distances[j][i]=distij;
             }
@@ -319,16 +351,29 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
             }
         }
         {
-            unique_lock<mutex> lock(mMutexFeatures);
-            mLDescriptor = vDescriptors[BestIdx].clone();
+            // Serializes the writers, readers do not lock
+            unique_lock<ProfiledMutex> lock(mMutexFeatures);
+            mLDescriptor.Store(vDescriptors[BestIdx]);
         }
 
     }
 
     Mat MapLine::GetDescriptor()
     {
-        unique_lock<mutex> lock(mMutexFeatures);
-        return mLDescriptor.clone();
+        return mLDescriptor.ToMat();
+    }
+
+    size_t MapLine::MemoryUsage()
+    {
+        size_t nBytes = sizeof(MapLine) + mPosGBA.total()*mPosGBA.elemSize() +
+                        obs_list.capacity()*sizeof(Vector3d) + pts_list.capacity()*sizeof(Vector4d);
+
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        nBytes += mObservations.size()*(sizeof(pair<KeyFrame*,size_t>)+4*sizeof(void*)) +
+                  mvdir_list.capacity()*sizeof(Vector3d);
+        for(size_t i=0; i<mvDesc_list.size(); i++)
+            nBytes += sizeof(Mat) + mvDesc_list[i].total()*mvDesc_list[i].elemSize();
+        return nBytes;
     }
 
     void MapLine::UpdateAverageDir()
@@ -337,8 +382,8 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
         KeyFrame* pRefKF;
         Vector6d Pos;
         {
-            unique_lock<mutex> lock1(mMutexFeatures);
-            unique_lock<mutex> lock2(mMutexPos);
+            unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+            unique_lock<ProfiledMutex> lock2(mMutexPos);
             if(mbBad)
                 return;
             observations = mObservations;
@@ -368,12 +413,12 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
 
         cv::Mat CM = MP - pRefKF->GetCameraCenter();
         const float dist = cv::norm(CM);
-        const int level = pRefKF->mvKeyLines[observations[pRefKF]].octave;
+        const int level = pRefKF->mvKeyLines.Octave(observations[pRefKF]);
         const float levelScaleFactor = pRefKF->mvScaleFactorsLine[level];
         const int nLevels = pRefKF->mnScaleLevelsLine;
 
         {
-            unique_lock<mutex> lock3(mMutexPos);
+            unique_lock<ProfiledMutex> lock3(mMutexPos);
             mfMaxDistance = dist*levelScaleFactor;
             mfMinDistance = mfMaxDistance/pRefKF->mvScaleFactorsLine[nLevels-1];
             mNormalVector = normal/n;
@@ -382,13 +427,13 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
 
     float MapLine::GetMinDistanceInvariance()
     {
-        unique_lock<mutex> lock(mMutexPos);
+        unique_lock<ProfiledMutex> lock(mMutexPos);
         return 0.8f*mfMinDistance;
     }
 
     float MapLine::GetMaxDistanceInvariance()
     {
-        unique_lock<mutex> lock(mMutexPos);
+        unique_lock<ProfiledMutex> lock(mMutexPos);
         return 1.2f*mfMaxDistance;
     }
 
@@ -396,7 +441,7 @@ MapLine::MapLine(Vector6d &Pos, Map *pMap, Frame *pFrame, const int &idxF):
     {
         float ratio;
         {
-            unique_lock<mutex> lock3(mMutexPos);
+            unique_lock<ProfiledMutex> lock3(mMutexPos);
             ratio = mfMaxDistance/currentDist;
         }
 
@@ -0,0 +1,158 @@
+#include "MapMessages.h"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+void WriteType(BinaryWriter &w, const MapMessageType type)
+{
+    w.Write((uint32_t)type);
+}
+
+bool ReadType(BinaryReader &r, const MapMessageType type)
+{
+    uint32_t t;
+    return r.Read(t) && t==(uint32_t)type;
+}
+
+void WritePose(BinaryWriter &w, const cv::Mat &T)
+{
+    cv::Mat T32;
+    T.convertTo(T32,CV_32F);
+    w.WriteMat(T32);
+}
+
+bool ReadPose(BinaryReader &r, cv::Mat &T)
+{
+    return r.ReadMat(T,4,4,CV_32F);
+}
+
+// Vectors of plain values, preceded by their size
+template<typename T>
+void WriteVector(BinaryWriter &w, const vector<T> &v)
+{
+    w.Write((uint32_t)v.size());
+    if(!v.empty())
+        w.Write(&v[0],v.size()*sizeof(T));
+}
+
+template<typename T>
+bool ReadVector(BinaryReader &r, vector<T> &v)
+{
+    uint32_t n;
+    if(!r.Read(n) || n>r.Remaining()/sizeof(T))
+        return false;
+    v.resize(n);
+    return n==0 || r.Read(&v[0],n*sizeof(T));
+}
+
+}
+
+MapMessageType GetMapMessageType(const string &msg)
+{
+    BinaryReader r(msg.data(),msg.size());
+    uint32_t t;
+    if(!r.Read(t) || t<MAP_MSG_HELLO || t>MAP_MSG_ALIGNMENT)
+        return MAP_MSG_INVALID;
+    return (MapMessageType)t;
+}
+
+string EncodeHello(const uint32_t nAgentId)
+{
+    string msg;
+    BinaryWriter w(msg);
+    WriteType(w,MAP_MSG_HELLO);
+    w.Write(nAgentId);
+    return msg;
+}
+
+bool DecodeHello(const string &msg, uint32_t &nAgentId)
+{
+    BinaryReader r(msg.data(),msg.size());
+    return ReadType(r,MAP_MSG_HELLO) && r.Read(nAgentId) && r.AtEnd();
+}
+
+string EncodeMapMessage(const KeyFrameMessage &m)
+{
+    string msg;
+    BinaryWriter w(msg);
+    WriteType(w,MAP_MSG_KEYFRAME);
+    w.Write(m.nId);
+    w.Write(m.timestamp);
+    WritePose(w,m.Tcw);
+    w.Write(m.camera);
+    EncodeFeatures(m.features,w);
+    WriteVector(w,m.vMapPointIds);
+    WriteVector(w,m.vMapPointPos);
+    WriteVector(w,m.vMapLineIds);
+    WriteVector(w,m.vMapLinePos);
+    return msg;
+}
+
+bool DecodeMapMessage(const string &msg, KeyFrameMessage &m)
+{
+    BinaryReader r(msg.data(),msg.size());
+    const bool bOK = ReadType(r,MAP_MSG_KEYFRAME) && r.Read(m.nId) && r.Read(m.timestamp) && ReadPose(r,m.Tcw) &&
+                     r.Read(m.camera) && DecodeFeatures(r,m.features) &&
+                     ReadVector(r,m.vMapPointIds) && ReadVector(r,m.vMapPointPos) &&
+                     ReadVector(r,m.vMapLineIds) && ReadVector(r,m.vMapLinePos) && r.AtEnd();
+
+    // One landmark slot per keypoint and per keyline
+    return bOK && m.vMapPointIds.size()==m.features.vKeys.size() && m.vMapPointPos.size()==m.vMapPointIds.size() &&
+           m.vMapLineIds.size()==m.features.vKeyLines.size() && m.vMapLinePos.size()==m.vMapLineIds.size();
+}
+
+string EncodeMapMessage(const PosesMessage &m)
+{
+    string msg;
+    BinaryWriter w(msg);
+    WriteType(w,MAP_MSG_POSES);
+    WriteVector(w,m.vKeyFrameIds);
+    for(size_t i=0; i<m.vTcw.size(); i++)
+        WritePose(w,m.vTcw[i]);
+    WriteVector(w,m.vMapPointIds);
+    WriteVector(w,m.vMapPointPos);
+    WriteVector(w,m.vMapLineIds);
+    WriteVector(w,m.vMapLinePos);
+    return msg;
+}
+
+bool DecodeMapMessage(const string &msg, PosesMessage &m)
+{
+    BinaryReader r(msg.data(),msg.size());
+    bool bOK = ReadType(r,MAP_MSG_POSES) && ReadVector(r,m.vKeyFrameIds);
+    if(bOK)
+    {
+        m.vTcw.resize(m.vKeyFrameIds.size());
+        for(size_t i=0; i<m.vTcw.size() && bOK; i++)
+            bOK = ReadPose(r,m.vTcw[i]);
+    }
+    bOK = bOK && ReadVector(r,m.vMapPointIds) && ReadVector(r,m.vMapPointPos) &&
+          ReadVector(r,m.vMapLineIds) && ReadVector(r,m.vMapLinePos) && r.AtEnd();
+
+    return bOK && m.vMapPointPos.size()==m.vMapPointIds.size() && m.vMapLinePos.size()==m.vMapLineIds.size();
+}
+
+string EncodeMapMessage(const AlignmentMessage &m)
+{
+    string msg;
+    BinaryWriter w(msg);
+    WriteType(w,MAP_MSG_ALIGNMENT);
+    w.Write(m.nReferenceAgent);
+    w.Write(m.nAgents);
+    WritePose(w,m.Sws);
+    return msg;
+}
+
+bool DecodeMapMessage(const string &msg, AlignmentMessage &m)
+{
+    BinaryReader r(msg.data(),msg.size());
+    return ReadType(r,MAP_MSG_ALIGNMENT) && r.Read(m.nReferenceAgent) && r.Read(m.nAgents) && ReadPose(r,m.Sws) &&
+           r.AtEnd();
+}
+
+} //namespace ORB_SLAM
@@ -27,11 +27,11 @@ namespace ORB_SLAM2
 {
 
 long unsigned int MapPoint::nNextId=0;
-mutex MapPoint::mGlobalMutex;
+ProfiledMutex MapPoint::mGlobalMutex("MapPoint::mGlobalMutex");
 
 MapPoint::MapPoint(const cv::Mat &Pos, KeyFrame *pRefKF, Map* pMap):
     mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
-    mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
+    mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLocalMapSnapshotForKF(), mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
     mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap)
 {
@@ -39,13 +39,16 @@ MapPoint::MapPoint(const cv::Mat &Pos, KeyFrame *pRefKF, Map* pMap):
     mNormalVector = cv::Mat::zeros(3,1,CV_32F);
 
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
-    unique_lock<mutex> lock(mpMap->mMutexPointCreation);
+    unique_lock<ProfiledMutex> lock(mpMap->mMutexPointCreation);
     mnId=nNextId++;
+    lock.unlock();
+
+    mpMap->UpdateSnapshotState(this,mWorldPos);
 }
 
 MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF):
     mnFirstKFid(-1), mnFirstFrame(pFrame->mnId), nObs(0), mnTrackReferenceForFrame(0), mnLastFrameSeen(0),
-    mnBALocalForKF(0), mnFuseCandidateForKF(0),mnLoopPointForKF(0), mnCorrectedByKF(0),
+    mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLocalMapSnapshotForKF(), mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(static_cast<KeyFrame*>(NULL)), mnVisible(1),
     mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap)
 {
@@ -63,43 +66,63 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
     mfMaxDistance = dist*levelScaleFactor;
     mfMinDistance = mfMaxDistance/pFrame->mvScaleFactors[nLevels-1];
 
-    pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
+    mDescriptor.Store(ORBDescriptorView::Row(pFrame->mDescriptors,idxF));
 
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
-    unique_lock<mutex> lock(mpMap->mMutexPointCreation);
+    unique_lock<ProfiledMutex> lock(mpMap->mMutexPointCreation);
     mnId=nNextId++;
+    lock.unlock();
+
+    mpMap->UpdateSnapshotState(this,mWorldPos);
 }
 
 void MapPoint::SetWorldPos(const cv::Mat &Pos)
 {
-    unique_lock<mutex> lock2(mGlobalMutex);
-    unique_lock<mutex> lock(mMutexPos);
+    unique_lock<ProfiledMutex> lock2(mGlobalMutex);
+    unique_lock<ProfiledMutex> lock(mMutexPos);
     Pos.copyTo(mWorldPos);
+    mpMap->UpdateSnapshotState(this,mWorldPos);
 }
 
 cv::Mat MapPoint::GetWorldPos()
 {
-    unique_lock<mutex> lock(mMutexPos);
+    unique_lock<ProfiledMutex> lock(mMutexPos);
     return mWorldPos.clone();
 }
 
 cv::Mat MapPoint::GetNormal()
 {
-    unique_lock<mutex> lock(mMutexPos);
+    unique_lock<ProfiledMutex> lock(mMutexPos);
     return mNormalVector.clone();
 }
 
 KeyFrame* MapPoint::GetReferenceKeyFrame()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return mpRefKF;
 }
 
 void MapPoint::AddObservation(KeyFrame* pKF, size_t idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     if(mObservations.count(pKF))
         return;
+
+    // Update redundancy counters: a keyframe observation is redundant with the other ones
+    // observing the point in the same or finer scale (used by keyframe culling)
+    const int level = pKF->mvKeysUn.Octave(idx);
+    int nRedundant=0;
+    for(map<KeyFrame*,size_t>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+    {
+        KeyFrame* pKFi = mit->first;
+        const int leveli = pKFi->mvKeysUn.Octave(mit->second);
+        if(level<=leveli+1)
+            pKFi->IncreasePointRedundancy(mit->second);
+        if(leveli<=level+1)
+            nRedundant++;
+    }
+    pKF->SetPointRedundancy(idx,nRedundant);
+
     mObservations[pKF]=idx;
 
     if(pKF->mvuRight[idx]>=0)
@@ -112,7 +135,7 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
 {
     bool bBad=false;
     {
-        unique_lock<mutex> lock(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
         if(mObservations.count(pKF))
         {
             int idx = mObservations[pKF];
@@ -123,6 +146,14 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
 
             mObservations.erase(pKF);
 
+            const int level = pKF->mvKeysUn.Octave(idx);
+            for(map<KeyFrame*,size_t>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+            {
+                if(level<=mit->first->mvKeysUn.Octave(mit->second)+1)
+                    mit->first->IncreasePointRedundancy(mit->second,-1);
+            }
+            pKF->SetPointRedundancy(idx,-1);
+
             if(mpRefKF==pKF)
                 mpRefKF=mObservations.begin()->first;
 
@@ -138,13 +169,13 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
 
 map<KeyFrame*, size_t> MapPoint::GetObservations()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return mObservations;
 }
 
 int MapPoint::Observations()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return nObs;
 }
 
@@ -152,8 +183,8 @@ void MapPoint::SetBadFlag()
 {
     map<KeyFrame*,size_t> obs;
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPos);
         mbBad=true;
         obs = mObservations;
         mObservations.clear();
@@ -161,6 +192,7 @@ void MapPoint::SetBadFlag()
     for(map<KeyFrame*,size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
+        pKF->SetPointRedundancy(mit->second,-1);
         pKF->EraseMapPointMatch(mit->second);
     }
 
@@ -169,8 +201,8 @@ void MapPoint::SetBadFlag()
 
 MapPoint* MapPoint::GetReplaced()
 {
-    unique_lock<mutex> lock1(mMutexFeatures);
-    unique_lock<mutex> lock2(mMutexPos);
+    unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock2(mMutexPos);
     return mpReplaced;
 }
 
@@ -182,8 +214,8 @@ void MapPoint::Replace(MapPoint* pMP)
     int nvisible, nfound;
     map<KeyFrame*,size_t> obs;
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPos);
         obs=mObservations;
         mObservations.clear();
         mbBad=true;
@@ -196,6 +228,7 @@ void MapPoint::Replace(MapPoint* pMP)
     {
         // Replace measurement in keyframe
         KeyFrame* pKF = mit->first;
+        pKF->SetPointRedundancy(mit->second,-1);
 
         if(!pMP->IsInKeyFrame(pKF))
         {
@@ -216,26 +249,26 @@ void MapPoint::Replace(MapPoint* pMP)
 
 bool MapPoint::isBad()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    unique_lock<mutex> lock2(mMutexPos);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock2(mMutexPos);
     return mbBad;
 }
 
 void MapPoint::IncreaseVisible(int n)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     mnVisible+=n;
 }
 
 void MapPoint::IncreaseFound(int n)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     mnFound+=n;
 }
 
 float MapPoint::GetFoundRatio()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return static_cast<float>(mnFound)/mnVisible;
 }
 
@@ -249,12 +282,12 @@ float MapPoint::GetFoundRatio()
 void MapPoint::ComputeDistinctiveDescriptors()
 {
     // Retrieve all observed descriptors
-    vector<cv::Mat> vDescriptors;
+    vector<ORBDescriptorView> vDescriptors;
 
     map<KeyFrame*,size_t> observations;
 
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
         if(mbBad)
             return;
         observations=mObservations;
@@ -270,7 +303,7 @@ void MapPoint::ComputeDistinctiveDescriptors()
         KeyFrame* pKF = mit->first;
 
         if(!pKF->isBad())
-            vDescriptors.push_back(pKF->mDescriptors.row(mit->second));
+            vDescriptors.push_back(ORBDescriptorView::Row(pKF->mDescriptors,mit->second));
     }
 
     if(vDescriptors.empty())
@@ -285,7 +318,7 @@ void MapPoint::ComputeDistinctiveDescriptors()
         Distances[i][i]=0;
         for(size_t j=i+1;j<N;j++)
         {
-            int distij = ORBmatcher::DescriptorDistance(vDescriptors[i],vDescriptors[j]);
+            int distij = HammingDistance(vDescriptors[i],vDescriptors[j]);
             Distances[i][j]=distij;
             Distances[j][i]=distij;
         }
@@ -308,20 +341,34 @@ void MapPoint::ComputeDistinctiveDescriptors()
     }
 
     {
-        unique_lock<mutex> lock(mMutexFeatures);
-        mDescriptor = vDescriptors[BestIdx].clone();
+        // Serializes the writers, readers do not lock
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        mDescriptor.Store(vDescriptors[BestIdx]);
     }
 }
 
 cv::Mat MapPoint::GetDescriptor()
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    return mDescriptor.clone();
+    return mDescriptor.ToMat();
+}
+
+size_t MapPoint::MemoryUsage()
+{
+    size_t nBytes = sizeof(MapPoint) + mPosGBA.total()*mPosGBA.elemSize();
+    {
+        unique_lock<ProfiledMutex> lock(mMutexPos);
+        nBytes += mWorldPos.total()*mWorldPos.elemSize() + mNormalVector.total()*mNormalVector.elemSize();
+    }
+    {
+        unique_lock<ProfiledMutex> lock(mMutexFeatures);
+        nBytes += mObservations.size()*(sizeof(pair<KeyFrame*,size_t>)+4*sizeof(void*));
+    }
+    return nBytes;
 }
 
 int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     if(mObservations.count(pKF))
         return mObservations[pKF];
     else
@@ -330,7 +377,7 @@ int MapPoint::GetIndexInKeyFrame(KeyFrame *pKF)
 
 bool MapPoint::IsInKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
+    unique_lock<ProfiledMutex> lock(mMutexFeatures);
     return (mObservations.count(pKF));
 }
 
@@ -344,8 +391,8 @@ void MapPoint::UpdateNormalAndDepth()
     KeyFrame* pRefKF;
     cv::Mat Pos;
     {
-        unique_lock<mutex> lock1(mMutexFeatures);
-        unique_lock<mutex> lock2(mMutexPos);
+        unique_lock<ProfiledMutex> lock1(mMutexFeatures);
+        unique_lock<ProfiledMutex> lock2(mMutexPos);
         if(mbBad)
             return;
         observations=mObservations;
@@ -369,12 +416,12 @@ void MapPoint::UpdateNormalAndDepth()
 
     cv::Mat PC = Pos - pRefKF->GetCameraCenter();
     const float dist = cv::norm(PC);
-    const int level = pRefKF->mvKeysUn[observations[pRefKF]].octave;
+    const int level = pRefKF->mvKeysUn.Octave(observations[pRefKF]);
     const float levelScaleFactor =  pRefKF->mvScaleFactors[level];
     const int nLevels = pRefKF->mnScaleLevels;
 
     {
-        unique_lock<mutex> lock3(mMutexPos);
+        unique_lock<ProfiledMutex> lock3(mMutexPos);
         mfMaxDistance = dist*levelScaleFactor;
         mfMinDistance = mfMaxDistance/pRefKF->mvScaleFactors[nLevels-1];
         mNormalVector = normal/n;
@@ -383,13 +430,13 @@ void MapPoint::UpdateNormalAndDepth()
 
 float MapPoint::GetMinDistanceInvariance()
 {
-    unique_lock<mutex> lock(mMutexPos);
+    unique_lock<ProfiledMutex> lock(mMutexPos);
     return 0.8f*mfMinDistance;
 }
 
 float MapPoint::GetMaxDistanceInvariance()
 {
-    unique_lock<mutex> lock(mMutexPos);
+    unique_lock<ProfiledMutex> lock(mMutexPos);
     return 1.2f*mfMaxDistance;
 }
 
@@ -397,7 +444,7 @@ int MapPoint::PredictScale(const float &currentDist, KeyFrame* pKF)
 {
     float ratio;
     {
-        unique_lock<mutex> lock(mMutexPos);
+        unique_lock<ProfiledMutex> lock(mMutexPos);
         ratio = mfMaxDistance/currentDist;
     }
 
@@ -414,7 +461,7 @@ int MapPoint::PredictScale(const float &currentDist, Frame* pF)
 {
     float ratio;
     {
-        unique_lock<mutex> lock(mMutexPos);
+        unique_lock<ProfiledMutex> lock(mMutexPos);
         ratio = mfMaxDistance/currentDist;
     }
 
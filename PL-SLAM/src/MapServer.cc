@@ -0,0 +1,630 @@
+#include "MapServer.h"
+#include "Frame.h"
+#include "MapPoint.h"
+#include "MapLine.h"
+#include "ORBmatcher.h"
+#include "Sim3Solver.h"
+#include "Optimizer.h"
+#include "Converter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+MapServer::MapServer(ORBVocabulary *pVoc, MapTransportListener *pListener, const bool bFixScale):
+    mpVocabulary(pVoc), mpListener(pListener), mbFixScale(bFixScale), mbFinishRequested(false), mbFinished(false)
+{
+    mpKeyFrameDB = new KeyFrameDatabase(*mpVocabulary);
+}
+
+MapServer::~MapServer()
+{
+    for(size_t i=0; i<mvpAgents.size(); i++)
+    {
+        mvpAgents[i]->pMap->clear();
+        delete mvpAgents[i]->pMap;
+        delete mvpAgents[i];
+    }
+    delete mpKeyFrameDB;
+}
+
+void MapServer::Run()
+{
+    while(!CheckFinish())
+    {
+        bool bProcessed = false;
+        Message message;
+        while(GetNextMessage(message))
+        {
+            ProcessMessage(message);
+            bProcessed = true;
+        }
+
+        MapTransport* pTransport = mpListener->Accept(bProcessed ? 0 : 10);
+        if(pTransport)
+        {
+            Connection* pConnection = new Connection();
+            pConnection->pTransport = pTransport;
+            pConnection->pAgent = static_cast<Agent*>(NULL);
+            pConnection->pThread = new thread(&MapServer::ReceiveMessages,this,pConnection);
+            mlpConnections.push_back(pConnection);
+        }
+    }
+
+    // The receiving threads end with their channel
+    for(list<Connection*>::iterator lit=mlpConnections.begin(), lend=mlpConnections.end(); lit!=lend; lit++)
+        (*lit)->pTransport->Close();
+
+    while(!mlpConnections.empty())
+    {
+        Message message;
+        if(!GetNextMessage(message))
+        {
+            usleep(1000);
+            continue;
+        }
+        if(message.bClosed)
+            ProcessMessage(message);
+    }
+
+    SetFinish();
+}
+
+void MapServer::ReceiveMessages(Connection *pConnection)
+{
+    MapTransport* pTransport = pConnection->pTransport;
+    while(!CheckFinish() && pTransport->IsOpen())
+    {
+        Message message;
+        if(!pTransport->Receive(message.data,100))
+            continue;
+
+        message.pConnection = pConnection;
+        message.bClosed = false;
+        unique_lock<mutex> lock(mMutexMessages);
+        mlMessages.push_back(message);
+    }
+
+    Message message;
+    message.pConnection = pConnection;
+    message.bClosed = true;
+    unique_lock<mutex> lock(mMutexMessages);
+    mlMessages.push_back(message);
+}
+
+bool MapServer::GetNextMessage(Message &message)
+{
+    unique_lock<mutex> lock(mMutexMessages);
+    if(mlMessages.empty())
+        return false;
+    message.pConnection = mlMessages.front().pConnection;
+    message.data.swap(mlMessages.front().data);
+    message.bClosed = mlMessages.front().bClosed;
+    mlMessages.pop_front();
+    return true;
+}
+
+void MapServer::ProcessMessage(Message &message)
+{
+    Connection* pConnection = message.pConnection;
+    Agent* pAgent = pConnection->pAgent;
+
+    if(message.bClosed)
+    {
+        pConnection->pThread->join();
+        delete pConnection->pThread;
+        delete pConnection->pTransport;
+        if(pAgent)
+        {
+            pAgent->pConnection = static_cast<Connection*>(NULL);
+            cout << "MapServer: agent " << pAgent->nId << " disconnected, its map is kept" << endl;
+        }
+        mlpConnections.remove(pConnection);
+        delete pConnection;
+        return;
+    }
+
+    switch(GetMapMessageType(message.data))
+    {
+    case MAP_MSG_HELLO:
+    {
+        uint32_t nAgentId;
+        if(!pAgent && DecodeHello(message.data,nAgentId))
+            AddAgent(pConnection,nAgentId);
+        return;
+    }
+    case MAP_MSG_KEYFRAME:
+    {
+        KeyFrameMessage m;
+        if(pAgent && DecodeMapMessage(message.data,m))
+        {
+            AddKeyFrame(pAgent,m);
+            return;
+        }
+        break;
+    }
+    case MAP_MSG_POSES:
+    {
+        PosesMessage m;
+        if(pAgent && DecodeMapMessage(message.data,m))
+        {
+            UpdatePoses(pAgent,m);
+            return;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    cerr << "MapServer: ignoring an invalid message" << (pAgent ? "" : " before the hello of the agent") << endl;
+}
+
+void MapServer::AddAgent(Connection *pConnection, const unsigned int nAgentId)
+{
+    for(size_t i=0; i<mvpAgents.size(); i++)
+    {
+        if(mvpAgents[i]->nId!=nAgentId)
+            continue;
+
+        if(mvpAgents[i]->pConnection)
+        {
+            cerr << "MapServer: agent " << nAgentId << " is already connected, closing the new connection" << endl;
+            pConnection->pTransport->Close();
+            return;
+        }
+
+        // A new connection is a new map of the agent
+        RemoveAgent(mvpAgents[i]);
+        break;
+    }
+
+    Agent* pAgent = new Agent();
+    pAgent->nId = nAgentId;
+    pAgent->pMap = new Map();
+    pAgent->pConnection = pConnection;
+    pAgent->pReference = pAgent;
+    mvpAgents.push_back(pAgent);
+    pConnection->pAgent = pAgent;
+
+    cout << "MapServer: agent " << nAgentId << " connected" << endl;
+}
+
+void MapServer::RemoveAgent(Agent *pAgent)
+{
+    vector<Agent*> vpShared = GetSharedMap(pAgent->pReference);
+    vpShared.erase(find(vpShared.begin(),vpShared.end(),pAgent));
+    if(!vpShared.empty() && pAgent->pReference==pAgent)
+        SetReference(pAgent,vpShared[0]);
+
+    const vector<KeyFrame*> vpKFs = pAgent->pMap->GetAllKeyFrames();
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        mpKeyFrameDB->erase(vpKFs[i]);
+        mKeyFrameAgents.erase(vpKFs[i]);
+    }
+
+    pAgent->pMap->clear();
+    delete pAgent->pMap;
+    mvpAgents.erase(find(mvpAgents.begin(),mvpAgents.end(),pAgent));
+    delete pAgent;
+
+    if(!vpShared.empty())
+        SendAlignments(vpShared[0]->pReference);
+}
+
+void MapServer::AddKeyFrame(Agent *pAgent, const KeyFrameMessage &m)
+{
+    if(pAgent->mKeyFrames.count(m.nId))
+        return;
+
+    if(!IsValidKeyFrame(m))
+    {
+        cerr << "MapServer: ignoring an invalid keyframe of agent " << pAgent->nId << endl;
+        return;
+    }
+
+    // The agents can have different cameras, the configuration of each agent is shared by its keyframes
+    if(!pAgent->pFrameConfig || memcmp(&pAgent->camera,&m.camera,sizeof(AgentCamera))!=0)
+    {
+        pAgent->camera = m.camera;
+        pAgent->pFrameConfig.reset(new FrameConfig(m.camera));
+    }
+
+    Frame F(m.features,pAgent->pFrameConfig,m.timestamp,mpVocabulary);
+    F.SetPose(m.Tcw);
+
+    KeyFrame* pKF = new KeyFrame(F,pAgent->pMap,mpKeyFrameDB);
+    pAgent->pMap->AddKeyFrame(pKF);
+    pAgent->mKeyFrames[m.nId] = pKF;
+    mKeyFrameAgents[pKF] = pAgent;
+
+    // Map points, with the latest position known by the client
+    vector<MapPoint*> vpMPs;
+    for(size_t i=0; i<m.vMapPointIds.size(); i++)
+    {
+        if(m.vMapPointIds[i]<0)
+            continue;
+
+        const cv::Point3f &p = m.vMapPointPos[i];
+        const cv::Mat pos = (cv::Mat_<float>(3,1) << p.x, p.y, p.z);
+
+        MapPoint* &pMP = pAgent->mMapPoints[m.vMapPointIds[i]];
+        if(!pMP)
+        {
+            pMP = new MapPoint(pos,pKF,pAgent->pMap);
+            pAgent->pMap->AddMapPoint(pMP);
+        }
+        else
+            pMP->SetWorldPos(pos);
+
+        pMP->AddObservation(pKF,i);
+        pKF->AddMapPoint(pMP,i);
+        vpMPs.push_back(pMP);
+    }
+
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        vpMPs[i]->ComputeDistinctiveDescriptors();
+        vpMPs[i]->UpdateNormalAndDepth();
+    }
+
+    // Map lines, only kept for the shared maps (place recognition uses the points)
+    vector<MapLine*> vpMLs;
+    for(size_t i=0; i<m.vMapLineIds.size(); i++)
+    {
+        if(m.vMapLineIds[i]<0)
+            continue;
+
+        const cv::Vec6d &l = m.vMapLinePos[i];
+        Vector6d pos;
+        pos << l[0], l[1], l[2], l[3], l[4], l[5];
+
+        MapLine* &pML = pAgent->mMapLines[m.vMapLineIds[i]];
+        if(!pML)
+        {
+            pML = new MapLine(pos,pKF,pAgent->pMap);
+            pAgent->pMap->AddMapLine(pML);
+        }
+        else
+            pML->SetWorldPos(pos);
+
+        pML->AddObservation(pKF,i);
+        pKF->AddMapLine(pML,i);
+        vpMLs.push_back(pML);
+    }
+
+    for(size_t i=0; i<vpMLs.size(); i++)
+    {
+        vpMLs[i]->ComputeDistinctiveDescriptors();
+        vpMLs[i]->UpdateAverageDir();
+    }
+
+    pKF->UpdateConnections();
+
+    DetectMerge(pAgent,pKF);
+
+    mpKeyFrameDB->add(pKF);
+}
+
+bool MapServer::IsValidKeyFrame(const KeyFrameMessage &m) const
+{
+    const AgentCamera &camera = m.camera;
+    if(camera.nScaleLevels<=0 || camera.nScaleLevels>MAX_SCALE_LEVELS || camera.nScaleLevelsLine<=0 ||
+       camera.nScaleLevelsLine>MAX_SCALE_LEVELS || !(camera.fScaleFactor>0) || !(camera.fScaleFactorLine>0) ||
+       !(camera.maxX>camera.minX) || !(camera.maxY>camera.minY) || !(camera.fx>0) || !(camera.fy>0))
+        return false;
+
+    // The scale tables, the grid and the descriptor distances are indexed with them
+    const CachedFeatures &features = m.features;
+    for(size_t i=0; i<features.vKeys.size(); i++)
+    {
+        const cv::KeyPoint &kp = features.vKeys[i];
+        if(kp.octave<0 || kp.octave>=camera.nScaleLevels || !std::isfinite(kp.pt.x) || !std::isfinite(kp.pt.y))
+            return false;
+    }
+    for(size_t i=0; i<features.vKeyLines.size(); i++)
+    {
+        const KeyLine &kl = features.vKeyLines[i];
+        if(kl.octave<0 || kl.octave>=camera.nScaleLevelsLine)
+            return false;
+    }
+    if((!features.vKeys.empty() && features.Descriptors.cols!=32) ||
+       (!features.vKeyLines.empty() && features.LineDescriptors.cols!=32))
+        return false;
+
+    // The inverted file of the keyframe database is indexed with the word ids
+    const unsigned int nWords = mpVocabulary->size();
+    for(DBoW2::BowVector::const_iterator vit=features.BowVec.begin(), vend=features.BowVec.end(); vit!=vend; vit++)
+    {
+        if(vit->first>=nWords)
+            return false;
+    }
+
+    return true;
+}
+
+void MapServer::UpdatePoses(Agent *pAgent, const PosesMessage &m)
+{
+    for(size_t i=0; i<m.vKeyFrameIds.size(); i++)
+    {
+        map<uint64_t,KeyFrame*>::iterator it = pAgent->mKeyFrames.find(m.vKeyFrameIds[i]);
+        if(it!=pAgent->mKeyFrames.end())
+            it->second->SetPose(m.vTcw[i]);
+    }
+
+    for(size_t i=0; i<m.vMapPointIds.size(); i++)
+    {
+        map<uint64_t,MapPoint*>::iterator it = pAgent->mMapPoints.find(m.vMapPointIds[i]);
+        if(it==pAgent->mMapPoints.end())
+            continue;
+        const cv::Point3f &p = m.vMapPointPos[i];
+        it->second->SetWorldPos((cv::Mat_<float>(3,1) << p.x, p.y, p.z));
+        it->second->UpdateNormalAndDepth();
+    }
+
+    for(size_t i=0; i<m.vMapLineIds.size(); i++)
+    {
+        map<uint64_t,MapLine*>::iterator it = pAgent->mMapLines.find(m.vMapLineIds[i]);
+        if(it==pAgent->mMapLines.end())
+            continue;
+        const cv::Vec6d &l = m.vMapLinePos[i];
+        Vector6d pos;
+        pos << l[0], l[1], l[2], l[3], l[4], l[5];
+        it->second->SetWorldPos(pos);
+    }
+}
+
+void MapServer::DetectMerge(Agent *pAgent, KeyFrame *pKF)
+{
+    // Same minimum score as loop closing: the lowest score of the covisible keyframes
+    const vector<KeyFrame*> vpConnectedKeyFrames = pKF->GetVectorCovisibleKeyFrames();
+    if(vpConnectedKeyFrames.empty())
+        return;
+
+    float minScore = 1;
+    for(size_t i=0; i<vpConnectedKeyFrames.size(); i++)
+        minScore = min(minScore,(float)mpVocabulary->score(pKF->mBowVec,vpConnectedKeyFrames[i]->mBowVec));
+
+    // Candidates of the same shared map are loops, they are closed by the clients
+    vector<KeyFrame*> vpCandidateKFs = mpKeyFrameDB->DetectLoopCandidates(pKF,minScore);
+
+    ORBmatcher matcher(0.75,true);
+
+    for(size_t i=0; i<vpCandidateKFs.size(); i++)
+    {
+        KeyFrame* pCandidateKF = vpCandidateKFs[i];
+        map<KeyFrame*,Agent*>::iterator ait = mKeyFrameAgents.find(pCandidateKF);
+        if(ait==mKeyFrameAgents.end() || ait->second->pReference==pAgent->pReference)
+            continue;
+        Agent* pCandidateAgent = ait->second;
+
+        vector<MapPoint*> vpMatches;
+        if(matcher.SearchByBoW(pKF,pCandidateKF,vpMatches)<20)
+            continue;
+
+        Sim3Solver solver(pKF,pCandidateKF,vpMatches,mbFixScale);
+        solver.SetRansacParameters(0.99,20,300);
+
+        bool bNoMore = false;
+        vector<bool> vbInliers;
+        int nInliers;
+        cv::Mat Scm;
+        while(Scm.empty() && !bNoMore)
+            Scm = solver.iterate(5,bNoMore,vbInliers,nInliers);
+        if(Scm.empty())
+            continue;
+
+        vector<MapPoint*> vpInlierMatches(vpMatches.size(),static_cast<MapPoint*>(NULL));
+        for(size_t j=0; j<vbInliers.size(); j++)
+            if(vbInliers[j])
+                vpInlierMatches[j] = vpMatches[j];
+
+        const cv::Mat R = solver.GetEstimatedRotation();
+        const cv::Mat t = solver.GetEstimatedTranslation();
+        const float s = solver.GetEstimatedScale();
+        matcher.SearchBySim3(pKF,pCandidateKF,vpInlierMatches,s,R,t,7.5);
+
+        g2o::Sim3 gScm(Converter::toMatrix3d(R),Converter::toVector3d(t),s);
+        if(Optimizer::OptimizeSim3(pKF,pCandidateKF,vpInlierMatches,gScm,10,mbFixScale)<MERGE_MIN_INLIERS)
+            continue;
+
+        // Scw: from the candidate world to the camera of pKF, Tcw: from the world of pKF to its camera
+        g2o::Sim3 gSmw(Converter::toMatrix3d(pCandidateKF->GetRotation()),Converter::toVector3d(pCandidateKF->GetTranslation()),1.0);
+        g2o::Sim3 gScw = gScm*gSmw;
+        g2o::Sim3 gTcw(Converter::toMatrix3d(pKF->GetRotation()),Converter::toVector3d(pKF->GetTranslation()),1.0);
+
+        cout << "MapServer: agent " << pAgent->nId << " (KF " << pKF->mnId << ") matches agent " << pCandidateAgent->nId
+             << " (KF " << pCandidateKF->mnId << ")" << endl;
+
+        MergeMaps(pAgent,pCandidateAgent,gScw.inverse()*gTcw);
+        return;
+    }
+}
+
+void MapServer::MergeMaps(Agent *pAgent1, Agent *pAgent2, const g2o::Sim3 &S12)
+{
+    // The shared map of pAgent1 moves into the frame of the shared map of pAgent2
+    Agent* pReference1 = pAgent1->pReference;
+    Agent* pReference2 = pAgent2->pReference;
+    const g2o::Sim3 Sr2r1 = pAgent2->Sws*S12*pAgent1->Sws.inverse();
+
+    const vector<Agent*> vpShared1 = GetSharedMap(pReference1);
+    for(size_t i=0; i<vpShared1.size(); i++)
+    {
+        vpShared1[i]->Sws = Sr2r1*vpShared1[i]->Sws;
+        vpShared1[i]->pReference = pReference2;
+    }
+
+    SendAlignments(pReference2);
+}
+
+void MapServer::SetReference(Agent *pOldReference, Agent *pNewReference)
+{
+    const g2o::Sim3 Sno = pNewReference->Sws.inverse();
+    const vector<Agent*> vpShared = GetSharedMap(pOldReference);
+    for(size_t i=0; i<vpShared.size(); i++)
+    {
+        vpShared[i]->Sws = Sno*vpShared[i]->Sws;
+        vpShared[i]->pReference = pNewReference;
+    }
+}
+
+void MapServer::SendAlignments(Agent *pReference)
+{
+    const vector<Agent*> vpShared = GetSharedMap(pReference);
+
+    AlignmentMessage m;
+    m.nReferenceAgent = pReference->nId;
+    m.nAgents = vpShared.size();
+
+    for(size_t i=0; i<vpShared.size(); i++)
+    {
+        if(!vpShared[i]->pConnection)
+            continue;
+        m.Sws = Converter::toCvMat(vpShared[i]->Sws);
+        vpShared[i]->pConnection->pTransport->Send(EncodeMapMessage(m));
+    }
+}
+
+vector<MapServer::Agent*> MapServer::GetSharedMap(Agent *pReference)
+{
+    vector<Agent*> vpShared;
+    for(size_t i=0; i<mvpAgents.size(); i++)
+        if(mvpAgents[i]->pReference==pReference)
+            vpShared.push_back(mvpAgents[i]);
+    return vpShared;
+}
+
+bool MapServer::SaveSharedMaps(const string &strPath)
+{
+    if(mkdir(strPath.c_str(),0755)!=0 && errno!=EEXIST)
+    {
+        cerr << "MapServer: cannot create " << strPath << endl;
+        return false;
+    }
+
+    bool bOK = true;
+    for(size_t r=0; r<mvpAgents.size(); r++)
+    {
+        Agent* pReference = mvpAgents[r];
+        if(pReference->pReference!=pReference)
+            continue;
+
+        stringstream ss;
+        ss << strPath << "/shared_map_" << pReference->nId;
+        const string strDir = ss.str();
+        if(mkdir(strDir.c_str(),0755)!=0 && errno!=EEXIST)
+        {
+            cerr << "MapServer: cannot create " << strDir << endl;
+            bOK = false;
+            continue;
+        }
+
+        const vector<Agent*> vpShared = GetSharedMap(pReference);
+
+        vector<Eigen::Vector3d> vPoints;
+        ofstream fLines((strDir+"/MapLines.txt").c_str());
+        fLines << fixed << setprecision(7);
+
+        for(size_t i=0; i<vpShared.size(); i++)
+        {
+            const g2o::Sim3 &Sws = vpShared[i]->Sws;
+            const cv::Mat Rsw = Converter::toCvMat(Sws.rotation().toRotationMatrix());
+
+            stringstream ssTraj;
+            ssTraj << strDir << "/KeyFrameTrajectory_agent" << vpShared[i]->nId << ".txt";
+            ofstream f(ssTraj.str().c_str());
+            f << fixed;
+
+            vector<KeyFrame*> vpKFs = vpShared[i]->pMap->GetAllKeyFrames();
+            sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
+            for(size_t k=0; k<vpKFs.size(); k++)
+            {
+                KeyFrame* pKF = vpKFs[k];
+                const Eigen::Vector3d Os = Sws.map(Converter::toVector3d(pKF->GetCameraCenter()));
+                const cv::Mat Rsc = Rsw*pKF->GetRotation().t();
+                const vector<float> q = Converter::toQuaternion(Rsc);
+                f << setprecision(6) << pKF->mTimeStamp << setprecision(7) << " " << Os(0) << " " << Os(1) << " " << Os(2)
+                  << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << endl;
+            }
+            bOK = bOK && !f.fail();
+
+            const vector<MapPoint*> vpMPs = vpShared[i]->pMap->GetAllMapPoints();
+            for(size_t k=0; k<vpMPs.size(); k++)
+                vPoints.push_back(Sws.map(Converter::toVector3d(vpMPs[k]->GetWorldPos())));
+
+            const vector<MapLine*> vpMLs = vpShared[i]->pMap->GetAllMapLines();
+            for(size_t k=0; k<vpMLs.size(); k++)
+            {
+                const Vector6d pos = vpMLs[k]->GetWorldPos();
+                const Eigen::Vector3d Ps = Sws.map(pos.head(3));
+                const Eigen::Vector3d Pe = Sws.map(pos.tail(3));
+                fLines << Ps(0) << " " << Ps(1) << " " << Ps(2) << " " << Pe(0) << " " << Pe(1) << " " << Pe(2) << "\n";
+            }
+        }
+
+        fLines.close();
+        bOK = bOK && !fLines.fail();
+
+        // Same format as System::SavePointCloud
+        ofstream f((strDir+"/PointCloud.ply").c_str());
+        f << "ply"
+          << endl << "format ascii 1.0"
+          << endl << "element vertex " << vPoints.size()
+          << endl << "property float x"
+          << endl << "property float y"
+          << endl << "property float z"
+          << endl << "property uchar red"
+          << endl << "property uchar green"
+          << endl << "property uchar blue"
+          << endl << "end_header" << endl;
+        f << fixed << setprecision(7);
+        for(size_t k=0; k<vPoints.size(); k++)
+            f << vPoints[k](0) << " " << vPoints[k](1) << " " << vPoints[k](2) << " " << "255 255 255" << "\n";
+        f.close();
+        bOK = bOK && !f.fail();
+
+        cout << "MapServer: shared map of " << vpShared.size() << " agents saved to " << strDir << endl;
+    }
+
+    return bOK;
+}
+
+void MapServer::RequestFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+}
+
+bool MapServer::CheckFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinishRequested;
+}
+
+void MapServer::SetFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+bool MapServer::isFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+} //namespace ORB_SLAM
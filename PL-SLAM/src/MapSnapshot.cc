@@ -0,0 +1,139 @@
+#include "MapSnapshot.h"
+#include "Converter.h"
+
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+template<typename T>
+size_t CountValid(const typename CowStateArray<T>::SharedChunks &vChunks)
+{
+    size_t n = 0;
+    for(size_t c=0; c<vChunks.size(); c++)
+    {
+        if(!vChunks[c])
+            continue;
+        n += count(vChunks[c]->mvbValid,vChunks[c]->mvbValid+CowStateArray<T>::CHUNK_SIZE,true);
+    }
+    return n;
+}
+
+// Calls f(state) for every valid state, in id order
+template<typename T, typename F>
+void ForEachValid(const typename CowStateArray<T>::SharedChunks &vChunks, F f)
+{
+    for(size_t c=0; c<vChunks.size(); c++)
+    {
+        const typename CowStateArray<T>::Chunk* pChunk = vChunks[c].get();
+        if(!pChunk)
+            continue;
+        for(size_t i=0; i<CowStateArray<T>::CHUNK_SIZE; i++)
+            if(pChunk->mvbValid[i])
+                f(pChunk->mvStates[i]);
+    }
+}
+
+}
+
+MapSnapshot::MapSnapshot(const CowStateArray<KeyFrameState>::SharedChunks &vKeyFrames,
+                         const CowStateArray<MapPointState>::SharedChunks &vMapPoints,
+                         const CowStateArray<MapLineState>::SharedChunks &vMapLines, const int nBigChangeIdx):
+    mvKeyFrames(vKeyFrames), mvMapPoints(vMapPoints), mvMapLines(vMapLines), mnBigChangeIdx(nBigChangeIdx)
+{
+}
+
+size_t MapSnapshot::KeyFramesInSnapshot() const
+{
+    return CountValid<KeyFrameState>(mvKeyFrames);
+}
+
+size_t MapSnapshot::MapPointsInSnapshot() const
+{
+    return CountValid<MapPointState>(mvMapPoints);
+}
+
+size_t MapSnapshot::MapLinesInSnapshot() const
+{
+    return CountValid<MapLineState>(mvMapLines);
+}
+
+bool MapSnapshot::SaveKeyFrameTrajectoryTUM(const string &filename) const
+{
+    ofstream f(filename.c_str());
+    if(!f.is_open())
+        return false;
+    f << fixed;
+
+    ForEachValid<KeyFrameState>(mvKeyFrames,[&f](const KeyFrameState &s)
+    {
+        if(s.bRigCamera)
+            return;
+
+        cv::Mat Tcw(3,4,CV_32F,const_cast<float*>(s.Tcw));
+        cv::Mat Rwc = Tcw.colRange(0,3).t();
+        cv::Mat Ow = -Rwc*Tcw.col(3);
+        vector<float> q = Converter::toQuaternion(Rwc);
+        f << setprecision(6) << s.timestamp << setprecision(7) << " " << Ow.at<float>(0) << " " << Ow.at<float>(1) << " " << Ow.at<float>(2)
+          << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << endl;
+    });
+
+    f.close();
+    return !f.fail();
+}
+
+bool MapSnapshot::SavePointCloud(const string &filename) const
+{
+    ofstream f(filename.c_str());
+    if(!f.is_open())
+        return false;
+
+    f << "ply"
+      << endl << "format ascii 1.0"
+      << endl << "element vertex " << MapPointsInSnapshot()
+      << endl << "property float x"
+      << endl << "property float y"
+      << endl << "property float z"
+      << endl << "property uchar red"
+      << endl << "property uchar green"
+      << endl << "property uchar blue"
+      << endl << "end_header" << endl;
+
+    f << fixed << setprecision(std::numeric_limits<double>::digits10+1);
+
+    ForEachValid<MapPointState>(mvMapPoints,[&f](const MapPointState &s)
+    {
+        f << s.pos[0] << " " << s.pos[1] << " " << s.pos[2] << " " << "255 255 255" << "\n";
+    });
+
+    f.close();
+    return !f.fail();
+}
+
+bool MapSnapshot::SaveMapLines(const string &filename) const
+{
+    ofstream f(filename.c_str());
+    if(!f.is_open())
+        return false;
+
+    f << fixed << setprecision(7);
+
+    ForEachValid<MapLineState>(mvMapLines,[&f](const MapLineState &s)
+    {
+        f << s.pos[0] << " " << s.pos[1] << " " << s.pos[2] << " "
+          << s.pos[3] << " " << s.pos[4] << " " << s.pos[5] << "\n";
+    });
+
+    f.close();
+    return !f.fail();
+}
+
+} //namespace ORB_SLAM
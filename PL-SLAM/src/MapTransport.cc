@@ -0,0 +1,220 @@
+#include "MapTransport.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+bool MakeAddress(const string &strPath, sockaddr_un &addr)
+{
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strPath.empty() || strPath.size()>=sizeof(addr.sun_path))
+    {
+        cerr << "MapTransport: invalid socket path " << strPath << endl;
+        return false;
+    }
+    strncpy(addr.sun_path,strPath.c_str(),sizeof(addr.sun_path)-1);
+    return true;
+}
+
+// Retries interrupted and partial transfers, false on error or end of stream
+bool WriteAll(const int fd, const char* pData, size_t n)
+{
+    while(n>0)
+    {
+        const ssize_t w = send(fd,pData,n,MSG_NOSIGNAL);
+        if(w<0 && errno==EINTR)
+            continue;
+        if(w<=0)
+            return false;
+        pData += w;
+        n -= w;
+    }
+    return true;
+}
+
+bool ReadAll(const int fd, char* pData, size_t n)
+{
+    while(n>0)
+    {
+        const ssize_t r = recv(fd,pData,n,0);
+        if(r<0 && errno==EINTR)
+            continue;
+        if(r<=0)
+            return false;
+        pData += r;
+        n -= r;
+    }
+    return true;
+}
+
+// False on timeout or error
+bool WaitReadable(const int fd, const int timeoutMs)
+{
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int r;
+    do
+    {
+        r = poll(&pfd,1,timeoutMs);
+    } while(r<0 && errno==EINTR);
+
+    return r>0;
+}
+
+}
+
+UnixSocketTransport::UnixSocketTransport(const int fd): mFd(fd), mbOpen(fd>=0)
+{
+}
+
+UnixSocketTransport::~UnixSocketTransport()
+{
+    Close();
+    if(mFd>=0)
+        close(mFd);
+}
+
+UnixSocketTransport* UnixSocketTransport::Connect(const string &strPath)
+{
+    sockaddr_un addr;
+    if(!MakeAddress(strPath,addr))
+        return NULL;
+
+    const int fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd<0)
+        return NULL;
+
+    if(connect(fd,reinterpret_cast<sockaddr*>(&addr),sizeof(addr))!=0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    return new UnixSocketTransport(fd);
+}
+
+bool UnixSocketTransport::Send(const string &msg)
+{
+    if(!IsOpen())
+        return false;
+
+    if(msg.size()>MAX_MESSAGE_SIZE)
+    {
+        cerr << "MapTransport: message of " << msg.size() << " bytes is too large" << endl;
+        return false;
+    }
+
+    unique_lock<mutex> lock(mMutexSend);
+    const uint32_t n = msg.size();
+    if(!WriteAll(mFd,reinterpret_cast<const char*>(&n),sizeof(n)) || !WriteAll(mFd,msg.data(),n))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool UnixSocketTransport::Receive(string &msg, const int timeoutMs)
+{
+    if(!IsOpen())
+        return false;
+
+    unique_lock<mutex> lock(mMutexReceive);
+    if(!WaitReadable(mFd,timeoutMs))
+        return false;
+
+    // Once the length arrives the rest of the message follows, read it blocking
+    uint32_t n;
+    if(!ReadAll(mFd,reinterpret_cast<char*>(&n),sizeof(n)) || n>MAX_MESSAGE_SIZE)
+    {
+        Close();
+        return false;
+    }
+
+    msg.resize(n);
+    if(n>0 && !ReadAll(mFd,&msg[0],n))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool UnixSocketTransport::IsOpen()
+{
+    unique_lock<mutex> lock(mMutexOpen);
+    return mbOpen;
+}
+
+void UnixSocketTransport::Close()
+{
+    unique_lock<mutex> lock(mMutexOpen);
+    if(!mbOpen)
+        return;
+    mbOpen = false;
+
+    // Wakes up the threads blocked on the socket. The descriptor is closed in the destructor,
+    // a concurrent call never uses a reused descriptor.
+    shutdown(mFd,SHUT_RDWR);
+}
+
+UnixSocketListener::UnixSocketListener(const int fd, const string &strPath): mFd(fd), mstrPath(strPath)
+{
+}
+
+UnixSocketListener::~UnixSocketListener()
+{
+    close(mFd);
+    unlink(mstrPath.c_str());
+}
+
+UnixSocketListener* UnixSocketListener::Listen(const string &strPath)
+{
+    sockaddr_un addr;
+    if(!MakeAddress(strPath,addr))
+        return NULL;
+
+    const int fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if(fd<0)
+        return NULL;
+
+    unlink(strPath.c_str());
+    if(bind(fd,reinterpret_cast<sockaddr*>(&addr),sizeof(addr))!=0 || listen(fd,16)!=0)
+    {
+        cerr << "MapTransport: cannot listen on " << strPath << ": " << strerror(errno) << endl;
+        close(fd);
+        return NULL;
+    }
+
+    return new UnixSocketListener(fd,strPath);
+}
+
+MapTransport* UnixSocketListener::Accept(const int timeoutMs)
+{
+    if(!WaitReadable(mFd,timeoutMs))
+        return NULL;
+
+    const int fd = accept(mFd,NULL,NULL);
+    if(fd<0)
+        return NULL;
+
+    return new UnixSocketTransport(fd);
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,98 @@
+#include "MemoryReport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+atomic<size_t> gnOptimizerBytes(0);
+atomic<size_t> gnOptimizerPeakBytes(0);
+}
+
+MemoryReport::MemoryReport(): mnKeyFrames(0), mnMapPoints(0), mnMapLines(0)
+{
+    for(int i=0; i<NUM_CATEGORIES; i++)
+    {
+        mvBytes[i] = 0;
+        mvPeakBytes[i] = 0;
+    }
+}
+
+size_t MemoryReport::Total() const
+{
+    size_t n = 0;
+    for(int i=0; i<NUM_CATEGORIES; i++)
+        n += mvBytes[i];
+    return n;
+}
+
+size_t MemoryReport::PeakTotal() const
+{
+    size_t n = 0;
+    for(int i=0; i<NUM_CATEGORIES; i++)
+        n += mvPeakBytes[i];
+    return n;
+}
+
+const char* MemoryReport::CategoryName(const int category)
+{
+    static const char* names[NUM_CATEGORIES] = {"kf_images", "kf_features", "kf_grids", "kf_graph", "map_points",
+                                                "map_lines", "kf_database", "vocabulary", "optimizer"};
+    if(category<0 || category>=NUM_CATEGORIES)
+        return "unknown";
+    return names[category];
+}
+
+string MemoryReport::ToString() const
+{
+    const double MB = 1024.0*1024.0;
+
+    stringstream ss;
+    ss << fixed << setprecision(1);
+    ss << "Memory: " << Total()/MB << " MB (sampled peak " << PeakTotal()/MB << ") KFs " << mnKeyFrames
+       << " MPs " << mnMapPoints << " MLs " << mnMapLines << " |";
+    for(int i=0; i<NUM_CATEGORIES; i++)
+        ss << " " << CategoryName(i) << " " << mvBytes[i]/MB << "/" << mvPeakBytes[i]/MB;
+    return ss.str();
+}
+
+size_t VocabularyMemoryUsage(const ORBVocabulary* pVoc)
+{
+    if(!pVoc || pVoc->empty())
+        return 0;
+
+    // A full k-ary tree has about words*k/(k-1) nodes. Each node holds its id, weight, parent, word id,
+    // the vector of its children (and is itself an entry of its parent's one), and its descriptor.
+    const size_t nWords = pVoc->size();
+    const size_t k = max(2,pVoc->getBranchingFactor());
+    const size_t nNodes = nWords*k/(k-1)+1;
+
+    const size_t nodeBytes = 3*sizeof(DBoW2::NodeId) + sizeof(DBoW2::WordValue) + sizeof(vector<DBoW2::NodeId>) +
+                             sizeof(DBoW2::NodeId) + sizeof(DBoW2::FORB::TDescriptor) + DBoW2::FORB::L;
+
+    return nNodes*nodeBytes + nWords*sizeof(void*);
+}
+
+void RecordOptimizerMemoryUsage(const size_t nBytes)
+{
+    gnOptimizerBytes = nBytes;
+
+    size_t nPeak = gnOptimizerPeakBytes;
+    while(nBytes>nPeak && !gnOptimizerPeakBytes.compare_exchange_weak(nPeak,nBytes))
+        ;
+}
+
+size_t GetOptimizerMemoryUsage(size_t &nPeakBytes)
+{
+    nPeakBytes = gnOptimizerPeakBytes;
+    return gnOptimizerBytes;
+}
+
+} //namespace ORB_SLAM
@@ -62,6 +62,10 @@
 
 #include "ORBextractor.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define ORB_SIMD_X86
+#include <immintrin.h>
+#endif
 
 using namespace cv;
 using namespace std;
@@ -146,6 +150,252 @@ static void computeOrbDescriptor(const KeyPoint& kpt,
     #undef GET_VALUE
 }
 
+// SIMD kernels for the orientation and the descriptor (x86: SSE2 baseline, AVX2 selected at runtime).
+// All paths give bit-identical results: moments are exact integer sums, and the rotated pattern
+// offsets are computed in float with the products rounded before the sum, as in the scalar code.
+#ifdef ORB_SIMD_X86
+
+enum { ORB_SIMD_SSE2 = 1, ORB_SIMD_AVX2 = 2 };
+
+static int detectSimdLevel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ORB_SIMD_AVX2;
+    return ORB_SIMD_SSE2;
+}
+
+static int simdLevel()
+{
+    static const int level = detectSimdLevel();
+    return level;
+}
+
+// Keep the products rounded to float, the compiler must not fuse them with the following add into a FMA
+#define ORB_NO_CONTRACT(v) __asm__("" : "+x"(v))
+
+static inline int hsum_epi32(__m128i x)
+{
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1,0,3,2)));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtsi128_si32(x);
+}
+
+#endif
+
+// Weights of the intensity centroid for each row of the circular patch, on 32 pixels u=-15..16
+// (the last one only pads the row). Zero outside the patch.
+struct ICAngleWeights
+{
+    short wu[HALF_PATCH_SIZE+1][32];
+    short wv[HALF_PATCH_SIZE+1][32];
+};
+
+static void computeICAngleWeights(const vector<int>& u_max, ICAngleWeights& w)
+{
+    for (int v = 0; v <= HALF_PATCH_SIZE; ++v)
+    {
+        const int d = u_max[v];
+        for (int k = 0; k < 32; ++k)
+        {
+            const int u = k - HALF_PATCH_SIZE;
+            const bool inside = u >= -d && u <= d;
+            w.wu[v][k] = (short)(inside ? u : 0);
+            w.wv[v][k] = (short)(inside ? v : 0);
+        }
+    }
+}
+
+#ifdef ORB_SIMD_X86
+
+static void computeOrientationSSE2(const Mat& image, vector<KeyPoint>& keypoints, const ICAngleWeights& w)
+{
+    const int step = (int)image.step1();
+    const __m128i zero = _mm_setzero_si128();
+
+    for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
+         keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
+    {
+        const uchar* center = &image.at<uchar> (cvRound(keypoint->pt.y), cvRound(keypoint->pt.x));
+
+        // Center line, v=0
+        const __m128i c0 = _mm_loadu_si128((const __m128i*)(center - HALF_PATCH_SIZE));
+        const __m128i c1 = _mm_loadu_si128((const __m128i*)(center - HALF_PATCH_SIZE + 16));
+        __m128i m10 = _mm_madd_epi16(_mm_unpacklo_epi8(c0, zero), _mm_loadu_si128((const __m128i*)&w.wu[0][0]));
+        m10 = _mm_add_epi32(m10, _mm_madd_epi16(_mm_unpackhi_epi8(c0, zero), _mm_loadu_si128((const __m128i*)&w.wu[0][8])));
+        m10 = _mm_add_epi32(m10, _mm_madd_epi16(_mm_unpacklo_epi8(c1, zero), _mm_loadu_si128((const __m128i*)&w.wu[0][16])));
+        m10 = _mm_add_epi32(m10, _mm_madd_epi16(_mm_unpackhi_epi8(c1, zero), _mm_loadu_si128((const __m128i*)&w.wu[0][24])));
+        __m128i m01 = _mm_setzero_si128();
+
+        for (int v = 1; v <= HALF_PATCH_SIZE; ++v)
+        {
+            const uchar* plus = center - HALF_PATCH_SIZE + v*step;
+            const uchar* minus = center - HALF_PATCH_SIZE - v*step;
+            const __m128i p[2] = { _mm_loadu_si128((const __m128i*)plus), _mm_loadu_si128((const __m128i*)(plus + 16)) };
+            const __m128i m[2] = { _mm_loadu_si128((const __m128i*)minus), _mm_loadu_si128((const __m128i*)(minus + 16)) };
+
+            for (int k = 0; k < 4; ++k)
+            {
+                const __m128i pk = (k & 1) ? _mm_unpackhi_epi8(p[k>>1], zero) : _mm_unpacklo_epi8(p[k>>1], zero);
+                const __m128i mk = (k & 1) ? _mm_unpackhi_epi8(m[k>>1], zero) : _mm_unpacklo_epi8(m[k>>1], zero);
+                m10 = _mm_add_epi32(m10, _mm_madd_epi16(_mm_add_epi16(pk, mk), _mm_loadu_si128((const __m128i*)&w.wu[v][8*k])));
+                m01 = _mm_add_epi32(m01, _mm_madd_epi16(_mm_sub_epi16(pk, mk), _mm_loadu_si128((const __m128i*)&w.wv[v][8*k])));
+            }
+        }
+
+        keypoint->angle = fastAtan2((float)hsum_epi32(m01), (float)hsum_epi32(m10));
+    }
+}
+
+__attribute__((target("avx2")))
+static void computeOrientationAVX2(const Mat& image, vector<KeyPoint>& keypoints, const ICAngleWeights& w)
+{
+    const int step = (int)image.step1();
+
+    for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
+         keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
+    {
+        const uchar* center = &image.at<uchar> (cvRound(keypoint->pt.y), cvRound(keypoint->pt.x));
+
+        // Center line, v=0
+        const __m256i c0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(center - HALF_PATCH_SIZE)));
+        const __m256i c1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(center - HALF_PATCH_SIZE + 16)));
+        __m256i m10 = _mm256_madd_epi16(c0, _mm256_loadu_si256((const __m256i*)&w.wu[0][0]));
+        m10 = _mm256_add_epi32(m10, _mm256_madd_epi16(c1, _mm256_loadu_si256((const __m256i*)&w.wu[0][16])));
+        __m256i m01 = _mm256_setzero_si256();
+
+        for (int v = 1; v <= HALF_PATCH_SIZE; ++v)
+        {
+            const uchar* plus = center - HALF_PATCH_SIZE + v*step;
+            const uchar* minus = center - HALF_PATCH_SIZE - v*step;
+
+            for (int k = 0; k < 2; ++k)
+            {
+                const __m256i pk = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(plus + 16*k)));
+                const __m256i mk = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(minus + 16*k)));
+                m10 = _mm256_add_epi32(m10, _mm256_madd_epi16(_mm256_add_epi16(pk, mk), _mm256_loadu_si256((const __m256i*)&w.wu[v][16*k])));
+                m01 = _mm256_add_epi32(m01, _mm256_madd_epi16(_mm256_sub_epi16(pk, mk), _mm256_loadu_si256((const __m256i*)&w.wv[v][16*k])));
+            }
+        }
+
+        const int m_10 = hsum_epi32(_mm_add_epi32(_mm256_castsi256_si128(m10), _mm256_extracti128_si256(m10, 1)));
+        const int m_01 = hsum_epi32(_mm_add_epi32(_mm256_castsi256_si128(m01), _mm256_extracti128_si256(m01, 1)));
+        keypoint->angle = fastAtan2((float)m_01, (float)m_10);
+    }
+}
+
+#endif
+
+// BRIEF pattern with the first points of the 256 tests followed by their second points,
+// so that the tests can be evaluated 16 or 32 at a time
+struct BriefPattern
+{
+    float x[512];
+    float y[512];
+};
+
+static void computeBriefPattern(const Point* pattern, BriefPattern& p)
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        p.x[i] = (float)pattern[2*i].x;
+        p.y[i] = (float)pattern[2*i].y;
+        p.x[256+i] = (float)pattern[2*i+1].x;
+        p.y[256+i] = (float)pattern[2*i+1].y;
+    }
+}
+
+#ifdef ORB_SIMD_X86
+
+// Offsets from the keypoint of the rotated pattern points: cvRound(x*b + y*a)*step + cvRound(x*a - y*b)
+static void computeBriefOffsetsSSE2(const BriefPattern& p, float a, float b, int step, int* offsets)
+{
+    const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b);
+    int rows[4], cols[4];
+
+    for (int i = 0; i < 512; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(p.x + i), y = _mm_loadu_ps(p.y + i);
+        __m128 xb = _mm_mul_ps(x, vb), ya = _mm_mul_ps(y, va);
+        __m128 xa = _mm_mul_ps(x, va), yb = _mm_mul_ps(y, vb);
+        ORB_NO_CONTRACT(xb); ORB_NO_CONTRACT(ya);
+        ORB_NO_CONTRACT(xa); ORB_NO_CONTRACT(yb);
+
+        // SSE2 has no 32 bit multiplication, the row offset is done in scalar
+        _mm_storeu_si128((__m128i*)rows, _mm_cvtps_epi32(_mm_add_ps(xb, ya)));
+        _mm_storeu_si128((__m128i*)cols, _mm_cvtps_epi32(_mm_sub_ps(xa, yb)));
+        for (int k = 0; k < 4; ++k)
+            offsets[i+k] = rows[k]*step + cols[k];
+    }
+}
+
+__attribute__((target("avx2")))
+static void computeBriefOffsetsAVX2(const BriefPattern& p, float a, float b, int step, int* offsets)
+{
+    const __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b);
+    const __m256i vstep = _mm256_set1_epi32(step);
+
+    for (int i = 0; i < 512; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(p.x + i), y = _mm256_loadu_ps(p.y + i);
+        __m256 xb = _mm256_mul_ps(x, vb), ya = _mm256_mul_ps(y, va);
+        __m256 xa = _mm256_mul_ps(x, va), yb = _mm256_mul_ps(y, vb);
+        ORB_NO_CONTRACT(xb); ORB_NO_CONTRACT(ya);
+        ORB_NO_CONTRACT(xa); ORB_NO_CONTRACT(yb);
+
+        const __m256i rows = _mm256_cvtps_epi32(_mm256_add_ps(xb, ya));
+        const __m256i cols = _mm256_cvtps_epi32(_mm256_sub_ps(xa, yb));
+        _mm256_storeu_si256((__m256i*)(offsets + i), _mm256_add_epi32(_mm256_mullo_epi32(rows, vstep), cols));
+    }
+}
+
+// Test t compares the pixels at offsets[t] and offsets[256+t], and sets bit t%8 of desc[t/8]
+static void computeBriefTestsSSE2(const uchar* center, const int* offsets, uchar* desc)
+{
+    uchar t0[256], t1[256];
+    for (int t = 0; t < 256; ++t)
+    {
+        t0[t] = center[offsets[t]];
+        t1[t] = center[offsets[256+t]];
+    }
+
+    // Unsigned comparison with the signed instruction
+    const __m128i sign = _mm_set1_epi8((char)0x80);
+    for (int t = 0; t < 256; t += 16)
+    {
+        const __m128i v0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(t0 + t)), sign);
+        const __m128i v1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(t1 + t)), sign);
+        const int mask = _mm_movemask_epi8(_mm_cmplt_epi8(v0, v1));
+        desc[t/8] = (uchar)(mask & 0xff);
+        desc[t/8+1] = (uchar)(mask >> 8);
+    }
+}
+
+__attribute__((target("avx2")))
+static void computeBriefTestsAVX2(const uchar* center, const int* offsets, uchar* desc)
+{
+    uchar t0[256], t1[256];
+    for (int t = 0; t < 256; ++t)
+    {
+        t0[t] = center[offsets[t]];
+        t1[t] = center[offsets[256+t]];
+    }
+
+    const __m256i sign = _mm256_set1_epi8((char)0x80);
+    for (int t = 0; t < 256; t += 32)
+    {
+        const __m256i v0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(t0 + t)), sign);
+        const __m256i v1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(t1 + t)), sign);
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v1, v0));
+        desc[t/8] = (uchar)(mask & 0xff);
+        desc[t/8+1] = (uchar)((mask >> 8) & 0xff);
+        desc[t/8+2] = (uchar)((mask >> 16) & 0xff);
+        desc[t/8+3] = (uchar)(mask >> 24);
+    }
+}
+
+#endif
+
 
 static int bit_pattern_31_[256*4] =
 {
@@ -471,6 +721,17 @@ ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
 
 static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, const vector<int>& umax)
 {
+#ifdef ORB_SIMD_X86
+    ICAngleWeights w;
+    computeICAngleWeights(umax, w);
+
+    if (simdLevel() == ORB_SIMD_AVX2)
+        computeOrientationAVX2(image, keypoints, w);
+    else
+        computeOrientationSSE2(image, keypoints, w);
+    return;
+#endif
+
     for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
          keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
     {
@@ -786,6 +1047,21 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
         const int wCell = ceil(width/nCols);
         const int hCell = ceil(height/nRows);
 
+        // One cv::FAST pass over the whole level with the high threshold. FAST detects 3 pixels away from the
+        // borders of the level area and the cells overlap by 6 pixels, so the detection areas of the cells tile the
+        // level and each corner is counted in the cell whose area contains it.
+        const Mat levelArea = mvImagePyramid[level].rowRange(minBorderY,maxBorderY).colRange(minBorderX,maxBorderX);
+        FAST(levelArea,vToDistributeKeys,iniThFAST,true);
+
+        vector<bool> vbCellHasKeys(nRows*nCols,false);
+        for(size_t k=0; k<vToDistributeKeys.size(); k++)
+        {
+            const int i = std::max(0,std::min(nRows-1,static_cast<int>((vToDistributeKeys[k].pt.y-3)/hCell)));
+            const int j = std::max(0,std::min(nCols-1,static_cast<int>((vToDistributeKeys[k].pt.x-3)/wCell)));
+            vbCellHasKeys[i*nCols+j] = true;
+        }
+
+        // Only the cells without corners are detected again, with the low threshold
         for(int i=0; i<nRows; i++)
         {
             const float iniY =minBorderY+i*hCell;
@@ -798,6 +1074,9 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
 
             for(int j=0; j<nCols; j++)
             {
+                if(vbCellHasKeys[i*nCols+j])
+                    continue;
+
                 const float iniX =minBorderX+j*wCell;
                 float maxX = iniX+wCell+6;
                 if(iniX>=maxBorderX-6)
@@ -807,24 +1086,14 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
 
                 vector<cv::KeyPoint> vKeysCell;
                 FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                     vKeysCell,iniThFAST,true);
-
-                if(vKeysCell.empty())
-                {
-                    FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                         vKeysCell,minThFAST,true);
-                }
+                     vKeysCell,minThFAST,true);
 
-                if(!vKeysCell.empty())
+                for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
                 {
-                    for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
-                    {
-                        (*vit).pt.x+=j*wCell;
-                        (*vit).pt.y+=i*hCell;
-                        vToDistributeKeys.push_back(*vit);
-                    }
+                    (*vit).pt.x+=j*wCell;
+                    (*vit).pt.y+=i*hCell;
+                    vToDistributeKeys.push_back(*vit);
                 }
-
             }
         }
 
@@ -1036,6 +1305,35 @@ static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Ma
 {
     descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
 
+#ifdef ORB_SIMD_X86
+    BriefPattern briefPattern;
+    computeBriefPattern(&pattern[0], briefPattern);
+
+    const bool bAVX2 = simdLevel() == ORB_SIMD_AVX2;
+    const int step = (int)image.step;
+    int offsets[512];
+
+    for (size_t i = 0; i < keypoints.size(); i++)
+    {
+        const KeyPoint& kpt = keypoints[i];
+        const float angle = (float)kpt.angle*factorPI;
+        const float a = (float)cos(angle), b = (float)sin(angle);
+        const uchar* center = &image.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
+
+        if (bAVX2)
+        {
+            computeBriefOffsetsAVX2(briefPattern, a, b, step, offsets);
+            computeBriefTestsAVX2(center, offsets, descriptors.ptr((int)i));
+        }
+        else
+        {
+            computeBriefOffsetsSSE2(briefPattern, a, b, step, offsets);
+            computeBriefTestsSSE2(center, offsets, descriptors.ptr((int)i));
+        }
+    }
+    return;
+#endif
+
     for (size_t i = 0; i < keypoints.size(); i++)
         computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
 }
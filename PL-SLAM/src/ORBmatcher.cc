@@ -84,57 +84,24 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
         if(vIndices.empty())
             continue;
 
-        const cv::Mat MPdescriptor = pMP->GetDescriptor();
-
-        int bestDist=256;
-        int bestLevel= -1;
-        int bestDist2=256;
-        int bestLevel2 = -1;
-        int bestIdx =-1 ;
+        ORBDescriptorBuffer bufferMP;
+        const ORBDescriptorView MPdescriptor = pMP->GetDescriptor(bufferMP);
+        const float maxErrorR = r*F.mvScaleFactors[nPredictedLevel];
 
         // Get best and second matches with near keypoints
-        for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
-        {
-            const size_t idx = *vit;
-
-            if(F.mvpMapPoints[idx])
-                if(F.mvpMapPoints[idx]->Observations()>0)
-                    continue;
-
-            if(F.mvuRight[idx]>0)
-            {
-                const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
-                if(er>r*F.mvScaleFactors[nPredictedLevel])
-                    continue;
-            }
-
-            const cv::Mat &d = F.mDescriptors.row(idx);
-
-            if(d.empty() || MPdescriptor.empty())
-                continue;
-            const int dist = DescriptorDistance(MPdescriptor,d);
-
-            if(dist<bestDist)
-            {
-                bestDist2=bestDist;
-                bestDist=dist;
-                bestLevel2 = bestLevel;
-                bestLevel = F.mvKeysUn[idx].octave;
-                bestIdx=idx;
-            }
-            else if(dist<bestDist2)
+        const BestMatch best = SearchBestMatch(MPdescriptor, vIndices, F.mDescriptors,
+            [&](const size_t idx) -> bool
             {
-                bestLevel2 = F.mvKeysUn[idx].octave;
-                bestDist2=dist;
-            }
-        }
+                if(F.mvpMapPoints[idx] && F.mvpMapPoints[idx]->Observations()>0)
+                    return true;
+                return F.mvuRight[idx]>0 && fabs(pMP->mTrackProjXR-F.mvuRight[idx])>maxErrorR;
+            },
+            [&](const size_t idx) { return F.mvKeysUn[idx].octave; });
 
         // Apply ratio to second match (only if best and second are in the same scale level)
-        if(bestDist<=TH_HIGH)
+        if(best.Accept(TH_HIGH,mfNNratio))
         {
-            if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
-                continue;
-
+            const int bestIdx = best.bestIdx;
             F.mvpMapPoints[bestIdx]=pMP;
             nmatches++;
         }
@@ -194,10 +161,7 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
 
     int nmatches=0;
 
-    vector<int> rotHist[HISTO_LENGTH];
-    for(int i=0;i<HISTO_LENGTH;i++)
-        rotHist[i].reserve(500);
-    const float factor = 1.0f/HISTO_LENGTH;
+    RotationHistogram rotHist(HISTO_LENGTH);
 
     // We perform the matching over ORB that belong to the same vocabulary node (at a certain level)
     // 将属于同一节点（特定层）的ORB特征进行匹配
@@ -226,7 +190,7 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                 if(pMP->isBad())
                     continue;                
 
-                const cv::Mat &dKF= pKF->mDescriptors.row(realIdxKF);   //取出KF中该特征对应的描述子
+                const ORBDescriptorView dKF = ORBDescriptorView::Row(pKF->mDescriptors,realIdxKF);   //取出KF中该特征对应的描述子
 
                 int bestDist1=256;  //最好的距离（最小距离）
                 int bestIdxF =-1 ;
@@ -240,11 +204,11 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                     if(vpMapPointMatches[realIdxF]) //表明这个点已经被匹配过了，不再匹配，加快速度
                         continue;
 
-                    const cv::Mat &dF = F.mDescriptors.row(realIdxF);   //取出F中该特征点对应的描述子
+                    const ORBDescriptorView dF = ORBDescriptorView::Row(F.mDescriptors,realIdxF);   //取出F中该特征点对应的描述子
 
                     if(dKF.empty() || dF.empty())
                         continue;
-                    const int dist =  DescriptorDistance(dKF,dF);   //求描述子之间的距离
+                    const int dist =  HammingDistance(dKF,dF);   //求描述子之间的距离
 
                     if(dist<bestDist1)  // dist < bestDist11 < bestDist2，更新bestDist1, bestDist2
                     {
@@ -273,14 +237,7 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                         // 如果图像旋转了，这个角度将发生改变，所有的特征点的角度变换应该是一致的，通过直方图统计得到最准确的角度变化值
                         if(mbCheckOrientation)
                         {
-                            float rot = kp.angle-F.mvKeys[bestIdxF].angle;  //该特征点的角度变化值
-                            if(rot<0.0)
-                                rot+=360.0f;
-                            int bin = round(rot*factor);    //将rot分配到bin组
-                            if(bin==HISTO_LENGTH)
-                                bin=0;
-                            assert(bin>=0 && bin<HISTO_LENGTH);
-                            rotHist[bin].push_back(bestIdxF);
+                            rotHist.Add(kp.angle-F.mvKeys[bestIdxF].angle,bestIdxF);
                         }
                         nmatches++;
                     }
@@ -304,22 +261,11 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
     //根据方向剔除误匹配的点
     if(mbCheckOrientation)
     {
-        int ind1=-1;
-        int ind2=-1;
-        int ind3=-1;
-
-        // 计算rotHist中最大的三个的index
-        ComputeThreeMaxima(rotHist,HISTO_LENGTH,ind1,ind2,ind3);
-
-        for(int i=0; i<HISTO_LENGTH; i++)
+        const vector<int> vInconsistent = rotHist.GetInconsistent();
+        for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
         {
-            if(i==ind1 || i==ind2 || i==ind3)
-                continue;
-            for(size_t j=0, jend=rotHist[i].size(); j<jend; j++)
-            {
-                vpMapPointMatches[rotHist[i][j]]=static_cast<MapPoint*>(NULL);
-                nmatches--;
-            }
+            vpMapPointMatches[vInconsistent[j]]=static_cast<MapPoint*>(NULL);
+            nmatches--;
         }
     }
 
@@ -404,7 +350,8 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        ORBDescriptorBuffer bufferMP;
+        const ORBDescriptorView dMP = pMP->GetDescriptor(bufferMP);
 
         int bestDist = 256;
         int bestIdx = -1;
@@ -414,16 +361,16 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
             if(vpMatched[idx])
                 continue;
 
-            const int &kpLevel= pKF->mvKeysUn[idx].octave;
+            const int kpLevel= pKF->mvKeysUn.Octave(idx);
 
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+            const ORBDescriptorView dKF = ORBDescriptorView::Row(pKF->mDescriptors,idx);
 
             if(dKF.empty() || dMP.empty())
                 continue;
-            const int dist = DescriptorDistance(dMP,dKF);
+            const int dist = HammingDistance(dMP,dKF);
 
             if(dist<bestDist)
             {
@@ -457,10 +404,7 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
     int nmatches=0;
     vnMatches12 = vector<int>(F1.mvKeysUn.size(),-1);
 
-    vector<int> rotHist[HISTO_LENGTH];  //HISTO_LENGTH=30
-    for(int i=0;i<HISTO_LENGTH;i++)
-        rotHist[i].reserve(500);
-    const float factor = 1.0f/HISTO_LENGTH;
+    RotationHistogram rotHist(HISTO_LENGTH);
 
     vector<int> vMatchedDistance(F2.mvKeysUn.size(),INT_MAX);
     vector<int> vnMatches21(F2.mvKeysUn.size(),-1);
@@ -477,7 +421,7 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
         if(vIndices2.empty())
             continue;
 
-        cv::Mat d1 = F1.mDescriptors.row(i1);
+        const ORBDescriptorView d1 = ORBDescriptorView::Row(F1.mDescriptors,i1);
 
         int bestDist = INT_MAX;
         int bestDist2 = INT_MAX;
@@ -487,11 +431,11 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
         {
             size_t i2 = *vit;
 
-            cv::Mat d2 = F2.mDescriptors.row(i2);
+            const ORBDescriptorView d2 = ORBDescriptorView::Row(F2.mDescriptors,i2);
 
             if(d1.empty() || d2.empty())
                 continue;
-            int dist = DescriptorDistance(d1,d2);
+            int dist = HammingDistance(d1,d2);
 
             if(vMatchedDistance[i2]<=dist)
                 continue;
@@ -524,14 +468,7 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
 
                 if(mbCheckOrientation)
                 {
-                    float rot = F1.mvKeysUn[i1].angle-F2.mvKeysUn[bestIdx2].angle;
-                    if(rot<0.0)
-                        rot+=360.0f;
-                    int bin = round(rot*factor);
-                    if(bin==HISTO_LENGTH)
-                        bin=0;
-                    assert(bin>=0 && bin<HISTO_LENGTH);
-                    rotHist[bin].push_back(i1);
+                    rotHist.Add(F1.mvKeysUn[i1].angle-F2.mvKeysUn[bestIdx2].angle,i1);
                 }
             }
         }
@@ -540,24 +477,14 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
 
     if(mbCheckOrientation)
     {
-        int ind1=-1;
-        int ind2=-1;
-        int ind3=-1;
-
-        ComputeThreeMaxima(rotHist,HISTO_LENGTH,ind1,ind2,ind3);
-
-        for(int i=0; i<HISTO_LENGTH; i++)
+        const vector<int> vInconsistent = rotHist.GetInconsistent();
+        for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
         {
-            if(i==ind1 || i==ind2 || i==ind3)
-                continue;
-            for(size_t j=0, jend=rotHist[i].size(); j<jend; j++)
+            int idx1 = vInconsistent[j];
+            if(vnMatches12[idx1]>=0)
             {
-                int idx1 = rotHist[i][j];
-                if(vnMatches12[idx1]>=0)
-                {
-                    vnMatches12[idx1]=-1;
-                    nmatches--;
-                }
+                vnMatches12[idx1]=-1;
+                nmatches--;
             }
         }
 
@@ -573,12 +500,12 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
 
 int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &vpMatches12)
 {
-    const vector<cv::KeyPoint> &vKeysUn1 = pKF1->mvKeysUn;
+    const CompactKeyPoints &vKeysUn1 = pKF1->mvKeysUn;
     const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
     const vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
     const cv::Mat &Descriptors1 = pKF1->mDescriptors;
 
-    const vector<cv::KeyPoint> &vKeysUn2 = pKF2->mvKeysUn;
+    const CompactKeyPoints &vKeysUn2 = pKF2->mvKeysUn;
     const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
     const vector<MapPoint*> vpMapPoints2 = pKF2->GetMapPointMatches();
     const cv::Mat &Descriptors2 = pKF2->mDescriptors;
@@ -586,11 +513,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
     vpMatches12 = vector<MapPoint*>(vpMapPoints1.size(),static_cast<MapPoint*>(NULL));
     vector<bool> vbMatched2(vpMapPoints2.size(),false);
 
-    vector<int> rotHist[HISTO_LENGTH];
-    for(int i=0;i<HISTO_LENGTH;i++)
-        rotHist[i].reserve(500);
-
-    const float factor = 1.0f/HISTO_LENGTH;
+    RotationHistogram rotHist(HISTO_LENGTH);
 
     int nmatches = 0;
 
@@ -613,7 +536,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
                 if(pMP1->isBad())
                     continue;
 
-                const cv::Mat &d1 = Descriptors1.row(idx1);
+                const ORBDescriptorView d1 = ORBDescriptorView::Row(Descriptors1,idx1);
 
                 int bestDist1=256;
                 int bestIdx2 =-1 ;
@@ -631,11 +554,11 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
                     if(pMP2->isBad())
                         continue;
 
-                    const cv::Mat &d2 = Descriptors2.row(idx2);
+                    const ORBDescriptorView d2 = ORBDescriptorView::Row(Descriptors2,idx2);
 
                     if(d1.empty() || d2.empty())
                         continue;
-                    int dist = DescriptorDistance(d1,d2);
+                    int dist = HammingDistance(d1,d2);
 
                     if(dist<bestDist1)
                     {
@@ -658,14 +581,7 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
 
                         if(mbCheckOrientation)
                         {
-                            float rot = vKeysUn1[idx1].angle-vKeysUn2[bestIdx2].angle;
-                            if(rot<0.0)
-                                rot+=360.0f;
-                            int bin = round(rot*factor);
-                            if(bin==HISTO_LENGTH)
-                                bin=0;
-                            assert(bin>=0 && bin<HISTO_LENGTH);
-                            rotHist[bin].push_back(idx1);
+                            rotHist.Add(vKeysUn1[idx1].angle-vKeysUn2[bestIdx2].angle,idx1);
                         }
                         nmatches++;
                     }
@@ -687,21 +603,11 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
 
     if(mbCheckOrientation)
     {
-        int ind1=-1;
-        int ind2=-1;
-        int ind3=-1;
-
-        ComputeThreeMaxima(rotHist,HISTO_LENGTH,ind1,ind2,ind3);
-
-        for(int i=0; i<HISTO_LENGTH; i++)
+        const vector<int> vInconsistent = rotHist.GetInconsistent();
+        for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
         {
-            if(i==ind1 || i==ind2 || i==ind3)
-                continue;
-            for(size_t j=0, jend=rotHist[i].size(); j<jend; j++)
-            {
-                vpMatches12[rotHist[i][j]]=static_cast<MapPoint*>(NULL);
-                nmatches--;
-            }
+            vpMatches12[vInconsistent[j]]=static_cast<MapPoint*>(NULL);
+            nmatches--;
         }
     }
 
@@ -742,11 +648,7 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
     vector<bool> vbMatched2(pKF2->N,false);
     vector<int> vMatches12(pKF1->N,-1);
 
-    vector<int> rotHist[HISTO_LENGTH];
-    for(int i=0;i<HISTO_LENGTH;i++)
-        rotHist[i].reserve(500);
-
-    const float factor = 1.0f/HISTO_LENGTH;
+    RotationHistogram rotHist(HISTO_LENGTH);
 
     // 将属于同一节点（特定层）的ORB特征进行匹配
     // FeatureVector的数据结构类似于：{(node1, feature_vector1) (node2, feature_vector2) ...}
@@ -787,7 +689,7 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
                 const cv::KeyPoint &kp1 = pKF1->mvKeysUn[idx1];
 
                 // step3.3：取出特征点对应的描述子
-                const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
+                const ORBDescriptorView d1 = ORBDescriptorView::Row(pKF1->mDescriptors,idx1);
                 
                 int bestDist = TH_LOW;
                 int bestIdx2 = -1;
@@ -813,12 +715,12 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
                             continue;
 
                     // step4.2：通过特征点索引idx2在pKF2中取出对应特征点的描述子
-                    const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
+                    const ORBDescriptorView d2 = ORBDescriptorView::Row(pKF2->mDescriptors,idx2);
 
                     // 计算idx1与idx2在两个关键帧中对应特征点的描述子距离
                     if(d1.empty() || d2.empty())
                         continue;
-                    const int dist = DescriptorDistance(d1,d2);
+                    const int dist = HammingDistance(d1,d2);
                     
                     if(dist>TH_LOW || dist>bestDist)
                         continue;
@@ -851,14 +753,7 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
 
                     if(mbCheckOrientation)
                     {
-                        float rot = kp1.angle-kp2.angle;
-                        if(rot<0.0)
-                            rot+=360.0f;
-                        int bin = round(rot*factor);
-                        if(bin==HISTO_LENGTH)
-                            bin=0;
-                        assert(bin>=0 && bin<HISTO_LENGTH);
-                        rotHist[bin].push_back(idx1);
+                        rotHist.Add(kp1.angle-kp2.angle,idx1);
                     }
                 }
             }
@@ -878,21 +773,11 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
 
     if(mbCheckOrientation)
     {
-        int ind1=-1;
-        int ind2=-1;
-        int ind3=-1;
-
-        ComputeThreeMaxima(rotHist,HISTO_LENGTH,ind1,ind2,ind3);
-
-        for(int i=0; i<HISTO_LENGTH; i++)
+        const vector<int> vInconsistent = rotHist.GetInconsistent();
+        for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
         {
-            if(i==ind1 || i==ind2 || i==ind3)
-                continue;
-            for(size_t j=0, jend=rotHist[i].size(); j<jend; j++)
-            {
-                vMatches12[rotHist[i][j]]=-1;
-                nmatches--;
-            }
+            vMatches12[vInconsistent[j]]=-1;
+            nmatches--;
         }
 
     }
@@ -985,7 +870,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
 
         // Match to the most similar keypoint in the radius
 
-        const cv::Mat dMP = pMP->GetDescriptor();
+        ORBDescriptorBuffer bufferMP;
+
+        const ORBDescriptorView dMP = pMP->GetDescriptor(bufferMP);
 
         int bestDist = 256;
         int bestIdx = -1;
@@ -1026,11 +913,11 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
                     continue;
             }
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+            const ORBDescriptorView dKF = ORBDescriptorView::Row(pKF->mDescriptors,idx);
 
             if(dMP.empty() || dKF.empty())
                 continue;
-            const int dist = DescriptorDistance(dMP,dKF);
+            const int dist = HammingDistance(dMP,dKF);
 
             if(dist<bestDist)
             {
@@ -1150,23 +1037,25 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
 
         // Match to the most similar keypoint in the radius
 
-        const cv::Mat dMP = pMP->GetDescriptor();
+        ORBDescriptorBuffer bufferMP;
+
+        const ORBDescriptorView dMP = pMP->GetDescriptor(bufferMP);
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
         for(vector<size_t>::const_iterator vit=vIndices.begin(); vit!=vIndices.end(); vit++)
         {
             const size_t idx = *vit;
-            const int &kpLevel = pKF->mvKeysUn[idx].octave;
+            const int kpLevel = pKF->mvKeysUn.Octave(idx);
 
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+            const ORBDescriptorView dKF = ORBDescriptorView::Row(pKF->mDescriptors,idx);
 
             if(dMP.empty() || dKF.empty())
                 continue;
-            int dist = DescriptorDistance(dMP,dKF);
+            int dist = HammingDistance(dMP,dKF);
 
             if(dist<bestDist)
             {
@@ -1291,7 +1180,8 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        ORBDescriptorBuffer bufferMP;
+        const ORBDescriptorView dMP = pMP->GetDescriptor(bufferMP);
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
@@ -1304,11 +1194,11 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF2->mDescriptors.row(idx);
+            const ORBDescriptorView dKF = ORBDescriptorView::Row(pKF2->mDescriptors,idx);
 
             if(dMP.empty() || dKF.empty())
                 continue;
-            const int dist = DescriptorDistance(dMP,dKF);
+            const int dist = HammingDistance(dMP,dKF);
 
             if(dist<bestDist)
             {
@@ -1373,7 +1263,8 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             continue;
 
         // Match to the most similar keypoint in the radius
-        const cv::Mat dMP = pMP->GetDescriptor();
+        ORBDescriptorBuffer bufferMP;
+        const ORBDescriptorView dMP = pMP->GetDescriptor(bufferMP);
 
         int bestDist = INT_MAX;
         int bestIdx = -1;
@@ -1386,11 +1277,11 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF1->mDescriptors.row(idx);
+            const ORBDescriptorView dKF = ORBDescriptorView::Row(pKF1->mDescriptors,idx);
 
             if(dMP.empty() || dKF.empty())
                 continue;
-            const int dist = DescriptorDistance(dMP,dKF);
+            const int dist = HammingDistance(dMP,dKF);
 
             if(dist<bestDist)
             {
@@ -1443,10 +1334,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
     int nmatches = 0;
 
     // Rotation Histogram (to check rotation consistency)
-    vector<int> rotHist[HISTO_LENGTH];  //HISTO_LENGTH=30
-    for(int i=0;i<HISTO_LENGTH;i++)
-        rotHist[i].reserve(500);
-    const float factor = 1.0f/HISTO_LENGTH;
+    RotationHistogram rotHist(HISTO_LENGTH);
 
     const cv::Mat Rcw = CurrentFrame.mTcw.rowRange(0,3).colRange(0,3);
     const cv::Mat tcw = CurrentFrame.mTcw.rowRange(0,3).col(3);
@@ -1505,7 +1393,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                 if(vIndices2.empty())
                     continue;
 
-                const cv::Mat dMP = pMP->GetDescriptor();
+                ORBDescriptorBuffer bufferMP;
+
+                const ORBDescriptorView dMP = pMP->GetDescriptor(bufferMP);
 
                 int bestDist = 256;
                 int bestIdx2 = -1;
@@ -1525,11 +1415,11 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                             continue;
                     }
 
-                    const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+                    const ORBDescriptorView d = ORBDescriptorView::Row(CurrentFrame.mDescriptors,i2);
 
                     if(dMP.empty() || d.empty())
                         continue;
-                    const int dist = DescriptorDistance(dMP,d);
+                    const int dist = HammingDistance(dMP,d);
 
                     if(dist<bestDist)
                     {
@@ -1545,14 +1435,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
 
                     if(mbCheckOrientation)
                     {
-                        float rot = LastFrame.mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle;
-                        if(rot<0.0)
-                            rot+=360.0f;
-                        int bin = round(rot*factor);
-                        if(bin==HISTO_LENGTH)
-                            bin=0;
-                        assert(bin>=0 && bin<HISTO_LENGTH);
-                        rotHist[bin].push_back(bestIdx2);
+                        rotHist.Add(LastFrame.mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle,bestIdx2);
                     }
                 }
             }
@@ -1562,22 +1445,11 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
     //Apply rotation consistency
     if(mbCheckOrientation)
     {
-        int ind1=-1;
-        int ind2=-1;
-        int ind3=-1;
-
-        ComputeThreeMaxima(rotHist,HISTO_LENGTH,ind1,ind2,ind3);
-
-        for(int i=0; i<HISTO_LENGTH; i++)
+        const vector<int> vInconsistent = rotHist.GetInconsistent();
+        for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
         {
-            if(i!=ind1 && i!=ind2 && i!=ind3)
-            {
-                for(size_t j=0, jend=rotHist[i].size(); j<jend; j++)
-                {
-                    CurrentFrame.mvpMapPoints[rotHist[i][j]]=static_cast<MapPoint*>(NULL);
-                    nmatches--;
-                }
-            }
+            CurrentFrame.mvpMapPoints[vInconsistent[j]]=static_cast<MapPoint*>(NULL);
+            nmatches--;
         }
     }
 
@@ -1593,10 +1465,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
     const cv::Mat Ow = -Rcw.t()*tcw;
 
     // Rotation Histogram (to check rotation consistency)
-    vector<int> rotHist[HISTO_LENGTH];
-    for(int i=0;i<HISTO_LENGTH;i++)
-        rotHist[i].reserve(500);
-    const float factor = 1.0f/HISTO_LENGTH;
+    RotationHistogram rotHist(HISTO_LENGTH);
 
     const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
 
@@ -1645,7 +1514,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
                 if(vIndices2.empty())
                     continue;
 
-                const cv::Mat dMP = pMP->GetDescriptor();
+                ORBDescriptorBuffer bufferMP;
+
+                const ORBDescriptorView dMP = pMP->GetDescriptor(bufferMP);
 
                 int bestDist = 256;
                 int bestIdx2 = -1;
@@ -1656,11 +1527,11 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
                     if(CurrentFrame.mvpMapPoints[i2])
                         continue;
 
-                    const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
+                    const ORBDescriptorView d = ORBDescriptorView::Row(CurrentFrame.mDescriptors,i2);
 
                     if(dMP.empty() || d.empty())
                         continue;
-                    const int dist = DescriptorDistance(dMP,d);
+                    const int dist = HammingDistance(dMP,d);
 
                     if(dist<bestDist)
                     {
@@ -1676,14 +1547,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
 
                     if(mbCheckOrientation)
                     {
-                        float rot = pKF->mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle;
-                        if(rot<0.0)
-                            rot+=360.0f;
-                        int bin = round(rot*factor);
-                        if(bin==HISTO_LENGTH)
-                            bin=0;
-                        assert(bin>=0 && bin<HISTO_LENGTH);
-                        rotHist[bin].push_back(bestIdx2);
+                        rotHist.Add(pKF->mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle,bestIdx2);
                     }
                 }
 
@@ -1693,90 +1557,21 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
 
     if(mbCheckOrientation)
     {
-        int ind1=-1;
-        int ind2=-1;
-        int ind3=-1;
-
-        ComputeThreeMaxima(rotHist,HISTO_LENGTH,ind1,ind2,ind3);
-
-        for(int i=0; i<HISTO_LENGTH; i++)
+        const vector<int> vInconsistent = rotHist.GetInconsistent();
+        for(size_t j=0, jend=vInconsistent.size(); j<jend; j++)
         {
-            if(i!=ind1 && i!=ind2 && i!=ind3)
-            {
-                for(size_t j=0, jend=rotHist[i].size(); j<jend; j++)
-                {
-                    CurrentFrame.mvpMapPoints[rotHist[i][j]]=NULL;
-                    nmatches--;
-                }
-            }
+            CurrentFrame.mvpMapPoints[vInconsistent[j]]=NULL;
+            nmatches--;
         }
     }
 
     return nmatches;
 }
 
-void ORBmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3)
-{
-    int max1=0;
-    int max2=0;
-    int max3=0;
-
-    for(int i=0; i<L; i++)
-    {
-        const int s = histo[i].size();
-        if(s>max1)
-        {
-            max3=max2;
-            max2=max1;
-            max1=s;
-            ind3=ind2;
-            ind2=ind1;
-            ind1=i;
-        }
-        else if(s>max2)
-        {
-            max3=max2;
-            max2=s;
-            ind3=ind2;
-            ind2=i;
-        }
-        else if(s>max3)
-        {
-            max3=s;
-            ind3=i;
-        }
-    }
-
-    if(max2<0.1f*(float)max1)
-    {
-        ind2=-1;
-        ind3=-1;
-    }
-    else if(max3<0.1f*(float)max1)
-    {
-        ind3=-1;
-    }
-}
-
-
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+// Hamming distance between two ORB descriptors (rows of a descriptor matrix)
 int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
 {
-    const int *pa = a.ptr<int32_t>();
-    const int *pb = b.ptr<int32_t>();
-
-    int dist=0;
-
-    for(int i=0; i<8; i++, pa++, pb++)
-    {
-        unsigned  int v = *pa ^ *pb;
-        v = v - ((v >> 1) & 0x55555555);
-        v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-        dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-    }
-
-    return dist;
+    return HammingDistance(ORBDescriptorView(a),ORBDescriptorView(b));
 }
 
 } //namespace ORB_SLAM
@@ -31,12 +31,29 @@
 #include<Eigen/StdVector>
 
 #include "Converter.h"
+#include "MemoryReport.h"
 
 #include <mutex>
 
 namespace ORB_SLAM2
 {
 
+#ifdef FLOAT_LOCAL_BA
+bool Optimizer::mbFloatLocalBA = true;
+#else
+bool Optimizer::mbFloatLocalBA = false;
+#endif
+bool Optimizer::mbValidateFloatLocalBA = false;
+
+// Estimated size of a g2o graph for the memory report: vertices with their diagonal Hessian block,
+// edges with their Jacobians and off-diagonal Hessian block
+static void RecordGraphMemoryUsage(const g2o::SparseOptimizer &optimizer)
+{
+    const size_t nVertexBytes = sizeof(g2o::VertexSE3Expmap) + 6*6*sizeof(double);
+    const size_t nEdgeBytes = sizeof(g2o::EdgeSE3ProjectXYZ) + 6*3*sizeof(double);
+    RecordOptimizerMemoryUsage(optimizer.vertices().size()*nVertexBytes + optimizer.edges().size()*nEdgeBytes);
+}
+
 
 void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, const bool bWithLineFeature, bool* pbStopFlag,  const unsigned long nLoopKF, const bool bRobust)
 {
@@ -196,6 +213,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     // Optimize!
     optimizer.initializeOptimization();
     optimizer.optimize(nIterations);
+    RecordGraphMemoryUsage(optimizer);
 
     // Recover optimized data
 
@@ -537,6 +555,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     // Optimize!
     optimizer.initializeOptimization();
     optimizer.optimize(nIterations);
+    RecordGraphMemoryUsage(optimizer);
 
     // Recover optimized data
     // 6.得到优化的结果
@@ -589,9 +608,6 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     //LineSegment Points
     for(size_t i=0; i<vpML.size(); i++)
     {
-        if(vbNotIncludedMP[i])
-            continue;
-
         MapLine* pML = vpML[i];
 
         if(pML->isBad())
@@ -611,6 +627,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
             pML->mPosGBA.create(6, 1, CV_32F);
             Converter::toCvMat(vStartP->estimate()).copyTo(pML->mPosGBA.rowRange(0,3));
             Converter::toCvMat(vEndP->estimate()).copyTo(pML->mPosGBA.rowRange(3,6));
+            pML->mnBAGlobalForKF = nLoopKF;
         }
     }
 
@@ -678,7 +695,7 @@ int Optimizer::PoseOptimization(Frame *pFrame)
     const float deltaLend = sqrt(3.84);
 
     {
-    unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+    unique_lock<ProfiledMutex> lock(MapPoint::mGlobalMutex);
 
     for(int i=0; i<N; i++)
     {
@@ -780,7 +797,7 @@ int Optimizer::PoseOptimization(Frame *pFrame)
     vnIndexLineEdgeEp.reserve(NL);
 
     {
-        unique_lock<mutex> lock(MapLine::mGlobalMutex);
+        unique_lock<ProfiledMutex> lock(MapLine::mGlobalMutex);
 
         for(int i=0; i<NL; i++)
         {
@@ -1013,7 +1030,7 @@ int Optimizer::PoseOptimizationWithPoints(Frame *pFrame)
     const float deltaMono = sqrt(5.991);
 
     {
-        unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+        unique_lock<ProfiledMutex> lock(MapPoint::mGlobalMutex);
 
         for(int i=0; i<N; i++)
         {
@@ -1154,7 +1171,7 @@ int Optimizer::PoseOptimizationWithLines(Frame *pFrame)
     vnIndexLineEdgeEp.reserve(NL);
 
     {
-        unique_lock<mutex> lock(MapLine::mGlobalMutex);
+        unique_lock<ProfiledMutex> lock(MapLine::mGlobalMutex);
 
         for(int i=0; i<NL; i++)
         {
@@ -1283,6 +1300,311 @@ int Optimizer::PoseOptimizationWithLines(Frame *pFrame)
     return nLineInitalCorrespondences-nLineBad;
 }
 
+int Optimizer::PoseOptimizationRig(Frame *pFrame, const vector<Frame*> &vpRigFrames, const vector<cv::Mat> &vTcc0)
+{
+    double invSigma = 1;
+    g2o::SparseOptimizer optimizer;
+    g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
+
+    linearSolver = new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
+
+    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+
+    g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
+    optimizer.setAlgorithm(solver);
+
+    int nInitialCorrespondences=0;
+
+    // Body pose: pose of the first camera
+    g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
+    vSE3->setEstimate(Converter::toSE3Quat(pFrame->mTcw));
+    vSE3->setId(0);
+    vSE3->setFixed(false);
+    optimizer.addVertex(vSE3);
+
+    const float deltaMono = sqrt(5.991);
+    const float deltaLend = sqrt(3.84);
+
+    // Points of the first camera
+    const int N = pFrame->N;
+
+    vector<g2o::EdgeSE3ProjectXYZOnlyPose*> vpEdgesMono;
+    vector<size_t> vnIndexEdgeMono;
+    vpEdgesMono.reserve(N);
+    vnIndexEdgeMono.reserve(N);
+
+    // Points of the other cameras
+    vector<EdgeSE3ProjectXYZOnlyPoseRig*> vpEdgesRig;
+    vector<pair<size_t,size_t> > vnIndexEdgeRig;
+
+    {
+    unique_lock<ProfiledMutex> lock(MapPoint::mGlobalMutex);
+
+    for(int i=0; i<N; i++)
+    {
+        MapPoint* pMP = pFrame->mvpMapPoints[i];
+        if(!pMP)
+            continue;
+
+        nInitialCorrespondences++;
+        pFrame->mvbOutlier[i] = false;
+
+        Eigen::Matrix<double,2,1> obs;
+        const cv::KeyPoint &kpUn = pFrame->mvKeysUn[i];
+        obs << kpUn.pt.x, kpUn.pt.y;
+
+        g2o::EdgeSE3ProjectXYZOnlyPose* e = new g2o::EdgeSE3ProjectXYZOnlyPose();
+
+        e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
+        e->setMeasurement(obs);
+        const float invSigma2 = pFrame->mvInvLevelSigma2[kpUn.octave];
+        e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+
+        g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+        e->setRobustKernel(rk);
+        rk->setDelta(deltaMono);
+
+        e->fx = pFrame->fx;
+        e->fy = pFrame->fy;
+        e->cx = pFrame->cx;
+        e->cy = pFrame->cy;
+        cv::Mat Xw = pMP->GetWorldPos();
+        e->Xw[0] = Xw.at<float>(0);
+        e->Xw[1] = Xw.at<float>(1);
+        e->Xw[2] = Xw.at<float>(2);
+
+        optimizer.addEdge(e);
+
+        vpEdgesMono.push_back(e);
+        vnIndexEdgeMono.push_back(i);
+    }
+
+    for(size_t c=0; c<vpRigFrames.size(); c++)
+    {
+        Frame* pF = vpRigFrames[c];
+        const g2o::SE3Quat Tcc0 = Converter::toSE3Quat(vTcc0[c]);
+
+        for(int i=0; i<pF->N; i++)
+        {
+            MapPoint* pMP = pF->mvpMapPoints[i];
+            if(!pMP)
+                continue;
+
+            nInitialCorrespondences++;
+            pF->mvbOutlier[i] = false;
+
+            Eigen::Matrix<double,2,1> obs;
+            const cv::KeyPoint &kpUn = pF->mvKeysUn[i];
+            obs << kpUn.pt.x, kpUn.pt.y;
+
+            EdgeSE3ProjectXYZOnlyPoseRig* e = new EdgeSE3ProjectXYZOnlyPoseRig();
+
+            e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
+            e->setMeasurement(obs);
+            const float invSigma2 = pF->mvInvLevelSigma2[kpUn.octave];
+            e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+
+            g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+            e->setRobustKernel(rk);
+            rk->setDelta(deltaMono);
+
+            e->fx = pF->fx;
+            e->fy = pF->fy;
+            e->cx = pF->cx;
+            e->cy = pF->cy;
+            e->Tcc0 = Tcc0;
+            cv::Mat Xw = pMP->GetWorldPos();
+            e->Xw[0] = Xw.at<float>(0);
+            e->Xw[1] = Xw.at<float>(1);
+            e->Xw[2] = Xw.at<float>(2);
+
+            optimizer.addEdge(e);
+
+            vpEdgesRig.push_back(e);
+            vnIndexEdgeRig.push_back(make_pair(c,i));
+        }
+    }
+    }
+
+    // Lines of the first camera
+    const int NL = pFrame->NL;
+
+    vector<EdgeLineProjectXYZOnlyPose*> vpEdgesLineSp;
+    vector<EdgeLineProjectXYZOnlyPose*> vpEdgesLineEp;
+    vector<size_t> vnIndexLineEdge;
+    vpEdgesLineSp.reserve(NL);
+    vpEdgesLineEp.reserve(NL);
+    vnIndexLineEdge.reserve(NL);
+
+    {
+        unique_lock<ProfiledMutex> lock(MapLine::mGlobalMutex);
+
+        for(int i=0; i<NL; i++)
+        {
+            MapLine* pML = pFrame->mvpMapLines[i];
+            if(!pML)
+                continue;
+
+            pFrame->mvbLineOutlier[i] = false;
+
+            const Eigen::Vector3d line_obs = pFrame->mvKeyLineFunctions[i];
+
+            EdgeLineProjectXYZOnlyPose* els = new EdgeLineProjectXYZOnlyPose();
+            els->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
+            els->setMeasurement(line_obs);
+            els->setInformation(Eigen::Matrix3d::Identity()*invSigma);
+            g2o::RobustKernelHuber* rk_line_s = new g2o::RobustKernelHuber;
+            els->setRobustKernel(rk_line_s);
+            rk_line_s->setDelta(deltaLend);
+            els->fx = pFrame->fx;
+            els->fy = pFrame->fy;
+            els->cx = pFrame->cx;
+            els->cy = pFrame->cy;
+            els->Xw = pML->mWorldPos.head(3);
+            optimizer.addEdge(els);
+
+            EdgeLineProjectXYZOnlyPose* ele = new EdgeLineProjectXYZOnlyPose();
+            ele->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
+            ele->setMeasurement(line_obs);
+            ele->setInformation(Eigen::Matrix3d::Identity()*invSigma);
+            g2o::RobustKernelHuber* rk_line_e = new g2o::RobustKernelHuber;
+            ele->setRobustKernel(rk_line_e);
+            rk_line_e->setDelta(deltaLend);
+            ele->fx = pFrame->fx;
+            ele->fy = pFrame->fy;
+            ele->cx = pFrame->cx;
+            ele->cy = pFrame->cy;
+            ele->Xw = pML->mWorldPos.tail(3);
+            optimizer.addEdge(ele);
+
+            vpEdgesLineSp.push_back(els);
+            vpEdgesLineEp.push_back(ele);
+            vnIndexLineEdge.push_back(i);
+        }
+    }
+
+    if(nInitialCorrespondences<3)
+        return 0;
+
+    // Same 4 rounds of optimization and inlier/outlier classification as PoseOptimization
+    const float chi2Mono[4]={5.991,5.991,5.991,5.991};
+    const float chi2LEnd[4]={3.84,3.84,3.84,3.84};
+    const int its[4]={10,10,10,10};
+
+    int nBad=0;
+    for(size_t it=0; it<4; it++)
+    {
+        vSE3->setEstimate(Converter::toSE3Quat(pFrame->mTcw));
+        optimizer.initializeOptimization(0);
+        optimizer.optimize(its[it]);
+
+        nBad=0;
+        for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
+        {
+            g2o::EdgeSE3ProjectXYZOnlyPose* e = vpEdgesMono[i];
+
+            const size_t idx = vnIndexEdgeMono[i];
+
+            if(pFrame->mvbOutlier[idx])
+            {
+                e->computeError();
+            }
+
+            const float chi2 = e->chi2();
+
+            if(chi2>chi2Mono[it])
+            {
+                pFrame->mvbOutlier[idx]=true;
+                e->setLevel(1);
+                nBad++;
+            }
+            else
+            {
+                pFrame->mvbOutlier[idx]=false;
+                e->setLevel(0);
+            }
+
+            if(it==2)
+                e->setRobustKernel(0);
+        }
+
+        for(size_t i=0, iend=vpEdgesRig.size(); i<iend; i++)
+        {
+            EdgeSE3ProjectXYZOnlyPoseRig* e = vpEdgesRig[i];
+
+            Frame* pF = vpRigFrames[vnIndexEdgeRig[i].first];
+            const size_t idx = vnIndexEdgeRig[i].second;
+
+            if(pF->mvbOutlier[idx])
+            {
+                e->computeError();
+            }
+
+            const float chi2 = e->chi2();
+
+            if(chi2>chi2Mono[it] || !e->isDepthPositive())
+            {
+                pF->mvbOutlier[idx]=true;
+                e->setLevel(1);
+                nBad++;
+            }
+            else
+            {
+                pF->mvbOutlier[idx]=false;
+                e->setLevel(0);
+            }
+
+            if(it==2)
+                e->setRobustKernel(0);
+        }
+
+        for(size_t i=0, iend=vpEdgesLineSp.size(); i<iend; i++)
+        {
+            EdgeLineProjectXYZOnlyPose* e1 = vpEdgesLineSp[i];
+            EdgeLineProjectXYZOnlyPose* e2 = vpEdgesLineEp[i];
+
+            const size_t idx = vnIndexLineEdge[i];
+
+            if(pFrame->mvbLineOutlier[idx])
+            {
+                e1->computeError();
+                e2->computeError();
+            }
+
+            if(e1->chi2()>chi2LEnd[it] || e2->chi2()>chi2LEnd[it])
+            {
+                pFrame->mvbLineOutlier[idx]=true;
+                e1->setLevel(1);
+                e2->setLevel(1);
+            }
+            else
+            {
+                pFrame->mvbLineOutlier[idx]=false;
+                e1->setLevel(0);
+                e2->setLevel(0);
+            }
+
+            if(it==2)
+            {
+                e1->setRobustKernel(0);
+                e2->setRobustKernel(0);
+            }
+        }
+
+        if(optimizer.edges().size()<10)
+            break;
+    }
+
+    // Recover optimized body pose and the poses of the other cameras
+    g2o::VertexSE3Expmap* vSE3_recov = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(0));
+    cv::Mat pose = Converter::toCvMat(vSE3_recov->estimate());
+    pFrame->SetPose(pose);
+    for(size_t c=0; c<vpRigFrames.size(); c++)
+        vpRigFrames[c]->SetPose(vTcc0[c]*pose);
+
+    return nInitialCorrespondences-nBad;
+}
+
 
 /**
  * @brief Local BA
@@ -1522,6 +1844,7 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
 
     optimizer.initializeOptimization();
     optimizer.optimize(5);
+    RecordGraphMemoryUsage(optimizer);
 
     bool bDoMore= true;
 
@@ -1606,45 +1929,79 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF, bool* pbStopFlag, Map* pMap
         }
     }
 
-    // Get Map Mutex
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    // Recover optimized data before taking the map mutex, tracking is only blocked while they are published
+    vector<cv::Mat> vKFPoses;
+    vKFPoses.reserve(lLocalKeyFrames.size());
+    for(list<KeyFrame*>::iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++)
+    {
+        g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex((*lit)->mnId));
+        vKFPoses.push_back(Converter::toCvMat(vSE3->estimate()));
+    }
 
-    if(!vToErase.empty())
+    vector<cv::Mat> vMPPositions;
+    vMPPositions.reserve(lLocalMapPoints.size());
+    for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++)
     {
-        for(size_t i=0;i<vToErase.size();i++)
+        g2o::VertexSBAPointXYZ* vPoint = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex((*lit)->mnId+maxKFid+1));
+        vMPPositions.push_back(Converter::toCvMat(vPoint->estimate()));
+    }
+
+    {
+        // Get Map Mutex
+        unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
+
+        if(!vToErase.empty())
         {
-            KeyFrame* pKFi = vToErase[i].first;
-            MapPoint* pMPi = vToErase[i].second;
-            pKFi->EraseMapPointMatch(pMPi);
-            pMPi->EraseObservation(pKFi);
+            for(size_t i=0;i<vToErase.size();i++)
+            {
+                KeyFrame* pKFi = vToErase[i].first;
+                MapPoint* pMPi = vToErase[i].second;
+                pKFi->EraseMapPointMatch(pMPi);
+                pMPi->EraseObservation(pKFi);
+            }
         }
-    }
 
-    // Recover optimized data
+        //Keyframes
+        size_t i=0;
+        for(list<KeyFrame*>::iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++, i++)
+            (*lit)->SetPose(vKFPoses[i]);
 
-    //Keyframes
-    for(list<KeyFrame*>::iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++)
-    {
-        KeyFrame* pKF = *lit;
-        g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(pKF->mnId));
-        g2o::SE3Quat SE3quat = vSE3->estimate();
-        pKF->SetPose(Converter::toCvMat(SE3quat));
+        //Points
+        i=0;
+        for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++, i++)
+            (*lit)->SetWorldPos(vMPPositions[i]);
     }
 
-    //Points
+    // Normals and depths only depend on the published poses, they are refreshed outside the map mutex
     for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++)
+        (*lit)->UpdateNormalAndDepth();
+}
+
+///包含有线特征的局部BA
+// Largest differences between the float line edges of a local BA and their double evaluation
+static void ValidateFloatLineEdges(const vector<EdgeLineProjectXYZ*> &vpLineEdgesSP, const vector<EdgeLineProjectXYZ*> &vpLineEdgesEP)
+{
+    double maxErrorDiff = 0, maxJacobianDiff = 0;
+    for(size_t i=0, iend=vpLineEdgesSP.size(); i<iend; i++)
     {
-        MapPoint* pMP = *lit;
-        g2o::VertexSBAPointXYZ* vPoint = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(pMP->mnId+maxKFid+1));
-        pMP->SetWorldPos(Converter::toCvMat(vPoint->estimate()));
-        pMP->UpdateNormalAndDepth();
+        static_cast<EdgeLineProjectXYZFloat*>(vpLineEdgesSP[i])->CompareWithDouble(maxErrorDiff,maxJacobianDiff);
+        static_cast<EdgeLineProjectXYZFloat*>(vpLineEdgesEP[i])->CompareWithDouble(maxErrorDiff,maxJacobianDiff);
     }
+
+    cout << "Float local BA: " << 2*vpLineEdgesSP.size() << " line edges, max residual difference " << maxErrorDiff
+         << ", max Jacobian difference " << 100*maxJacobianDiff << "%" << endl;
 }
 
-///包含有线特征的局部BA
 void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, Map *pMap)
 {
+    const bool bFloatLines = mbFloatLocalBA;
+
     double invSigma = 0.5;
+
+    // Keyframes of the other cameras of a rig are optimized through the keyframe of the first camera
+    if(pKF->mpRigKF)
+        pKF = pKF->mpRigKF;
+
     // Local KeyFrames: First Breath Search from Current KeyFrame
     list<KeyFrame*> lLocalKeyFrames;
 
@@ -1657,14 +2014,34 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
     for(int i=0, iend=vNeighKFs.size(); i<iend; i++)
     {
         KeyFrame* pKFi = vNeighKFs[i];
+        if(pKFi->mpRigKF)
+            pKFi = pKFi->mpRigKF;
+        if(pKFi->mnBALocalForKF==pKF->mnId)
+            continue;
         pKFi->mnBALocalForKF = pKF->mnId;
         if(!pKFi->isBad())
             lLocalKeyFrames.push_back(pKFi);
     }
 
-    list<MapPoint*> lLocalMapPoints;
-    // step3：将lLocalKeyFrames的MapPoints加入到lLocalMapPoints
+    // Keyframes of the other cameras of the local rigs, their poses follow the keyframe of the first camera
+    list<KeyFrame*> lLocalRigKeyFrames;
     for(list<KeyFrame*>::iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++)
+    {
+        const vector<KeyFrame*> &vpRigKFs = (*lit)->mvpRigKFs;
+        for(size_t i=0, iend=vpRigKFs.size(); i<iend; i++)
+        {
+            KeyFrame* pRigKF = vpRigKFs[i];
+            pRigKF->mnBALocalForKF = pKF->mnId;
+            if(!pRigKF->isBad())
+                lLocalRigKeyFrames.push_back(pRigKF);
+        }
+    }
+
+    list<MapPoint*> lLocalMapPoints;
+    // step3：将lLocalKeyFrames(包括多相机的其他关键帧)的MapPoints加入到lLocalMapPoints
+    list<KeyFrame*> lPointKeyFrames(lLocalKeyFrames);
+    lPointKeyFrames.insert(lPointKeyFrames.end(),lLocalRigKeyFrames.begin(),lLocalRigKeyFrames.end());
+    for(list<KeyFrame*>::iterator lit=lPointKeyFrames.begin(), lend=lPointKeyFrames.end(); lit!=lend; lit++)
     {
         vector<MapPoint*> vpMPs = (*lit)->GetMapPointMatches();
         for(vector<MapPoint*>::iterator vit=vpMPs.begin(), vend=vpMPs.end(); vit!=vend; vit++)
@@ -1713,7 +2090,7 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
         map<KeyFrame*, size_t > observations = (*lit)->GetObservations();
         for(map<KeyFrame*, size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
-            KeyFrame* pKFi = mit->first;
+            KeyFrame* pKFi = mit->first->mpRigKF ? mit->first->mpRigKF : mit->first;
 
             if(pKFi->mnBALocalForKF!=pKF->mnId && pKFi->mnBAFixedForKF!=pKF->mnId)
             {
@@ -1732,6 +2109,10 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
         {
             KeyFrame* pKFi = mit->first;
 
+            // Line observations of the other cameras of a rig are not used
+            if(pKFi->mpRigKF)
+                continue;
+
             if(pKFi->mnBALocalForKF!=pKF->mnId && pKFi->mnBAFixedForKF!=pKF->mnId)
             {
                 pKFi->mnBAFixedForKF=pKF->mnId;
@@ -1796,6 +2177,11 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
     vector<MapPoint*> vpMapPointEdgeMono;
     vpMapPointEdgeMono.reserve(nExpectedSize);
 
+    // Observations of the other cameras of a rig, connected to the pose of the first camera
+    vector<EdgeSE3ProjectXYZRig*> vpEdgesRig;
+    vector<KeyFrame*> vpEdgeKFRig;
+    vector<MapPoint*> vpMapPointEdgeRig;
+
     const float thHuberMono = sqrt(5.991);
     const float thHuberLEnd = sqrt(3.84);
 
@@ -1817,7 +2203,40 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
         {
             KeyFrame* pKFi = mit->first;
 
-            if(!pKFi->isBad())
+            if(pKFi->mpRigKF)
+            {
+                if(pKFi->isBad() || !optimizer.vertex(pKFi->mpRigKF->mnId))
+                    continue;
+
+                const cv::KeyPoint &kpUn = pKFi->mvKeysUn[mit->second];
+
+                Eigen::Matrix<double,2,1> obs;
+                obs << kpUn.pt.x, kpUn.pt.y;
+
+                EdgeSE3ProjectXYZRig* e = new EdgeSE3ProjectXYZRig();
+
+                e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(id)));
+                e->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKFi->mpRigKF->mnId)));
+                e->setMeasurement(obs);
+                const float &invSigma2 = pKFi->mvInvLevelSigma2[kpUn.octave];
+                e->setInformation(Eigen::Matrix2d::Identity()*invSigma2);
+
+                g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+                e->setRobustKernel(rk);
+                rk->setDelta(thHuberMono);
+
+                e->fx = pKFi->fx;
+                e->fy = pKFi->fy;
+                e->cx = pKFi->cx;
+                e->cy = pKFi->cy;
+                e->Tcc0 = Converter::toSE3Quat(pKFi->mTcc0);
+
+                optimizer.addEdge(e);
+                vpEdgesRig.push_back(e);
+                vpEdgeKFRig.push_back(pKFi);
+                vpMapPointEdgeRig.push_back(pMP);
+            }
+            else if(!pKFi->isBad())
             {
                 const cv::KeyPoint &kpUn = pKFi->mvKeysUn[mit->second];
 
@@ -1895,13 +2314,13 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
         {
             KeyFrame* pKFi = mit->first;
 
-            if(!pKFi->isBad())
+            if(!pKFi->isBad() && !pKFi->mpRigKF)
             {
                 Eigen::Vector3d line_obs;
                 line_obs = pKFi->mvKeyLineFunctions[mit->second];
 
                 // StartPoint
-                EdgeLineProjectXYZ* e1 = new EdgeLineProjectXYZ();
+                EdgeLineProjectXYZ* e1 = bFloatLines ? new EdgeLineProjectXYZFloat() : new EdgeLineProjectXYZ();
 
                 e1->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(ids)));
                 e1->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKFi->mnId)));
@@ -1925,7 +2344,7 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
                 vpMapLineEdge.push_back(pML);
 
                 // EndPoint
-                EdgeLineProjectXYZ* e2 = new EdgeLineProjectXYZ();
+                EdgeLineProjectXYZ* e2 = bFloatLines ? new EdgeLineProjectXYZFloat() : new EdgeLineProjectXYZ();
 
                 e2->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(ide)));
                 e2->setVertex(1, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(pKFi->mnId)));
@@ -1956,6 +2375,7 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
 
     optimizer.initializeOptimization();
     optimizer.optimize(5);
+    RecordGraphMemoryUsage(optimizer);
 
     bool bDoMore = true;
 
@@ -1981,6 +2401,21 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
             e->setRobustKernel(0);
         }
 
+        for(size_t i=0, iend=vpEdgesRig.size(); i<iend; i++)
+        {
+            EdgeSE3ProjectXYZRig* e = vpEdgesRig[i];
+            MapPoint* pMP = vpMapPointEdgeRig[i];
+
+            if(pMP->isBad())
+                continue;
+
+            if(e->chi2()>5.991 || !e->isDepthPositive())
+            {
+                e->setLevel(1);
+            }
+            e->setRobustKernel(0);
+        }
+
         for(size_t i=0, iend=vpMapLineEdge.size(); i<iend; i++)
         {
             EdgeLineProjectXYZ* e1 = vpLineEdgesSP[i];
@@ -2004,8 +2439,11 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
         optimizer.optimize(10);
     }
 
+    if(bFloatLines && mbValidateFloatLocalBA)
+        ValidateFloatLineEdges(vpLineEdgesSP,vpLineEdgesEP);
+
     vector<pair<KeyFrame*, MapPoint*>> vToErase;
-    vToErase.reserve(vpEdgesMono.size());
+    vToErase.reserve(vpEdgesMono.size()+vpEdgesRig.size());
 
     // check inlier observations
     for(size_t i=0, iend=vpEdgesMono.size(); i<iend; i++)
@@ -2023,6 +2461,18 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
         }
     }
 
+    for(size_t i=0, iend=vpEdgesRig.size(); i<iend; i++)
+    {
+        EdgeSE3ProjectXYZRig* e = vpEdgesRig[i];
+        MapPoint* pMP = vpMapPointEdgeRig[i];
+
+        if(pMP->isBad())
+            continue;
+
+        if(e->chi2()>5.991 || !e->isDepthPositive())
+            vToErase.push_back(make_pair(vpEdgeKFRig[i],pMP));
+    }
+
     vector<pair<KeyFrame*,MapLine*>> vLineToErase;
     vLineToErase.reserve(vpLineEdgesSP.size());
     for(size_t i=0, iend=vpLineEdgesSP.size(); i<iend; i++)
@@ -2041,51 +2491,33 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
         }
     }
 
-    // Get Map Mutex
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
-
-    if(!vToErase.empty())
-    {
-        for(size_t i=0; i<vToErase.size(); i++)
-        {
-            KeyFrame* pKFi = vToErase[i].first;
-            MapPoint* pMPi = vToErase[i].second;
-            pKFi->EraseMapPointMatch(pMPi);
-            pMPi->EraseObservation(pKFi);
-        }
-    }
-
-    if(!vLineToErase.empty())
+    // Recover optimized data before taking the map mutex, tracking is only blocked while they are published
+    vector<cv::Mat> vKFPoses;
+    vKFPoses.reserve(lLocalKeyFrames.size());
+    for(list<KeyFrame*>::iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++)
     {
-        for(size_t i=0; i<vLineToErase.size(); i++)
-        {
-            KeyFrame* pKFi = vLineToErase[i].first;
-            MapLine* pMLi = vLineToErase[i].second;
-            pKFi->EraseMapLineMatch(pMLi);
-            pMLi->EraseObservation(pKFi);
-        }
+        g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex((*lit)->mnId));
+        vKFPoses.push_back(Converter::toCvMat(vSE3->estimate()));
     }
 
-    // Recover optimized data
-    //Keyframes
-    for(list<KeyFrame*>::iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++)
+    vector<cv::Mat> vRigKFPoses;
+    vRigKFPoses.reserve(lLocalRigKeyFrames.size());
+    for(list<KeyFrame*>::iterator lit=lLocalRigKeyFrames.begin(), lend=lLocalRigKeyFrames.end(); lit!=lend; lit++)
     {
-        KeyFrame* pKF = *lit;
-        g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(pKF->mnId));
-        g2o::SE3Quat SE3quat = vSE3->estimate();
-        pKF->SetPose(Converter::toCvMat(SE3quat));
+        g2o::VertexSE3Expmap* vSE3 = static_cast<g2o::VertexSE3Expmap*>(optimizer.vertex((*lit)->mpRigKF->mnId));
+        vRigKFPoses.push_back((*lit)->mTcc0*Converter::toCvMat(vSE3->estimate()));
     }
 
-    //Points
+    vector<cv::Mat> vMPPositions;
+    vMPPositions.reserve(lLocalMapPoints.size());
     for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++)
     {
-        MapPoint* pMP = *lit;
-        g2o::VertexSBAPointXYZ* vPoint = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(pMP->mnId+maxKFid+1));
-        pMP->SetWorldPos(Converter::toCvMat(vPoint->estimate()));
-        pMP->UpdateNormalAndDepth();
+        g2o::VertexSBAPointXYZ* vPoint = static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex((*lit)->mnId+maxKFid+1));
+        vMPPositions.push_back(Converter::toCvMat(vPoint->estimate()));
     }
 
-    // Lines
+    vector<Vector6d,Eigen::aligned_allocator<Vector6d> > vMLPositions;
+    vMLPositions.reserve(lLocalMapLines.size());
     for(list<MapLine*>::iterator lit=lLocalMapLines.begin(), lend=lLocalMapLines.end(); lit!=lend; lit++)
     {
         MapLine* pML = *lit;
@@ -2094,9 +2526,61 @@ void Optimizer::LocalBundleAdjustmentWithLine(KeyFrame *pKF, bool *pbStopFlag, M
 
         Vector6d LinePos;
         LinePos << Converter::toVector3d(Converter::toCvMat(vStartP->estimate())), Converter::toVector3d(Converter::toCvMat(vEndP->estimate()));
-        pML->SetWorldPos(LinePos);
-        pML->UpdateAverageDir();
+        vMLPositions.push_back(LinePos);
+    }
+
+    {
+        // Get Map Mutex
+        unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
+
+        if(!vToErase.empty())
+        {
+            for(size_t i=0; i<vToErase.size(); i++)
+            {
+                KeyFrame* pKFi = vToErase[i].first;
+                MapPoint* pMPi = vToErase[i].second;
+                pKFi->EraseMapPointMatch(pMPi);
+                pMPi->EraseObservation(pKFi);
+            }
+        }
+
+        if(!vLineToErase.empty())
+        {
+            for(size_t i=0; i<vLineToErase.size(); i++)
+            {
+                KeyFrame* pKFi = vLineToErase[i].first;
+                MapLine* pMLi = vLineToErase[i].second;
+                pKFi->EraseMapLineMatch(pMLi);
+                pMLi->EraseObservation(pKFi);
+            }
+        }
+
+        //Keyframes
+        size_t i=0;
+        for(list<KeyFrame*>::iterator lit=lLocalKeyFrames.begin(), lend=lLocalKeyFrames.end(); lit!=lend; lit++, i++)
+            (*lit)->SetPose(vKFPoses[i]);
+
+        i=0;
+        for(list<KeyFrame*>::iterator lit=lLocalRigKeyFrames.begin(), lend=lLocalRigKeyFrames.end(); lit!=lend; lit++, i++)
+            (*lit)->SetPose(vRigKFPoses[i]);
+
+        //Points
+        i=0;
+        for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++, i++)
+            (*lit)->SetWorldPos(vMPPositions[i]);
+
+        // Lines
+        i=0;
+        for(list<MapLine*>::iterator lit=lLocalMapLines.begin(), lend=lLocalMapLines.end(); lit!=lend; lit++, i++)
+            (*lit)->SetWorldPos(vMLPositions[i]);
     }
+
+    // Normals, depths and line directions are refreshed outside the map mutex
+    for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++)
+        (*lit)->UpdateNormalAndDepth();
+
+    for(list<MapLine*>::iterator lit=lLocalMapLines.begin(), lend=lLocalMapLines.end(); lit!=lend; lit++)
+        (*lit)->UpdateAverageDir();
 }
 
 void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
@@ -2306,10 +2790,12 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
     // Optimize!
     optimizer.initializeOptimization();
     optimizer.optimize(20);
+    RecordGraphMemoryUsage(optimizer);
 
-    unique_lock<mutex> lock(pMap->mMutexMapUpdate);
+    // Corrected poses and positions are computed before taking the map mutex, tracking is only blocked while they are published
 
     // SE3 Pose Recovering. Sim3:[sR t;0 1] -> SE3:[R t/s;0 1]
+    vector<cv::Mat> vCorrectedTiw(vpKFs.size());
     for(size_t i=0;i<vpKFs.size();i++)
     {
         KeyFrame* pKFi = vpKFs[i];
@@ -2325,12 +2811,11 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
 
         eigt *=(1./s); //[R t/s;0 1]
 
-        cv::Mat Tiw = Converter::toCvSE3(eigR,eigt);
-
-        pKFi->SetPose(Tiw);
+        vCorrectedTiw[i] = Converter::toCvSE3(eigR,eigt);
     }
 
     // Correct points. Transform to "non-optimized" reference keyframe pose and transform back with optimized pose
+    vector<cv::Mat> vCorrectedP3Dw(vpMPs.size());
     for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
     {
         MapPoint* pMP = vpMPs[i];
@@ -2357,10 +2842,70 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
         Eigen::Matrix<double,3,1> eigP3Dw = Converter::toVector3d(P3Dw);
         Eigen::Matrix<double,3,1> eigCorrectedP3Dw = correctedSwr.map(Srw.map(eigP3Dw));
 
-        cv::Mat cvCorrectedP3Dw = Converter::toCvMat(eigCorrectedP3Dw);
-        pMP->SetWorldPos(cvCorrectedP3Dw);
+        vCorrectedP3Dw[i] = Converter::toCvMat(eigCorrectedP3Dw);
+    }
+
+    // Correct lines, both endpoints as the points
+    const vector<MapLine*> vpMLs = pMap->GetAllMapLines();
+    vector<Vector6d,Eigen::aligned_allocator<Vector6d> > vCorrectedLinePos(vpMLs.size());
+    vector<char> vbLineCorrected(vpMLs.size(),false);
+    for(size_t i=0, iend=vpMLs.size(); i<iend; i++)
+    {
+        MapLine* pML = vpMLs[i];
+
+        if(pML->isBad())
+            continue;
+
+        int nIDr;
+        if(pML->mnCorrectedByKF==pCurKF->mnId)
+        {
+            nIDr = pML->mnCorrectedReference;
+        }
+        else
+        {
+            KeyFrame* pRefKF = pML->GetReferenceKeyFrame();
+            if(!pRefKF)
+                continue;
+            nIDr = pRefKF->mnId;
+        }
+
+        g2o::Sim3 Srw = vScw[nIDr];
+        g2o::Sim3 correctedSwr = vCorrectedSwc[nIDr];
+
+        const Vector6d Pos = pML->GetWorldPos();
+        vCorrectedLinePos[i] << correctedSwr.map(Srw.map(Pos.head(3))), correctedSwr.map(Srw.map(Pos.tail(3)));
+        vbLineCorrected[i] = true;
+    }
+
+    {
+        unique_lock<ProfiledMutex> lock(pMap->mMutexMapUpdate);
+
+        for(size_t i=0;i<vpKFs.size();i++)
+            vpKFs[i]->SetPose(vCorrectedTiw[i]);
+
+        for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
+        {
+            if(!vCorrectedP3Dw[i].empty())
+                vpMPs[i]->SetWorldPos(vCorrectedP3Dw[i]);
+        }
+
+        for(size_t i=0, iend=vpMLs.size(); i<iend; i++)
+        {
+            if(vbLineCorrected[i])
+                vpMLs[i]->SetWorldPos(vCorrectedLinePos[i]);
+        }
+    }
 
-        pMP->UpdateNormalAndDepth();
+    for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
+    {
+        if(!vCorrectedP3Dw[i].empty())
+            vpMPs[i]->UpdateNormalAndDepth();
+    }
+
+    for(size_t i=0, iend=vpMLs.size(); i<iend; i++)
+    {
+        if(vbLineCorrected[i])
+            vpMLs[i]->UpdateAverageDir();
     }
 }
 
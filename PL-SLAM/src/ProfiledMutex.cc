@@ -0,0 +1,244 @@
+#include "ProfiledMutex.h"
+
+#ifdef PROFILE_LOCKS
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <cxxabi.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+// Function-local statics: mutexes with static storage (MapPoint::mGlobalMutex) register before main
+mutex& RegistryMutex()
+{
+    static mutex m;
+    return m;
+}
+
+map<string,LockStats*>& Registry()
+{
+    static map<string,LockStats*> registry;
+    return registry;
+}
+
+void AtomicMax(atomic<uint64_t> &a, const uint64_t v)
+{
+    uint64_t cur = a.load(memory_order_relaxed);
+    while(v>cur && !a.compare_exchange_weak(cur,v,memory_order_relaxed))
+        ;
+}
+
+uint64_t ElapsedNs(const chrono::steady_clock::time_point &t0, const chrono::steady_clock::time_point &t1)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(t1-t0).count();
+}
+
+string SiteName(void* address)
+{
+    if(!address)
+        return "other";
+
+    Dl_info info;
+    if(dladdr(address,&info) && info.dli_sname)
+    {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname,NULL,NULL,&status);
+        stringstream ss;
+        ss << (status==0 && demangled ? demangled : info.dli_sname)
+           << "+0x" << hex << (static_cast<char*>(address)-static_cast<char*>(info.dli_saddr));
+        free(demangled);
+        return ss.str();
+    }
+
+    stringstream ss;
+    ss << address;
+    return ss.str();
+}
+
+}
+
+LockStats::LockStats(const string &name): mName(name)
+{
+    for(int i=0; i<NUM_SITES; i++)
+    {
+        Site &s = mvSites[i];
+        s.address = static_cast<void*>(NULL);
+        s.count = 0;
+        s.contended = 0;
+        s.waitNs = 0;
+        s.holdNs = 0;
+        s.maxWaitNs = 0;
+        s.maxHoldNs = 0;
+    }
+}
+
+LockStats::Site* LockStats::GetSite(void* address)
+{
+    const size_t nSlots = NUM_SITES-1;
+    const size_t h = (reinterpret_cast<size_t>(address)>>4)%nSlots;
+    for(size_t i=0; i<nSlots; i++)
+    {
+        Site &s = mvSites[(h+i)%nSlots];
+        void* a = s.address.load(memory_order_acquire);
+        if(a==address)
+            return &s;
+        if(!a)
+        {
+            void* expected = static_cast<void*>(NULL);
+            if(s.address.compare_exchange_strong(expected,address) || expected==address)
+                return &s;
+        }
+    }
+    return &mvSites[NUM_SITES-1];
+}
+
+ProfiledMutex::ProfiledMutex(const char* name): mpSite(static_cast<LockStats::Site*>(NULL))
+{
+    unique_lock<mutex> lock(RegistryMutex());
+    LockStats* &pStats = Registry()[name];
+    if(!pStats)
+        pStats = new LockStats(name);
+    mpStats = pStats;
+}
+
+__attribute__((noinline)) void ProfiledMutex::lock()
+{
+    void* address = __builtin_return_address(0);
+
+    if(mMutex.try_lock())
+    {
+        Acquired(address,0,false);
+        return;
+    }
+
+    const chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    mMutex.lock();
+    Acquired(address,ElapsedNs(t0,chrono::steady_clock::now()),true);
+}
+
+__attribute__((noinline)) bool ProfiledMutex::try_lock()
+{
+    void* address = __builtin_return_address(0);
+
+    if(!mMutex.try_lock())
+        return false;
+
+    Acquired(address,0,false);
+    return true;
+}
+
+void ProfiledMutex::unlock()
+{
+    const uint64_t holdNs = ElapsedNs(mLockTime,chrono::steady_clock::now());
+    LockStats::Site* pSite = mpSite;
+    mMutex.unlock();
+
+    pSite->holdNs.fetch_add(holdNs,memory_order_relaxed);
+    AtomicMax(pSite->maxHoldNs,holdNs);
+}
+
+void ProfiledMutex::Acquired(void* address, const uint64_t waitNs, const bool bContended)
+{
+    LockStats::Site* pSite = mpStats->GetSite(address);
+    pSite->count.fetch_add(1,memory_order_relaxed);
+    if(bContended)
+    {
+        pSite->contended.fetch_add(1,memory_order_relaxed);
+        pSite->waitNs.fetch_add(waitNs,memory_order_relaxed);
+        AtomicMax(pSite->maxWaitNs,waitNs);
+    }
+
+    mpSite = pSite;
+    mLockTime = chrono::steady_clock::now();
+}
+
+bool LockProfilingEnabled()
+{
+    return true;
+}
+
+void WriteLockProfile(ostream &os)
+{
+    struct Row
+    {
+        string lock, site;
+        uint64_t count, contended, waitNs, holdNs, maxWaitNs, maxHoldNs;
+    };
+
+    vector<Row> vRows;
+    {
+        unique_lock<mutex> lock(RegistryMutex());
+        for(map<string,LockStats*>::const_iterator mit=Registry().begin(), mend=Registry().end(); mit!=mend; mit++)
+        {
+            const LockStats* pStats = mit->second;
+
+            // One line for the whole lock, then one per call site
+            Row total = {pStats->mName, "*", 0, 0, 0, 0, 0, 0};
+            vector<Row> vSites;
+            for(int i=0; i<LockStats::NUM_SITES; i++)
+            {
+                const LockStats::Site &s = pStats->mvSites[i];
+                Row r = {pStats->mName, "", s.count.load(), s.contended.load(), s.waitNs.load(), s.holdNs.load(),
+                         s.maxWaitNs.load(), s.maxHoldNs.load()};
+                if(r.count==0)
+                    continue;
+                r.site = SiteName(i==LockStats::NUM_SITES-1 ? static_cast<void*>(NULL) : s.address.load());
+
+                total.count += r.count;
+                total.contended += r.contended;
+                total.waitNs += r.waitNs;
+                total.holdNs += r.holdNs;
+                total.maxWaitNs = max(total.maxWaitNs,r.maxWaitNs);
+                total.maxHoldNs = max(total.maxHoldNs,r.maxHoldNs);
+                vSites.push_back(r);
+            }
+
+            if(total.count==0)
+                continue;
+
+            sort(vSites.begin(),vSites.end(),[](const Row &a, const Row &b) { return a.waitNs>b.waitNs; });
+            vRows.push_back(total);
+            vRows.insert(vRows.end(),vSites.begin(),vSites.end());
+        }
+    }
+
+    os << "# lock\tsite\tcount\tcontended\twait_ms\tmax_wait_ms\thold_ms\tmax_hold_ms" << endl;
+    os << fixed << setprecision(3);
+    for(size_t i=0; i<vRows.size(); i++)
+    {
+        const Row &r = vRows[i];
+        os << r.lock << "\t" << r.site << "\t" << r.count << "\t" << r.contended << "\t"
+           << r.waitNs*1e-6 << "\t" << r.maxWaitNs*1e-6 << "\t" << r.holdNs*1e-6 << "\t" << r.maxHoldNs*1e-6 << endl;
+    }
+}
+
+} //namespace ORB_SLAM
+
+#else
+
+namespace ORB_SLAM2
+{
+
+bool LockProfilingEnabled()
+{
+    return false;
+}
+
+void WriteLockProfile(std::ostream &os)
+{
+}
+
+} //namespace ORB_SLAM
+
+#endif
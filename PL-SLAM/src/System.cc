@@ -22,6 +22,8 @@
 
 #include "System.h"
 #include "Converter.h"
+#include "MemoryReport.h"
+#include "ProfiledMutex.h"
 #include <thread>
 #include <pangolin/pangolin.h>
 #include <iomanip>
@@ -35,8 +37,11 @@ bool has_suffix(const std::string &str, const std::string &suffix) {
 }
 
 System::System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor,
-               const bool bUseViewer):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mbReset(false),mbActivateLocalizationMode(false),
-        mbDeactivateLocalizationMode(false)
+               const bool bUseViewer):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)),
+        mpCheckpointer(static_cast<MapCheckpointer*>(NULL)), mptCheckpointer(static_cast<thread*>(NULL)),
+        mpMapClient(static_cast<MapClient*>(NULL)), mptMapClient(static_cast<thread*>(NULL)), mbReset(false),mbActivateLocalizationMode(false),
+        mbDeactivateLocalizationMode(false), mnMemoryReportInterval(0), mnFramesSinceMemoryReport(0),
+        mptMemoryReport(static_cast<thread*>(NULL)), mbMemoryReportRequested(false), mbMemoryReportFinishRequested(false)
 {
     // Output welcome message
     cout << endl <<
@@ -63,6 +68,29 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     }
 
 
+    // Log a memory report every System.memoryReportInterval frames (0: disabled)
+    int nMemoryReportInterval = fsSettings["System.memoryReportInterval"];
+    mnMemoryReportInterval = max(0,nMemoryReportInterval);
+
+    // Write a map checkpoint every System.checkpointInterval seconds in System.checkpointPath. Checkpoints are disabled
+    // unless one of them is set (only System.checkpointPath: checkpoints on SaveMapCheckpoint only).
+    double fCheckpointInterval = fsSettings["System.checkpointInterval"];
+    string strCheckpointPath = "MapCheckpoints";
+    if(!fsSettings["System.checkpointPath"].empty())
+        strCheckpointPath = (string)fsSettings["System.checkpointPath"];
+    const bool bCheckpoints = fCheckpointInterval>0 || !fsSettings["System.checkpointPath"].empty();
+
+    // Stream the map to the map server at MapServer.address (Unix socket path) as agent MapServer.agentId
+    string strMapServerAddress;
+    if(!fsSettings["MapServer.address"].empty())
+        strMapServerAddress = (string)fsSettings["MapServer.address"];
+    int nAgentId = fsSettings["MapServer.agentId"];
+
+    // Query the loop detector with every keyframe (default) instead of scheduling the queries
+    int nQueryEveryKeyFrame = 1;
+    if(!fsSettings["LoopClosing.queryEveryKeyFrame"].empty())
+        nQueryEveryKeyFrame = fsSettings["LoopClosing.queryEveryKeyFrame"];
+
     //Load ORB Vocabulary
     cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
 
@@ -86,8 +114,8 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     //Create KeyFrame Database
     mpKeyFrameDatabase = new KeyFrameDatabase(*mpVocabulary);
 
-    //Create the Map
-    mpMap = new Map();
+    //Create the Map, with the element states of the snapshots for the checkpoints and the poses sent to the map server
+    mpMap = new Map(bCheckpoints || !strMapServerAddress.empty());
 
     //Create Drawers. These are used by the Viewer
     mpFrameDrawer = new FrameDrawer(mpMap);
@@ -103,9 +131,27 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     mptLocalMapping = new thread(&ORB_SLAM2::LocalMapping::Run,mpLocalMapper);
 
     //Initialize the Loop Closing thread and launch
-    mpLoopCloser = new LoopClosing(mpMap, mpKeyFrameDatabase, mpVocabulary, mSensor!=MONOCULAR);
+    mpLoopCloser = new LoopClosing(mpMap, mpKeyFrameDatabase, mpVocabulary, mSensor!=MONOCULAR, nQueryEveryKeyFrame==0);
     mptLoopClosing = new thread(&ORB_SLAM2::LoopClosing::Run, mpLoopCloser);
 
+    //Initialize the Map Checkpointer thread and launch
+    if(bCheckpoints)
+    {
+        mpCheckpointer = new MapCheckpointer(mpMap, strCheckpointPath, max(0.0,fCheckpointInterval));
+        mptCheckpointer = new thread(&ORB_SLAM2::MapCheckpointer::Run, mpCheckpointer);
+    }
+
+    //Initialize the Memory Report thread and launch
+    if(mnMemoryReportInterval>0)
+        mptMemoryReport = new thread(&ORB_SLAM2::System::RunMemoryReports, this);
+
+    //Initialize the Map Client thread and launch
+    if(!strMapServerAddress.empty())
+    {
+        mpMapClient = new MapClient(mpMap, strMapServerAddress, max(0,nAgentId));
+        mptMapClient = new thread(&ORB_SLAM2::MapClient::Run, mpMapClient);
+    }
+
     //Initialize the Viewer thread and launch
     if(bUseViewer)
     {
@@ -170,6 +216,8 @@ cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const
 
     cv::Mat Tcw = mpTracker->GrabImageStereo(imLeft,imRight,timestamp);
 
+    LogMemoryReport();
+
     unique_lock<mutex> lock2(mMutexState);
     mTrackingState = mpTracker->mState;
     mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
@@ -221,6 +269,8 @@ cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const doub
 
     cv::Mat Tcw = mpTracker->GrabImageRGBD(im,depthmap,timestamp);
 
+    LogMemoryReport();
+
     unique_lock<mutex> lock2(mMutexState);
     mTrackingState = mpTracker->mState;
     mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
@@ -272,6 +322,64 @@ cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
 
     cv::Mat Tcw = mpTracker->GrabImageMonocular(im,timestamp);
 
+    LogMemoryReport();
+
+    unique_lock<mutex> lock2(mMutexState);
+    mTrackingState = mpTracker->mState;
+    mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
+    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+    mTrackedMapLines = mpTracker->mCurrentFrame.mvpMapLines;    //仿照KeyPoint，自己添加的
+    mTrackedKeyLines = mpTracker->mCurrentFrame.mvKeylinesUn;    //仿照KeyPoint，自己添加的
+
+    return Tcw;
+}
+
+cv::Mat System::TrackMultiCamera(const vector<cv::Mat> &vIms, const double &timestamp)
+{
+    if(mSensor!=MONOCULAR)
+    {
+        cerr << "ERROR: you called TrackMultiCamera but input sensor was not set to Monocular." << endl;
+        exit(-1);
+    }
+
+    // Check mode change
+    {
+        unique_lock<mutex> lock(mMutexMode);
+        if(mbActivateLocalizationMode)
+        {
+            mpLocalMapper->RequestStop();
+
+            // Wait until Local Mapping has effectively stopped
+            while(!mpLocalMapper->isStopped())
+            {
+                usleep(1000);
+            }
+
+            mpTracker->InformOnlyTracking(true);
+            mbActivateLocalizationMode = false;
+        }
+        if(mbDeactivateLocalizationMode)
+        {
+            mpTracker->InformOnlyTracking(false);
+            mpLocalMapper->Release();
+            mbDeactivateLocalizationMode = false;
+        }
+    }
+
+    // Check reset
+    {
+    unique_lock<mutex> lock(mMutexReset);
+    if(mbReset)
+    {
+        mpTracker->Reset();
+        mbReset = false;
+    }
+    }
+
+    cv::Mat Tcw = mpTracker->GrabImageMultiCamera(vIms,timestamp);
+
+    LogMemoryReport();
+
     unique_lock<mutex> lock2(mMutexState);
     mTrackingState = mpTracker->mState;
     mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
@@ -282,6 +390,81 @@ cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
     return Tcw;
 }
 
+MemoryReport System::GetMemoryReport()
+{
+    MemoryReport report;
+
+    {
+        // A reset (Tracking::Reset) waits for the report before it deletes the elements
+        unique_lock<ProfiledMutex> lock(mpMap->mMutexMapClear);
+
+        const vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
+        for(size_t i=0; i<vpKFs.size(); i++)
+            vpKFs[i]->AddMemoryUsage(report);
+
+        const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
+        for(size_t i=0; i<vpMPs.size(); i++)
+            report.mvBytes[MemoryReport::MAP_POINTS] += vpMPs[i]->MemoryUsage();
+
+        const vector<MapLine*> vpMLs = mpMap->GetAllMapLines();
+        for(size_t i=0; i<vpMLs.size(); i++)
+            report.mvBytes[MemoryReport::MAP_LINES] += vpMLs[i]->MemoryUsage();
+
+        report.mnKeyFrames = vpKFs.size();
+        report.mnMapPoints = vpMPs.size();
+        report.mnMapLines = vpMLs.size();
+    }
+
+    report.mvBytes[MemoryReport::KEYFRAME_DATABASE] = mpKeyFrameDatabase->MemoryUsage();
+    report.mvBytes[MemoryReport::VOCABULARY] = VocabularyMemoryUsage(mpVocabulary);
+
+    size_t nOptimizerPeak;
+    report.mvBytes[MemoryReport::OPTIMIZER] = GetOptimizerMemoryUsage(nOptimizerPeak);
+
+    unique_lock<mutex> lock(mMutexMemoryReport);
+    mvMemoryPeakBytes.resize(MemoryReport::NUM_CATEGORIES,0);
+    mvMemoryPeakBytes[MemoryReport::OPTIMIZER] = max(mvMemoryPeakBytes[MemoryReport::OPTIMIZER],nOptimizerPeak);
+    for(int i=0; i<MemoryReport::NUM_CATEGORIES; i++)
+    {
+        mvMemoryPeakBytes[i] = max(mvMemoryPeakBytes[i],report.mvBytes[i]);
+        report.mvPeakBytes[i] = mvMemoryPeakBytes[i];
+    }
+
+    return report;
+}
+
+void System::LogMemoryReport()
+{
+    if(mnMemoryReportInterval<=0 || ++mnFramesSinceMemoryReport<mnMemoryReportInterval)
+        return;
+
+    mnFramesSinceMemoryReport = 0;
+    unique_lock<mutex> lock(mMutexMemoryReportRequest);
+    mbMemoryReportRequested = true;
+}
+
+void System::RunMemoryReports()
+{
+    while(1)
+    {
+        bool bReport, bFinish;
+        {
+            unique_lock<mutex> lock(mMutexMemoryReportRequest);
+            bReport = mbMemoryReportRequested;
+            bFinish = mbMemoryReportFinishRequested;
+            mbMemoryReportRequested = false;
+        }
+
+        if(bReport)
+            cout << GetMemoryReport().ToString() << endl;
+
+        if(bFinish)
+            break;
+
+        usleep(50000);
+    }
+}
+
 void System::ActivateLocalizationMode()
 {
     unique_lock<mutex> lock(mMutexMode);
@@ -317,6 +500,18 @@ void System::Shutdown()
 {
     mpLocalMapper->RequestFinish();
     mpLoopCloser->RequestFinish();
+    if(mpCheckpointer)
+        mpCheckpointer->RequestFinish();
+    if(mpMapClient)
+        mpMapClient->RequestFinish();
+    if(mptMemoryReport)
+    {
+        {
+            unique_lock<mutex> lock(mMutexMemoryReportRequest);
+            mbMemoryReportFinishRequested = true;
+        }
+        mptMemoryReport->join();
+    }
     if(mpViewer)
     {
         mpViewer->RequestFinish();
@@ -325,7 +520,8 @@ void System::Shutdown()
     }
 
     // Wait until all thread have effectively stopped
-    while(!mpLocalMapper->isFinished() || !mpLoopCloser->isFinished() || mpLoopCloser->isRunningGBA())
+    while(!mpLocalMapper->isFinished() || !mpLoopCloser->isFinished() || mpLoopCloser->isRunningGBA() ||
+          (mpCheckpointer && !mpCheckpointer->isFinished()) || (mpMapClient && !mpMapClient->isFinished()))
     {
         usleep(5000);
     }
@@ -416,7 +612,8 @@ void System::SaveKeyFrameTrajectoryTUM(const string &filename)
 
        // pKF->SetPose(pKF->GetPose()*Two);
 
-        if(pKF->isBad())
+        // The keyframes of the other cameras of a rig are not part of the trajectory
+        if(pKF->isBad() || pKF->mpRigKF)
             continue;
 
         cv::Mat R = pKF->GetRotation().t();
@@ -448,7 +645,7 @@ void System::SaveKeyFrameTrajectoryMonoKitti(const string &filename)
 
         // pKF->SetPose(pKF->GetPose()*Two);
 
-        if(pKF->isBad())
+        if(pKF->isBad() || pKF->mpRigKF)
             continue;
 
         cv::Mat R = pKF->GetRotation().t();
@@ -518,6 +715,20 @@ void System::SaveTrajectoryKITTI(const string &filename)
     cout << endl << "trajectory saved!" << endl;
 }
 
+void System::SaveLockProfile(const string &filename)
+{
+    if(!LockProfilingEnabled())
+        return;
+
+    cout << endl << "Saving lock profile to " << filename << " ..." << endl;
+
+    ofstream f;
+    f.open(filename.c_str());
+    WriteLockProfile(f);
+    f.close();
+    cout << endl << "lock profile saved!" << endl;
+}
+
 void System::SavePointCloud(const string &filename)
 {
     cout << endl << "Saving PointCloud Map to " << filename << " ..." << endl;
@@ -556,6 +767,65 @@ void System::SavePointCloud(const string &filename)
     cout << endl << "PointCloud Map saved! " << endl;
 }
 
+void System::SaveMapCheckpoint()
+{
+    if(!mpCheckpointer)
+    {
+        cerr << "Map checkpoints are disabled, set System.checkpointPath or System.checkpointInterval" << endl;
+        return;
+    }
+
+    mpCheckpointer->RequestCheckpoint();
+}
+
+bool System::GetSharedMapAlignment(cv::Mat &Sws, unsigned int &nReferenceAgent)
+{
+    return mpMapClient && mpMapClient->GetSharedMapAlignment(Sws,nReferenceAgent);
+}
+
+void System::SaveSharedKeyFrameTrajectoryTUM(const string &filename)
+{
+    cv::Mat Sws;
+    unsigned int nReferenceAgent;
+    if(!GetSharedMapAlignment(Sws,nReferenceAgent))
+    {
+        cerr << "SaveSharedKeyFrameTrajectoryTUM: the map is not merged with the map of another agent" << endl;
+        return;
+    }
+
+    cout << endl << "Saving keyframe trajectory in the frame of agent " << nReferenceAgent << " to " << filename << " ..." << endl;
+
+    // Sws = [s*Rws tws]
+    const cv::Mat sRws = Sws.rowRange(0,3).colRange(0,3);
+    const cv::Mat tws = Sws.rowRange(0,3).col(3);
+    const cv::Mat Rws = sRws/cv::norm(sRws.col(0));
+
+    vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
+    sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
+
+    ofstream f;
+    f.open(filename.c_str());
+    f << fixed;
+
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+
+        // The keyframes of the other cameras of a rig are not part of the trajectory
+        if(pKF->isBad() || pKF->mpRigKF)
+            continue;
+
+        cv::Mat R = Rws*pKF->GetRotation().t();
+        vector<float> q = Converter::toQuaternion(R);
+        cv::Mat t = sRws*pKF->GetCameraCenter()+tws;
+        f << setprecision(6) << pKF->mTimeStamp << setprecision(7) << " " << t.at<float>(0) << " " << t.at<float>(1) << " " << t.at<float>(2)
+          << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << endl;
+    }
+
+    f.close();
+    cout << endl << "shared trajectory saved!" << endl;
+}
+
 void System::ShowPointCloud()
 {
 //    typedef pcl::PointXYZ PointT;
@@ -32,6 +32,7 @@
 
 #include"Optimizer.h"
 #include"PnPsolver.h"
+#include"FeatureCache.h"
 
 #include<iostream>
 
@@ -46,7 +47,9 @@ namespace ORB_SLAM2
 Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer, MapDrawer *pMapDrawer, Map *pMap, KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor):
     mState(NO_IMAGES_YET), mSensor(sensor), mbOnlyTracking(false), mbVO(false), mpORBVocabulary(pVoc),
     mpKeyFrameDB(pKFDB), mpInitializer(static_cast<Initializer*>(NULL)), mpSystem(pSys), mpViewer(NULL),
-    mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpMap(pMap), mnLastRelocFrameId(0)
+    mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpMap(pMap), mnLocalMapSnapshotVersion(0),
+    mnLocalMapSnapshotFrameId(0), mnLocalizationSnapshotsBigChangeIdx(0), mbLastFrameIsCurrent(false), mnLastRelocFrameId(0),
+    mnLastRelocTryFrameId(0)
 {
     // Load camera parameters from settings file
 
@@ -63,16 +66,32 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     K.at<float>(1,2) = cy;
     K.copyTo(mK);
 
+    // Camera.type: PinHole (default, k1 k2 p1 p2 [k3]) or KannalaBrandt8 (fisheye, k1 k2 k3 k4)
+    string sCameraType;
+    if(!fSettings["Camera.type"].empty())
+        fSettings["Camera.type"] >> sCameraType;
+    mnCameraModel = sCameraType=="KannalaBrandt8" ? CAMERA_KANNALA_BRANDT : CAMERA_PINHOLE;
+
     cv::Mat DistCoef(4,1,CV_32F);
-    DistCoef.at<float>(0) = fSettings["Camera.k1"];
-    DistCoef.at<float>(1) = fSettings["Camera.k2"];
-    DistCoef.at<float>(2) = fSettings["Camera.p1"];
-    DistCoef.at<float>(3) = fSettings["Camera.p2"];
-    const float k3 = fSettings["Camera.k3"];
-    if(k3!=0)
+    if(mnCameraModel==CAMERA_KANNALA_BRANDT)
     {
-        DistCoef.resize(5);
-        DistCoef.at<float>(4) = k3;
+        DistCoef.at<float>(0) = fSettings["Camera.k1"];
+        DistCoef.at<float>(1) = fSettings["Camera.k2"];
+        DistCoef.at<float>(2) = fSettings["Camera.k3"];
+        DistCoef.at<float>(3) = fSettings["Camera.k4"];
+    }
+    else
+    {
+        DistCoef.at<float>(0) = fSettings["Camera.k1"];
+        DistCoef.at<float>(1) = fSettings["Camera.k2"];
+        DistCoef.at<float>(2) = fSettings["Camera.p1"];
+        DistCoef.at<float>(3) = fSettings["Camera.p2"];
+        const float k3 = fSettings["Camera.k3"];
+        if(k3!=0)
+        {
+            DistCoef.resize(5);
+            DistCoef.at<float>(4) = k3;
+        }
     }
     DistCoef.copyTo(mDistCoef);
 
@@ -102,17 +121,32 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     mMinFrames = 0;
     mMaxFrames = fps;
 
+    // Localization mode: frames between relocalization attempts while tracking visual odometry points
+    int nRelocInterval = fSettings["Localization.relocInterval"];
+    mnRelocIntervalVO = nRelocInterval>0 ? nRelocInterval : max(1,mMaxFrames/3);
+
     cout << endl << "Camera Parameters: " << endl;
     cout << "- fx: " << fx << endl;
     cout << "- fy: " << fy << endl;
     cout << "- cx: " << cx << endl;
     cout << "- cy: " << cy << endl;
-    cout << "- k1: " << DistCoef.at<float>(0) << endl;
-    cout << "- k2: " << DistCoef.at<float>(1) << endl;
-    if(DistCoef.rows==5)
-        cout << "- k3: " << DistCoef.at<float>(4) << endl;
-    cout << "- p1: " << DistCoef.at<float>(2) << endl;
-    cout << "- p2: " << DistCoef.at<float>(3) << endl;
+    if(mnCameraModel==CAMERA_KANNALA_BRANDT)
+    {
+        cout << "- model: KannalaBrandt8" << endl;
+        cout << "- k1: " << DistCoef.at<float>(0) << endl;
+        cout << "- k2: " << DistCoef.at<float>(1) << endl;
+        cout << "- k3: " << DistCoef.at<float>(2) << endl;
+        cout << "- k4: " << DistCoef.at<float>(3) << endl;
+    }
+    else
+    {
+        cout << "- k1: " << DistCoef.at<float>(0) << endl;
+        cout << "- k2: " << DistCoef.at<float>(1) << endl;
+        if(DistCoef.rows==5)
+            cout << "- k3: " << DistCoef.at<float>(4) << endl;
+        cout << "- p1: " << DistCoef.at<float>(2) << endl;
+        cout << "- p2: " << DistCoef.at<float>(3) << endl;
+    }
     cout << "- fps: " << fps << endl;
 
 
@@ -138,8 +172,9 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     float fScaleFactorLine = fSettings["LINEextractor.scaleFactor"];
     int nLevelsLine = fSettings["LINEextractor.nLevels"];
     int min_length = fSettings["LINEextractor.min_line_length"];
+    int nDetectorLine = fSettings["LINEextractor.detector"];
 
-    mpLSDextractorLeft = new LINEextractor(nLevelsLine, fScaleFactorLine, nFeaturesLine, min_length);
+    mpLSDextractorLeft = new LINEextractor(nLevelsLine, fScaleFactorLine, nFeaturesLine, min_length, nDetectorLine);
 
     if(sensor==System::STEREO)
         mpORBextractorRight = new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
@@ -147,6 +182,31 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     if(sensor==System::MONOCULAR)
         mpIniORBextractor = new ORBextractor(2*nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
 
+    // Multi-camera rig (monocular): Rig.nCameras cameras sharing the calibration above,
+    // Rig.Tc0c<i> is the pose of camera i in the frame of camera 0 (4x4 matrix)
+    mpRig = static_cast<CameraRig*>(NULL);
+    int nRigCameras = fSettings["Rig.nCameras"];
+    if(sensor==System::MONOCULAR && nRigCameras>1)
+    {
+        vector<cv::Mat> vTc0c;
+        vector<ORBextractor*> vpORBextractors;
+        vector<LINEextractor*> vpLINEextractors;
+        for(int i=1; i<nRigCameras; i++)
+        {
+            cv::Mat Tc0c;
+            fSettings["Rig.Tc0c"+to_string(i)] >> Tc0c;
+            if(Tc0c.rows!=4 || Tc0c.cols!=4)
+            {
+                cerr << "Rig.Tc0c" << i << " must be a 4x4 matrix" << endl;
+                exit(-1);
+            }
+            vTc0c.push_back(Tc0c);
+            vpORBextractors.push_back(new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST));
+            vpLINEextractors.push_back(new LINEextractor(nLevelsLine, fScaleFactorLine, nFeaturesLine, min_length, nDetectorLine));
+        }
+        mpRig = new CameraRig(vTc0c,vpORBextractors,vpLINEextractors);
+    }
+
     cout << endl  << "ORB Extractor Parameters: " << endl;
     cout << "- Number of Features: " << nFeatures << endl;
     cout << "- Scale Levels: " << nLevels << endl;
@@ -154,6 +214,34 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     cout << "- Initial Fast Threshold: " << fIniThFAST << endl;
     cout << "- Minimum Fast Threshold: " << fMinThFAST << endl;
 
+    cout << endl  << "LINE Extractor Parameters: " << endl;
+    cout << "- Detector: " << (nDetectorLine==LINEextractor::EDLINES ? "EDLines" : "LSD") << endl;
+    cout << "- Number of Features: " << nFeaturesLine << endl;
+    cout << "- Scale Levels: " << nLevelsLine << endl;
+    cout << "- Scale Factor: " << mpLSDextractorLeft->GetScaleFactor() << endl;
+
+    if(mpRig)
+        cout << endl << "Multi-camera rig: " << mpRig->GetNumCameras() << " cameras" << endl;
+
+    // Feature cache: features of the monocular frames saved to / loaded from this directory
+    if(!fSettings["FeatureCache.path"].empty() && !Frame::mpFeatureCache)
+    {
+        string strCachePath;
+        fSettings["FeatureCache.path"] >> strCachePath;
+        if(!strCachePath.empty())
+        {
+            Frame::mpFeatureCache = new FeatureCache(strCachePath);
+            cout << endl << "Feature cache: " << strCachePath << endl;
+        }
+    }
+
+    // Float evaluation of the line edges of the local BA
+    if(!fSettings["Optimizer.floatLocalBA"].empty())
+        Optimizer::mbFloatLocalBA = (int)fSettings["Optimizer.floatLocalBA"]!=0;
+    Optimizer::mbValidateFloatLocalBA = (int)fSettings["Optimizer.validateFloatLocalBA"]!=0;
+    if(Optimizer::mbFloatLocalBA)
+        cout << endl << "Local BA: float line edges" << (Optimizer::mbValidateFloatLocalBA ? " (validated against double)" : "") << endl;
+
     if(sensor==System::STEREO || sensor==System::RGBD)
     {
         mThDepth = mbf*(float)fSettings["ThDepth"]/fx;
@@ -219,7 +307,8 @@ cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRe
         }
     }
 
-    mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+    RotateFrames();
+    mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,GetFrameConfig(mImGray),mbf,mThDepth);
 
     Track();
 
@@ -250,7 +339,8 @@ cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const d
     if((fabs(mDepthMapFactor-1.0f)>1e-5) || imDepth.type()!=CV_32F)
         imDepth.convertTo(imDepth,CV_32F,mDepthMapFactor);
 
-    mCurrentFrame = Frame(mImGray,imDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+    RotateFrames();
+    mCurrentFrame = Frame(mImGray,imDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,GetFrameConfig(mImGray),mbf,mThDepth);
 
     Track();
 
@@ -299,18 +389,99 @@ cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp)
     //mImGray = mImGray(Rect(15, 15, 610, 450));*/
 
     static int count=0;
+    RotateFrames();
     if(mState==NOT_INITIALIZED || mState==NO_IMAGES_YET)
     {
-        mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpLSDextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mask);
+        mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpLSDextractorLeft,mpORBVocabulary,GetFrameConfig(mImGray),mbf,mThDepth,mask);
     }
     else
-        mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpLSDextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,mask);
+        mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpLSDextractorLeft,mpORBVocabulary,GetFrameConfig(mImGray),mbf,mThDepth,mask);
+
+    Track();
+
+    return mCurrentFrame.mTcw.clone();
+}
+
+cv::Mat Tracking::GrabImageMultiCamera(const vector<cv::Mat> &vIms, const double &timestamp)
+{
+    if(!mpRig || (int)vIms.size()!=mpRig->GetNumCameras())
+    {
+        cerr << "GrabImageMultiCamera: one image per camera of the rig is expected" << endl;
+        return cv::Mat();
+    }
+
+    vector<cv::Mat> vImGray(vIms.size());
+    for(size_t i=0; i<vIms.size(); i++)
+    {
+        vImGray[i] = vIms[i];
+        if(vImGray[i].channels()==3)
+        {
+            if(mbRGB)
+                cvtColor(vImGray[i],vImGray[i],cv::COLOR_RGB2GRAY);
+            else
+                cvtColor(vImGray[i],vImGray[i],cv::COLOR_BGR2GRAY);
+        }
+        else if(vImGray[i].channels()==4)
+        {
+            if(mbRGB)
+                cvtColor(vImGray[i],vImGray[i],cv::COLOR_RGBA2GRAY);
+            else
+                cvtColor(vImGray[i],vImGray[i],cv::COLOR_BGRA2GRAY);
+        }
+    }
+    mImGray = vImGray[0];
+
+    RotateFrames();
+    if(mState==NOT_INITIALIZED || mState==NO_IMAGES_YET)
+    {
+        // The map is initialized by camera 0 alone
+        mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpLSDextractorLeft,mpORBVocabulary,GetFrameConfig(mImGray),mbf,mThDepth,mask);
+    }
+    else
+    {
+        // Features of all the cameras are extracted concurrently, the other cameras by the workers of the rig
+        mpRig->StartExtraction(vector<cv::Mat>(vImGray.begin()+1,vImGray.end()), timestamp,
+                               mpORBVocabulary, GetFrameConfig(mImGray), mbf, mThDepth);
+        mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpLSDextractorLeft,mpORBVocabulary,GetFrameConfig(mImGray),mbf,mThDepth,mask);
+        mpRig->WaitForFrames();
+        mpRig->AssignFrameId(mCurrentFrame);
+    }
 
     Track();
 
     return mCurrentFrame.mTcw.clone();
 }
 
+const FrameConfigPtr &Tracking::GetFrameConfig(const cv::Mat &im)
+{
+    // The image bounds are computed from the first image
+    if(!mpFrameConfig)
+        mpFrameConfig.reset(new FrameConfig(mpORBextractorLeft,mpLSDextractorLeft,mK,mDistCoef,mnCameraModel,im.size()));
+    return mpFrameConfig;
+}
+
+/**
+ * @brief 当前帧成为上一帧
+ *
+ * 不拷贝当前帧：在处理下一帧之前才把当前帧move到mLastFrame（见RotateFrames()），在此之前不能读取mLastFrame
+ */
+void Tracking::SetLastFrame()
+{
+    mbLastFrameIsCurrent = true;
+}
+
+/**
+ * @brief 在构造新的当前帧之前调用，两个Frame对象轮换，关键点、描述子、网格等缓冲区随帧一起移动
+ */
+void Tracking::RotateFrames()
+{
+    if(!mbLastFrameIsCurrent)
+        return;
+
+    mLastFrame = std::move(mCurrentFrame);
+    mbLastFrameIsCurrent = false;
+}
+
 void Tracking::Track()
 {
     // Track包含两部分：估计运动、跟踪局部地图
@@ -326,7 +497,7 @@ void Tracking::Track()
     mLastProcessedState=mState;
 
     // Get Map Mutex -> Map cannot be changed
-    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+    unique_lock<ProfiledMutex> lock(mpMap->mMutexMapUpdate);
 
     if(mState==NOT_INITIALIZED)
     {
@@ -428,7 +599,12 @@ void Tracking::Track()
                         vbOutMM = mCurrentFrame.mvbOutlier;
                         TcwMM = mCurrentFrame.mTcw.clone();
                     }
-                    bOKReloc = Relocalization();
+                    // Relocalization is expensive, it is only tried when the motion model fails or every mnRelocIntervalVO frames
+                    if(!bOKMM || mCurrentFrame.mnId>=mnLastRelocTryFrameId+mnRelocIntervalVO)
+                    {
+                        bOKReloc = Relocalization();
+                        mnLastRelocTryFrameId = mCurrentFrame.mnId;
+                    }
 
                     if(bOKMM && !bOKReloc)
                     {
@@ -573,7 +749,7 @@ void Tracking::Track()
         if(!mCurrentFrame.mpReferenceKF)
             mCurrentFrame.mpReferenceKF = mpReferenceKF;
 
-        mLastFrame = Frame(mCurrentFrame);
+        SetLastFrame();
     }
 
     // Store frame pose information to retrieve the complete camera trajectory afterwards.
@@ -632,7 +808,7 @@ void Tracking::StereoInitialization()
 
         mpLocalMapper->InsertKeyFrame(pKFini);
 
-        mLastFrame = Frame(mCurrentFrame);
+        SetLastFrame();
         mnLastKeyFrameId=mCurrentFrame.mnId;
         mpLastKeyFrame = pKFini;
 
@@ -663,7 +839,7 @@ void Tracking::MonocularInitialization()
             // step 1：得到用于初始化的第一帧，初始化需要两帧
             mInitialFrame = Frame(mCurrentFrame);
             // 记录最近的一帧
-            mLastFrame = Frame(mCurrentFrame);
+            SetLastFrame();
             // mvbPreMatched最大的情况就是当前帧所有的特征点都被匹配上
             mvbPrevMatched.resize(mCurrentFrame.mvKeysUn.size());
             for(size_t i=0; i<mCurrentFrame.mvKeysUn.size(); i++)
@@ -807,7 +983,7 @@ void Tracking::MonocularInitialization()
             CreateInitialMapMonoWithLine();
         }
 
-        mLastFrame = Frame(mCurrentFrame);
+        SetLastFrame();
     }
 }
 
@@ -925,7 +1101,7 @@ void Tracking::CreateInitialMapMonocular()
     mpReferenceKF = pKFcur;
     mCurrentFrame.mpReferenceKF = pKFcur;
 
-    mLastFrame = Frame(mCurrentFrame);
+    SetLastFrame();
 
     mpMap->SetReferenceMapPoints(mvpLocalMapPoints);
 
@@ -1095,7 +1271,7 @@ void Tracking::CreateInitialMapMonoWithLine()
     mpReferenceKF = pKFcur;
     mCurrentFrame.mpReferenceKF = pKFcur;
 
-    mLastFrame = Frame(mCurrentFrame);
+    SetLastFrame();
 
     mpMap->SetReferenceMapPoints(mvpLocalMapPoints);
     mpMap->SetReferenceMapLines(mvpLocalMapLines);
@@ -1142,8 +1318,6 @@ void Tracking::CheckReplacedInLastFrame()
 
 bool Tracking::TrackReferenceKeyFrame()
 {
-    cv::Mat pic = DrawLines(mpReferenceKF, &mCurrentFrame);
-
     // Compute Bag of Words vector
     mCurrentFrame.ComputeBoW();
 
@@ -1152,29 +1326,36 @@ bool Tracking::TrackReferenceKeyFrame()
     vector<MapPoint*> vpMapPointMatches;
     LSDmatcher lmatcher(0.8, true);
 
-    lmatcher.pic = pic;
-
     int nmatches = matcher.SearchByBoW(mpReferenceKF,mCurrentFrame,vpMapPointMatches);
     int lmatches = 0;
-    lmatches = lmatcher.SearchDouble(mpReferenceKF, mCurrentFrame);
 
-    //cerr<<lmatches<<"__________________"<<endl;
+    mCurrentFrame.mvpMapPoints = vpMapPointMatches;
+    mCurrentFrame.SetPose(mLastFrame.mTcw);
 
-    if(nmatches<15  && lmatches<5)
-        return false;
+    // Line matches left by a failed TrackWithMotionModel
+    fill(mCurrentFrame.mvpMapLines.begin(),mCurrentFrame.mvpMapLines.end(),static_cast<MapLine*>(NULL));
 
-    mCurrentFrame.mvpMapPoints = vpMapPointMatches;
+    if(nmatches > 20)
+    {
+        // 点的匹配足够：先由点估计位姿，再将参考关键帧的MapLines投影到当前帧，在线段网格中局部搜索
+        Optimizer::PoseOptimizationWithPoints(&mCurrentFrame);
 
-    // 通过优化3D-2D的重投影误差来获得位姿
-    mCurrentFrame.SetPose(mLastFrame.mTcw);
-    if(nmatches > 20){
-         Optimizer::PoseOptimizationWithPoints(&mCurrentFrame);
+        lmatches = lmatcher.SearchByProjection(mpReferenceKF, mCurrentFrame, 3);
 
-         for(int i =0; i<mCurrentFrame.NL; i++)
-            if(mCurrentFrame.mvpMapLines[i])
-                mCurrentFrame.mvpMapLines[i]=static_cast<MapLine*>(NULL);
+        // 通过优化3D-2D的重投影误差来获得位姿（点和线）
+        if(lmatches > 0)
+            Optimizer::PoseOptimization(&mCurrentFrame);
+    }
+    else
+    {
+        // 点太少，无法预测线段的位置：描述子暴力匹配
+        lmatcher.pic = DrawLines(mpReferenceKF, &mCurrentFrame);
+        lmatches = lmatcher.SearchDouble(mpReferenceKF, mCurrentFrame);
+
+        if(nmatches<15  && lmatches<5)
+            return false;
 
-    }else{
+        // 通过优化3D-2D的重投影误差来获得位姿
         Optimizer::PoseOptimization(&mCurrentFrame);
     }
 
@@ -1504,6 +1685,11 @@ bool Tracking::TrackLocalMapWithLines()
     mnMatchesInliers = 0;
     mnLineMatchesInliers = 0;
 
+    // The other cameras of a rig are matched with the optimized pose and refine it together with this camera,
+    // their inliers count for the tracking. Frames grabbed with a single image have no rig frames.
+    if(mpRig && mpRig->HasFrames(mCurrentFrame))
+        mnMatchesInliers += mpRig->TrackLocalMap(mCurrentFrame,mvpLocalMapPoints);
+
     // Update MapPoints Statistics
     // step5：更新当前帧的MapPoints被观测程度，并统计跟踪局部地图的效果
     for(int i=0; i<mCurrentFrame.N; i++)
@@ -1596,6 +1782,18 @@ bool Tracking::NeedNewKeyFrame()
         nMinObs=2;
     int nRefMatches = mpReferenceKF->TrackedMapPoints(nMinObs);
 
+    // The inliers of the other cameras of a rig are counted, and so are the map points of their keyframes
+    if(mpRig && mpRig->HasFrames(mCurrentFrame))
+    {
+        KeyFrame* pRefKF = mpReferenceKF->mpRigKF ? mpReferenceKF->mpRigKF : mpReferenceKF;
+        nRefMatches = pRefKF->TrackedMapPoints(nMinObs);
+        for(size_t i=0; i<pRefKF->mvpRigKFs.size(); i++)
+        {
+            if(!pRefKF->mvpRigKFs[i]->isBad())
+                nRefMatches += pRefKF->mvpRigKFs[i]->TrackedMapPoints(nMinObs);
+        }
+    }
+
     // Local Mapping accept keyframes?
     // step4：查询局部地图管理器是否繁忙
     bool bLocalMappingIdle = mpLocalMapper->AcceptKeyFrames();
@@ -1670,6 +1868,10 @@ void Tracking::CreateNewKeyFrame()
 
     KeyFrame* pKF = new KeyFrame(mCurrentFrame,mpMap,mpKeyFrameDB);
 
+    // Keyframes of the other cameras of the rig, attached to this one
+    if(mpRig && mpRig->HasFrames(mCurrentFrame))
+        pKF->mvpRigKFs = mpRig->CreateKeyFrames(pKF,mpMap,mpKeyFrameDB);
+
     mpReferenceKF = pKF;
     mCurrentFrame.mpReferenceKF = pKF;
 
@@ -1735,6 +1937,10 @@ void Tracking::CreateNewKeyFrame()
         }
     }
 
+    // The keyframe of camera 0 is processed last, local BA and the local map snapshot are run for it
+    for(size_t i=0; i<pKF->mvpRigKFs.size(); i++)
+        mpLocalMapper->InsertKeyFrame(pKF->mvpRigKFs[i]);
+
     mpLocalMapper->InsertKeyFrame(pKF);
 
     mpLocalMapper->SetNotStop(false);
@@ -1771,12 +1977,24 @@ void Tracking::SearchLocalPoints()
 
     int nToMatch=0;
 
+    // The first MapPoints come from the snapshot, their cached positions allow a cheap culling
+    const size_t nCached = mnLocalMapSnapshotVersion>0 ? mpLocalMapSnapshot->mvPointPos.size() : 0;
+    const cv::Mat Rcw = mCurrentFrame.mTcw.rowRange(0,3).colRange(0,3);
+    const cv::Mat tcw = mCurrentFrame.mTcw.rowRange(0,3).col(3);
+
     // Project points in frame and check its visibility
-    for(vector<MapPoint*>::iterator vit=mvpLocalMapPoints.begin(), vend=mvpLocalMapPoints.end(); vit!=vend; vit++)
+    for(size_t i=0, iend=mvpLocalMapPoints.size(); i<iend; i++)
     {
-        MapPoint* pMP = *vit;
+        MapPoint* pMP = mvpLocalMapPoints[i];
         if(pMP->mnLastFrameSeen == mCurrentFrame.mnId)
             continue;
+        if(i<nCached && !LocalMapSnapshot::MaybeVisible(mpLocalMapSnapshot->mvPointPos[i], Rcw, tcw,
+                                                        mCurrentFrame.fx, mCurrentFrame.fy, mCurrentFrame.cx, mCurrentFrame.cy,
+                                                        mCurrentFrame.mnMinX, mCurrentFrame.mnMaxX, mCurrentFrame.mnMinY, mCurrentFrame.mnMaxY))
+        {
+            pMP->mbTrackInView = false;
+            continue;
+        }
         if(pMP->isBad())
             continue;
         // Project (this fills MapPoint variables for matching)
@@ -1824,14 +2042,30 @@ void Tracking::SearchLocalLines()
 
     int nToMatch = 0;
 
+    // 局部地图来自LocalMapping发布的快照时，前nCached条线段有缓存的端点位置，可以先做粗略的可见性剔除
+    const size_t nCached = mnLocalMapSnapshotVersion>0 ? mpLocalMapSnapshot->mvLineStartPos.size() : 0;
+    const cv::Mat Rcw = mCurrentFrame.mTcw.rowRange(0,3).colRange(0,3);
+    const cv::Mat tcw = mCurrentFrame.mTcw.rowRange(0,3).col(3);
+
     // step2：将所有局部MapLines投影到当前帧，判断是否在视野范围内，然后进行投影匹配
-    for(vector<MapLine*>::iterator vit=mvpLocalMapLines.begin(), vend=mvpLocalMapLines.end(); vit!=vend; vit++)
+    for(size_t i=0, iend=mvpLocalMapLines.size(); i<iend; i++)
     {
-        MapLine* pML = *vit;
+        MapLine* pML = mvpLocalMapLines[i];
 
         // 已经被当前帧观测到MapLine，不再判断是否能被当前帧观测到
         if(pML->mnLastFrameSeen == mCurrentFrame.mnId)
             continue;
+        if(i<nCached &&
+           !LocalMapSnapshot::MaybeVisible(mpLocalMapSnapshot->mvLineStartPos[i], Rcw, tcw,
+                                           mCurrentFrame.fx, mCurrentFrame.fy, mCurrentFrame.cx, mCurrentFrame.cy,
+                                           mCurrentFrame.mnMinX, mCurrentFrame.mnMaxX, mCurrentFrame.mnMinY, mCurrentFrame.mnMaxY) &&
+           !LocalMapSnapshot::MaybeVisible(mpLocalMapSnapshot->mvLineEndPos[i], Rcw, tcw,
+                                           mCurrentFrame.fx, mCurrentFrame.fy, mCurrentFrame.cx, mCurrentFrame.cy,
+                                           mCurrentFrame.mnMinX, mCurrentFrame.mnMaxX, mCurrentFrame.mnMinY, mCurrentFrame.mnMaxY))
+        {
+            pML->mbTrackInView = false;
+            continue;
+        }
         if(pML->isBad())
             continue;
 
@@ -1902,12 +2136,167 @@ void Tracking::UpdateLocalMap()
     mpMap->SetReferenceMapPoints(mvpLocalMapPoints);
     mpMap->SetReferenceMapLines(mvpLocalMapLines);
 
+    // Use the local map published by LocalMapping if tracking is still around its keyframe
+    if(UpdateLocalMapFromSnapshot())
+        return;
+
     // Update
+    mnLocalMapSnapshotVersion = 0;
     UpdateLocalKeyFrames();
     UpdateLocalPoints();
     UpdateLocalLines();
 }
 
+/**
+ * @brief 使用LocalMapping发布的局部地图，called by UpdateLocalMap()
+ *
+ * 新版本的局部地图只在关键帧到来时整体替换，之后每帧只补充当前帧观测到但不在局部地图中的关键帧
+ * @return 若参考关键帧不在局部地图中（或地图发生了大的变化），返回false，需要重建局部地图
+ */
+bool Tracking::UpdateLocalMapFromSnapshot()
+{
+    std::shared_ptr<const LocalMapSnapshot> pSnapshot;
+    if(!mbOnlyTracking)
+    {
+        pSnapshot = mpLocalMapper->GetLocalMapSnapshot();
+        if(!pSnapshot || pSnapshot->mnBigChangeIdx!=mpMap->GetLastBigChangeIdx())
+            return false;
+    }
+
+    // Each map point vote for the keyframes in which it has been observed
+    map<KeyFrame*,int> keyframeCounter;
+    for(int i=0; i<mCurrentFrame.N; i++)
+    {
+        if(mCurrentFrame.mvpMapPoints[i])
+        {
+            MapPoint* pMP = mCurrentFrame.mvpMapPoints[i];
+            if(!pMP->isBad())
+            {
+                const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+                for(map<KeyFrame*,size_t>::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
+                    keyframeCounter[it->first]++;
+            }
+            else
+            {
+                mCurrentFrame.mvpMapPoints[i]=NULL;
+            }
+        }
+    }
+
+    int max=0;
+    KeyFrame* pKFmax= static_cast<KeyFrame*>(NULL);
+    for(map<KeyFrame*,int>::const_iterator it=keyframeCounter.begin(), itEnd=keyframeCounter.end(); it!=itEnd; it++)
+    {
+        if(!it->first->isBad() && it->second>max)
+        {
+            max=it->second;
+            pKFmax=it->first;
+        }
+    }
+
+    if(!pKFmax)
+        return false;
+
+    // Localization mode: the map does not change, the local map of each keyframe is built once and reused
+    if(mbOnlyTracking)
+        pSnapshot = GetLocalizationSnapshot(pKFmax);
+
+    if(!pSnapshot->Contains(pKFmax))
+        return false;
+
+    // Swap in the new version
+    if(pSnapshot!=mpLocalMapSnapshot || mnLocalMapSnapshotVersion==0)
+    {
+        mpLocalMapSnapshot = pSnapshot;
+        mnLocalMapSnapshotVersion = pSnapshot->mnVersion;
+        mnLocalMapSnapshotFrameId = mCurrentFrame.mnId;
+
+        mvpLocalKeyFrames = pSnapshot->mvpKeyFrames;
+        mvpLocalMapPoints = pSnapshot->mvpMapPoints;
+        mvpLocalMapLines = pSnapshot->mvpMapLines;
+
+        for(size_t i=0, iend=mvpLocalKeyFrames.size(); i<iend; i++)
+            mvpLocalKeyFrames[i]->mnTrackReferenceForFrame = mnLocalMapSnapshotFrameId;
+        for(size_t i=0, iend=mvpLocalMapPoints.size(); i<iend; i++)
+            mvpLocalMapPoints[i]->mnTrackReferenceForFrame = mnLocalMapSnapshotFrameId;
+        for(size_t i=0, iend=mvpLocalMapLines.size(); i<iend; i++)
+            mvpLocalMapLines[i]->mnTrackReferenceForFrame = mnLocalMapSnapshotFrameId;
+    }
+
+    // Add the keyframes observed by the current frame that are not yet in the local map
+    // (e.g. keyframes inserted after the snapshot was built), with their MapPoints and MapLines
+    for(map<KeyFrame*,int>::const_iterator it=keyframeCounter.begin(), itEnd=keyframeCounter.end(); it!=itEnd; it++)
+    {
+        KeyFrame* pKF = it->first;
+        if(pKF->isBad() || pKF->mnTrackReferenceForFrame==mnLocalMapSnapshotFrameId)
+            continue;
+
+        mvpLocalKeyFrames.push_back(pKF);
+        pKF->mnTrackReferenceForFrame = mnLocalMapSnapshotFrameId;
+
+        const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
+        for(vector<MapPoint*>::const_iterator itMP=vpMPs.begin(), itEndMP=vpMPs.end(); itMP!=itEndMP; itMP++)
+        {
+            MapPoint* pMP = *itMP;
+            if(!pMP || pMP->mnTrackReferenceForFrame==mnLocalMapSnapshotFrameId || pMP->isBad())
+                continue;
+            mvpLocalMapPoints.push_back(pMP);
+            pMP->mnTrackReferenceForFrame = mnLocalMapSnapshotFrameId;
+        }
+
+        const vector<MapLine*> vpMLs = pKF->GetMapLineMatches();
+        for(vector<MapLine*>::const_iterator itML=vpMLs.begin(), itEndML=vpMLs.end(); itML!=itEndML; itML++)
+        {
+            MapLine* pML = *itML;
+            if(!pML || pML->mnTrackReferenceForFrame==mnLocalMapSnapshotFrameId || pML->isBad())
+                continue;
+            mvpLocalMapLines.push_back(pML);
+            pML->mnTrackReferenceForFrame = mnLocalMapSnapshotFrameId;
+        }
+    }
+
+    mpReferenceKF = pKFmax;
+    mCurrentFrame.mpReferenceKF = mpReferenceKF;
+
+    return true;
+}
+
+/**
+ * @brief 定位模式下关键帧的局部地图，第一次使用时建立，之后直接复用（只保留最近使用的LOCALIZATION_SNAPSHOTS个）
+ *
+ * 定位模式下LocalMapping处于停止状态，地图不再变化，Tracking可以自己建立局部地图
+ */
+std::shared_ptr<const LocalMapSnapshot> Tracking::GetLocalizationSnapshot(KeyFrame *pKF)
+{
+    const int nBigChangeIdx = mpMap->GetLastBigChangeIdx();
+    if(nBigChangeIdx!=mnLocalizationSnapshotsBigChangeIdx)
+    {
+        mmLocalizationSnapshots.clear();
+        mlLocalizationSnapshotsLRU.clear();
+        mnLocalizationSnapshotsBigChangeIdx = nBigChangeIdx;
+    }
+
+    // Most recently used at the back of the list
+    map<KeyFrame*,LocalizationSnapshotEntry>::iterator mit = mmLocalizationSnapshots.find(pKF);
+    if(mit!=mmLocalizationSnapshots.end())
+    {
+        mlLocalizationSnapshotsLRU.splice(mlLocalizationSnapshotsLRU.end(),mlLocalizationSnapshotsLRU,mit->second.second);
+        return mit->second.first;
+    }
+
+    if(mmLocalizationSnapshots.size()>=LOCALIZATION_SNAPSHOTS)
+    {
+        mmLocalizationSnapshots.erase(mlLocalizationSnapshotsLRU.front());
+        mlLocalizationSnapshotsLRU.pop_front();
+    }
+
+    std::shared_ptr<const LocalMapSnapshot> pSnapshot = std::make_shared<const LocalMapSnapshot>(pKF, pKF->mnId+1, nBigChangeIdx,
+                                                                                                  LocalMapSnapshot::LOCALIZATION);
+    mmLocalizationSnapshots[pKF] = make_pair(pSnapshot,mlLocalizationSnapshotsLRU.insert(mlLocalizationSnapshotsLRU.end(),pKF));
+
+    return pSnapshot;
+}
+
 /**
  * @brief 更新局部关键点，called by UpdateLocalMap()
  *
@@ -2287,6 +2676,16 @@ void Tracking::Reset()
     mlFrameTimes.clear();
     mlbLost.clear();
 
+    mpLocalMapSnapshot.reset();
+    mnLocalMapSnapshotVersion = 0;
+    mmLocalizationSnapshots.clear();
+    mlLocalizationSnapshotsLRU.clear();
+
+    mbLastFrameIsCurrent = false;
+
+    if(mpRig)
+        mpRig->Reset();
+
     if(mpViewer)
         mpViewer->Release();
 }
@@ -2306,26 +2705,50 @@ void Tracking::ChangeCalibration(const string &strSettingPath)
     K.at<float>(1,2) = cy;
     K.copyTo(mK);
 
+    // Camera.type: PinHole (default, k1 k2 p1 p2 [k3]) or KannalaBrandt8 (fisheye, k1 k2 k3 k4)
+    string sCameraType;
+    if(!fSettings["Camera.type"].empty())
+        fSettings["Camera.type"] >> sCameraType;
+    mnCameraModel = sCameraType=="KannalaBrandt8" ? CAMERA_KANNALA_BRANDT : CAMERA_PINHOLE;
+
     cv::Mat DistCoef(4,1,CV_32F);
-    DistCoef.at<float>(0) = fSettings["Camera.k1"];
-    DistCoef.at<float>(1) = fSettings["Camera.k2"];
-    DistCoef.at<float>(2) = fSettings["Camera.p1"];
-    DistCoef.at<float>(3) = fSettings["Camera.p2"];
-    const float k3 = fSettings["Camera.k3"];
-    if(k3!=0)
+    if(mnCameraModel==CAMERA_KANNALA_BRANDT)
+    {
+        DistCoef.at<float>(0) = fSettings["Camera.k1"];
+        DistCoef.at<float>(1) = fSettings["Camera.k2"];
+        DistCoef.at<float>(2) = fSettings["Camera.k3"];
+        DistCoef.at<float>(3) = fSettings["Camera.k4"];
+    }
+    else
     {
-        DistCoef.resize(5);
-        DistCoef.at<float>(4) = k3;
+        DistCoef.at<float>(0) = fSettings["Camera.k1"];
+        DistCoef.at<float>(1) = fSettings["Camera.k2"];
+        DistCoef.at<float>(2) = fSettings["Camera.p1"];
+        DistCoef.at<float>(3) = fSettings["Camera.p2"];
+        const float k3 = fSettings["Camera.k3"];
+        if(k3!=0)
+        {
+            DistCoef.resize(5);
+            DistCoef.at<float>(4) = k3;
+        }
     }
     DistCoef.copyTo(mDistCoef);
 
     mbf = fSettings["Camera.bf"];
 
-    Frame::mbInitialComputations = true;
+    // Rebuilt with the next image
+    mpFrameConfig.reset();
 }
 
 void Tracking::InformOnlyTracking(const bool &flag)
 {
+    // The cached local maps are only valid while the map does not change
+    if(flag!=mbOnlyTracking)
+    {
+        mmLocalizationSnapshots.clear();
+        mlLocalizationSnapshotsLRU.clear();
+    }
+
     mbOnlyTracking = flag;
 }
 
@@ -2371,7 +2794,7 @@ cv::Mat Tracking::DrawLines(KeyFrame* KF1, Frame* F2)
         cv::cvtColor(F2->ImageGray, mImRGBTemp, cv::COLOR_GRAY2BGR);
         cv::Mat cubemapMatch_rgb(nRows, nCols * 2, mImRGBTemp.type());
 
-        drawKeylines(mImRGBPrevTemp, KF1->mvKeyLines, mImRGBPrevTemp, Scalar(200, 0, 0));
+        drawKeylines(mImRGBPrevTemp, KF1->mvKeyLines.ToVector(), mImRGBPrevTemp, Scalar(200, 0, 0));
         drawKeylines(mImRGBTemp, F2->mvKeylinesUn, mImRGBTemp, Scalar(0, 200, 0));
 
         for(int i = 0; i < KF1->mvKeyLines.size(); i++){